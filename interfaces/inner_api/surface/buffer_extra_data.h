@@ -35,6 +35,26 @@ public:
     virtual GSError ExtraSet(const std::string &key, int64_t value) = 0;
     virtual GSError ExtraSet(const std::string &key, double value) = 0;
     virtual GSError ExtraSet(const std::string &key, const std::string& value) = 0;
+    // true when nothing was set, such data needs no parcel to reach the other side
+    virtual bool IsEmpty() const
+    {
+        return false;
+    }
+    // the compact encoding, only for peers that announced PACKED_EXTRA_DATA_VERSION
+    virtual GSError WritePackedToParcel(MessageParcel &parcel)
+    {
+        return WriteToParcel(parcel);
+    }
+    // changes with every ExtraSet and ReadFromParcel and is unique in the process, 0 when not tracked
+    virtual uint64_t GetVersion() const
+    {
+        return 0;
+    }
+    // ReadFromParcel got the unchanged marker, the receiver keeps the data it holds for the buffer
+    virtual bool IsUnchanged() const
+    {
+        return false;
+    }
 };
 } // namespace OHOS
 
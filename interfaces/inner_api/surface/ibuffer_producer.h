@@ -16,6 +16,7 @@
 #ifndef INTERFACES_INNERKITS_SURFACE_IBUFFER_PRODUCER_H
 #define INTERFACES_INNERKITS_SURFACE_IBUFFER_PRODUCER_H
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -46,6 +47,14 @@ public:
         std::vector<uint32_t> deletingBuffers;
         bool isConnected;
     };
+    struct ProducerCacheDelta {
+        // the queue's cache generation the delta brings the producer up to
+        uint64_t generation = 0;
+        // buffers holds the whole cache rather than the changes, nothing is reported as removed
+        bool isFull = false;
+        std::map<uint32_t, sptr<SurfaceBuffer>> buffers;
+        std::vector<uint32_t> removedSequences;
+    };
     virtual GSError GetProducerInitInfo(ProducerInitInfo &info) = 0;
 
     virtual GSError RequestBuffer(const BufferRequestConfig &config, sptr<BufferExtraData> &bedata,
@@ -189,6 +198,25 @@ public:
         (void)needMap;
         return SURFACE_ERROR_NOT_SUPPORT;
     }
+    /**
+     * @brief Merge FlushBuffer and the RequestBuffer of the next frame to reduce once ipc.
+     * @return The result of the flush. When the flush succeeded, requestRet holds the result of the request.
+     *         The request never waits for the consumer, GSERROR_NO_BUFFER means a normal RequestBuffer is needed.
+     */
+    virtual GSError FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata, sptr<SyncFence> fence,
+        BufferFlushConfigWithDamages& flushConfig, const BufferRequestConfig& requestConfig,
+        sptr<BufferExtraData>& requestBedata, RequestBufferReturnValue& retval, GSError& requestRet)
+    {
+        (void)sequence;
+        (void)bedata;
+        (void)fence;
+        (void)flushConfig;
+        (void)requestConfig;
+        (void)requestBedata;
+        (void)retval;
+        (void)requestRet;
+        return SURFACE_ERROR_NOT_SUPPORT;
+    }
     virtual GSError GetCycleBuffersNumber(uint32_t& cycleBuffersNumber)
     {
         (void)cycleBuffersNumber;
@@ -265,6 +293,16 @@ public:
         (void)buffers;
         return SURFACE_ERROR_NOT_SUPPORT;
     }
+    /**
+     * @brief Gets the buffers the queue cached and the sequences it dropped since the given cache generation.
+     * Falls back to the whole cache when generation is 0 or older than the queue's change log reaches.
+     */
+    virtual GSError SyncProducerCacheDelta(uint64_t generation, ProducerCacheDelta &delta)
+    {
+        (void)generation;
+        (void)delta;
+        return SURFACE_ERROR_NOT_SUPPORT;
+    }
     virtual GSError CleanProducerBySeqNum(const std::vector<uint32_t>& seqNums)
     {
         (void)seqNums;
@@ -280,6 +318,27 @@ public:
         (void)mode;
         return SURFACE_ERROR_NOT_SUPPORT;
     }
+    /**
+     * @brief Moves RequestBuffer, FlushBuffer and the release callbacks onto a shared-memory channel.
+     *        Calls the channel can not carry still go over binder, the results are the same.
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link SURFACE_ERROR_NOT_SUPPORT} 50102000 - Not surport usage.
+     */
+    virtual GSError EnableControlChannel()
+    {
+        return SURFACE_ERROR_NOT_SUPPORT;
+    }
+    /**
+     * @brief Sends FlushBuffer as a oneway transaction. Flushes keep their order with the calls after them, an
+     *        error of an async flush is returned by the next RequestBuffer.
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link SURFACE_ERROR_NOT_SUPPORT} 50102000 - Not surport usage.
+     */
+    virtual GSError SetFlushBufferAsyncMode(bool isAsync)
+    {
+        (void)isAsync;
+        return SURFACE_ERROR_NOT_SUPPORT;
+    }
     virtual GSError SetVideoDimensionType(VideoDimType videoDimType) = 0;
     virtual GSError GetVideoDimensionType(VideoDimType &videoDimType) = 0;
     DECLARE_INTERFACE_DESCRIPTOR(u"surf.IBufferProducer");
@@ -356,6 +415,14 @@ protected:
         BUFFER_PRODUCER_SET_SINGLE_BUFFER_MODE,
         BUFFER_PRODUCER_SET_VIDEO_DIMENSION_TYPE,
         BUFFER_PRODUCER_GET_VIDEO_DIMENSION_TYPE,
+        BUFFER_PRODUCER_SETUP_CONTROL_CHANNEL,
+        BUFFER_PRODUCER_FLUSH_AND_REQUEST_BUFFER,
+        BUFFER_PRODUCER_FLUSH_BUFFER_ASYNC,
+        BUFFER_PRODUCER_REQUEST_BUFFER_AFTER_ASYNC_FLUSH,
+        BUFFER_PRODUCER_WAIT_ASYNC_FLUSH,
+        BUFFER_PRODUCER_SYNC_PRODUCER_CACHE_DELTA,
+        // keep last, the number of commands
+        BUFFER_PRODUCER_BUTT,
     };
 };
 } // namespace OHOS
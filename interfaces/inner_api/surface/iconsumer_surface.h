@@ -365,6 +365,12 @@ public:
         (void)queueSize;
         return SURFACE_ERROR_NOT_SUPPORT;
     }
+    virtual GSError SetAutoQueueSize(bool enabled, uint32_t minQueueSize)
+    {
+        (void)enabled;
+        (void)minQueueSize;
+        return SURFACE_ERROR_NOT_SUPPORT;
+    }
     virtual GSError SetLppDrawSource(bool isShbSource, bool isRsSource)
     {
         (void)isShbSource;
@@ -61,6 +61,16 @@ public:
         return GSERROR_NOT_SUPPORT;
     }
 
+    virtual GSError RequestBuffers(std::vector<sptr<SurfaceBuffer>> &buffers,
+        std::vector<sptr<SyncFence>> &fences, BufferRequestConfig &config, uint32_t count)
+    {
+        (void)buffers;
+        (void)fences;
+        (void)config;
+        (void)count;
+        return GSERROR_NOT_SUPPORT;
+    }
+
     virtual GSError CancelBuffer(sptr<SurfaceBuffer>& buffer)
     {
         (void)buffer;
@@ -519,6 +529,21 @@ public:
         (void)needMap;
         return GSERROR_NOT_SUPPORT;
     }
+    /**
+     * @brief Merge FlushBuffer and RequestBuffer of the next frame to reduce once ipc.
+     */
+    virtual GSError FlushAndRequestBuffer(sptr<SurfaceBuffer>& buffer, const sptr<SyncFence>& fence,
+        BufferFlushConfigWithDamages& flushConfig, sptr<SurfaceBuffer>& nextBuffer, sptr<SyncFence>& nextFence,
+        BufferRequestConfig& requestConfig)
+    {
+        (void)buffer;
+        (void)fence;
+        (void)flushConfig;
+        (void)nextBuffer;
+        (void)nextFence;
+        (void)requestConfig;
+        return GSERROR_NOT_SUPPORT;
+    }
     /**
      * @brief Avoidance plan, which can be deleted later.
      */
@@ -734,6 +759,26 @@ public:
         (void)videoDimType;
         return GSERROR_NOT_SUPPORT;
     }
+    /**
+     * @brief Move RequestBuffer, FlushBuffer and the release callbacks of a remote producer onto a shared-memory
+     *        channel instead of one binder transaction each. Calls the channel can not carry still use binder.
+     * @return Returns the error code of the EnableControlChannel.
+     */
+    virtual GSError EnableControlChannel()
+    {
+        return GSERROR_NOT_SUPPORT;
+    }
+    /**
+     * @brief Let FlushBuffer of a remote producer return without waiting for the consumer. An error of such a
+     *        flush is returned by the next RequestBuffer instead.
+     * @param isAsync Indicates whether FlushBuffer is asynchronous.
+     * @return Returns the error code of the SetFlushBufferAsyncMode.
+     */
+    virtual GSError SetFlushBufferAsyncMode(bool isAsync)
+    {
+        (void)isAsync;
+        return GSERROR_NOT_SUPPORT;
+    }
     /**
      * @brief Get a buffer type leak.
      * @return Returns the bufferTypeLeak string.
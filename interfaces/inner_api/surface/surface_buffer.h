@@ -19,6 +19,8 @@
 #include <functional>
 
 #include <memory>
+#include <utility>
+#include <vector>
 #include <refbase.h>
 
 #include "buffer_handle_utils.h"
@@ -34,6 +36,7 @@ class IProducerListener;
 class MessageParcel;
 class Parcel;
 class SyncFence;
+class FenceSet;
 
 using ProducerInitInfo = struct {
     uint64_t uniqueId;
@@ -127,6 +130,58 @@ public:
     virtual GSError GetMetadata(uint32_t key, std::vector<uint8_t>& value) = 0;
     virtual GSError ListMetadataKeys(std::vector<uint32_t>& keys) = 0;
     virtual GSError EraseMetadataKey(uint32_t key) = 0;
+    /*
+     * @Description: SetMetadataBatch, sets several keys with one lock of the buffer
+     * @param metadata：Pairs of metadata key and value
+     * @param enableCache：Same as SetMetadata
+     * @return  Returns GSERROR_OK if every key is set; stops at the first key that fails and returns its error.
+     */
+    virtual GSError SetMetadataBatch(const std::vector<std::pair<uint32_t, std::vector<uint8_t>>>& metadata,
+        bool enableCache = true)
+    {
+        for (const auto& [key, value] : metadata) {
+            GSError ret = SetMetadata(key, value, enableCache);
+            if (ret != GSERROR_OK) {
+                return ret;
+            }
+        }
+        return GSERROR_OK;
+    }
+    /*
+     * @Description: GetMetadataBatch, gets several keys with one lock of the buffer
+     * @param keys：Metadata keys
+     * @param values：Resized to the number of keys, values[i] is left empty if keys[i] is not set
+     * @return  Returns GSERROR_OK if the buffer could be queried; returns GErrorCode otherwise.
+     */
+    virtual GSError GetMetadataBatch(const std::vector<uint32_t>& keys, std::vector<std::vector<uint8_t>>& values)
+    {
+        values.assign(keys.size(), {});
+        for (size_t i = 0; i < keys.size(); i++) {
+            (void)GetMetadata(keys[i], values[i]);
+        }
+        return GSERROR_OK;
+    }
+    /*
+     * @Description: InvalidateMetadataCache, drops the metadata values read or written through this object, the
+     *               next reads go to the allocation again. Called when another process may have changed them.
+     */
+    virtual void InvalidateMetadataCache() {}
+    /*
+     * @Description: GetAppliedMetadataGeneration, the producer metadata generation last pushed to this allocation
+     * @return  Returns 0 if nothing was pushed since the allocation changed.
+     */
+    virtual uint64_t GetAppliedMetadataGeneration() const
+    {
+        return 0;
+    }
+    /*
+     * @Description: SetAppliedMetadataGeneration, records that the producer metadata of a generation was pushed
+     * @param generation：Producer metadata generation
+     */
+    virtual void SetAppliedMetadataGeneration(uint64_t generation)
+    {
+        (void)generation;
+    }
 
     virtual void SetCropMetadata(const Rect& crop)
     {
@@ -222,6 +277,11 @@ public:
     }
     virtual void SetAndMergeSyncFence(const sptr<SyncFence>& syncFence) = 0;
     virtual sptr<SyncFence> GetSyncFence() const = 0;
+    /* a copy of the pending sync fences that leaves them unmerged, nullptr when there is none */
+    virtual sptr<FenceSet> GetSyncFences() const
+    {
+        return nullptr;
+    }
     /**
      * @brief Allocates a surface buffer based on the specified configuration.
      *
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTILS_INCLUDE_FENCE_SET_H
+#define UTILS_INCLUDE_FENCE_SET_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <refbase.h>
+#include "sync_fence.h"
+
+namespace OHOS {
+/*
+ * holds fences without merging them. Merge builds one sync file only when a single fd is needed,
+ * for a parcel or a C API, and signaled members are dropped first so that usually nothing is merged
+ */
+class FenceSet : public RefBase {
+public:
+    static constexpr uint32_t MAX_FENCE_COUNT = 8;
+
+    FenceSet() = default;
+    virtual ~FenceSet() = default;
+
+    FenceSet(const FenceSet& rhs) = delete;
+    FenceSet& operator=(const FenceSet& rhs) = delete;
+
+    /* null, invalid and already held fences are ignored, a full set prunes and then merges its members */
+    void Add(const sptr<SyncFence>& fence);
+    void Add(const sptr<FenceSet>& fences);
+    size_t GetSize();
+    /* one poll for all members; drops the signaled ones, SIGNALED when none is left */
+    FenceStatus GetStatus();
+    /* waits for all members, returns like SyncFence::Wait */
+    int32_t Wait(uint32_t timeout);
+    /* returns INVALID_FENCE when nothing is pending, the fence itself when one is, otherwise merges */
+    sptr<SyncFence> Merge(const std::string &name);
+    void Clear();
+
+    /* SYNC_IOC_MERGE calls made by all sets of this process */
+    static uint64_t GetMergeCount();
+
+private:
+    FenceStatus PruneLocked();
+    sptr<SyncFence> MergeLocked(const std::string &name);
+
+    std::mutex mutex_;
+    std::vector<sptr<SyncFence>> fences_;
+    static inline std::atomic<uint64_t> mergeCount_ = 0;
+};
+}
+
+#endif // UTILS_INCLUDE_FENCE_SET_H
@@ -18,6 +18,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <mutex>
 #include <vector>
@@ -42,6 +43,9 @@ struct SyncPointInfo {
     FenceStatus status;
 };
 
+/* result is 0 once signaled, -ETIME on timeout or another negative errno; timestamp is the signal time */
+using SyncFenceCallback = std::function<void(int32_t result, int64_t timestamp)>;
+
 class SyncFence : public RefBase {
 public:
     explicit SyncFence(int32_t fenceFd);
@@ -57,6 +61,8 @@ public:
     static const ns_sec_t INVALID_TIMESTAMP;
     static const ns_sec_t FENCE_PENDING_TIMESTAMP;
     int32_t Wait(uint32_t timeout);
+    /* waits on the shared fence waiter thread instead of blocking, callback runs on that thread */
+    int32_t WaitAsync(uint32_t timeout, const SyncFenceCallback &callback);
     static sptr<SyncFence> MergeFence(const std::string &name,
             const sptr<SyncFence>& fence1, const sptr<SyncFence>& fence2);
     ns_sec_t SyncFileReadTimestamp();
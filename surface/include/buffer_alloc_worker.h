@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_ALLOC_WORKER_H
+#define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_ALLOC_WORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "surface_type.h"
+
+namespace OHOS {
+/**
+ * Process-wide pool that runs buffer allocations off the caller's thread.
+ * Up to MAX_THREADS allocations run at once. Threads are started on first use and stay parked afterwards.
+ * Post hands back a future that completes with the task's result.
+ */
+class BufferAllocWorker {
+public:
+    static BufferAllocWorker& GetInstance();
+    std::future<GSError> Post(std::function<GSError()> task);
+
+    BufferAllocWorker(const BufferAllocWorker&) = delete;
+    BufferAllocWorker& operator=(const BufferAllocWorker&) = delete;
+
+private:
+    static constexpr size_t MAX_THREADS = 2;
+
+    BufferAllocWorker() = default;
+    ~BufferAllocWorker();
+    void WorkLoop();
+
+    std::mutex mutex_;
+    std::condition_variable taskCon_;
+    std::deque<std::packaged_task<GSError()>> tasks_;
+    std::vector<std::thread> threads_;
+    size_t idleThreads_ = 0;
+    bool isStopped_ = false;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_BUFFER_ALLOC_WORKER_H
@@ -16,7 +16,11 @@
 #ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_CLIENT_PRODUCER_H
 #define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_CLIENT_PRODUCER_H
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <set>
+#include <thread>
 #include <vector>
 #include <mutex>
 
@@ -26,6 +30,7 @@
 #include <ibuffer_producer.h>
 
 #include "surface_buffer_impl.h"
+#include "surface_control_channel.h"
 
 namespace OHOS {
 class BufferClientProducer : public IRemoteProxy<IBufferProducer> {
@@ -121,6 +126,9 @@ public:
         RequestBufferReturnValue& retval) override;
     GSError AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, sptr<BufferExtraData>& bedata,
         const sptr<SyncFence>& fence, BufferFlushConfigWithDamages& config, bool needMap) override;
+    GSError FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata, sptr<SyncFence> fence,
+        BufferFlushConfigWithDamages& flushConfig, const BufferRequestConfig& requestConfig,
+        sptr<BufferExtraData>& requestBedata, RequestBufferReturnValue& retval, GSError& requestRet) override;
     GSError GetCycleBuffersNumber(uint32_t& cycleBuffersNumber) override;
     GSError SetCycleBuffersNumber(uint32_t cycleBuffersNumber) override;
     GSError SetFrameGravity(int32_t frameGravity) override;
@@ -131,10 +139,13 @@ public:
     GSError SetLppShareFd(int fd, bool state) override;
     GSError SetAlphaType(GraphicAlphaType alphaType) override;
     GSError SyncProducerCache(std::map<uint32_t, sptr<SurfaceBuffer>>& buffers) override;
+    GSError SyncProducerCacheDelta(uint64_t generation, ProducerCacheDelta &delta) override;
     GSError SetSingleBufferMode(SingleBufferMode mode) override;
     GSError CleanReleasedBuffers(std::vector<uint32_t> &cleanedSeqNums) override;
     GSError SetVideoDimensionType(VideoDimType videoDimType) override;
     GSError GetVideoDimensionType(VideoDimType &videoDimType) override;
+    GSError EnableControlChannel() override;
+    GSError SetFlushBufferAsyncMode(bool isAsync) override;
 
 private:
     GSError MessageVariables(MessageParcel &arg);
@@ -144,8 +155,29 @@ private:
         sptr<SyncFence>& fence, float matrix[16], uint32_t matrixSize, bool isUseNewMatrix, uint32_t command);
     GSError RequestBufferCommon(const BufferRequestConfig &config, sptr<BufferExtraData> &bedata,
         RequestBufferReturnValue &retval, uint32_t command);
+    GSError ReadRequestBufferReply(MessageParcel &reply, const BufferRequestConfig &config,
+        sptr<BufferExtraData> &bedata, RequestBufferReturnValue &retval);
     GSError ReadRequestBuffersReply(MessageParcel &reply, const BufferRequestConfig &config,
         std::vector<sptr<BufferExtraData>> &bedata, std::vector<RequestBufferReturnValue> &retvalues, uint32_t num);
+    GSError RequestBufferFromChannel(const BufferRequestConfig &config, RequestBufferReturnValue &retval);
+    bool FlushBufferToChannel(uint32_t sequence, const sptr<BufferExtraData> &bedata, const sptr<SyncFence> &fence,
+        const BufferFlushConfigWithDamages &config);
+    static void ControlChannelLoop(wptr<BufferClientProducer> producer, sptr<SurfaceControlChannel> channel);
+    void DrainControlChannel(const sptr<SurfaceControlChannel> &channel);
+    void HandleReleaseRecord(const SurfaceControlRecord &record, const sptr<SyncFence> &fence);
+    void StopControlChannel();
+    GSError FlushBufferAsync(uint32_t sequence, const sptr<BufferExtraData> &bedata, const sptr<SyncFence> &fence,
+        const BufferFlushConfigWithDamages &config);
+    GSError RequestBufferAfterAsyncFlush(const BufferRequestConfig &config, sptr<BufferExtraData> &bedata,
+        RequestBufferReturnValue &retval, uint64_t serial);
+    // makes the server run the oneway flushes sent so far before the sync call that follows
+    GSError WaitAsyncFlush();
+    // the queue holds the extra data a request reply just sent, a flush that did not change it sends a marker
+    void RecordQueueExtraData(uint32_t sequence, const sptr<BufferExtraData> &bedata);
+    // returns the version recorded for the sequence, 0 when there was none
+    uint64_t ForgetQueueExtraData(uint32_t sequence);
+    void ClearQueueExtraData();
+    GSError WriteExtraData(MessageParcel &arguments, uint32_t sequence, const sptr<BufferExtraData> &bedata);
 
     static inline BrokerDelegator<BufferClientProducer> delegator_;
     static inline const std::string DEFAULT_NAME = "not init";
@@ -154,6 +186,42 @@ private:
     std::mutex mutex_;
     sptr<IBufferProducerToken> token_;
     GraphicTransformType lastSetTransformType_ = GraphicTransformType::GRAPHIC_ROTATE_BUTT;
+
+    struct ControlReply {
+        int32_t status = 0;
+        uint32_t sequence = 0;
+        sptr<SyncFence> fence = nullptr;
+    };
+    // guards everything below
+    std::mutex controlChannelMutex_;
+    std::condition_variable controlReplyCond_;
+    sptr<SurfaceControlChannel> controlChannel_ = nullptr;
+    std::thread controlChannelThread_;
+    uint32_t nextControlRequestId_ = 0;
+    // requests still waiting for their reply, a reply for any other id is given back with CancelBuffer
+    std::set<uint32_t> waitingControlRequests_;
+    std::map<uint32_t, ControlReply> controlReplies_;
+    // the release records arrive over the channel, this is who gets them
+    sptr<IProducerListener> releaseListener_ = nullptr;
+
+    std::atomic<bool> isFlushAsync_ = false;
+    // tags the async flushes of this proxy. oneway calls carry no calling pid, and a pid alone would let a new
+    // proxy in the same process match the serials and errors of an old one
+    const uint64_t asyncFlushSession_;
+    // held while a oneway flush is sent, so the serials reach the server in order
+    std::mutex asyncFlushMutex_;
+    // the last oneway flush sent, and the last one a sync call waited for
+    std::atomic<uint64_t> asyncFlushSerial_ = 0;
+    std::atomic<uint64_t> syncedAsyncFlushSerial_ = 0;
+    // an async flush error returned by WaitAsyncFlush, given to the next RequestBuffer
+    std::atomic<GSError> deferredFlushError_ = GSERROR_OK;
+    // the queue announced the packed config encoding in GetProducerInitInfo
+    std::atomic<bool> isPeerPackedConfig_ = false;
+    // the queue announced the packed extra data encoding and the unchanged marker
+    std::atomic<bool> isPeerPackedExtraData_ = false;
+    std::mutex queueExtraDataMutex_;
+    // sequence and extra data version, at most one entry per buffer in the queue
+    std::vector<std::pair<uint32_t, uint64_t>> queueExtraDataVersions_;
 };
 }; // namespace OHOS
 
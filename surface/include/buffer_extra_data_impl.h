@@ -17,14 +17,21 @@
 #define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_EXTRA_DATA_IMPL_H
 
 #include <buffer_extra_data.h>
-#include <any>
 #include <mutex>
+#include <vector>
 
 namespace OHOS {
+// the packed extra data encoding a reader of this version understands, announced in GetProducerInitInfo
+constexpr uint32_t PACKED_EXTRA_DATA_VERSION = 1;
+
 class BufferExtraDataImpl : public BufferExtraData {
 public:
+    BufferExtraDataImpl();
     virtual GSError ReadFromParcel(MessageParcel &parcel) override;
     virtual GSError WriteToParcel(MessageParcel &parcel) override;
+    virtual GSError WritePackedToParcel(MessageParcel &parcel) override;
+    // sent instead of the data when the peer already holds the same version for the buffer
+    static GSError WriteUnchangedToParcel(MessageParcel &parcel);
     virtual GSError ExtraGet(const std::string &key, int32_t &value) const override;
     virtual GSError ExtraGet(const std::string &key, int64_t &value) const override;
     virtual GSError ExtraGet(const std::string &key, double &value) const override;
@@ -33,6 +40,21 @@ public:
     virtual GSError ExtraSet(const std::string &key, int64_t value) override;
     virtual GSError ExtraSet(const std::string &key, double value) override;
     virtual GSError ExtraSet(const std::string &key, const std::string& value) override;
+    virtual bool IsEmpty() const override
+    {
+        std::lock_guard<std::mutex> lockGuard(mtx_);
+        return datas_.empty();
+    }
+    virtual uint64_t GetVersion() const override
+    {
+        std::lock_guard<std::mutex> lockGuard(mtx_);
+        return version_;
+    }
+    virtual bool IsUnchanged() const override
+    {
+        std::lock_guard<std::mutex> lockGuard(mtx_);
+        return isUnchanged_;
+    }
 
 private:
     enum class ExtraDataType : int32_t {
@@ -41,16 +63,44 @@ private:
         f64,
         string,
     };
+    // keys many producers set get a one byte id on the packed wire, 0 sends the key itself. Append only
+    enum class ExtraDataKeyId : uint8_t {
+        NONE = 0,
+        SUPPORT_FAST_COMPOSE,
+        TIMESTAMP,
+        DATA_SIZE,
+        IS_KEY_FRAME,
+        BUTT,
+    };
+    struct ExtraData {
+        std::string key;
+        ExtraDataKeyId keyId = ExtraDataKeyId::NONE;
+        ExtraDataType type = ExtraDataType::i32;
+        union {
+            int32_t i32;
+            int64_t i64;
+            double f64;
+        } number = {};
+        std::string string;
+    };
+
+    static ExtraDataKeyId FindKeyId(const std::string &key);
     template<class T>
     GSError ExtraGet(const std::string &key, ExtraDataType type, T &value) const;
-    GSError ExtraSet(const std::string &key, ExtraDataType type, const std::any& val);
-    GSError ReadExtraDataItem(MessageParcel &parcel, const std::string &key, ExtraDataType type);
+    template<class T>
+    GSError ExtraSet(const std::string &key, ExtraDataType type, const T &value);
+    // returns nullptr when the key is new and there is no room for it
+    ExtraData *FindOrAddLocked(const std::string &key);
+    const ExtraData *FindLocked(const std::string &key) const;
+    GSError ReadExtraDataItemLocked(MessageParcel &parcel, ExtraData &data, int32_t typeVal);
+    GSError ReadLegacyLocked(MessageParcel &parcel);
+    GSError ReadPackedLocked(MessageParcel &parcel);
+    void UpdateVersionLocked();
 
-    struct ExtraData {
-        std::any val;
-        ExtraDataType type;
-    };
-    std::map<std::string, struct ExtraData> datas_;
+    // a handful of entries at most, scanning them beats a node based map
+    std::vector<ExtraData> datas_;
+    uint64_t version_ = 0;
+    bool isUnchanged_ = false;
     mutable std::mutex mtx_;
 };
 } // namespace OHOS
@@ -16,6 +16,8 @@
 #ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_H
 #define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_H
 
+#include <array>
+#include <atomic>
 #include <map>
 #include <list>
 #include <vector>
@@ -27,7 +29,12 @@
 #include "surface_type.h"
 #include <surface_tunnel_handle.h>
 #include "surface_buffer.h"
+#include "fence_set.h"
 #include "consumer_surface_delegator.h"
+#include "buffer_queue_slot_table.h"
+#include "buffer_queue_depth_controller.h"
+#include "buffer_queue_waiter.h"
+#include "surface_memory_budget.h"
 
 namespace OHOS {
 enum BufferState {
@@ -50,6 +57,10 @@ using BufferElement = struct BufferElement {
 
     BufferRequestConfig config;
     sptr<SyncFence> fence;
+    /**
+     * fences a released buffer still waits for, kept unmerged until ResolveReleaseFenceLocked folds them into fence.
+     */
+    sptr<FenceSet> releaseFences = nullptr;
     int64_t timestamp;
     std::vector<Rect> damages;
     HDRMetaDataType hdrMetaDataType = HDRMetaDataType::HDR_NOT_USED;
@@ -103,17 +114,68 @@ struct LppSlotInfo {
     uint32_t isStopShbDraw = 0;
 };
 
+using BufferElementTable = SequenceSlotTable<BufferElement, SURFACE_MAX_QUEUE_SIZE>;
+
+/**
+ * The part of BufferRequestConfig that decides whether a free buffer can be reused without realloc,
+ * see BufferRequestConfig::operator==.
+ */
+struct BufferConfigKey {
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t format = 0;
+    uint64_t usage = 0;
+
+    static BufferConfigKey FromConfig(const BufferRequestConfig &config)
+    {
+        return { config.width, config.height, config.format, config.usage };
+    }
+    bool operator==(const BufferConfigKey &other) const
+    {
+        return width == other.width && height == other.height && format == other.format && usage == other.usage;
+    }
+};
+
+struct BufferConfigKeyHash {
+    size_t operator()(const BufferConfigKey &key) const
+    {
+        uint64_t hash = (static_cast<uint64_t>(static_cast<uint32_t>(key.width)) << 32) ^
+            static_cast<uint32_t>(key.height);
+        hash ^= (static_cast<uint64_t>(static_cast<uint32_t>(key.format)) << 16) ^ key.usage;
+        return static_cast<size_t>(hash ^ (hash >> 29));
+    }
+};
+
+struct FreeListKeyOf {
+    const BufferElementTable *table = nullptr;
+    bool operator()(uint32_t sequence, BufferConfigKey &key) const
+    {
+        auto it = table->find(sequence);
+        if (it == table->end()) {
+            return false;
+        }
+        key = BufferConfigKey::FromConfig(it->second.config);
+        return true;
+    }
+};
+
+using FreeSequenceList = KeyedSequenceList<SURFACE_MAX_QUEUE_SIZE, BufferConfigKey, BufferConfigKeyHash, FreeListKeyOf>;
+
 using BufferAndFence = std::pair<sptr<SurfaceBuffer>, sptr<SyncFence>>;
 
 class SURFACE_HIDDEN BufferQueue : public RefBase {
 public:
     BufferQueue(const std::string &name);
     virtual ~BufferQueue();
+    void OnFirstStrongRef(const void *objectId) override;
 
     GSError GetProducerInitInfo(ProducerInitInfo &info);
 
     GSError RequestBuffer(const BufferRequestConfig &config, sptr<BufferExtraData> &bedata,
                           struct IBufferProducer::RequestBufferReturnValue &retval);
+    // never allocates, blocks or hands out a handle. GSERROR_NO_BUFFER when the producer has to go the full way
+    GSError RequestCachedBuffer(const BufferRequestConfig &config,
+                                struct IBufferProducer::RequestBufferReturnValue &retval);
 
     GSError ReuseBuffer(const BufferRequestConfig &config, sptr<BufferExtraData> &bedata,
                         struct IBufferProducer::RequestBufferReturnValue &retval, std::unique_lock<std::mutex> &lock,
@@ -123,6 +185,19 @@ public:
 
     GSError FlushBuffer(uint32_t sequence, sptr<BufferExtraData> bedata,
                         sptr<SyncFence> fence, const BufferFlushConfigWithDamages &config);
+    // requests one buffer per entry of retvalues under one lock, retvalues is cut to the buffers served and the
+    // result is the one of the first request that failed
+    GSError RequestBuffers(const BufferRequestConfig &config, std::vector<sptr<BufferExtraData>> &bedata,
+        std::vector<struct IBufferProducer::RequestBufferReturnValue> &retvalues);
+    // flushes in order under one lock and stops at the first failure, the consumer hears of every flushed buffer
+    GSError FlushBuffers(const std::vector<uint32_t> &sequences, const std::vector<sptr<BufferExtraData>> &bedata,
+        const std::vector<sptr<SyncFence>> &fences, const std::vector<BufferFlushConfigWithDamages> &configs);
+    // returns the flush result, requestRet is only set when the flush succeeded. the request never waits and gives
+    // GSERROR_NO_BUFFER when no free buffer can be handed out right away
+    GSError FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata, sptr<SyncFence> fence,
+        const BufferFlushConfigWithDamages &flushConfig, const BufferRequestConfig &requestConfig,
+        sptr<BufferExtraData> &requestBedata, struct IBufferProducer::RequestBufferReturnValue &retval,
+        GSError &requestRet);
 
     GSError DoFlushBuffer(uint32_t sequence, sptr<BufferExtraData> bedata,
         sptr<SyncFence> fence, const BufferFlushConfigWithDamages &config);
@@ -147,6 +222,16 @@ public:
 
     uint32_t GetQueueSize();
     GSError SetQueueSize(uint32_t queueSize);
+    /**
+     * @brief Lets the queue pick its own size between minQueueSize and the max queue size from the observed producer
+     * blocking, flushed backlog and consumer hold times. SetQueueSize still works and the tuning goes on from there.
+     *
+     * @param enabled Turns the auto queue size mode on or off, turning it off keeps the current size.
+     * @param minQueueSize Smallest size the queue shrinks to, must be larger than the detach reserve slot number.
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link GSERROR_INVALID_ARGUMENTS} 40001000 - Invalid minQueueSize.
+     */
+    GSError SetAutoQueueSize(bool enabled, uint32_t minQueueSize);
 
     GSError GetName(std::string &name);
 
@@ -187,8 +272,7 @@ public:
     GSError SetBufferName(const std::string &bufferName);
     inline bool IsBufferHold()
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        return isBufferHold_;
+        return isBufferHold_.load();
     }
     GSError SetScalingMode(uint32_t sequence, ScalingMode scalingMode);
     GSError GetScalingMode(uint32_t sequence, ScalingMode &scalingMode);
@@ -209,12 +293,10 @@ public:
     bool GetStatus() const;
     void SetStatus(bool status);
 
-    void SetBatchHandle(bool batch);
-
     GSError SetProducerCacheCleanFlag(bool flag);
     inline void ConsumerRequestCpuAccess(bool on)
     {
-        isCpuAccessable_ = on;
+        isCpuAccessable_.store(on);
     }
 
     GSError AttachBufferToQueue(sptr<SurfaceBuffer> buffer, InvokerType invokerType);
@@ -278,6 +360,7 @@ public:
     GSError SetIsPriorityAlloc(bool isPriorityAlloc);
     bool IsCached(uint32_t bufferSeqNum) const;
     GSError SyncProducerCache(std::map<uint32_t, sptr<SurfaceBuffer>>& buffers);
+    GSError SyncProducerCacheDelta(uint64_t generation, IBufferProducer::ProducerCacheDelta &delta);
 
     /**
      * @brief Set the Drop Frame Level for the buffer queue.
@@ -295,6 +378,12 @@ public:
     GSError SetVideoDimensionType(VideoDimType videoDimType);
     GSError GetVideoDimensionType(VideoDimType &videoDimType);
     GSError GetVideoDimensionType(uint32_t sequence, VideoDimType &videoDimType);
+
+    // SurfaceMemoryBudget, must be called without mutex_ held
+    void CollectMemoryUsage(SurfaceMemoryBudget::QueueUsage &usage,
+        std::vector<SurfaceMemoryBudget::ReclaimCandidate> &candidates);
+    // frees a buffer that is still in the free list, returns its size or 0 if it was not freed
+    uint32_t ReclaimFreeBuffer(uint32_t sequence);
 private:
     GSError AllocBuffer(sptr<SurfaceBuffer>& buffer, const sptr<SurfaceBuffer>& previousBuffer,
         const BufferRequestConfig& config, std::unique_lock<std::mutex>& lock);
@@ -314,7 +403,7 @@ private:
     bool CheckProducerCacheListLocked();
     GSError SetProducerCacheCleanFlagLocked(bool flag, std::unique_lock<std::mutex> &lock);
     GSError AttachBufferUpdateStatus(std::unique_lock<std::mutex> &lock, uint32_t sequence,
-        int32_t timeOut, std::map<uint32_t, BufferElement>::iterator &mapIter);
+        int32_t timeOut, BufferElementTable::iterator &mapIter);
     void AttachBufferUpdateBufferInfo(sptr<SurfaceBuffer>& buffer, bool needMap);
     void ListenerBufferReleasedCb(sptr<SurfaceBuffer> &buffer, const sptr<SyncFence> &fence,
         bool isOnReleaseBufferWithSequenceAndFence,
@@ -343,6 +432,8 @@ private:
     void ReleaseDropBuffers(std::vector<BufferAndFence> &dropBuffers);
     void DropBuffersByLevel(std::vector<BufferAndFence> &dropBuffers);
     void OnBufferDeleteForRS(uint32_t sequence);
+    // records that the buffer under sequence was added to or removed from bufferQueueCache_
+    void LogCacheChangeLocked(uint32_t sequence);
     void DeleteBufferInCacheNoWaitForAllocatingState(uint32_t sequence);
     void AddDeletingBuffersLocked(std::vector<uint32_t> &deletingBuffers);
     GSError DetachBufferFromQueueLocked(uint32_t sequence, InvokerType invokerType,
@@ -363,12 +454,16 @@ private:
         struct IBufferProducer::RequestBufferReturnValue &retval, std::unique_lock<std::mutex> &lock);
     GSError CancelBufferLocked(uint32_t sequence, sptr<BufferExtraData> bedata);
     void DumpPropertyListener();
-    void AllocBuffers(const BufferRequestConfig &config, uint32_t allocBufferCount,
-        std::map<uint32_t, sptr<SurfaceBuffer>> &surfaceBufferCache);
+    GSError PreAllocBufferTask(const BufferRequestConfig &config, uint64_t generation);
     void DeleteFreeListCacheLocked(uint32_t sequence);
+    // hands the allocation of a dropped free buffer to BufferRecyclePool
+    void RecycleBufferLocked(const BufferElement &element);
+    const sptr<SyncFence> &ResolveReleaseFenceLocked(BufferElement &element);
 
     void MarkBufferReclaimableByIdLocked(uint32_t sequence);
     GSError SetQueueSizeLocked(uint32_t queueSize, std::unique_lock<std::mutex> &lock);
+    void ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision decision,
+        std::unique_lock<std::mutex> &lock);
     void FlushLppBuffer();
     GSError ReuseBufferForNoBlockMode(sptr<SurfaceBuffer> &buffer, sptr<BufferExtraData> &bedata,
         BufferRequestConfig &updateConfig, const BufferRequestConfig &config,
@@ -386,20 +481,21 @@ private:
     void CleanReleasedBuffersLocked(std::unique_lock<std::mutex> &lock, std::vector<uint32_t> &cleanedSeqNums);
     void OnCleanCacheForBufferInfoMapLocked(sptr<IBufferConsumerListener> listener);
     sptr<ConsumerSurfaceDelegator> GetDelegator();
-    int32_t defaultWidth_ = 0;
-    int32_t defaultHeight_ = 0;
-    uint64_t defaultUsage_ = 0;
+    // read-mostly properties are atomics so their getters never wait behind a request or acquire on mutex_
+    std::atomic<int32_t> defaultWidth_ = 0;
+    std::atomic<int32_t> defaultHeight_ = 0;
+    std::atomic<uint64_t> defaultUsage_ = 0;
     uint32_t bufferQueueSize_ = SURFACE_DEFAULT_QUEUE_SIZE;
     ScalingMode scalingMode_ = ScalingMode::SCALING_MODE_SCALE_TO_WINDOW;
     VideoDimType videoDimType_ = VideoDimType::VIDEO_DIM_TYPE_2D;
-    GraphicTransformType transform_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
+    std::atomic<GraphicTransformType> transform_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
     GraphicTransformType lastFlushedTransform_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
     std::string name_;
-    std::list<uint32_t> freeList_;
-    std::list<uint32_t> dirtyList_;
-    std::list<uint32_t> deletingList_;
-    std::list<uint32_t> producerCacheList_;
-    std::map<uint32_t, BufferElement> bufferQueueCache_;
+    FreeSequenceList freeList_ { FreeListKeyOf { &bufferQueueCache_ } };
+    SequenceList<SURFACE_MAX_QUEUE_SIZE> dirtyList_;
+    SequenceList<SURFACE_MAX_QUEUE_SIZE> deletingList_;
+    SequenceList<SURFACE_MAX_QUEUE_SIZE> producerCacheList_;
+    BufferElementTable bufferQueueCache_;
     sptr<IBufferConsumerListener> listener_ = nullptr;
     IBufferConsumerListenerClazz *listenerClazz_ = nullptr;
     mutable std::mutex mutex_;
@@ -416,8 +512,13 @@ private:
     std::map<uint64_t, sptr<IProducerListener>> propertyChangeListeners_;
     OnDeleteBufferFunc onBufferDeleteForRSMainThread_;
     OnDeleteBufferFunc onBufferDeleteForRSHardwareThread_;
-    std::condition_variable waitReqCon_;
+    // producers blocked in ReuseBufferForBlockMode, woken one per freed buffer
+    BufferWaiterQueue requestWaiters_;
+    BufferQueueDepthController depthController_;
+    // a shrink decided while a producer was allocating, applied by a later release once no allocation runs
+    bool isDepthShrinkDeferred_ = false;
     std::condition_variable waitAttachCon_;
+    uint32_t attachWaiterCount_ = 0;
     sptr<SurfaceTunnelHandle> tunnelHandle_ = nullptr;
     TunnelLayerState tunnelLayerState_;
     bool isValidStatus_ = true;
@@ -428,14 +529,14 @@ private:
     sptr<SyncFence> preBufferReleasedFence_;
     sptr<ConsumerSurfaceDelegator> sptrCSurfaceDelegator_;
     std::mutex delegatorMutex_;
-    bool isCpuAccessable_ = false;
-    GraphicTransformType transformHint_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
-    bool isBufferHold_ = false;
+    std::atomic<bool> isCpuAccessable_ = false;
+    std::atomic<GraphicTransformType> transformHint_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
+    std::atomic<bool> isBufferHold_ = false;
     bool isBatch_ = false;
     OHSurfaceSource sourceType_ = OHSurfaceSource::OH_SURFACE_SOURCE_DEFAULT;
     std::string appFrameworkType_ = "";
-    float hdrWhitePointBrightness_ = 0.0;
-    float sdrWhitePointBrightness_ = 0.0;
+    std::atomic<float> hdrWhitePointBrightness_ = 0.0;
+    std::atomic<float> sdrWhitePointBrightness_ = 0.0;
     uint32_t acquireLastFlushedBufSequence_;
     int32_t globalAlpha_ = -1;
     // The default is false, where true indicates non blocking mode and false indicates blocking mode.
@@ -454,8 +555,18 @@ private:
     // Lpp >>
     int32_t connectedPid_ = 0;
     int32_t listenerSeqAndFenceCallingPid_ = 0;
-    bool isAllocatingBuffer_ = false;
+    // producers allocating, or waiting on a realloc fence, with mutex_ dropped; cache deletes wait for them
+    uint32_t allocatingBufferCount_ = 0;
     std::condition_variable isAllocatingBufferCon_;
+    // slots promised to allocations that are not in bufferQueueCache_ yet, GetUsedSize counts them as used
+    uint32_t reservedSlotCount_ = 0;
+    uint32_t preAllocPendingCount_ = 0;
+    // bumped when the cache is cleared, pre-allocations started before that are dropped instead of inserted
+    uint64_t preAllocGeneration_ = 0;
+    // counts the changes to bufferQueueCache_, the sequence touched by change n is at n % CACHE_CHANGE_LOG_SIZE
+    static constexpr uint64_t CACHE_CHANGE_LOG_SIZE = 2 * SURFACE_MAX_QUEUE_SIZE;
+    uint64_t cacheGeneration_ = 0;
+    std::array<uint32_t, CACHE_CHANGE_LOG_SIZE> cacheChangeLog_ = {};
     int64_t lastFlushedDesiredPresentTimeStamp_ = 0;
     bool bufferSupportFastCompose_ = false;
     uint32_t rotatingBufferNumber_ = 0;
@@ -470,6 +581,9 @@ private:
     int32_t dropFrameLevel_ = 0;  // Drop frame level: 0=no drop, >0=keep latest N frames
     SingleBufferMode singleBufferMode_ = SingleBufferMode::SINGLE_BUFFER_MODE_NONE;
     std::vector<CleanCacheBufferInfo> bufferInfoMap_;
+    // free buffers handed out with a matching config, and ones handed out for realloc
+    uint64_t reallocAvoidedCount_ = 0;
+    uint64_t reallocFallbackCount_ = 0;
 };
 }; // namespace OHOS
 
@@ -101,6 +101,7 @@ public:
     GSError GetLastConsumeTime(int64_t &lastConsumeTime) const;
     GSError SetMaxQueueSize(uint32_t queueSize);
     GSError GetMaxQueueSize(uint32_t &queueSize) const;
+    GSError SetAutoQueueSize(bool enabled, uint32_t minQueueSize);
     GSError SetLppDrawSource(bool isShbSource, bool isRsSource);
     GSError GetAlphaType(GraphicAlphaType &alphaType);
     GSError SetIsPriorityAlloc(bool isPriorityAlloc);
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_DEPTH_CONTROLLER_H
+#define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_DEPTH_CONTROLLER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace OHOS {
+/**
+ * Picks the queue size of a BufferQueue in auto queue size mode from what the pipeline did over the last
+ * WINDOW_FRAMES releases. It grows by one when producers often block in RequestBuffer while flushed buffers are not
+ * piling up, which means the consumer holds buffers too long for the current depth. It shrinks by one when no request
+ * blocked, every request found a spare free buffer and the consumer returns buffers faster than they come in.
+ * All methods must be called with the queue mutex held.
+ */
+class BufferQueueDepthController {
+public:
+    enum class Decision {
+        KEEP,
+        GROW,
+        SHRINK,
+    };
+
+    // a request counts as blocked once it waited this long
+    static constexpr int64_t BLOCKED_THRESHOLD_NS = 1000000; // 1ms
+    static constexpr uint32_t WINDOW_FRAMES = 60;
+    static constexpr uint32_t GROW_BLOCKED_PERCENT = 10;
+    static constexpr uint32_t GROW_MAX_AVG_DIRTY_DEPTH = 1;
+
+    void Enable(uint32_t minQueueSize)
+    {
+        isEnabled_ = true;
+        minQueueSize_ = minQueueSize;
+        ResetWindow();
+    }
+
+    void Disable()
+    {
+        isEnabled_ = false;
+    }
+
+    bool IsEnabled() const
+    {
+        return isEnabled_;
+    }
+
+    uint32_t GetMinQueueSize() const
+    {
+        return minQueueSize_;
+    }
+
+    // freeCount is the free list length when the request came in
+    void OnRequest(uint32_t freeCount)
+    {
+        if (!isEnabled_) {
+            return;
+        }
+        window_.requests++;
+        window_.minFreeAtRequest = std::min(window_.minFreeAtRequest, freeCount);
+    }
+
+    void OnRequestWaited(int64_t waitNs)
+    {
+        if (isEnabled_ && waitNs >= BLOCKED_THRESHOLD_NS) {
+            window_.blockedRequests++;
+        }
+    }
+
+    // dirtyDepth is the dirty list length before the acquire
+    void OnAcquire(uint32_t dirtyDepth)
+    {
+        if (!isEnabled_) {
+            return;
+        }
+        window_.acquires++;
+        window_.dirtyDepthSum += dirtyDepth;
+    }
+
+    // called for every release, returns the decision when a window is complete
+    Decision OnRelease(int64_t holdNs, int64_t now, uint32_t queueSize, uint32_t maxQueueSize)
+    {
+        if (!isEnabled_) {
+            return Decision::KEEP;
+        }
+        if (lastReleaseTime_ != 0) {
+            window_.releaseIntervalSum += now - lastReleaseTime_;
+        }
+        lastReleaseTime_ = now;
+        window_.holdSum += holdNs;
+        if (++window_.releases < WINDOW_FRAMES) {
+            return Decision::KEEP;
+        }
+        Decision decision = Decide(queueSize, maxQueueSize);
+        last_ = window_;
+        lastDecision_ = decision;
+        if (decision == Decision::GROW) {
+            grows_++;
+        } else if (decision == Decision::SHRINK) {
+            shrinks_++;
+        }
+        ResetWindow();
+        return decision;
+    }
+
+    static const char *DecisionStr(Decision decision)
+    {
+        switch (decision) {
+            case Decision::GROW:
+                return "grow";
+            case Decision::SHRINK:
+                return "shrink";
+            default:
+                return "keep";
+        }
+    }
+
+    void Dump(std::string &result) const
+    {
+        result += "enabled = " + std::to_string(isEnabled_) +
+            ", min = " + std::to_string(minQueueSize_) +
+            ", grows = " + std::to_string(grows_) +
+            ", shrinks = " + std::to_string(shrinks_) +
+            ", last = " + DecisionStr(lastDecision_) +
+            " (requests = " + std::to_string(last_.requests) +
+            ", blocked = " + std::to_string(last_.blockedRequests) +
+            ", avgDirtyDepth = " + std::to_string(AvgDirtyDepth(last_)) +
+            ", avgHold = " + std::to_string(AvgHoldNs(last_) / 1000) + "us" + // 1000: ns to us
+            ", avgReleaseInterval = " + std::to_string(AvgReleaseIntervalNs(last_) / 1000) + "us)"; // ns to us
+    }
+
+private:
+    struct Window {
+        uint32_t requests = 0;
+        uint32_t blockedRequests = 0;
+        uint32_t minFreeAtRequest = std::numeric_limits<uint32_t>::max();
+        uint32_t acquires = 0;
+        uint64_t dirtyDepthSum = 0;
+        uint32_t releases = 0;
+        int64_t holdSum = 0;
+        int64_t releaseIntervalSum = 0;
+    };
+
+    static uint32_t AvgDirtyDepth(const Window &window)
+    {
+        return window.acquires == 0 ? 0 : static_cast<uint32_t>(window.dirtyDepthSum / window.acquires);
+    }
+
+    static int64_t AvgHoldNs(const Window &window)
+    {
+        return window.releases == 0 ? 0 : window.holdSum / window.releases;
+    }
+
+    static int64_t AvgReleaseIntervalNs(const Window &window)
+    {
+        return window.releases <= 1 ? 0 : window.releaseIntervalSum / (window.releases - 1);
+    }
+
+    Decision Decide(uint32_t queueSize, uint32_t maxQueueSize) const
+    {
+        uint32_t percent = 100; // 100: percent
+        if (queueSize < maxQueueSize && window_.requests > 0 &&
+            window_.blockedRequests * percent >= window_.requests * GROW_BLOCKED_PERCENT &&
+            AvgDirtyDepth(window_) <= GROW_MAX_AVG_DIRTY_DEPTH) {
+            return Decision::GROW;
+        }
+        // one free buffer was never needed over the whole window
+        if (queueSize > minQueueSize_ && window_.requests > 0 && window_.blockedRequests == 0 &&
+            window_.minFreeAtRequest >= 2 && AvgHoldNs(window_) < AvgReleaseIntervalNs(window_)) { // 2: one spare
+            return Decision::SHRINK;
+        }
+        return Decision::KEEP;
+    }
+
+    void ResetWindow()
+    {
+        window_ = Window();
+        lastReleaseTime_ = 0;
+    }
+
+    bool isEnabled_ = false;
+    uint32_t minQueueSize_ = 1;
+    Window window_;
+    Window last_;
+    int64_t lastReleaseTime_ = 0;
+    Decision lastDecision_ = Decision::KEEP;
+    uint64_t grows_ = 0;
+    uint64_t shrinks_ = 0;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_DEPTH_CONTROLLER_H
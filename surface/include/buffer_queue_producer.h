@@ -16,6 +16,11 @@
 #ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_PRODUCER_H
 #define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_PRODUCER_H
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <thread>
 #include <vector>
 #include <mutex>
 #include <refbase.h>
@@ -28,6 +33,8 @@
 #include "isurface_permission.h"
 
 #include "buffer_queue.h"
+#include "producer_command_stats.h"
+#include "surface_control_channel.h"
 
 namespace OHOS {
 class SURFACE_HIDDEN BufferQueueProducer : public IRemoteStub<IBufferProducer> {
@@ -134,6 +141,9 @@ public:
         RequestBufferReturnValue& retval) override;
     GSError AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, sptr<BufferExtraData>& bedata,
         const sptr<SyncFence>& fence, BufferFlushConfigWithDamages& config, bool needMap) override;
+    GSError FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata, sptr<SyncFence> fence,
+        BufferFlushConfigWithDamages& flushConfig, const BufferRequestConfig& requestConfig,
+        sptr<BufferExtraData>& requestBedata, RequestBufferReturnValue& retval, GSError& requestRet) override;
     GSError GetCycleBuffersNumber(uint32_t& cycleBuffersNumber) override;
     GSError SetCycleBuffersNumber(uint32_t cycleBuffersNumber) override;
     GSError SetFrameGravity(int32_t frameGravity) override;
@@ -145,11 +155,14 @@ public:
     GSError SetAlphaType(GraphicAlphaType alphaType) override;
     GSError GetAvailableBufferCount(uint32_t &count) override;
     GSError SyncProducerCache(std::map<uint32_t, sptr<SurfaceBuffer>>& buffers) override;
+    GSError SyncProducerCacheDelta(uint64_t generation, ProducerCacheDelta &delta) override;
     GSError CleanReleasedBuffers(std::vector<uint32_t> &cleanedSeqNums) override;
     GSError CleanProducerBySeqNum(const std::vector<uint32_t>& seqNums) override;
     GSError SetVideoDimensionType(VideoDimType videoDimType) override;
     GSError GetVideoDimensionType(VideoDimType &videoDimType) override;
     GSError SetPermissionRules(sptr<ISurfacePermission>& permission);
+    // per command call counts and latencies, only collected while the stats parameter is set
+    void DumpCommandStats(std::string &result);
 
 private:
     GSError CheckConnectLocked();
@@ -213,6 +226,13 @@ private:
     int32_t SetRequestBufferNoblockModeRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t RequestAndDetachBufferRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t AttachAndFlushBufferRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
+    int32_t FlushAndRequestBufferRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
+    int32_t FlushBufferAsyncRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
+    int32_t RequestBufferAfterAsyncFlushRemote(MessageParcel &arguments, MessageParcel &reply,
+        MessageOption &option);
+    int32_t WaitAsyncFlushRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
+    // waits until the async flushes up to serial ran, returns and clears their first error
+    GSError WaitAsyncFlush(uint64_t session, uint64_t serial);
     int32_t GetRotatingBuffersNumberRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t SetRotatingBuffersNumberRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t SetFrameGravityRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
@@ -224,12 +244,15 @@ private:
     int32_t SetLppShareFdRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t SetAlphaTypeRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t SyncProducerCacheRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
+    int32_t SyncProducerCacheDeltaRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t SetSingleBufferModeRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t SetVideoDimensionTypeRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
     int32_t GetVideoDimensionTypeRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
 
     void SetConnectedPidLocked(int32_t connectedPid);
     void SetListenerSeqAndFenceCallingPid(int32_t listenerSeqAndFenceCallingPid);
+    int32_t WriteRequestBufferReply(MessageParcel &reply, GSError sRet, const RequestBufferReturnValue &retval,
+        const sptr<BufferExtraData> &bedata, bool isPackedExtraData);
     int32_t AttachBufferToQueueReadBuffer(MessageParcel &arguments,
         MessageParcel &reply, MessageOption &option, sptr<SurfaceBuffer> &buffer);
     void ReportQueueBufferTimeIfNeeded(int64_t startTimeNs);
@@ -237,9 +260,31 @@ private:
     int32_t PreAllocBuffersRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
 
     int32_t CleanReleasedBuffersRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
-
-    static const std::map<uint32_t, std::function<int32_t(BufferQueueProducer *that, MessageParcel &arguments,
-        MessageParcel &reply, MessageOption &option)>> memberFuncMap_;
+    int32_t SetupControlChannelRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option);
+
+    GSError ConnectByPid(int32_t callingPid);
+    GSError SetupControlChannel(const sptr<SurfaceControlChannel> &channel, int32_t callingPid);
+    void StopControlChannel();
+    static void ControlChannelLoop(wptr<BufferQueueProducer> producer, sptr<SurfaceControlChannel> channel);
+    // runs what the producer put on the channel before anything it sends over binder afterwards
+    void DrainControlChannel();
+    void HandleControlRecordLocked(const SurfaceControlRecord &record, int32_t fenceFd);
+    void RequestBufferFromChannelLocked(const SurfaceControlRecord &record);
+    void FlushBufferFromChannelLocked(const SurfaceControlRecord &record, const sptr<SyncFence> &fence);
+    GSError RegisterReleaseListenerInner(const sptr<IProducerListener> &listener,
+        bool isOnReleaseBufferWithSequenceAndFence, const sptr<SurfaceControlChannel> &channel);
+
+    using RemoteFunc = int32_t (BufferQueueProducer::*)(MessageParcel &arguments, MessageParcel &reply,
+        MessageOption &option);
+    struct RemoteFuncEntry {
+        RemoteFunc func = nullptr;
+        const char *name = nullptr;
+    };
+    // indexed by command code, codes without a handler keep an empty entry
+    using RemoteFuncTable = std::array<RemoteFuncEntry, BUFFER_PRODUCER_BUTT>;
+    static constexpr RemoteFuncTable BuildRemoteFuncTable();
+    static const char *GetRemoteFuncName(uint32_t code);
+    static const RemoteFuncTable remoteFuncTable_;
 
     class ProducerSurfaceDeathRecipient : public IRemoteObject::DeathRecipient {
     public:
@@ -263,6 +308,28 @@ private:
     static const uint32_t MAGIC_INIT = 0x16273849;
     uint32_t magicNum_ = MAGIC_INIT;
     sptr<ISurfacePermission> permission_ = nullptr;
+
+    // held while draining, so channel records and binder calls are handled in the order the producer made them
+    std::mutex controlChannelMutex_;
+    std::atomic<bool> hasControlChannel_ = false;
+    sptr<SurfaceControlChannel> controlChannel_ = nullptr;
+    // the pid that set up the channel, records have no binder calling pid
+    int32_t controlChannelPid_ = 0;
+    std::thread controlChannelThread_;
+    // the listener as the producer registered it, wrapped before it goes to the queue while a channel is up
+    sptr<IProducerListener> releaseListener_ = nullptr;
+    bool isOnReleaseBufferWithSequenceAndFence_ = false;
+
+    // oneway flushes overtake nothing but may be overtaken by sync calls, those wait for asyncFlushSerial_
+    std::mutex asyncFlushMutex_;
+    std::condition_variable asyncFlushCon_;
+    // oneway transactions carry no calling pid, each producer proxy sends a session id of its own
+    uint64_t asyncFlushSession_ = 0;
+    uint64_t asyncFlushSerial_ = 0;
+    // the first error since the producer last asked, returned by its next ordered request
+    GSError asyncFlushError_ = GSERROR_OK;
+
+    std::unique_ptr<ProducerCommandStats> commandStats_ = nullptr;
 };
 }; // namespace OHOS
 
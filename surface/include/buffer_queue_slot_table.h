@@ -0,0 +1,572 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_SLOT_TABLE_H
+#define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_SLOT_TABLE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace OHOS {
+/**
+ * Slot table keyed by buffer sequence number.
+ * Elements live in fixed-size slot blocks that are never released before the table itself, so references and
+ * iterators stay valid while other elements are inserted or erased, just like std::map. A sorted seq->slot index
+ * keeps iteration in ascending sequence order. Once the working set of a queue is reached, lookups, inserts and
+ * erases do not touch the heap.
+ */
+template<typename T, size_t Capacity, size_t BlockSize = 8>
+class SequenceSlotTable {
+public:
+    using key_type = uint32_t;
+    using mapped_type = T;
+    using value_type = std::pair<const uint32_t, T>;
+    using size_type = size_t;
+
+    template<bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename SequenceSlotTable::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const value_type *, value_type *>;
+        using reference = std::conditional_t<IsConst, const value_type &, value_type &>;
+        using TablePtr = std::conditional_t<IsConst, const SequenceSlotTable *, SequenceSlotTable *>;
+
+        Iterator() = default;
+        Iterator(TablePtr table, uint32_t slot) : table_(table), slot_(slot) {}
+        template<bool OtherConst, typename = std::enable_if_t<IsConst && !OtherConst>>
+        Iterator(const Iterator<OtherConst> &other) : table_(other.table_), slot_(other.slot_) {}
+
+        reference operator*() const
+        {
+            return *table_->SlotAt(slot_);
+        }
+        pointer operator->() const
+        {
+            return &*table_->SlotAt(slot_);
+        }
+        Iterator &operator++()
+        {
+            slot_ = table_->NextSlot(table_->SlotAt(slot_)->first);
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+        bool operator==(const Iterator &other) const
+        {
+            return slot_ == other.slot_;
+        }
+        bool operator!=(const Iterator &other) const
+        {
+            return slot_ != other.slot_;
+        }
+
+    private:
+        friend class SequenceSlotTable;
+        template<bool> friend class Iterator;
+        TablePtr table_ = nullptr;
+        uint32_t slot_ = INVALID_SLOT;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    SequenceSlotTable() : sentinel_(std::in_place, std::piecewise_construct, std::forward_as_tuple(0),
+        std::forward_as_tuple())
+    {
+        index_.reserve(Capacity);
+        freeSlots_.reserve(Capacity);
+    }
+    ~SequenceSlotTable() = default;
+    SequenceSlotTable(const SequenceSlotTable &) = delete;
+    SequenceSlotTable &operator=(const SequenceSlotTable &) = delete;
+
+    iterator begin()
+    {
+        return iterator(this, index_.empty() ? INVALID_SLOT : index_.front().slot);
+    }
+    iterator end()
+    {
+        return iterator(this, INVALID_SLOT);
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(this, index_.empty() ? INVALID_SLOT : index_.front().slot);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(this, INVALID_SLOT);
+    }
+
+    size_type size() const
+    {
+        return index_.size();
+    }
+    bool empty() const
+    {
+        return index_.empty();
+    }
+
+    iterator find(uint32_t sequence)
+    {
+        auto pos = LowerBound(sequence);
+        return iterator(this, (pos != index_.end() && pos->sequence == sequence) ? pos->slot : INVALID_SLOT);
+    }
+    const_iterator find(uint32_t sequence) const
+    {
+        auto pos = LowerBound(sequence);
+        return const_iterator(this, (pos != index_.end() && pos->sequence == sequence) ? pos->slot : INVALID_SLOT);
+    }
+    size_type count(uint32_t sequence) const
+    {
+        return find(sequence) == end() ? 0 : 1;
+    }
+
+    T &operator[](uint32_t sequence)
+    {
+        auto pos = LowerBound(sequence);
+        if (pos != index_.end() && pos->sequence == sequence) {
+            return SlotAt(pos->slot)->second;
+        }
+        uint32_t slot = AcquireSlot();
+        auto &entry = SlotAt(slot);
+        entry.emplace(std::piecewise_construct, std::forward_as_tuple(sequence), std::forward_as_tuple());
+        index_.insert(pos, IndexEntry { sequence, slot });
+        return entry->second;
+    }
+
+    iterator erase(iterator it)
+    {
+        uint32_t sequence = it->first;
+        auto pos = LowerBound(sequence);
+        auto next = index_.erase(pos);
+        ReleaseSlot(it.slot_);
+        return iterator(this, next == index_.end() ? INVALID_SLOT : next->slot);
+    }
+    size_type erase(uint32_t sequence)
+    {
+        auto it = find(sequence);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (const auto &entry : index_) {
+            ReleaseSlot(entry.slot);
+        }
+        index_.clear();
+    }
+
+private:
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+    struct IndexEntry {
+        uint32_t sequence;
+        uint32_t slot;
+    };
+    using Slot = std::optional<value_type>;
+    using Block = std::array<Slot, BlockSize>;
+
+    // end() resolves to a value-initialized sentinel rather than faulting, as tolerant as the map header node
+    Slot &SlotAt(uint32_t slot)
+    {
+        if (slot == INVALID_SLOT) {
+            return sentinel_;
+        }
+        return (*blocks_[slot / BlockSize])[slot % BlockSize];
+    }
+    const Slot &SlotAt(uint32_t slot) const
+    {
+        if (slot == INVALID_SLOT) {
+            return sentinel_;
+        }
+        return (*blocks_[slot / BlockSize])[slot % BlockSize];
+    }
+
+    typename std::vector<IndexEntry>::iterator LowerBound(uint32_t sequence)
+    {
+        return std::lower_bound(index_.begin(), index_.end(), sequence,
+            [](const IndexEntry &entry, uint32_t seq) { return entry.sequence < seq; });
+    }
+    typename std::vector<IndexEntry>::const_iterator LowerBound(uint32_t sequence) const
+    {
+        return std::lower_bound(index_.begin(), index_.end(), sequence,
+            [](const IndexEntry &entry, uint32_t seq) { return entry.sequence < seq; });
+    }
+
+    uint32_t NextSlot(uint32_t sequence) const
+    {
+        auto pos = std::upper_bound(index_.begin(), index_.end(), sequence,
+            [](uint32_t seq, const IndexEntry &entry) { return seq < entry.sequence; });
+        return pos == index_.end() ? INVALID_SLOT : pos->slot;
+    }
+
+    uint32_t AcquireSlot()
+    {
+        if (freeSlots_.empty()) {
+            uint32_t base = static_cast<uint32_t>(blocks_.size() * BlockSize);
+            blocks_.push_back(std::make_unique<Block>());
+            // hand out lower slots first so a shallow queue stays inside its first block
+            for (uint32_t i = BlockSize; i > 0; i--) {
+                freeSlots_.push_back(base + i - 1);
+            }
+        }
+        uint32_t slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        return slot;
+    }
+    void ReleaseSlot(uint32_t slot)
+    {
+        SlotAt(slot).reset();
+        freeSlots_.push_back(slot);
+    }
+
+    std::vector<std::unique_ptr<Block>> blocks_;
+    std::vector<uint32_t> freeSlots_;
+    std::vector<IndexEntry> index_;
+    Slot sentinel_;
+};
+
+/**
+ * FIFO of buffer sequence numbers stored in a ring.
+ * The ring is sized for Capacity entries and only grows if a caller pushes past it, so the steady-state
+ * push_back/pop_front/erase path of a queue does not allocate.
+ */
+template<size_t Capacity>
+class SequenceList {
+public:
+    using value_type = uint32_t;
+    using size_type = size_t;
+
+    template<bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const uint32_t *, uint32_t *>;
+        using reference = std::conditional_t<IsConst, const uint32_t &, uint32_t &>;
+        using ListPtr = std::conditional_t<IsConst, const SequenceList *, SequenceList *>;
+
+        Iterator() = default;
+        Iterator(ListPtr list, size_t offset) : list_(list), offset_(offset) {}
+        template<bool OtherConst, typename = std::enable_if_t<IsConst && !OtherConst>>
+        Iterator(const Iterator<OtherConst> &other) : list_(other.list_), offset_(other.offset_) {}
+
+        reference operator*() const
+        {
+            return list_->At(offset_);
+        }
+        pointer operator->() const
+        {
+            return &list_->At(offset_);
+        }
+        Iterator &operator++()
+        {
+            ++offset_;
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator tmp = *this;
+            ++offset_;
+            return tmp;
+        }
+        bool operator==(const Iterator &other) const
+        {
+            return offset_ == other.offset_;
+        }
+        bool operator!=(const Iterator &other) const
+        {
+            return offset_ != other.offset_;
+        }
+
+    private:
+        friend class SequenceList;
+        template<bool> friend class Iterator;
+        ListPtr list_ = nullptr;
+        size_t offset_ = 0;
+    };
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    SequenceList() : ring_(Capacity) {}
+    SequenceList(std::initializer_list<uint32_t> sequences) : SequenceList()
+    {
+        *this = sequences;
+    }
+    SequenceList &operator=(std::initializer_list<uint32_t> sequences)
+    {
+        clear();
+        for (uint32_t sequence : sequences) {
+            push_back(sequence);
+        }
+        return *this;
+    }
+
+    iterator begin()
+    {
+        return iterator(this, 0);
+    }
+    iterator end()
+    {
+        return iterator(this, size_);
+    }
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0);
+    }
+    const_iterator end() const
+    {
+        return const_iterator(this, size_);
+    }
+
+    size_type size() const
+    {
+        return size_;
+    }
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+    uint32_t &front()
+    {
+        return ring_[head_];
+    }
+    const uint32_t &front() const
+    {
+        return ring_[head_];
+    }
+
+    void push_back(uint32_t sequence)
+    {
+        if (size_ == ring_.size()) {
+            Grow();
+        }
+        ring_[(head_ + size_) % ring_.size()] = sequence;
+        size_++;
+    }
+    void pop_front()
+    {
+        if (size_ == 0) {
+            return;
+        }
+        head_ = (head_ + 1) % ring_.size();
+        size_--;
+    }
+
+    iterator erase(iterator it)
+    {
+        // close the gap by shifting the tail forward, the element after the erased one takes its offset
+        for (size_t i = it.offset_; i + 1 < size_; i++) {
+            At(i) = At(i + 1);
+        }
+        size_--;
+        return iterator(this, it.offset_);
+    }
+    void remove(uint32_t sequence)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < size_; i++) {
+            if (At(i) != sequence) {
+                At(kept++) = At(i);
+            }
+        }
+        size_ = kept;
+    }
+
+    void clear()
+    {
+        head_ = 0;
+        size_ = 0;
+    }
+
+private:
+    uint32_t &At(size_t offset)
+    {
+        return ring_[(head_ + offset) % ring_.size()];
+    }
+    const uint32_t &At(size_t offset) const
+    {
+        return ring_[(head_ + offset) % ring_.size()];
+    }
+    void Grow()
+    {
+        std::vector<uint32_t> ring(ring_.size() * 2);
+        for (size_t i = 0; i < size_; i++) {
+            ring[i] = At(i);
+        }
+        ring_.swap(ring);
+        head_ = 0;
+    }
+
+    std::vector<uint32_t> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+/**
+ * SequenceList that also buckets its entries by a key derived from each sequence when it is pushed.
+ * FindFirst looks up one bucket instead of walking the whole list, and within a bucket entries keep the fifo
+ * order of the list. Buckets keep their storage once emptied, so a queue cycling through the same configs does
+ * not allocate.
+ */
+template<size_t Capacity, typename Key, typename KeyHash, typename KeyOf>
+class KeyedSequenceList : public SequenceList<Capacity> {
+public:
+    using Base = SequenceList<Capacity>;
+    using typename Base::iterator;
+
+    explicit KeyedSequenceList(KeyOf keyOf) : keyOf_(keyOf) {}
+    KeyedSequenceList &operator=(std::initializer_list<uint32_t> sequences)
+    {
+        clear();
+        for (uint32_t sequence : sequences) {
+            push_back(sequence);
+        }
+        return *this;
+    }
+
+    void push_back(uint32_t sequence)
+    {
+        Base::push_back(sequence);
+        Key key;
+        if (keyOf_(sequence, key)) {
+            BucketFor(key).sequences.push_back(sequence);
+        }
+    }
+    void pop_front()
+    {
+        if (Base::empty()) {
+            return;
+        }
+        Unindex(Base::front(), false);
+        Base::pop_front();
+    }
+    iterator erase(iterator it)
+    {
+        Unindex(*it, false);
+        return Base::erase(it);
+    }
+    void remove(uint32_t sequence)
+    {
+        Unindex(sequence, true);
+        Base::remove(sequence);
+    }
+    void clear()
+    {
+        for (auto &bucket : buckets_) {
+            bucket.sequences.clear();
+        }
+        Base::clear();
+    }
+
+    // first sequence under key, in fifo order, accepted by pred
+    template<typename Pred>
+    bool FindFirst(const Key &key, Pred pred, uint32_t &sequence) const
+    {
+        size_t hash = KeyHash()(key);
+        for (const auto &bucket : buckets_) {
+            if (bucket.hash != hash || bucket.sequences.empty() || !(bucket.key == key)) {
+                continue;
+            }
+            for (uint32_t candidate : bucket.sequences) {
+                if (pred(candidate)) {
+                    sequence = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+        return false;
+    }
+    bool EraseFirst(uint32_t sequence)
+    {
+        for (auto it = Base::begin(); it != Base::end(); ++it) {
+            if (*it == sequence) {
+                erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Bucket {
+        size_t hash;
+        Key key;
+        std::vector<uint32_t> sequences;
+    };
+
+    Bucket &BucketFor(const Key &key)
+    {
+        size_t hash = KeyHash()(key);
+        Bucket *idle = nullptr;
+        for (auto &bucket : buckets_) {
+            if (bucket.hash == hash && bucket.key == key) {
+                return bucket;
+            }
+            if (idle == nullptr && bucket.sequences.empty()) {
+                idle = &bucket;
+            }
+        }
+        if (idle != nullptr) {
+            idle->hash = hash;
+            idle->key = key;
+            return *idle;
+        }
+        buckets_.push_back(Bucket { hash, key, {} });
+        return buckets_.back();
+    }
+    void Unindex(uint32_t sequence, bool all)
+    {
+        for (auto &bucket : buckets_) {
+            auto &sequences = bucket.sequences;
+            for (auto it = sequences.begin(); it != sequences.end();) {
+                if (*it != sequence) {
+                    ++it;
+                    continue;
+                }
+                it = sequences.erase(it);
+                if (!all) {
+                    return;
+                }
+            }
+        }
+    }
+
+    KeyOf keyOf_;
+    std::vector<Bucket> buckets_;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_SLOT_TABLE_H
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_WAITER_H
+#define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_WAITER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace OHOS {
+/**
+ * FIFO queue of threads blocked on the queue mutex until a buffer can be handed to them.
+ * Every waiter sleeps on its own condition variable. NotifyOne wakes only the oldest waiter, so one freed buffer
+ * wakes one requester instead of all of them. A woken waiter that finds the buffer already taken goes back to the
+ * head of the queue and keeps its turn. NotifyAll is for state changes every waiter must see, such as a status
+ * change or a bigger queue. All methods must be called with the mutex passed to WaitFor held.
+ */
+class BufferWaiterQueue {
+public:
+    struct Stats {
+        uint64_t waits = 0;
+        uint64_t timeouts = 0;
+        // woken for a handoff but the buffer was gone, the waiter went back to the head of the queue
+        uint64_t requeues = 0;
+        uint32_t maxQueued = 0;
+        int64_t maxWaitNs = 0;
+        // waits by log2 of the wait time in microseconds, the last bucket takes everything longer
+        std::array<uint64_t, 16> waitHistogram = {};
+    };
+
+    BufferWaiterQueue() = default;
+    ~BufferWaiterQueue() = default;
+    BufferWaiterQueue(const BufferWaiterQueue &) = delete;
+    BufferWaiterQueue &operator=(const BufferWaiterQueue &) = delete;
+
+    // blocks until pred holds or timeout passes, returns pred()
+    template<typename Pred>
+    bool WaitFor(std::unique_lock<std::mutex> &lock, std::chrono::milliseconds timeout, Pred pred)
+    {
+        if (pred()) {
+            return true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + timeout;
+        Waiter self;
+        waiters_.push_back(&self);
+        stats_.maxQueued = std::max(stats_.maxQueued, static_cast<uint32_t>(waiters_.size()));
+        bool ready = false;
+        while (!(ready = pred())) {
+            if (self.cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+                ready = pred();
+                break;
+            }
+            if (self.notified && !(ready = pred())) {
+                self.notified = false;
+                waiters_.push_front(&self);
+                stats_.requeues++;
+            }
+        }
+        auto it = std::find(waiters_.begin(), waiters_.end(), &self);
+        if (it != waiters_.end()) {
+            waiters_.erase(it);
+        } else if (!ready) {
+            // the handoff came too late for this waiter, pass it on so the buffer is not left unclaimed
+            NotifyOne();
+        }
+        Record(std::chrono::steady_clock::now() - start, ready);
+        return ready;
+    }
+
+    void NotifyOne()
+    {
+        if (waiters_.empty()) {
+            return;
+        }
+        Waiter *waiter = waiters_.front();
+        waiters_.pop_front();
+        waiter->notified = true;
+        waiter->cv.notify_one();
+    }
+
+    void NotifyAll()
+    {
+        while (!waiters_.empty()) {
+            NotifyOne();
+        }
+    }
+
+    size_t Size() const
+    {
+        return waiters_.size();
+    }
+
+    const Stats &GetStats() const
+    {
+        return stats_;
+    }
+
+    // wait time in microseconds below which the given permille of waits finished, rounded up to a bucket edge
+    int64_t GetWaitPercentileUs(uint32_t permille) const
+    {
+        if (stats_.waits == 0) {
+            return 0;
+        }
+        uint64_t target = (stats_.waits * permille + 999) / 1000; // 999: round up
+        uint64_t seen = 0;
+        for (size_t i = 0; i < stats_.waitHistogram.size(); i++) {
+            seen += stats_.waitHistogram[i];
+            if (seen >= target) {
+                return int64_t(1) << (i + 1);
+            }
+        }
+        return int64_t(1) << stats_.waitHistogram.size();
+    }
+
+    void Dump(std::string &result) const
+    {
+        result += "waits = " + std::to_string(stats_.waits) +
+            ", timeouts = " + std::to_string(stats_.timeouts) +
+            ", requeues = " + std::to_string(stats_.requeues) +
+            ", maxQueued = " + std::to_string(stats_.maxQueued) +
+            ", p50 <= " + std::to_string(GetWaitPercentileUs(500)) + "us" + // 500: p50
+            ", p99 <= " + std::to_string(GetWaitPercentileUs(990)) + "us" + // 990: p99
+            ", max = " + std::to_string(stats_.maxWaitNs / 1000) + "us"; // 1000: ns to us
+    }
+
+private:
+    struct Waiter {
+        std::condition_variable cv;
+        bool notified = false;
+    };
+
+    void Record(std::chrono::steady_clock::duration waited, bool ready)
+    {
+        int64_t waitNs = std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+        stats_.waits++;
+        if (!ready) {
+            stats_.timeouts++;
+        }
+        stats_.maxWaitNs = std::max(stats_.maxWaitNs, waitNs);
+        size_t bucket = 0;
+        for (int64_t us = waitNs / 1000; us > 1 && bucket + 1 < stats_.waitHistogram.size(); us >>= 1) { // ns to us
+            bucket++;
+        }
+        stats_.waitHistogram[bucket]++;
+    }
+
+    std::deque<Waiter *> waiters_;
+    Stats stats_;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_BUFFER_QUEUE_WAITER_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_BUFFER_RECYCLE_POOL_H
+#define FRAMEWORKS_SURFACE_INCLUDE_BUFFER_RECYCLE_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "surface_buffer.h"
+#include "surface_type.h"
+
+namespace OHOS {
+/**
+ * Process-wide pool of allocations taken from buffers that a queue dropped.
+ * A queue allocating a buffer with the same width, height, format and usage takes the allocation over instead of
+ * going through AllocMem and Mmap again. Allocations are only handed back to a queue connected to the same producer
+ * pid, so one app never sees what another app drew. The pool is bounded in bytes, oldest entries go first, and
+ * entries older than MAX_AGE are freed by a background sweep.
+ * Only buffers of a producer in this process are taken, a remote peer may still map a buffer the queue dropped.
+ * The pool is off by default, persist.graphic.buffer_recycle_pool.max_kb turns it on.
+ */
+class BufferRecyclePool {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;
+        uint32_t count = 0;
+    };
+
+    static BufferRecyclePool& GetInstance();
+
+    // takes the allocation out of buffer if nothing else references it and ownerPid is 0 or this process,
+    // returns false if it was not taken
+    bool Put(const sptr<SurfaceBuffer>& buffer, const BufferRequestConfig& config, int32_t ownerPid);
+    // gives buffer a pooled allocation made for the same config, returns false on a miss
+    bool Get(const sptr<SurfaceBuffer>& buffer, const BufferRequestConfig& config, int32_t ownerPid);
+    void Clear();
+    Stats GetStats();
+    void Dump(std::string& result);
+
+    BufferRecyclePool(const BufferRecyclePool&) = delete;
+    BufferRecyclePool& operator=(const BufferRecyclePool&) = delete;
+
+private:
+    static constexpr std::chrono::milliseconds MAX_AGE { 3000 };
+
+    struct Entry {
+        BufferHandle* handle = nullptr;
+        BufferRequestConfig config;
+        int32_t ownerPid = 0;
+        uint32_t size = 0;
+        std::chrono::steady_clock::time_point putTime;
+    };
+
+    BufferRecyclePool();
+    ~BufferRecyclePool();
+    static bool IsSameShape(const BufferRequestConfig& lhs, const BufferRequestConfig& rhs);
+    // moves the entries past the age or byte limit to freed, the caller frees them outside mutex_
+    void EvictLocked(std::chrono::steady_clock::time_point now, uint64_t incomingBytes,
+        std::vector<BufferHandle*>& freed);
+    void SweepLoop();
+
+    std::mutex mutex_;
+    std::condition_variable sweepCon_;
+    // oldest first
+    std::deque<Entry> entries_;
+    std::thread sweepThread_;
+    uint64_t maxBytes_ = 0;
+    bool isStopped_ = false;
+    Stats stats_;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_BUFFER_RECYCLE_POOL_H
@@ -37,9 +37,23 @@ GSError WriteFileDescriptor(MessageParcel &parcel, int32_t fd);
 
 bool GetBoolParameter(const std::string &name, const std::string &defaultValue);
 
+// the packed config encoding a reader of this version understands, announced in GetProducerInitInfo
+constexpr uint32_t PACKED_CONFIG_VERSION = 1;
+
+// zigzag varints of the packed encodings. out needs room for VARINT_MAX_BYTES, GetVarint fails past end
+constexpr size_t VARINT_MAX_BYTES = 10;
+uint8_t *PutVarint(uint8_t *out, int64_t signedValue);
+bool GetVarint(const uint8_t *&in, const uint8_t *end, int64_t &signedValue);
+
+// the readers take both encodings, isPacked may only be set when the peer announced PACKED_CONFIG_VERSION
 bool ReadRequestConfig(MessageParcel &parcel, BufferRequestConfig &config);
-static inline GSError WriteRequestConfig(MessageParcel &parcel, BufferRequestConfig const &config)
+GSError WritePackedRequestConfig(MessageParcel &parcel, const BufferRequestConfig &config);
+static inline GSError WriteRequestConfig(MessageParcel &parcel, BufferRequestConfig const &config,
+    bool isPacked = false)
 {
+    if (isPacked) {
+        return WritePackedRequestConfig(parcel, config);
+    }
     if (!parcel.WriteInt32(config.width) || !parcel.WriteInt32(config.height) ||
         !parcel.WriteInt32(config.strideAlignment) || !parcel.WriteInt32(config.format) ||
         !parcel.WriteUint64(config.usage) || !parcel.WriteInt32(config.timeout) ||
@@ -51,7 +65,7 @@ static inline GSError WriteRequestConfig(MessageParcel &parcel, BufferRequestCon
 }
 
 GSError ReadFlushConfig(MessageParcel &parcel, BufferFlushConfigWithDamages &config);
-GSError WriteFlushConfig(MessageParcel &parcel, const BufferFlushConfigWithDamages &config);
+GSError WriteFlushConfig(MessageParcel &parcel, const BufferFlushConfigWithDamages &config, bool isPacked = false);
 
 GSError ReadSurfaceBufferImpl(MessageParcel &parcel, uint32_t &sequence, sptr<SurfaceBuffer> &buffer,
     std::function<int(MessageParcel &parcel, std::function<int(Parcel &)>readFdDefaultFunc)> readSafeFdFunc = nullptr);
@@ -719,6 +719,17 @@ public:
      *         {@link SURFACE_ERROR_UNKOWN} 50002000 - Inner error.
      */
     GSError GetMaxQueueSize(uint32_t &queueSize) const override;
+    /**
+     * @brief Let the queue size itself between minQueueSize and the Max Queue Size from how the producer and the
+     * consumer use it. SetQueueSize still works and the tuning goes on from there.
+     *
+     * @param enabled [in] turns the auto queue size on or off, turning it off keeps the current size.
+     * @param minQueueSize [in] the smallest size the queue shrinks to.
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link GSERROR_INVALID_ARGUMENTS} 40001000 - Invalid minQueueSize.
+     *         {@link SURFACE_ERROR_UNKOWN} 50002000 - Inner error.
+     */
+    GSError SetAutoQueueSize(bool enabled, uint32_t minQueueSize) override;
     /**
      * @brief Set the playback source for Lpp video
      *
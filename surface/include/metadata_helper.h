@@ -25,7 +25,6 @@
 #include "v1_0/hdr_static_metadata.h"
 #include "v1_0/buffer_handle_meta_key_type.h"
 #ifdef RS_ENABLE_TV_PQ_METADATA
-#include <functional>
 #include "tv_pq_metadata.h"
 #endif
 
@@ -93,11 +92,61 @@ public:
     static GSError GetCropRectMetadata(const sptr<SurfaceBuffer>& buffer,
         HDI::Display::Graphic::Common::V1_0::BufferHandleMetaRegion& crop);
 
+    // what a compositor reads for every layer each frame, a flag tells whether the buffer carries the key
+    struct LayerMetadata {
+        bool hasColorSpaceInfo = false;
+        HDI::Display::Graphic::Common::V1_0::CM_ColorSpaceInfo colorSpaceInfo = {};
+        bool hasHdrMetadataType = false;
+        HDI::Display::Graphic::Common::V1_0::CM_HDR_Metadata_Type hdrMetadataType = {};
+        bool hasCropRect = false;
+        HDI::Display::Graphic::Common::V1_0::BufferHandleMetaRegion cropRect = {};
+        // empty if not set
+        std::vector<uint8_t> hdrStaticMetadata;
+        std::vector<uint8_t> hdrDynamicMetadata;
+    };
+    // reads all of LayerMetadata with one GetMetadataBatch
+    static GSError GetLayerMetadata(const sptr<SurfaceBuffer>& buffer, LayerMetadata& metadata);
+
     static GSError SetROIMetadata(sptr<SurfaceBuffer>& buffer, const std::vector<uint8_t>& roiMetadata);
     static GSError GetROIMetadata(const sptr<SurfaceBuffer>& buffer, std::vector<uint8_t>& roiMetadata);
 
 #ifdef RS_ENABLE_TV_PQ_METADATA
-    using OnSetFieldsFunc = std::function<void(TvPQMetadata &tvPQMetadata)>;
+    // collects TvPQMetadata field updates, Commit writes them all with one GetMetadata and one SetMetadata
+    class TvPQMetadataTransaction {
+    public:
+        explicit TvPQMetadataTransaction(const sptr<SurfaceBuffer>& buffer) : buffer_(buffer) {}
+
+        TvPQMetadataTransaction& SetSceneTag(unsigned char value);
+        TvPQMetadataTransaction& SetUIFrameCount(unsigned char value);
+        TvPQMetadataTransaction& SetVideoFrameCount(unsigned char value);
+        TvPQMetadataTransaction& SetVideoFrameRate(unsigned char value);
+        TvPQMetadataTransaction& SetVideoDecoderHigh(unsigned short vidVdhWidth, unsigned short vidVdhHeight);
+        TvPQMetadataTransaction& SetVideoTVScaleMode(unsigned char value);
+        TvPQMetadataTransaction& SetVideoTVDpPixelFormat(unsigned int value);
+        TvPQMetadataTransaction& SetVideoColorimetryHdr(unsigned char hdr, unsigned char colorimetry);
+        TvPQMetadataTransaction& SetVideoTVInfo(const TvVideoWindow& tvVideoWindow);
+        // applies the updates on top of what the buffer carries, the write is skipped if nothing changes
+        GSError Commit();
+
+    private:
+        enum Field : uint32_t {
+            FIELD_SCENE_TAG = 1 << 0,
+            FIELD_UI_FRAME_COUNT = 1 << 1,
+            FIELD_VIDEO_FRAME_COUNT = 1 << 2,
+            FIELD_VIDEO_FRAME_RATE = 1 << 3,
+            FIELD_VIDEO_DECODER_HIGH = 1 << 4,
+            FIELD_SCALE_MODE = 1 << 5,
+            FIELD_DP_PIXEL_FORMAT = 1 << 6,
+            FIELD_COLORIMETRY_HDR = 1 << 7,
+            FIELD_VIDEO_WINDOW = 1 << 8,
+        };
+        void ApplyTo(TvPQMetadata& tvMetadata) const;
+
+        sptr<SurfaceBuffer> buffer_;
+        TvPQMetadata fields_ = {};
+        uint32_t dirtyFields_ = 0;
+    };
+
     static GSError SetVideoTVMetadata(sptr<SurfaceBuffer>& buffer, const TvPQMetadata& tvMetadata);
     static GSError GetVideoTVMetadata(const sptr<SurfaceBuffer>& buffer, TvPQMetadata& tvMetadata);
 
@@ -121,9 +170,6 @@ public:
     static GSError GetSDRDynamicMetadata(const sptr<SurfaceBuffer>& buffer,
         std::vector<uint8_t>& sdrDynamicMetadata);
 private:
-#ifdef RS_ENABLE_TV_PQ_METADATA
-    static GSError UpdateTVMetadataField(sptr<SurfaceBuffer>& buffer, OnSetFieldsFunc func);
-#endif
     static constexpr uint32_t PRIMARIES_MASK =
         static_cast<uint32_t>(HDI::Display::Graphic::Common::V1_0::CM_PRIMARIES_MASK);
     static constexpr uint32_t TRANSFUNC_MASK =
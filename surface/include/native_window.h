@@ -21,10 +21,11 @@
 #include <refbase.h>
 #include <surface.h>
 #include <surface_buffer.h>
-#include <unordered_map>
 #include <atomic>
 #include <mutex>
 
+#include "producer_buffer_cache.h"
+
 struct SURFACE_HIDDEN NativeWindowMagic : public OHOS::RefBase {
     NativeWindowMagic(NativeObjectMagic m) : magic(m) {}
     virtual ~NativeWindowMagic() {}
@@ -36,11 +37,12 @@ struct NativeWindow : public NativeWindowMagic {
     ~NativeWindow();
     OHOS::sptr<OHOS::Surface> surface;
     int64_t uiTimestamp = 0;
-    std::unordered_map<uint32_t, NativeWindowBuffer*> bufferCache_;
+    // the producer surface's cache once the window is set on it, a cache of the window's own before that.
+    // only assigned before the window is published, the wrappers it hands out are tagged with this window
+    OHOS::sptr<OHOS::ProducerBufferCache> bufferCache_;
     std::atomic<int64_t> desiredPresentTimestamp{0};
     char* appFrameworkType_ = nullptr;
     std::once_flag appFrameworkTypeOnceFlag_;
-    std::mutex mutex_;
 };
 
 struct NativeWindowBuffer : public NativeWindowMagic {
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_PRODUCER_BUFFER_CACHE_H
+#define FRAMEWORKS_SURFACE_INCLUDE_PRODUCER_BUFFER_CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <refbase.h>
+
+#include "buffer_queue_slot_table.h"
+#include "surface_buffer.h"
+#include "surface_type.h"
+
+struct NativeWindowBuffer;
+
+namespace OHOS {
+/**
+ * Buffers a producer has received, shared by a ProducerSurface and the NativeWindow created on top of it.
+ * An entry holds the SurfaceBuffer together with the NativeWindowBuffers handed out for it, so a lookup, an insert or
+ * a delete covers both under one lock. Several windows may be created on one surface, each one gets wrappers of its
+ * own and only releases those.
+ * The producer may forget a buffer while the application still holds its NativeWindowBuffer, such an entry keeps
+ * only the wrapper until the buffer comes back or the queue deletes it.
+ */
+class ProducerBufferCache : public RefBase {
+public:
+    ProducerBufferCache() = default;
+    ~ProducerBufferCache() override;
+    ProducerBufferCache(const ProducerBufferCache &) = delete;
+    ProducerBufferCache &operator=(const ProducerBufferCache &) = delete;
+
+    // nullptr when the producer has not cached the buffer
+    sptr<SurfaceBuffer> Find(uint32_t sequence) const;
+    bool Contains(uint32_t sequence) const;
+    void Insert(uint32_t sequence, const sptr<SurfaceBuffer> &buffer);
+    // the producer forgets the buffer, its NativeWindowBuffers stay valid
+    void EraseBuffer(uint32_t sequence);
+    void ClearBuffers();
+    // the queue deleted the buffer, its NativeWindowBuffers are released as well
+    void Erase(uint32_t sequence);
+    void Clear();
+    // buffers the producer has cached, wrapper-only entries are not counted
+    size_t Size() const;
+
+    // the NativeWindowBuffer window hands out for buffer, created on first use and owned by the cache
+    NativeWindowBuffer *GetNativeWindowBuffer(const void *window, const sptr<SurfaceBuffer> &buffer,
+        int64_t uiTimestamp);
+    // window goes away, releases the NativeWindowBuffers it handed out and keeps the buffers
+    void ClearNativeWindowBuffers(const void *window);
+
+private:
+    struct WindowBuffer {
+        const void *window = nullptr;
+        NativeWindowBuffer *nativeWindowBuffer = nullptr;
+    };
+    struct Entry {
+        sptr<SurfaceBuffer> buffer = nullptr;
+        // usually one, a second window on the same surface adds its own
+        std::vector<WindowBuffer> windowBuffers;
+    };
+    static void ReleaseWindowBuffers(Entry &entry);
+    using EntryTable = SequenceSlotTable<Entry, SURFACE_MAX_QUEUE_SIZE>;
+
+    mutable std::mutex mutex_;
+    EntryTable entries_;
+    size_t bufferCount_ = 0;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_PRODUCER_BUFFER_CACHE_H
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_PRODUCER_COMMAND_STATS_H
+#define FRAMEWORKS_SURFACE_INCLUDE_PRODUCER_COMMAND_STATS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace OHOS {
+/**
+ * Call counts and latency histograms of the commands a BufferQueueProducer stub serves, indexed by command code.
+ * Every command has its own cache line of relaxed atomics, so binder threads record without locks and only share a
+ * line when they run the same command. Only created while persist.graphic.surface.producer_command_stats is set.
+ */
+class ProducerCommandStats {
+public:
+    // calls by log2 of the latency in microseconds, the last bucket takes everything longer
+    static constexpr size_t HISTOGRAM_BUCKETS = 16;
+
+    struct Snapshot {
+        uint64_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+        std::array<uint64_t, HISTOGRAM_BUCKETS> histogram = {};
+    };
+
+    explicit ProducerCommandStats(size_t commandCount);
+    ~ProducerCommandStats() = default;
+    ProducerCommandStats(const ProducerCommandStats &) = delete;
+    ProducerCommandStats &operator=(const ProducerCommandStats &) = delete;
+
+    void Record(uint32_t code, int64_t latencyNs);
+    Snapshot GetSnapshot(uint32_t code) const;
+    // latency in microseconds below which the given permille of calls finished, rounded up to a bucket edge
+    static int64_t GetPercentileUs(const Snapshot &snapshot, uint32_t permille);
+    // one line per command called so far, busiest first
+    void Dump(std::string &result, const std::function<const char *(uint32_t code)> &getName) const;
+
+private:
+    struct alignas(64) Command {
+        std::atomic<uint64_t> count = 0;
+        std::atomic<uint64_t> totalNs = 0;
+        std::atomic<uint64_t> maxNs = 0;
+        std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> histogram = {};
+    };
+
+    size_t commandCount_;
+    std::unique_ptr<Command[]> commands_;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_PRODUCER_COMMAND_STATS_H
@@ -30,6 +30,7 @@
 #include <vector>
 #include "buffer_queue.h"
 #include "buffer_queue_consumer.h"
+#include "producer_buffer_cache.h"
 #include "producer_surface_delegator.h"
 #include "surface_buffer.h"
 
@@ -75,7 +76,8 @@ public:
     GSError RequestBuffer(sptr<SurfaceBuffer>& buffer,
                           int32_t &fence, BufferRequestConfig &config) override;
     /**
-     * @brief Request buffers for data production.
+     * @brief Request as many buffers as the queue can hand out for data production.
+     * The requested buffers are appended to buffer.
      *
      * @param buffer [out] The buffers for data production.
      * @param fence [out] fence fds for asynchronous waiting mechanism.
@@ -90,6 +92,24 @@ public:
      */
     GSError RequestBuffers(std::vector<sptr<SurfaceBuffer>> &buffers,
         std::vector<sptr<SyncFence>> &fences, BufferRequestConfig &config) override;
+    /**
+     * @brief Request at most count buffers for data production.
+     * The requested buffers are appended to buffer, fewer than count if the queue has fewer to hand out.
+     *
+     * @param buffer [out] The buffers for data production.
+     * @param fence [out] fence fds for asynchronous waiting mechanism.
+     * @param config [in] The parameter type for requesting a buffer.
+     * @param count [in] The most buffers to request, 1 to SURFACE_MAX_QUEUE_SIZE.
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link GSERROR_INVALID_ARGUMENTS} 40001000 - Param invalid.
+     *         {@link GSERROR_NO_CONSUMER} 41202000 - no consumer.
+     *         {@link GSERROR_NO_BUFFER} 40601000 - no buffer.
+     *         {@link} GSERROR_CONSUMER_IS_CONNECTED 41206000 - consumer is connected already.
+     *
+     * @see FlushBuffers
+     */
+    GSError RequestBuffers(std::vector<sptr<SurfaceBuffer>> &buffers,
+        std::vector<sptr<SyncFence>> &fences, BufferRequestConfig &config, uint32_t count) override;
     /**
      * @brief Cancel the requested buffer.
      * Change buffer state from requested to released.
@@ -763,6 +783,22 @@ public:
      */
     GSError AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, const sptr<SyncFence>& fence,
                                  BufferFlushConfig& config, bool needMap) override;
+    /**
+     * @brief Flush the buffer and request the buffer of the next frame in one call.
+     *
+     * @param buffer [in] The buffer to flush.
+     * @param fence [in] Fence fd of the buffer to flush.
+     * @param flushConfig [in] The parameter type for flushing the buffer.
+     * @param nextBuffer [out] The requested buffer, only set when the call succeeds.
+     * @param nextFence [out] Release fence of the requested buffer.
+     * @param requestConfig [in] The parameter type for requesting the buffer.
+     * @return {@link GSERROR_OK} 0 - Success, both the flush and the request.
+     *         Otherwise the error of the flush, or of the request when the flush succeeded and nextBuffer is
+     *         nullptr.
+     */
+    GSError FlushAndRequestBuffer(sptr<SurfaceBuffer>& buffer, const sptr<SyncFence>& fence,
+        BufferFlushConfigWithDamages& flushConfig, sptr<SurfaceBuffer>& nextBuffer, sptr<SyncFence>& nextFence,
+        BufferRequestConfig& requestConfig) override;
     /**
      * @brief Get the Cycle Buffers Number from the surface.
      *
@@ -911,6 +947,21 @@ public:
      *         {@link SURFACE_ERROR_UNKNOWN} 50002000 - Inner error.
      */
     GSError GetVideoDimensionType(VideoDimType &videoDimType) override;
+    /**
+     * @brief Move the per-frame calls to the consumer onto a shared-memory channel.
+     *
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link SURFACE_ERROR_NOT_SUPPORT} 50102000 - The producer is not remote.
+     */
+    GSError EnableControlChannel() override;
+    /**
+     * @brief Send FlushBuffer to the consumer without waiting for its result.
+     *
+     * @param isAsync [in] Indicates whether FlushBuffer is asynchronous.
+     * @return {@link GSERROR_OK} 0 - Success.
+     *         {@link SURFACE_ERROR_NOT_SUPPORT} 50102000 - The producer is not remote.
+     */
+    GSError SetFlushBufferAsyncMode(bool isAsync) override;
 
 private:
     ProducerSurface(sptr<IBufferProducer>& producer);
@@ -923,6 +974,7 @@ private:
         IBufferProducer::RequestBufferReturnValue &retval, BufferRequestConfig &config);
     GSError AddCacheLocked(sptr<SurfaceBuffer>& attachedBuffer);
     GSError SetMetadataValue(sptr<SurfaceBuffer>& buffer);
+    void UpdateUserMetadataLocked(const std::string& key, const std::string& val);
     GSError CleanCacheLocked(bool cleanAll);
     void SetBufferConfigLocked(sptr<BufferExtraData>& bedataimpl,
         IBufferProducer::RequestBufferReturnValue& retval, BufferRequestConfig& config);
@@ -934,14 +986,24 @@ private:
 
     GSError RequestBufferLocked(sptr<SurfaceBuffer>& buffer,
         sptr<SyncFence>& fence, BufferRequestConfig& config);
+    GSError HandleRequestBufferResultLocked(GSError ret, sptr<BufferExtraData>& bedataimpl,
+        IBufferProducer::RequestBufferReturnValue& retval, sptr<SurfaceBuffer>& buffer, sptr<SyncFence>& fence,
+        BufferRequestConfig& config);
     GSError ProducerSurfaceCancelBufferLocked(sptr<SurfaceBuffer>& buffer);
     GSError OnBufferReleasedWithSequenceAndFence(uint32_t sequence, const sptr<SyncFence> &fence);
-    GSError SyncProducerCacheLocked();
+    // brings bufferProducerCache_ up to the queue's cache, sequence is the buffer that was missing
+    GSError SyncProducerCacheLocked(uint32_t sequence);
     GSError CleanCache(bool cleanAll, uint32_t& bufferSeq) override;
 
     mutable std::mutex mutex_;
     std::atomic_bool inited_ = false;
-    std::map<int32_t, sptr<SurfaceBuffer>> bufferProducerCache_;
+    // shared with the NativeWindow set on this surface
+    sptr<ProducerBufferCache> bufferProducerCache_ = new ProducerBufferCache();
+    // the queue's cache generation bufferProducerCache_ was last synced to, 0 asks for the whole cache
+    uint64_t producerCacheGeneration_ = 0;
+    // kept between RequestBuffers calls so a batch only allocates extra data for the buffers it hands out
+    std::vector<IBufferProducer::RequestBufferReturnValue> batchRetvalues_;
+    std::vector<sptr<BufferExtraData>> batchExtraData_;
     std::map<std::string, std::string> userData_;
     sptr<IBufferProducer> producer_ = nullptr;
     std::string name_ = "not init";
@@ -957,6 +1019,10 @@ private:
     std::mutex delegatorMutex_;
     std::map<std::string, OnUserDataChangeFunc> onUserDataChange_;
     std::mutex lockMutex_;
+    // user data pushed to requested buffers as metadata, converted once when set, guarded by lockMutex_
+    std::map<uint32_t, std::vector<uint8_t>> userMetadata_;
+    // 0 until a metadata key is set, a new process-wide unique value on every change
+    uint64_t userMetadataGeneration_ = 0;
     std::string bufferName_ = "";
     int32_t requestWidth_ = 0;
     int32_t requestHeight_ = 0;
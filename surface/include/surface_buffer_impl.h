@@ -16,11 +16,13 @@
 #ifndef FRAMEWORKS_SURFACE_INCLUDE_SURFACE_BUFFER_IMPL_H
 #define FRAMEWORKS_SURFACE_INCLUDE_SURFACE_BUFFER_IMPL_H
 
+#include <set>
 #include <buffer_extra_data.h>
 #include <buffer_handle_parcel.h>
 #include <buffer_handle_utils.h>
 #include <surface_buffer.h>
 #include "egl_data.h"
+#include "fence_set.h"
 #include "native_buffer.h"
 #include "stdint.h"
 #include "sync_fence.h"
@@ -28,6 +30,10 @@
 struct BufferWrapper {};
 
 namespace OHOS {
+namespace HDI::Display::Buffer::V1_4 {
+class IDisplayBuffer;
+}
+
 class SurfaceBufferImpl : public SurfaceBuffer {
 public:
     SurfaceBufferImpl();
@@ -81,6 +87,12 @@ public:
     GSError GetMetadata(uint32_t key, std::vector<uint8_t>& value) override;
     GSError ListMetadataKeys(std::vector<uint32_t>& keys) override;
     GSError EraseMetadataKey(uint32_t key) override;
+    GSError SetMetadataBatch(const std::vector<std::pair<uint32_t, std::vector<uint8_t>>>& metadata,
+        bool enableCache = true) override;
+    GSError GetMetadataBatch(const std::vector<uint32_t>& keys, std::vector<std::vector<uint8_t>>& values) override;
+    void InvalidateMetadataCache() override;
+    uint64_t GetAppliedMetadataGeneration() const override;
+    void SetAppliedMetadataGeneration(uint64_t generation) override;
 
     void SetCropMetadata(const Rect& crop) override;
     bool GetCropMetadata(Rect& crop) override;
@@ -106,6 +118,7 @@ public:
     bool IsReclaimed() override;
     void SetAndMergeSyncFence(const sptr<SyncFence>& syncFence) override;
     sptr<SyncFence> GetSyncFence() const override;
+    sptr<FenceSet> GetSyncFences() const override;
     GSError Alloc(const BufferRequestConfig& config, const sptr<SurfaceBuffer>& previousBuffer = nullptr) override;
     uint64_t GetBufferId() const override;
     uint64_t GetFlushedTimestamp() const override;
@@ -124,32 +137,70 @@ public:
     void SetSurfaceBufferVideoDimensionType(const VideoDimType &videoDimType) override;
     VideoDimType GetSurfaceBufferVideoDimensionType() const override;
 
+    // hands the allocation over to the caller, the buffer is left without a handle
+    BufferHandle* TakeBufferHandle();
+    // takes over an allocation made for config by another buffer instead of allocating a new one
+    void AdoptBufferHandle(const BufferRequestConfig& config, BufferHandle* handle);
+    static void FreeTakenBufferHandle(BufferHandle* handle);
+
 private:
     void FreeBufferHandleLocked();
     bool MetaDataCachedLocked(const uint32_t key, const std::vector<uint8_t>& value);
+    GSError SetMetadataLocked(HDI::Display::Buffer::V1_4::IDisplayBuffer& displayBuffer, uint32_t key,
+        const std::vector<uint8_t>& value, bool enableCache);
+    GSError GetMetadataLocked(HDI::Display::Buffer::V1_4::IDisplayBuffer& displayBuffer, uint32_t key,
+        std::vector<uint8_t>& value);
+    void ClearMetadataCacheLocked();
     GSError GetImageLayout(void *layout);
     static void InitMemMgrMembers();
     static uint32_t GenerateSequenceNumber(uint32_t& seqNum);
     void NotifyBufferDestructorCallback() const;
     void RecordOriginalBufferHandleFields();
+    void PublishHandleFieldsLocked();
+    void MergeSyncFencesLocked() const;
 
     BufferHandle *handle_ = nullptr;
     uint32_t sequenceNumber_ = UINT32_MAX;
     uint64_t bufferId_ = UINT64_MAX;
     sptr<BufferExtraData> bedata_ = nullptr;
     sptr<EglData> eglData_ = nullptr;
-    GraphicColorGamut surfaceBufferColorGamut_ = GraphicColorGamut::GRAPHIC_COLOR_GAMUT_SRGB;
-    GraphicTransformType transform_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
+    std::atomic<GraphicColorGamut> surfaceBufferColorGamut_ = GraphicColorGamut::GRAPHIC_COLOR_GAMUT_SRGB;
+    std::atomic<GraphicTransformType> transform_ = GraphicTransformType::GRAPHIC_ROTATE_NONE;
     ScalingMode scalingMode_ = ScalingMode::SCALING_MODE_SCALE_TO_WINDOW;
     SingleBufferMode singleBufferMode_ = SingleBufferMode::SINGLE_BUFFER_MODE_NONE;
     VideoDimType videoDimType_ = VideoDimType::VIDEO_DIM_TYPE_2D;
     int32_t surfaceBufferWidth_ = 0;
     int32_t surfaceBufferHeight_ = 0;
     mutable std::mutex mutex_;
+    // copies of the allocation-time fields of handle_ for the getters, so they never take mutex_.
+    // only written with mutex_ held, by PublishHandleFieldsLocked whenever handle_ is replaced
+    struct PublishedFields {
+        std::atomic<BufferHandle*> handle = nullptr;
+        std::atomic<int32_t> width = -1;
+        std::atomic<int32_t> height = -1;
+        std::atomic<int32_t> stride = -1;
+        std::atomic<int32_t> format = -1;
+        std::atomic<uint64_t> usage = UINT64_MAX;
+        std::atomic<uint64_t> phyAddr = 0;
+        std::atomic<int32_t> fd = -1;
+        std::atomic<uint32_t> size = 0;
+        std::atomic<uint32_t> seqNum = UINT32_MAX;
+    };
+    PublishedFields published_;
     OH_NativeBuffer_Planes planesInfo_ = {0, {}};
     BufferRequestConfig bufferRequestConfig_ = {0, 0, 0, 0, 0, 0};
     bool isConsumerAttachBufferFlag_ = false;
+    // values set with enableCache, only used to skip setting the same value again
     std::map<uint32_t, std::vector<uint8_t>> metaDataCache_;
+    // values known to be in the allocation, dropped by InvalidateMetadataCache when the buffer comes back
+    // from another process, which may have changed them
+    std::map<uint32_t, std::vector<uint8_t>> metaDataReadCache_;
+    // keys the allocation does not have, dropped together with metaDataReadCache_ and when the key is set
+    std::set<uint32_t> metaDataAbsentKeys_;
+    std::vector<uint32_t> metaDataKeys_;
+    bool isMetaDataKeysCached_ = false;
+    // producer metadata generation pushed to the allocation, reset with metaDataCache_
+    std::atomic<uint64_t> appliedMetadataGeneration_ = 0;
     Rect crop_ = {0, 0, 0, 0};
     std::atomic<uint32_t> bufferDeletedFlag_ = 0;
     std::atomic<bool> isReclaimed_ = false;
@@ -160,7 +211,9 @@ private:
     static inline MemMgrFunctionPtr resumeFunc_ = nullptr;
     static inline int32_t ownPid_ = -1;
     static inline std::atomic<bool> initMemMgrSucceed_ = false;
-    sptr<SyncFence> syncFence_ = nullptr;
+    // syncFence_ is the merged view, fences added since it was built wait unmerged in syncFences_
+    mutable sptr<SyncFence> syncFence_ = nullptr;
+    mutable sptr<FenceSet> syncFences_ = nullptr;
     std::atomic<uint64_t> lastFlushedTime_ = 0;
 
     mutable std::mutex bufferDtorCbMutex_;
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_SURFACE_CONTROL_CHANNEL_H
+#define FRAMEWORKS_SURFACE_INCLUDE_SURFACE_CONTROL_CHANNEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+
+#include <refbase.h>
+
+#include "surface_type.h"
+
+namespace OHOS {
+class MessageParcel;
+
+enum class SurfaceControlRecordType : uint32_t {
+    // producer to queue, asks for a buffer the producer already caches, never allocates or blocks
+    REQUEST = 1,
+    // queue to producer, answers the REQUEST with the same id
+    REQUEST_REPLY,
+    // producer to queue
+    FLUSH,
+    // queue to producer, a buffer went back to the free list or was requested on the producer's behalf
+    RELEASE,
+};
+
+struct SurfaceControlRecord {
+    static constexpr uint32_t MAX_DAMAGES = 4;
+
+    SurfaceControlRecordType type = SurfaceControlRecordType::REQUEST;
+    uint32_t id = 0;
+    int32_t status = 0;
+    uint32_t sequence = 0;
+    // a RELEASE without sequence is a plain OnBufferReleased
+    bool hasSequence = false;
+    // the fence fd goes over the socket, in the same order as the records
+    bool hasFence = false;
+    BufferRequestConfig config = {};
+    int64_t timestamp = 0;
+    int64_t desiredPresentTimestamp = 0;
+    uint32_t damageCount = 0;
+    Rect damages[MAX_DAMAGES] = {};
+};
+static_assert(std::is_trivially_copyable_v<SurfaceControlRecord>, "records are copied through shared memory");
+
+/**
+ * Shared-memory transport between a producer and its BufferQueue for the per-frame calls.
+ * A memfd holds two single-producer single-consumer rings of SurfaceControlRecord, one per direction. Each ring has
+ * an eventfd doorbell that is only rung while the reader sleeps. Fence fds go over a SOCK_SEQPACKET socketpair with
+ * SCM_RIGHTS, sent before their record is published so the reader always finds them. Closing either end shows up
+ * as a hangup on the socket, so a reader never waits for a dead peer.
+ * Setup goes over binder: the producer creates both ends and sends the queue end with WriteToMessageParcel.
+ * Everything the queue reads from shared memory is checked, a broken index closes the channel.
+ * Send is safe from several threads, Receive and Wait must come from one thread at a time.
+ */
+class SurfaceControlChannel : public RefBase {
+public:
+    enum class Role : uint32_t {
+        PRODUCER = 0,
+        QUEUE = 1,
+    };
+
+    static constexpr uint32_t DEFAULT_CAPACITY = 64;
+    static constexpr uint32_t MAX_CAPACITY = 1024;
+
+    static GSError CreatePair(sptr<SurfaceControlChannel>& producerEnd, sptr<SurfaceControlChannel>& queueEnd,
+        uint32_t capacity = DEFAULT_CAPACITY);
+    static sptr<SurfaceControlChannel> ReadFromMessageParcel(MessageParcel& parcel);
+    GSError WriteToMessageParcel(MessageParcel& parcel) const;
+    ~SurfaceControlChannel() override;
+
+    // fenceFd < 0 sends no fence, the caller keeps its fd. GSERROR_NO_BUFFER when the ring is full
+    GSError Send(const SurfaceControlRecord& record, int32_t fenceFd = -1);
+    // GSERROR_NO_ENTRY when nothing is pending. fenceFd is -1 or a new fd owned by the caller
+    GSError Receive(SurfaceControlRecord& record, int32_t& fenceFd);
+    // returns once a record may be pending, after timeoutMs (-1 waits forever), on Shutdown or when the peer is gone
+    void Wait(int32_t timeoutMs);
+    // wakes a Wait on this end and makes it return right away from now on
+    void Shutdown();
+    bool IsClosed() const;
+    Role GetRole() const
+    {
+        return role_;
+    }
+
+    SurfaceControlChannel(const SurfaceControlChannel&) = delete;
+    SurfaceControlChannel& operator=(const SurfaceControlChannel&) = delete;
+
+private:
+    struct alignas(64) RingIndex {
+        // written by the reader
+        std::atomic<uint32_t> head = 0;
+        // set by the reader before it sleeps, cleared by the writer that rings the doorbell
+        std::atomic<uint32_t> isSleeping = 0;
+    };
+    struct alignas(64) RingTail {
+        // written by the writer
+        std::atomic<uint32_t> tail = 0;
+    };
+    struct SharedHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t capacity;
+        uint32_t recordSize;
+        RingIndex heads[2];
+        RingTail tails[2];
+    };
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring indexes are shared between processes");
+
+    static constexpr uint32_t MAGIC = 0x53435243; // "SCRC"
+    static constexpr uint32_t VERSION = 1;
+
+    SurfaceControlChannel(Role role, uint32_t capacity, int32_t memFd, void* shared, size_t sharedSize,
+        const int32_t doorbells[2], int32_t socketFd);
+    static size_t SharedSize(uint32_t capacity);
+    static sptr<SurfaceControlChannel> Attach(Role role, int32_t memFd, const int32_t doorbells[2],
+        int32_t socketFd);
+    uint32_t SendRing() const
+    {
+        return static_cast<uint32_t>(role_);
+    }
+    uint32_t ReceiveRing() const
+    {
+        return 1 - static_cast<uint32_t>(role_);
+    }
+    SurfaceControlRecord* Records(uint32_t ring) const;
+    GSError SendFence(int32_t fenceFd);
+    int32_t ReceiveFence();
+    void RingDoorbell(uint32_t ring);
+
+    Role role_;
+    uint32_t capacity_;
+    int32_t memFd_;
+    SharedHeader* header_;
+    size_t sharedSize_;
+    int32_t doorbells_[2];
+    int32_t socketFd_;
+    std::mutex sendMutex_;
+    std::atomic<bool> isShutdown_ = false;
+    std::atomic<bool> isBroken_ = false;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_SURFACE_CONTROL_CHANNEL_H
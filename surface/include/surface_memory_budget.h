@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAMEWORKS_SURFACE_INCLUDE_SURFACE_MEMORY_BUDGET_H
+#define FRAMEWORKS_SURFACE_INCLUDE_SURFACE_MEMORY_BUDGET_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <refbase.h>
+
+namespace OHOS {
+class BufferQueue;
+
+/**
+ * Per-process budget for the buffer memory held by all BufferQueues.
+ * Allocations are added to an estimate. Once the estimate reaches the high watermark, a reclaim pass runs on
+ * BufferAllocWorker. The pass recounts every queue exactly and frees free buffers until usage is back under the
+ * low watermark, starting with the recycle pool. Free buffers go least recently acquired first. The last flushed
+ * buffer of a queue is only freed once the queue has been idle for IDLE_RECLAIM_MS, longest idle first.
+ * Buffers held by the producer or the consumer are never touched.
+ * A high watermark of 0 turns the budget off.
+ */
+class SurfaceMemoryBudget {
+public:
+    struct QueueUsage {
+        uint64_t uniqueId = 0;
+        std::string name;
+        uint64_t bytes = 0;
+        uint32_t bufferCount = 0;
+        // steady clock ns of the latest acquire, 0 if nothing was acquired yet
+        int64_t lastActiveTime = 0;
+    };
+
+    struct ReclaimCandidate {
+        // kept alive by the pass that collected it
+        BufferQueue *queue = nullptr;
+        uint32_t sequence = 0;
+        uint32_t size = 0;
+        int64_t lastAcquireTime = 0;
+        int64_t queueLastActiveTime = 0;
+        // the queue's last flushed buffer, kept until the queue goes idle
+        bool isLastFrame = false;
+    };
+
+    struct Stats {
+        uint64_t highWatermark = 0;
+        uint64_t lowWatermark = 0;
+        uint64_t estimatedBytes = 0;
+        // exact usage counted by the last pass, before reclaiming
+        uint64_t lastCountedBytes = 0;
+        uint32_t queueCount = 0;
+        uint64_t reclaimPasses = 0;
+        uint64_t reclaimedBuffers = 0;
+        uint64_t reclaimedBytes = 0;
+    };
+
+    static SurfaceMemoryBudget& GetInstance();
+
+    // called once the queue has its first strong ref, it is only held weakly
+    void RegisterQueue(BufferQueue *queue);
+    void UnregisterQueue(BufferQueue *queue);
+    // called with the queue mutex held, only touches atomics and may schedule a reclaim pass
+    void OnBufferAllocated(uint32_t size);
+    void SetWatermarks(uint64_t highWatermark, uint64_t lowWatermark);
+    // frees buffers until usage is at most targetBytes, returns the bytes freed. must not hold any queue mutex
+    uint64_t Reclaim(uint64_t targetBytes);
+    // must not hold any queue mutex
+    std::vector<QueueUsage> GetQueueUsage();
+    Stats GetStats();
+    void Dump(std::string &result);
+
+    SurfaceMemoryBudget(const SurfaceMemoryBudget&) = delete;
+    SurfaceMemoryBudget& operator=(const SurfaceMemoryBudget&) = delete;
+
+private:
+    static constexpr int64_t IDLE_RECLAIM_MS = 5000;
+    static constexpr int64_t MIN_PASS_INTERVAL_MS = 500;
+
+    SurfaceMemoryBudget();
+    ~SurfaceMemoryBudget() = default;
+    static void SortCandidates(std::vector<ReclaimCandidate> &candidates, int64_t now);
+    // the registry lock is dropped before calling into the queues, their mutex and delete callbacks may run
+    // a queue destructor, which unregisters
+    std::vector<sptr<BufferQueue>> PromoteQueues();
+
+    std::mutex registryMutex_;
+    std::vector<wptr<BufferQueue>> queues_;
+    // one reclaim pass at a time
+    std::mutex passMutex_;
+    std::mutex statsMutex_;
+    Stats stats_;
+    std::atomic<uint64_t> highWatermark_ = 0;
+    std::atomic<uint64_t> lowWatermark_ = 0;
+    std::atomic<uint64_t> estimatedBytes_ = 0;
+    std::atomic<int64_t> lastPassTime_ = 0;
+    std::atomic<bool> isPassPending_ = false;
+};
+} // namespace OHOS
+
+#endif // FRAMEWORKS_SURFACE_INCLUDE_SURFACE_MEMORY_BUDGET_H
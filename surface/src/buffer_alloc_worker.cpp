@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer_alloc_worker.h"
+
+#include <pthread.h>
+
+namespace OHOS {
+BufferAllocWorker& BufferAllocWorker::GetInstance()
+{
+    static BufferAllocWorker instance;
+    return instance;
+}
+
+BufferAllocWorker::~BufferAllocWorker()
+{
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        isStopped_ = true;
+    }
+    taskCon_.notify_all();
+    for (auto &thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+std::future<GSError> BufferAllocWorker::Post(std::function<GSError()> task)
+{
+    std::packaged_task<GSError()> packagedTask(std::move(task));
+    std::future<GSError> future = packagedTask.get_future();
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        tasks_.push_back(std::move(packagedTask));
+        if (idleThreads_ < tasks_.size() && threads_.size() < MAX_THREADS) {
+            threads_.emplace_back([this]() { WorkLoop(); });
+        }
+    }
+    taskCon_.notify_one();
+    return future;
+}
+
+void BufferAllocWorker::WorkLoop()
+{
+    pthread_setname_np(pthread_self(), "BufferAlloc");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        idleThreads_++;
+        taskCon_.wait(lock, [this]() { return isStopped_ || !tasks_.empty(); });
+        idleThreads_--;
+        // finish what is queued before stopping, every caller holds a future for its task
+        if (tasks_.empty()) {
+            return;
+        }
+        std::packaged_task<GSError()> task = std::move(tasks_.front());
+        tasks_.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+} // namespace OHOS
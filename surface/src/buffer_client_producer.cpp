@@ -15,9 +15,13 @@
 
 #include "buffer_client_producer.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cinttypes>
+#include <unistd.h>
 
 #include <iremote_stub.h>
+#include "buffer_extra_data_impl.h"
 #include "buffer_log.h"
 #include "buffer_utils.h"
 #include "hebc_white_list.h"
@@ -48,14 +52,21 @@
 namespace OHOS {
 namespace {
     constexpr size_t MATRIX4_SIZE = 16;
+    // a request over the control channel that takes longer goes over binder instead
+    constexpr int64_t CONTROL_REQUEST_TIMEOUT_MS = 100;
+    // set on control channel threads, their replies are read by the very thread that runs the release listener
+    thread_local bool g_isControlChannelThread = false;
+    std::atomic<uint32_t> g_nextAsyncFlushSession = 0;
 }
 BufferClientProducer::BufferClientProducer(const sptr<IRemoteObject>& impl)
-    : IRemoteProxy<IBufferProducer>(impl)
+    : IRemoteProxy<IBufferProducer>(impl),
+    asyncFlushSession_((static_cast<uint64_t>(getpid()) << 32) | (++g_nextAsyncFlushSession)) // 32: pid in high bits
 {
 }
 
 BufferClientProducer::~BufferClientProducer()
 {
+    StopControlChannel();
 }
 
 GSError BufferClientProducer::MessageVariables(MessageParcel &arg)
@@ -75,6 +86,10 @@ GSError BufferClientProducer::SendRequest(uint32_t command, MessageParcel &arg,
         BLOGE("Remote is nullptr, uniqueId: %{public}" PRIu64 ".", uniqueId_);
         return GSERROR_SERVER_ERROR;
     }
+    if (opt.GetFlags() == MessageOption::TF_SYNC && command != BUFFER_PRODUCER_WAIT_ASYNC_FLUSH &&
+        command != BUFFER_PRODUCER_REQUEST_BUFFER_AFTER_ASYNC_FLUSH) {
+        (void)WaitAsyncFlush();
+    }
     int32_t ret = remote->SendRequest(command, arg, reply, opt);
     if (ret != ERR_NONE) {
         BLOGE("SendRequest ret: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, uniqueId_);
@@ -102,14 +117,24 @@ GSError BufferClientProducer::RequestBufferCommon(const BufferRequestConfig &con
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
 
-    GSError ret = WriteRequestConfig(arguments, config);
+    GSError ret = WriteRequestConfig(arguments, config, isPeerPackedConfig_);
     if (ret != GSERROR_OK) {
         return ret;
     }
+    // older queues stop reading before it and answer with the legacy encoding
+    if (!arguments.WriteUint32(PACKED_EXTRA_DATA_VERSION)) {
+        return GSERROR_BINDER;
+    }
 
     retval.isConnected = false;
     SEND_REQUEST(command, arguments, reply, option);
-    ret = CheckRetval(reply);
+    return ReadRequestBufferReply(reply, config, bedata, retval);
+}
+
+GSError BufferClientProducer::ReadRequestBufferReply(MessageParcel &reply, const BufferRequestConfig &config,
+    sptr<BufferExtraData> &bedata, RequestBufferReturnValue &retval)
+{
+    GSError ret = CheckRetval(reply);
     if (ret != GSERROR_OK) {
         if (!reply.ReadBool(retval.isConnected)) {
             BLOGE("RequestBufferCommon read isConnected failed");
@@ -134,6 +159,7 @@ GSError BufferClientProducer::RequestBufferCommon(const BufferRequestConfig &con
     if (ret != GSERROR_OK) {
         return SURFACE_ERROR_UNKOWN;
     }
+    RecordQueueExtraData(retval.sequence, bedata);
     retval.fence = SyncFence::ReadFromMessageParcel(reply);
     if (!reply.ReadUInt32Vector(&retval.deletingBuffers)) {
         return GSERROR_BINDER;
@@ -145,9 +171,43 @@ GSError BufferClientProducer::RequestBufferCommon(const BufferRequestConfig &con
 GSError BufferClientProducer::RequestBuffer(const BufferRequestConfig &config, sptr<BufferExtraData> &bedata,
                                             RequestBufferReturnValue &retval)
 {
+    GSError flushRet = deferredFlushError_.exchange(GSERROR_OK);
+    if (flushRet != GSERROR_OK) {
+        retval.isConnected = false;
+        return flushRet;
+    }
+    uint64_t serial = asyncFlushSerial_.load();
+    if (serial != syncedAsyncFlushSerial_.load()) {
+        return RequestBufferAfterAsyncFlush(config, bedata, retval, serial);
+    }
+    if (RequestBufferFromChannel(config, retval) == GSERROR_OK) {
+        return GSERROR_OK;
+    }
     return RequestBufferCommon(config, bedata, retval, BUFFER_PRODUCER_REQUEST_BUFFER);
 }
 
+GSError BufferClientProducer::RequestBufferAfterAsyncFlush(const BufferRequestConfig &config,
+    sptr<BufferExtraData> &bedata, RequestBufferReturnValue &retval, uint64_t serial)
+{
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+
+    if (!arguments.WriteUint64(asyncFlushSession_) || !arguments.WriteUint64(serial)) {
+        return GSERROR_BINDER;
+    }
+    GSError ret = WriteRequestConfig(arguments, config, isPeerPackedConfig_);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (!arguments.WriteUint32(PACKED_EXTRA_DATA_VERSION)) {
+        return GSERROR_BINDER;
+    }
+
+    retval.isConnected = false;
+    SEND_REQUEST(BUFFER_PRODUCER_REQUEST_BUFFER_AFTER_ASYNC_FLUSH, arguments, reply, option);
+    syncedAsyncFlushSerial_ = serial;
+    return ReadRequestBufferReply(reply, config, bedata, retval);
+}
+
 GSError BufferClientProducer::ReadRequestBuffersReply(MessageParcel &reply,
     const BufferRequestConfig &config, std::vector<sptr<BufferExtraData>> &bedata,
     std::vector<RequestBufferReturnValue> &retvalues, uint32_t num)
@@ -175,6 +235,7 @@ GSError BufferClientProducer::ReadRequestBuffersReply(MessageParcel &reply,
         if (ret != GSERROR_OK) {
             return SURFACE_ERROR_UNKOWN;
         }
+        RecordQueueExtraData(retval.sequence, bedata[i]);
         retval.fence = SyncFence::ReadFromMessageParcel(reply);
         if (!reply.ReadUInt32Vector(&retval.deletingBuffers)) {
             return GSERROR_BINDER;
@@ -192,10 +253,13 @@ GSError BufferClientProducer::RequestBuffers(const BufferRequestConfig &config,
     if (!arguments.WriteUint32(num)) {
         return GSERROR_BINDER;
     }
-    GSError ret = WriteRequestConfig(arguments, config);
+    GSError ret = WriteRequestConfig(arguments, config, isPeerPackedConfig_);
     if (ret != GSERROR_OK) {
         return ret;
     }
+    if (!arguments.WriteUint32(PACKED_EXTRA_DATA_VERSION)) {
+        return GSERROR_BINDER;
+    }
     retvalues[0].isConnected = false;
     SEND_REQUEST(BUFFER_PRODUCER_REQUEST_BUFFERS, arguments, reply, option);
     ret = CheckRetval(reply);
@@ -287,7 +351,17 @@ GSError BufferClientProducer::GetProducerInitInfo(ProducerInitInfo &info)
         !reply.ReadUint64(info.producerId) || !reply.ReadInt32(info.transformHint)) {
         return GSERROR_BINDER;
     }
-    return CheckRetval(reply);
+    GSError ret = CheckRetval(reply);
+    // an older queue sends no versions and keeps getting the legacy encodings
+    uint32_t packedConfigVersion = 0;
+    if (ret == GSERROR_OK && reply.ReadUint32(packedConfigVersion)) {
+        isPeerPackedConfig_ = packedConfigVersion >= PACKED_CONFIG_VERSION;
+    }
+    uint32_t packedExtraDataVersion = 0;
+    if (ret == GSERROR_OK && reply.ReadUint32(packedExtraDataVersion)) {
+        isPeerPackedExtraData_ = packedExtraDataVersion >= PACKED_EXTRA_DATA_VERSION;
+    }
+    return ret;
 }
 
 GSError BufferClientProducer::CancelBuffer(uint32_t sequence, sptr<BufferExtraData> bedata)
@@ -297,7 +371,7 @@ GSError BufferClientProducer::CancelBuffer(uint32_t sequence, sptr<BufferExtraDa
     if (!arguments.WriteUint32(sequence)) {
         return GSERROR_BINDER;
     }
-    GSError ret = bedata->WriteToParcel(arguments);
+    GSError ret = WriteExtraData(arguments, sequence, bedata);
     if (ret != GSERROR_OK) {
         return GSERROR_BINDER;
     }
@@ -309,19 +383,28 @@ GSError BufferClientProducer::CancelBuffer(uint32_t sequence, sptr<BufferExtraDa
 GSError BufferClientProducer::FlushBuffer(uint32_t sequence, sptr<BufferExtraData> bedata,
                                           sptr<SyncFence> fence, BufferFlushConfigWithDamages &config)
 {
+    if (FlushBufferToChannel(sequence, bedata, fence, config)) {
+        if (OHOS::RsFrameReportExt::GetInstance().GetEnable()) {
+            OHOS::RsFrameReportExt::GetInstance().HandleSwapBuffer();
+        }
+        return GSERROR_OK;
+    }
+    if (isFlushAsync_.load()) {
+        return FlushBufferAsync(sequence, bedata, fence, config);
+    }
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
 
     if (!arguments.WriteUint32(sequence)) {
         return GSERROR_BINDER;
     }
-    GSError ret = bedata->WriteToParcel(arguments);
+    GSError ret = WriteExtraData(arguments, sequence, bedata);
     if (ret != GSERROR_OK) {
         return ret;
     }
     if (!fence->WriteToMessageParcel(arguments)) {
         return GSERROR_BINDER;
     }
-    ret = WriteFlushConfig(arguments, config);
+    ret = WriteFlushConfig(arguments, config, isPeerPackedConfig_);
     if (ret != GSERROR_OK) {
         return ret;
     }
@@ -338,6 +421,78 @@ GSError BufferClientProducer::FlushBuffer(uint32_t sequence, sptr<BufferExtraDat
     return GSERROR_OK;
 }
 
+GSError BufferClientProducer::FlushBufferAsync(uint32_t sequence, const sptr<BufferExtraData> &bedata,
+    const sptr<SyncFence> &fence, const BufferFlushConfigWithDamages &config)
+{
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+    option.SetFlags(MessageOption::TF_ASYNC);
+
+    std::lock_guard<std::mutex> lockGuard(asyncFlushMutex_);
+    uint64_t serial = asyncFlushSerial_.load() + 1;
+    if (!arguments.WriteUint64(asyncFlushSession_) || !arguments.WriteUint64(serial) ||
+        !arguments.WriteUint32(sequence)) {
+        return GSERROR_BINDER;
+    }
+    GSError ret = WriteExtraData(arguments, sequence, bedata);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (!fence->WriteToMessageParcel(arguments)) {
+        return GSERROR_BINDER;
+    }
+    ret = WriteFlushConfig(arguments, config, isPeerPackedConfig_);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+
+    SEND_REQUEST(BUFFER_PRODUCER_FLUSH_BUFFER_ASYNC, arguments, reply, option);
+    asyncFlushSerial_ = serial;
+    if (OHOS::RsFrameReportExt::GetInstance().GetEnable()) {
+        OHOS::RsFrameReportExt::GetInstance().HandleSwapBuffer();
+    }
+    return GSERROR_OK;
+}
+
+GSError BufferClientProducer::WaitAsyncFlush()
+{
+    uint64_t serial = asyncFlushSerial_.load();
+    if (serial == syncedAsyncFlushSerial_.load()) {
+        return GSERROR_OK;
+    }
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+    if (!arguments.WriteUint64(asyncFlushSession_) || !arguments.WriteUint64(serial)) {
+        return GSERROR_BINDER;
+    }
+    SEND_REQUEST(BUFFER_PRODUCER_WAIT_ASYNC_FLUSH, arguments, reply, option);
+    syncedAsyncFlushSerial_ = serial;
+    GSError ret = CheckRetval(reply);
+    if (ret != GSERROR_OK) {
+        GSError expected = GSERROR_OK;
+        deferredFlushError_.compare_exchange_strong(expected, ret);
+    }
+    return ret;
+}
+
+GSError BufferClientProducer::SetFlushBufferAsyncMode(bool isAsync)
+{
+    if (!isAsync) {
+        isFlushAsync_ = false;
+        return GSERROR_OK;
+    }
+    // a server that does not know the async commands would drop oneway flushes silently, ask it first.
+    // the probe also makes the server forget the serials and errors of any earlier session
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+    if (!arguments.WriteUint64(asyncFlushSession_) || !arguments.WriteUint64(0)) {
+        return GSERROR_BINDER;
+    }
+    if (SendRequest(BUFFER_PRODUCER_WAIT_ASYNC_FLUSH, arguments, reply, option) != GSERROR_OK ||
+        CheckRetval(reply) != GSERROR_OK) {
+        return SURFACE_ERROR_NOT_SUPPORT;
+    }
+    isFlushAsync_ = true;
+    return GSERROR_OK;
+}
+
 GSError BufferClientProducer::FlushBuffers(const std::vector<uint32_t> &sequences,
     const std::vector<sptr<BufferExtraData>> &bedata,
     const std::vector<sptr<SyncFence>> &fences,
@@ -353,14 +508,14 @@ GSError BufferClientProducer::FlushBuffers(const std::vector<uint32_t> &sequence
     }
     GSError ret = GSERROR_OK;
     for (uint32_t i = 0; i < sequences.size(); ++i) {
-        ret = bedata[i]->WriteToParcel(arguments);
+        ret = WriteExtraData(arguments, sequences[i], bedata[i]);
         if (ret != GSERROR_OK) {
             return ret;
         }
         if (!fences[i]->WriteToMessageParcel(arguments)) {
             return GSERROR_BINDER;
         }
-        ret = WriteFlushConfig(arguments, configs[i]);
+        ret = WriteFlushConfig(arguments, configs[i], isPeerPackedConfig_);
         if (ret != GSERROR_OK) {
             return ret;
         }
@@ -382,6 +537,7 @@ GSError BufferClientProducer::AttachBufferToQueue(sptr<SurfaceBuffer> buffer)
         BLOGE("WriteBufferRequestConfig ret: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, uniqueId_);
         return ret;
     }
+    ForgetQueueExtraData(sequence);
     SEND_REQUEST(BUFFER_PRODUCER_ATTACH_BUFFER_TO_QUEUE, arguments, reply, option);
     return CheckRetval(reply);
 }
@@ -394,6 +550,7 @@ GSError BufferClientProducer::DetachBufferFromQueue(sptr<SurfaceBuffer> buffer)
     if (ret != GSERROR_OK) {
         return ret;
     }
+    ForgetQueueExtraData(sequence);
     SEND_REQUEST(BUFFER_PRODUCER_DETACH_BUFFER_FROM_QUEUE, arguments, reply, option);
     return CheckRetval(reply);
 }
@@ -414,6 +571,7 @@ GSError BufferClientProducer::AttachBuffer(sptr<SurfaceBuffer>& buffer, int32_t
     if (!arguments.WriteInt32(timeOut)) {
         return GSERROR_BINDER;
     }
+    ForgetQueueExtraData(sequence);
     SEND_REQUEST(BUFFER_PRODUCER_ATTACH_BUFFER, arguments, reply, option);
     return CheckRetval(reply);
 }
@@ -437,7 +595,12 @@ GSError BufferClientProducer::RegisterReleaseListener(sptr<IProducerListener> li
     }
 
     SEND_REQUEST(BUFFER_PRODUCER_REGISTER_RELEASE_LISTENER, arguments, reply, option);
-    return CheckRetval(reply);
+    GSError ret = CheckRetval(reply);
+    if (ret == GSERROR_OK) {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        releaseListener_ = listener;
+    }
+    return ret;
 }
 
 GSError BufferClientProducer::RegisterPropertyListener(sptr<IProducerListener> listener, uint64_t producerId)
@@ -488,6 +651,10 @@ GSError BufferClientProducer::RegisterReleaseListenerBackup(sptr<IProducerListen
 
 GSError BufferClientProducer::UnRegisterReleaseListener()
 {
+    {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        releaseListener_ = nullptr;
+    }
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
     SEND_REQUEST(BUFFER_PRODUCER_UNREGISTER_RELEASE_LISTENER, arguments, reply, option);
     return CheckRetval(reply);
@@ -666,6 +833,7 @@ GSError BufferClientProducer::CleanCache(bool cleanAll, uint32_t *bufSeqNum)
     if (!arguments.WriteBool(cleanAll)) {
         return GSERROR_BINDER;
     }
+    ClearQueueExtraData();
     SEND_REQUEST(BUFFER_PRODUCER_CLEAN_CACHE, arguments, reply, option);
     GSError ret = CheckRetval(reply);
     if (ret == GSERROR_OK && bufSeqNum != nullptr) {
@@ -681,6 +849,7 @@ GSError BufferClientProducer::GoBackground()
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
 
+    ClearQueueExtraData();
     SEND_REQUEST(BUFFER_PRODUCER_GO_BACKGROUND, arguments, reply, option);
     return CheckRetval(reply);
 }
@@ -726,6 +895,7 @@ GSError BufferClientProducer::Disconnect(uint32_t *bufSeqNum)
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
 
+    ClearQueueExtraData();
     SEND_REQUEST(BUFFER_PRODUCER_DISCONNECT, arguments, reply, option);
     GSError ret = CheckRetval(reply);
     if (ret == GSERROR_OK && bufSeqNum != nullptr) {
@@ -749,6 +919,7 @@ GSError BufferClientProducer::DisconnectStrictly()
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
 
+    ClearQueueExtraData();
     SEND_REQUEST(BUFFER_PRODUCER_DISCONNECT_STRICTLY, arguments, reply, option);
     return CheckRetval(reply);
 }
@@ -1080,14 +1251,16 @@ GSError BufferClientProducer::AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer,
         return ret;
     }
 
-    ret = bedata->WriteToParcel(arguments);
+    // the queue gets a buffer it never sent, whatever it held for the sequence before is gone
+    ForgetQueueExtraData(buffer->GetSeqNum());
+    ret = WriteExtraData(arguments, buffer->GetSeqNum(), bedata);
     if (ret != GSERROR_OK) {
         return ret;
     }
     if (!fence->WriteToMessageParcel(arguments)) {
         return GSERROR_BINDER;
     }
-    ret = WriteFlushConfig(arguments, config);
+    ret = WriteFlushConfig(arguments, config, isPeerPackedConfig_);
     if (ret != GSERROR_OK) {
         return ret;
     }
@@ -1098,6 +1271,55 @@ GSError BufferClientProducer::AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer,
     return CheckRetval(reply);
 }
 
+GSError BufferClientProducer::FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata,
+    sptr<SyncFence> fence, BufferFlushConfigWithDamages& flushConfig, const BufferRequestConfig& requestConfig,
+    sptr<BufferExtraData>& requestBedata, RequestBufferReturnValue& retval, GSError& requestRet)
+{
+    // the control channel already saves both round trips
+    if (FlushBufferToChannel(sequence, bedata, fence, flushConfig)) {
+        if (OHOS::RsFrameReportExt::GetInstance().GetEnable()) {
+            OHOS::RsFrameReportExt::GetInstance().HandleSwapBuffer();
+        }
+        requestRet = RequestBuffer(requestConfig, requestBedata, retval);
+        return GSERROR_OK;
+    }
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+
+    if (!arguments.WriteUint32(sequence)) {
+        return GSERROR_BINDER;
+    }
+    GSError ret = WriteExtraData(arguments, sequence, bedata);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (!fence->WriteToMessageParcel(arguments)) {
+        return GSERROR_BINDER;
+    }
+    ret = WriteFlushConfig(arguments, flushConfig, isPeerPackedConfig_);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    ret = WriteRequestConfig(arguments, requestConfig, isPeerPackedConfig_);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (!arguments.WriteUint32(PACKED_EXTRA_DATA_VERSION)) {
+        return GSERROR_BINDER;
+    }
+
+    retval.isConnected = false;
+    SEND_REQUEST(BUFFER_PRODUCER_FLUSH_AND_REQUEST_BUFFER, arguments, reply, option);
+    ret = CheckRetval(reply);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (OHOS::RsFrameReportExt::GetInstance().GetEnable()) {
+        OHOS::RsFrameReportExt::GetInstance().HandleSwapBuffer();
+    }
+    requestRet = ReadRequestBufferReply(reply, requestConfig, requestBedata, retval);
+    return GSERROR_OK;
+}
+
 GSError BufferClientProducer::GetCycleBuffersNumber(uint32_t& cycleBuffersNumber)
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
@@ -1146,7 +1368,7 @@ GSError BufferClientProducer::SetFixedRotation(int32_t fixedRotation)
 GSError BufferClientProducer::PreAllocBuffers(const BufferRequestConfig &config, uint32_t allocBufferCount)
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
-    GSError ret = WriteRequestConfig(arguments, config);
+    GSError ret = WriteRequestConfig(arguments, config, isPeerPackedConfig_);
     if (ret != GSERROR_OK) {
         return ret;
     }
@@ -1206,6 +1428,39 @@ GSError BufferClientProducer::SyncProducerCache(std::map<uint32_t, sptr<SurfaceB
     return GSERROR_OK;
 }
 
+GSError BufferClientProducer::SyncProducerCacheDelta(uint64_t generation, ProducerCacheDelta &delta)
+{
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+    if (!arguments.WriteUint64(generation)) {
+        return GSERROR_BINDER;
+    }
+    SEND_REQUEST(BUFFER_PRODUCER_SYNC_PRODUCER_CACHE_DELTA, arguments, reply, option);
+    GSError ret = CheckRetval(reply);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    uint32_t size = 0;
+    if (!reply.ReadUint64(delta.generation) || !reply.ReadBool(delta.isFull) ||
+        !reply.ReadUInt32Vector(&delta.removedSequences) || !reply.ReadUint32(size)) {
+        BLOGE("SyncProducerCacheDelta read reply failed");
+        return GSERROR_BINDER;
+    }
+    if (size > SURFACE_MAX_QUEUE_SIZE) {
+        BLOGE("SyncProducerCacheDelta size too large");
+        return SURFACE_ERROR_UNKOWN;
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t seqNum;
+        sptr<SurfaceBuffer> buffer;
+        ret = ReadSurfaceBufferImpl(reply, seqNum, buffer);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        delta.buffers[seqNum] = buffer;
+    }
+    return GSERROR_OK;
+}
+
 GSError BufferClientProducer::SetSingleBufferMode(SingleBufferMode mode)
 {
     DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
@@ -1227,4 +1482,249 @@ GSError BufferClientProducer::CleanReleasedBuffers(std::vector<uint32_t> &cleane
     }
     return ret;
 }
+
+GSError BufferClientProducer::EnableControlChannel()
+{
+    std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+    if (controlChannel_ != nullptr && !controlChannel_->IsClosed()) {
+        return GSERROR_OK;
+    }
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    GSError ret = SurfaceControlChannel::CreatePair(producerEnd, queueEnd);
+    if (ret != GSERROR_OK) {
+        BLOGE("CreatePair failed: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, uniqueId_);
+        return ret;
+    }
+    DEFINE_MESSAGE_VARIABLES(arguments, reply, option);
+    ret = queueEnd->WriteToMessageParcel(arguments);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    SEND_REQUEST(BUFFER_PRODUCER_SETUP_CONTROL_CHANNEL, arguments, reply, option);
+    ret = CheckRetval(reply);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (controlChannel_ != nullptr) {
+        // the old channel is closed, its thread ends on its own
+        controlChannel_->Shutdown();
+        if (controlChannelThread_.joinable()) {
+            controlChannelThread_.detach();
+        }
+    }
+    controlChannel_ = producerEnd;
+    controlChannelThread_ = std::thread(ControlChannelLoop, wptr<BufferClientProducer>(this), producerEnd);
+    return GSERROR_OK;
+}
+
+void BufferClientProducer::StopControlChannel()
+{
+    sptr<SurfaceControlChannel> channel = nullptr;
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        channel = controlChannel_;
+        controlChannel_ = nullptr;
+        thread = std::move(controlChannelThread_);
+    }
+    if (channel != nullptr) {
+        channel->Shutdown();
+    }
+    if (!thread.joinable()) {
+        return;
+    }
+    // the last reference may go away in a release callback on the channel thread itself
+    if (thread.get_id() == std::this_thread::get_id()) {
+        thread.detach();
+    } else {
+        thread.join();
+    }
+}
+
+void BufferClientProducer::ControlChannelLoop(wptr<BufferClientProducer> producer,
+    sptr<SurfaceControlChannel> channel)
+{
+    g_isControlChannelThread = true;
+    while (!channel->IsClosed()) {
+        channel->Wait(-1);
+        sptr<BufferClientProducer> that = producer.promote();
+        if (that == nullptr) {
+            break;
+        }
+        that->DrainControlChannel(channel);
+    }
+}
+
+void BufferClientProducer::DrainControlChannel(const sptr<SurfaceControlChannel> &channel)
+{
+    SurfaceControlRecord record;
+    int32_t fenceFd = -1;
+    while (channel->Receive(record, fenceFd) == GSERROR_OK) {
+        sptr<SyncFence> fence = fenceFd >= 0 ? new SyncFence(fenceFd) : SyncFence::InvalidFence();
+        if (record.type == SurfaceControlRecordType::RELEASE) {
+            HandleReleaseRecord(record, fence);
+            continue;
+        }
+        if (record.type != SurfaceControlRecordType::REQUEST_REPLY) {
+            BLOGW("unexpected control record: %{public}u, uniqueId: %{public}" PRIu64 ".",
+                static_cast<uint32_t>(record.type), uniqueId_);
+            continue;
+        }
+        bool isWaited = false;
+        {
+            std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+            if (waitingControlRequests_.count(record.id) != 0) {
+                controlReplies_[record.id] = { record.status, record.sequence, fence };
+                isWaited = true;
+            }
+        }
+        if (isWaited) {
+            controlReplyCond_.notify_all();
+        } else if (record.status == GSERROR_OK) {
+            // the requester went over binder in the meantime, nobody owns this buffer
+            BLOGW("late control reply, sequence: %{public}u, uniqueId: %{public}" PRIu64 ".",
+                record.sequence, uniqueId_);
+            (void)CancelBuffer(record.sequence, new BufferExtraDataImpl);
+        }
+    }
+}
+
+void BufferClientProducer::HandleReleaseRecord(const SurfaceControlRecord &record, const sptr<SyncFence> &fence)
+{
+    sptr<IProducerListener> listener = nullptr;
+    {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        listener = releaseListener_;
+    }
+    if (listener == nullptr) {
+        return;
+    }
+    if (record.hasSequence) {
+        (void)listener->OnBufferReleasedWithSequenceAndFence(record.sequence, fence);
+    } else {
+        (void)listener->OnBufferReleased();
+    }
+}
+
+GSError BufferClientProducer::RequestBufferFromChannel(const BufferRequestConfig &config,
+    RequestBufferReturnValue &retval)
+{
+    // a request from OnBufferReleased would wait for a reply only this thread can read, use binder right away
+    if (g_isControlChannelThread) {
+        return GSERROR_NOT_SUPPORT;
+    }
+    std::unique_lock<std::mutex> lock(controlChannelMutex_);
+    if (controlChannel_ == nullptr) {
+        return GSERROR_NOT_SUPPORT;
+    }
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::REQUEST;
+    record.id = ++nextControlRequestId_;
+    record.config = config;
+    GSError ret = controlChannel_->Send(record);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    uint32_t id = record.id;
+    waitingControlRequests_.insert(id);
+    bool hasReply = controlReplyCond_.wait_for(lock, std::chrono::milliseconds(CONTROL_REQUEST_TIMEOUT_MS),
+        [this, id]() { return controlReplies_.count(id) != 0; });
+    waitingControlRequests_.erase(id);
+    if (!hasReply) {
+        BLOGW("control request %{public}u timeout, uniqueId: %{public}" PRIu64 ".", id, uniqueId_);
+        return GSERROR_NO_BUFFER;
+    }
+    ControlReply reply = std::move(controlReplies_[id]);
+    controlReplies_.erase(id);
+    if (reply.status != GSERROR_OK) {
+        return static_cast<GSError>(reply.status);
+    }
+    // the queue only answers with buffers this producer already caches
+    retval.sequence = reply.sequence;
+    retval.buffer = nullptr;
+    retval.fence = reply.fence;
+    retval.deletingBuffers.clear();
+    retval.isConnected = true;
+    return GSERROR_OK;
+}
+
+bool BufferClientProducer::FlushBufferToChannel(uint32_t sequence, const sptr<BufferExtraData> &bedata,
+    const sptr<SyncFence> &fence, const BufferFlushConfigWithDamages &config)
+{
+    if (bedata == nullptr || !bedata->IsEmpty() || fence == nullptr ||
+        config.damages.size() > SurfaceControlRecord::MAX_DAMAGES) {
+        return false;
+    }
+    sptr<SurfaceControlChannel> channel = nullptr;
+    {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        channel = controlChannel_;
+    }
+    if (channel == nullptr) {
+        return false;
+    }
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::FLUSH;
+    record.sequence = sequence;
+    record.timestamp = config.timestamp;
+    record.desiredPresentTimestamp = config.desiredPresentTimestamp;
+    record.damageCount = static_cast<uint32_t>(config.damages.size());
+    std::copy(config.damages.begin(), config.damages.end(), record.damages);
+    if (channel->Send(record, fence->Get()) != GSERROR_OK) {
+        return false;
+    }
+    ForgetQueueExtraData(sequence);
+    return true;
+}
+
+void BufferClientProducer::RecordQueueExtraData(uint32_t sequence, const sptr<BufferExtraData> &bedata)
+{
+    if (!isPeerPackedExtraData_.load()) {
+        return;
+    }
+    uint64_t version = bedata->GetVersion();
+    std::lock_guard<std::mutex> lockGuard(queueExtraDataMutex_);
+    for (auto &[recordedSequence, recordedVersion] : queueExtraDataVersions_) {
+        if (recordedSequence == sequence) {
+            recordedVersion = version;
+            return;
+        }
+    }
+    queueExtraDataVersions_.emplace_back(sequence, version);
+}
+
+uint64_t BufferClientProducer::ForgetQueueExtraData(uint32_t sequence)
+{
+    std::lock_guard<std::mutex> lockGuard(queueExtraDataMutex_);
+    for (auto it = queueExtraDataVersions_.begin(); it != queueExtraDataVersions_.end(); it++) {
+        if (it->first == sequence) {
+            uint64_t version = it->second;
+            *it = queueExtraDataVersions_.back();
+            queueExtraDataVersions_.pop_back();
+            return version;
+        }
+    }
+    return 0;
+}
+
+void BufferClientProducer::ClearQueueExtraData()
+{
+    std::lock_guard<std::mutex> lockGuard(queueExtraDataMutex_);
+    queueExtraDataVersions_.clear();
+}
+
+GSError BufferClientProducer::WriteExtraData(MessageParcel &arguments, uint32_t sequence,
+    const sptr<BufferExtraData> &bedata)
+{
+    if (!isPeerPackedExtraData_.load()) {
+        return bedata->WriteToParcel(arguments);
+    }
+    // the record is used once, after the flush or cancel the consumer may change the queue's copy
+    uint64_t queueVersion = ForgetQueueExtraData(sequence);
+    uint64_t version = bedata->GetVersion();
+    bool isUnchanged = version != 0 && version == queueVersion;
+    return isUnchanged ? BufferExtraDataImpl::WriteUnchangedToParcel(arguments) :
+        bedata->WritePackedToParcel(arguments);
+}
 }; // namespace OHOS
@@ -14,82 +14,262 @@
  */
 
 #include "buffer_extra_data_impl.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <type_traits>
 #include <message_parcel.h>
+#include <securec.h>
 #include "buffer_log.h"
+#include "buffer_utils.h"
 
 namespace OHOS {
 namespace {
 constexpr int32_t BUFFER_EXTRA_DATA_MAGIC = 0x4567;
+constexpr int32_t BUFFER_EXTRA_DATA_PACKED_MAGIC = 0x4568 | (PACKED_EXTRA_DATA_VERSION << 16);
+constexpr int32_t BUFFER_EXTRA_DATA_UNCHANGED_MAGIC = 0x4569;
+// most extra data is a few numbers, larger data uses the heap
+constexpr size_t PACKED_EXTRA_DATA_STACK_SIZE = 256;
+// indexed by ExtraDataKeyId
+constexpr const char *WELL_KNOWN_KEYS[] = {
+    "",
+    "SupportFastCompose",
+    "timeStamp",
+    "dataSize",
+    "isKeyFrame",
+};
+
+std::atomic<uint64_t> g_nextVersion = 0;
+
+uint8_t *PutBytes(uint8_t *out, const std::string &bytes)
+{
+    out = PutVarint(out, static_cast<int64_t>(bytes.size()));
+    if (!bytes.empty()) {
+        (void)memcpy_s(out, bytes.size(), bytes.data(), bytes.size());
+    }
+    return out + bytes.size();
+}
+
+bool GetBytes(const uint8_t *&in, const uint8_t *end, std::string &bytes)
+{
+    int64_t size = 0;
+    if (!GetVarint(in, end, size) || size < 0 || size > end - in) {
+        return false;
+    }
+    bytes.assign(reinterpret_cast<const char *>(in), static_cast<size_t>(size));
+    in += size;
+    return true;
+}
 } // namespace
 
-GSError BufferExtraDataImpl::ReadExtraDataItem(MessageParcel &parcel, const std::string &key, ExtraDataType type)
+BufferExtraDataImpl::BufferExtraDataImpl()
 {
-    switch (type) {
-        case ExtraDataType::i32: {
-            int32_t val = 0;
-            if (!parcel.ReadInt32(val)) {
+    UpdateVersionLocked();
+}
+
+void BufferExtraDataImpl::UpdateVersionLocked()
+{
+    version_ = ++g_nextVersion;
+}
+
+BufferExtraDataImpl::ExtraDataKeyId BufferExtraDataImpl::FindKeyId(const std::string &key)
+{
+    static_assert(std::size(WELL_KNOWN_KEYS) == static_cast<size_t>(ExtraDataKeyId::BUTT), "one name per key id");
+    for (size_t i = 1; i < std::size(WELL_KNOWN_KEYS); i++) {
+        if (key == WELL_KNOWN_KEYS[i]) {
+            return static_cast<ExtraDataKeyId>(i);
+        }
+    }
+    return ExtraDataKeyId::NONE;
+}
+
+const BufferExtraDataImpl::ExtraData *BufferExtraDataImpl::FindLocked(const std::string &key) const
+{
+    for (const auto &data : datas_) {
+        if (data.key == key) {
+            return &data;
+        }
+    }
+    return nullptr;
+}
+
+BufferExtraDataImpl::ExtraData *BufferExtraDataImpl::FindOrAddLocked(const std::string &key)
+{
+    for (auto &data : datas_) {
+        if (data.key == key) {
+            return &data;
+        }
+    }
+    if (datas_.size() > SURFACE_MAX_USER_DATA_COUNT) {
+        BLOGW("SurfaceBuffer has too many extra data, cannot save one more!!!");
+        return nullptr;
+    }
+    auto &data = datas_.emplace_back();
+    data.key = key;
+    data.keyId = FindKeyId(key);
+    return &data;
+}
+
+GSError BufferExtraDataImpl::ReadExtraDataItemLocked(MessageParcel &parcel, ExtraData &data, int32_t typeVal)
+{
+    data.type = static_cast<ExtraDataType>(typeVal);
+    switch (data.type) {
+        case ExtraDataType::i32:
+            if (!parcel.ReadInt32(data.number.i32)) {
                 BLOGE("ReadFromParcel read i32 failed");
                 return GSERROR_INTERNAL;
             }
-            return ExtraSet(key, type, val);
-        }
-        case ExtraDataType::i64: {
-            int64_t val = 0;
-            if (!parcel.ReadInt64(val)) {
+            return GSERROR_OK;
+        case ExtraDataType::i64:
+            if (!parcel.ReadInt64(data.number.i64)) {
                 BLOGE("ReadFromParcel read i64 failed");
                 return GSERROR_INTERNAL;
             }
-            return ExtraSet(key, type, val);
-        }
-        case ExtraDataType::f64: {
-            double val = 0.0;
-            if (!parcel.ReadDouble(val)) {
+            return GSERROR_OK;
+        case ExtraDataType::f64:
+            if (!parcel.ReadDouble(data.number.f64)) {
                 BLOGE("ReadFromParcel read f64 failed");
                 return GSERROR_INTERNAL;
             }
-            return ExtraSet(key, type, val);
-        }
-        case ExtraDataType::string: {
-            std::string val;
-            if (!parcel.ReadString(val)) {
+            return GSERROR_OK;
+        case ExtraDataType::string:
+            if (!parcel.ReadString(data.string)) {
                 BLOGE("ReadFromParcel read string failed");
                 return GSERROR_INTERNAL;
             }
-            return ExtraSet(key, type, val);
-        }
-        default:
             return GSERROR_OK;
+        default:
+            return GSERROR_NO_ENTRY;
     }
 }
 
-GSError BufferExtraDataImpl::ReadFromParcel(MessageParcel &parcel)
+GSError BufferExtraDataImpl::ReadLegacyLocked(MessageParcel &parcel)
 {
-    int32_t magic = 0;
-    if (parcel.ReadInt32(magic) == false || magic != BUFFER_EXTRA_DATA_MAGIC) {
-        BLOGW("read failed, magic: %{public}d", magic);
-        return GSERROR_INTERNAL;
-    }
-
     int32_t size = 0;
     if (!parcel.ReadInt32(size) || size > SURFACE_MAX_USER_DATA_COUNT) {
         BLOGE("ReadFromParcel size invalid: %{public}d", size);
         return GSERROR_INTERNAL;
     }
-
-    GSError ret = GSERROR_OK;
+    // entries are read in place, a reused object keeps its string capacity
+    datas_.resize(static_cast<size_t>(std::max(size, 0)));
+    size_t count = 0;
     for (int32_t i = 0; i < size; i++) {
-        std::string key;
+        ExtraData &data = datas_[count];
         int32_t typeVal = 0;
-        if (!parcel.ReadString(key) || !parcel.ReadInt32(typeVal)) {
+        if (!parcel.ReadString(data.key) || !parcel.ReadInt32(typeVal)) {
             BLOGE("ReadFromParcel read key/type failed");
             return GSERROR_INTERNAL;
         }
-        ret = ReadExtraDataItem(parcel, key, static_cast<ExtraDataType>(typeVal));
+        GSError ret = ReadExtraDataItemLocked(parcel, data, typeVal);
+        if (ret == GSERROR_NO_ENTRY) {
+            // an unknown type carries no value, the entry is dropped
+            continue;
+        }
         if (ret != GSERROR_OK) {
-            BLOGE("ExtraSet failed, ret %{public}d", ret);
-            break;
+            return ret;
+        }
+        data.keyId = FindKeyId(data.key);
+        count++;
+    }
+    datas_.resize(count);
+    return GSERROR_OK;
+}
+
+GSError BufferExtraDataImpl::ReadPackedLocked(MessageParcel &parcel)
+{
+    uint32_t size = 0;
+    if (!parcel.ReadUint32(size)) {
+        BLOGE("ReadFromParcel read packed size failed");
+        return GSERROR_INTERNAL;
+    }
+    const uint8_t *in = parcel.ReadBuffer(size);
+    if (in == nullptr) {
+        BLOGE("ReadFromParcel read packed data failed");
+        return GSERROR_INTERNAL;
+    }
+    const uint8_t *end = in + size;
+    int64_t count = 0;
+    if (!GetVarint(in, end, count) || count < 0 || count > SURFACE_MAX_USER_DATA_COUNT) {
+        BLOGE("ReadFromParcel packed count invalid");
+        return GSERROR_INTERNAL;
+    }
+    datas_.resize(static_cast<size_t>(count));
+    for (auto &data : datas_) {
+        // key id and type take one byte each
+        if (end - in < 2 || *in >= static_cast<uint8_t>(ExtraDataKeyId::BUTT)) {
+            return GSERROR_INTERNAL;
+        }
+        data.keyId = static_cast<ExtraDataKeyId>(*in++);
+        if (data.keyId == ExtraDataKeyId::NONE) {
+            if (!GetBytes(in, end, data.key)) {
+                return GSERROR_INTERNAL;
+            }
+        } else {
+            data.key = WELL_KNOWN_KEYS[static_cast<size_t>(data.keyId)];
+        }
+        if (in == end) {
+            return GSERROR_INTERNAL;
+        }
+        data.type = static_cast<ExtraDataType>(*in++);
+        int64_t value = 0;
+        bool isValid = true;
+        switch (data.type) {
+            case ExtraDataType::i32:
+                isValid = GetVarint(in, end, value) && value >= INT32_MIN && value <= INT32_MAX;
+                data.number.i32 = static_cast<int32_t>(value);
+                break;
+            case ExtraDataType::i64:
+                isValid = GetVarint(in, end, data.number.i64);
+                break;
+            case ExtraDataType::f64:
+                isValid = end - in >= static_cast<ptrdiff_t>(sizeof(double)) &&
+                    memcpy_s(&data.number.f64, sizeof(double), in, sizeof(double)) == EOK;
+                in += isValid ? sizeof(double) : 0;
+                break;
+            case ExtraDataType::string:
+                isValid = GetBytes(in, end, data.string);
+                break;
+            default:
+                isValid = false;
+                break;
+        }
+        if (!isValid) {
+            BLOGE("ReadFromParcel read packed item failed");
+            return GSERROR_INTERNAL;
         }
     }
+    if (in != end) {
+        BLOGE("ReadFromParcel packed data has trailing bytes");
+        return GSERROR_INTERNAL;
+    }
+    return GSERROR_OK;
+}
+
+GSError BufferExtraDataImpl::ReadFromParcel(MessageParcel &parcel)
+{
+    int32_t magic = 0;
+    if (!parcel.ReadInt32(magic)) {
+        BLOGW("read failed, magic: %{public}d", magic);
+        return GSERROR_INTERNAL;
+    }
+    std::lock_guard<std::mutex> lockGuard(mtx_);
+    UpdateVersionLocked();
+    isUnchanged_ = false;
+    GSError ret = GSERROR_INTERNAL;
+    if (magic == BUFFER_EXTRA_DATA_UNCHANGED_MAGIC) {
+        isUnchanged_ = true;
+        datas_.clear();
+        return GSERROR_OK;
+    } else if (magic == BUFFER_EXTRA_DATA_PACKED_MAGIC) {
+        ret = ReadPackedLocked(parcel);
+    } else if (magic == BUFFER_EXTRA_DATA_MAGIC) {
+        ret = ReadLegacyLocked(parcel);
+    } else {
+        BLOGW("read failed, magic: %{public}d", magic);
+    }
+    if (ret != GSERROR_OK) {
+        datas_.clear();
+    }
     return ret;
 }
 
@@ -100,52 +280,129 @@ GSError BufferExtraDataImpl::WriteToParcel(MessageParcel &parcel)
         return GSERROR_BINDER;
     }
     bool ipcRet = true;
-    for (const auto &[key, data] : datas_) {
-        if (!parcel.WriteString(key) || !parcel.WriteInt32(static_cast<int32_t>(data.type))) {
+    for (const auto &data : datas_) {
+        if (!parcel.WriteString(data.key) || !parcel.WriteInt32(static_cast<int32_t>(data.type))) {
             return GSERROR_BINDER;
         }
         switch (data.type) {
-            case ExtraDataType::i32: {
-                int32_t i32 = -1;
-                auto pVal = std::any_cast<int32_t>(&data.val);
-                if (pVal != nullptr) {
-                    i32 = *pVal;
-                }
-                ipcRet = parcel.WriteInt32(i32);
+            case ExtraDataType::i32:
+                ipcRet = parcel.WriteInt32(data.number.i32);
                 break;
-            }
-            case ExtraDataType::i64: {
-                int64_t i64 = -1;
-                auto pVal = std::any_cast<int64_t>(&data.val);
-                if (pVal != nullptr) {
-                    i64 = *pVal;
-                }
-                ipcRet = parcel.WriteInt64(i64);
+            case ExtraDataType::i64:
+                ipcRet = parcel.WriteInt64(data.number.i64);
                 break;
-            }
-            case ExtraDataType::f64: {
-                double f64 = -1;
-                auto pVal = std::any_cast<double>(&data.val);
-                if (pVal != nullptr) {
-                    f64 = *pVal;
-                }
-                ipcRet = parcel.WriteDouble(f64);
+            case ExtraDataType::f64:
+                ipcRet = parcel.WriteDouble(data.number.f64);
                 break;
-            }
-            case ExtraDataType::string: {
-                std::string string = "-1";
-                auto pVal = std::any_cast<std::string>(&data.val);
-                if (pVal != nullptr) {
-                    string = *pVal;
-                }
-                ipcRet = parcel.WriteString(string);
+            case ExtraDataType::string:
+                ipcRet = parcel.WriteString(data.string);
                 break;
-            }
             default:
                 break;
         }
+        if (!ipcRet) {
+            return GSERROR_BINDER;
+        }
     }
-    return ipcRet ? GSERROR_OK : GSERROR_BINDER;
+    return GSERROR_OK;
+}
+
+GSError BufferExtraDataImpl::WritePackedToParcel(MessageParcel &parcel)
+{
+    std::lock_guard<std::mutex> lockGuard(mtx_);
+    // count, then per item the key id, the key when it has no id, the type and the value
+    size_t maxSize = VARINT_MAX_BYTES;
+    for (const auto &data : datas_) {
+        maxSize += 2 + VARINT_MAX_BYTES * 2 + data.key.size() + data.string.size(); // 2: key id and type
+    }
+    uint8_t stackBlob[PACKED_EXTRA_DATA_STACK_SIZE];
+    std::vector<uint8_t> heapBlob;
+    uint8_t *blob = stackBlob;
+    if (maxSize > sizeof(stackBlob)) {
+        heapBlob.resize(maxSize);
+        blob = heapBlob.data();
+    }
+    uint8_t *out = PutVarint(blob, static_cast<int64_t>(datas_.size()));
+    for (const auto &data : datas_) {
+        *out++ = static_cast<uint8_t>(data.keyId);
+        if (data.keyId == ExtraDataKeyId::NONE) {
+            out = PutBytes(out, data.key);
+        }
+        *out++ = static_cast<uint8_t>(data.type);
+        switch (data.type) {
+            case ExtraDataType::i32:
+                out = PutVarint(out, data.number.i32);
+                break;
+            case ExtraDataType::i64:
+                out = PutVarint(out, data.number.i64);
+                break;
+            case ExtraDataType::f64:
+                (void)memcpy_s(out, sizeof(double), &data.number.f64, sizeof(double));
+                out += sizeof(double);
+                break;
+            case ExtraDataType::string:
+                out = PutBytes(out, data.string);
+                break;
+            default:
+                break;
+        }
+    }
+    uint32_t size = static_cast<uint32_t>(out - blob);
+    if (!parcel.WriteInt32(BUFFER_EXTRA_DATA_PACKED_MAGIC) || !parcel.WriteUint32(size) ||
+        !parcel.WriteBuffer(blob, size)) {
+        return GSERROR_BINDER;
+    }
+    return GSERROR_OK;
+}
+
+GSError BufferExtraDataImpl::WriteUnchangedToParcel(MessageParcel &parcel)
+{
+    return parcel.WriteInt32(BUFFER_EXTRA_DATA_UNCHANGED_MAGIC) ? GSERROR_OK : GSERROR_BINDER;
+}
+
+template<class T>
+GSError BufferExtraDataImpl::ExtraSet(const std::string &key, ExtraDataType type, const T &value)
+{
+    std::lock_guard<std::mutex> lockGuard(mtx_);
+    ExtraData *data = FindOrAddLocked(key);
+    if (data == nullptr) {
+        return GSERROR_OUT_OF_RANGE;
+    }
+    data->type = type;
+    if constexpr (std::is_same_v<T, int32_t>) {
+        data->number.i32 = value;
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+        data->number.i64 = value;
+    } else if constexpr (std::is_same_v<T, double>) {
+        data->number.f64 = value;
+    } else {
+        data->string = value;
+    }
+    UpdateVersionLocked();
+    return GSERROR_OK;
+}
+
+template<class T>
+GSError BufferExtraDataImpl::ExtraGet(const std::string &key, ExtraDataType type, T &value) const
+{
+    std::lock_guard<std::mutex> lockGuard(mtx_);
+    const ExtraData *data = FindLocked(key);
+    if (data == nullptr) {
+        return GSERROR_NO_ENTRY;
+    }
+    if (data->type != type) {
+        return GSERROR_TYPE_ERROR;
+    }
+    if constexpr (std::is_same_v<T, int32_t>) {
+        value = data->number.i32;
+    } else if constexpr (std::is_same_v<T, int64_t>) {
+        value = data->number.i64;
+    } else if constexpr (std::is_same_v<T, double>) {
+        value = data->number.f64;
+    } else {
+        value = data->string;
+    }
+    return GSERROR_OK;
 }
 
 GSError BufferExtraDataImpl::ExtraGet(const std::string &key, int32_t &value) const
@@ -188,35 +445,4 @@ GSError BufferExtraDataImpl::ExtraSet(const std::string &key, const std::string&
     return ExtraSet(key, ExtraDataType::string, value);
 }
 
-template<class T>
-GSError BufferExtraDataImpl::ExtraGet(const std::string &key, ExtraDataType type, T &value) const
-{
-    std::lock_guard<std::mutex> lockGuard(mtx_);
-    auto it = datas_.find(key);
-    if (it == datas_.end()) {
-        return GSERROR_NO_ENTRY;
-    }
-    if (it->second.type != type) {
-        return GSERROR_TYPE_ERROR;
-    }
-    auto pVal = std::any_cast<T>(&it->second.val);
-    if (pVal == nullptr) {
-        return GSERROR_TYPE_ERROR;
-    }
-    value = *pVal;
-    return GSERROR_OK;
-}
-
-GSError BufferExtraDataImpl::ExtraSet(const std::string &key, ExtraDataType type, const std::any& val)
-{
-    std::lock_guard<std::mutex> lockGuard(mtx_);
-    auto it = datas_.find(key);
-    if (it == datas_.end() && datas_.size() > SURFACE_MAX_USER_DATA_COUNT) {
-        BLOGW("SurfaceBuffer has too many extra data, cannot save one more!!!");
-        return GSERROR_OUT_OF_RANGE;
-    }
-    datas_[key].type = type;
-    datas_[key].val = val;
-    return GSERROR_OK;
-}
 } // namespace OHOS
@@ -27,13 +27,16 @@
 #include <parameters.h>
 
 #include "acquire_fence_manager.h"
+#include "buffer_alloc_worker.h"
 #include "buffer_utils.h"
 #include "buffer_log.h"
+#include "buffer_recycle_pool.h"
 #include "hebc_white_list.h"
 #include "hitrace_meter.h"
 #include "metadata_helper.h"
 #include "sandbox_utils.h"
 #include "surface_buffer_impl.h"
+#include "surface_memory_budget.h"
 #include "sync_fence.h"
 #include "sync_fence_tracker.h"
 #include "surface_utils.h"
@@ -109,18 +112,26 @@ BufferQueue::BufferQueue(const std::string &name)
     }
 }
 
+void BufferQueue::OnFirstStrongRef(const void *objectId)
+{
+    // a queue only held by a raw pointer is never registered, so a reclaim pass cannot promote it and free it
+    SurfaceMemoryBudget::GetInstance().RegisterQueue(this);
+}
+
 BufferQueue::~BufferQueue()
 {
     BLOGD("~BufferQueue dtor, uniqueId: %{public}" PRIu64 ".", uniqueId_);
-    for (auto &[id, _] : bufferQueueCache_) {
+    SurfaceMemoryBudget::GetInstance().UnregisterQueue(this);
+    for (auto &[id, element] : bufferQueueCache_) {
         OnBufferDeleteForRS(id);
+        RecycleBufferLocked(element);
     }
     SetLppShareFd(-1, false);
 }
 
 uint32_t BufferQueue::GetUsedSize()
 {
-    return static_cast<uint32_t>(bufferQueueCache_.size());
+    return static_cast<uint32_t>(bufferQueueCache_.size()) + reservedSlotCount_;
 }
 
 sptr<ConsumerSurfaceDelegator> BufferQueue::GetDelegator()
@@ -133,29 +144,32 @@ GSError BufferQueue::GetProducerInitInfo(ProducerInitInfo &info)
 {
     std::lock_guard<std::mutex> lockGuard(mutex_);
     info.name = name_;
-    info.width = defaultWidth_;
-    info.height = defaultHeight_;
+    info.width = defaultWidth_.load();
+    info.height = defaultHeight_.load();
     info.uniqueId = uniqueId_;
     info.isInHebcList = HebcWhiteList::GetInstance().Check(info.appName);
     info.bufferName = bufferName_;
     info.producerId = g_ProducerId.fetch_add(1);
-    info.transformHint = transformHint_;
+    info.transformHint = transformHint_.load();
     return GSERROR_OK;
 }
 
 GSError BufferQueue::PopFromFreeListLocked(sptr<SurfaceBuffer> &buffer,
     const BufferRequestConfig &config)
 {
-    for (auto it = freeList_.begin(); it != freeList_.end(); it++) {
-        auto mapIter = bufferQueueCache_.find(*it);
-        if (mapIter != bufferQueueCache_.end() && mapIter->second.config == config) {
-            if (mapIter->first == acquireLastFlushedBufSequence_) {
-                continue;
-            }
-            buffer = mapIter->second.buffer;
-            freeList_.erase(it);
-            return GSERROR_OK;
+    uint32_t sequence = 0;
+    bool found = freeList_.FindFirst(BufferConfigKey::FromConfig(config), [this, &config](uint32_t seq) {
+        if (seq == acquireLastFlushedBufSequence_) {
+            return false;
         }
+        auto mapIter = bufferQueueCache_.find(seq);
+        return mapIter != bufferQueueCache_.end() && mapIter->second.config == config;
+    }, sequence);
+    if (found) {
+        buffer = bufferQueueCache_[sequence].buffer;
+        freeList_.EraseFirst(sequence);
+        reallocAvoidedCount_++;
+        return GSERROR_OK;
     }
 
     if (freeList_.empty() || GetUsedSize() < bufferQueueSize_ - detachReserveSlotNum_ ||
@@ -173,6 +187,7 @@ GSError BufferQueue::PopFromFreeListLocked(sptr<SurfaceBuffer> &buffer,
     buffer->SetSurfaceBufferColorGamut(config.colorGamut);
     buffer->SetSurfaceBufferTransform(config.transform);
     freeList_.pop_front();
+    reallocFallbackCount_++;
     return GSERROR_OK;
 }
 
@@ -269,7 +284,7 @@ void BufferQueue::SetSurfaceBufferHebcMetaLocked(sptr<SurfaceBuffer> buffer)
 
     V2_0::BufferHandleAttrKey key = V2_0::BufferHandleAttrKey::ATTRKEY_REQUEST_ACCESS_TYPE;
     std::vector<uint8_t> values;
-    if (isCpuAccessable_) { // hebc is off
+    if (isCpuAccessable_.load()) { // hebc is off
         values.emplace_back(static_cast<uint8_t>(V2_0::HebcAccessType::HEBC_ACCESS_CPU_ACCESS));
     } else { // hebc is on
         values.emplace_back(static_cast<uint8_t>(V2_0::HebcAccessType::HEBC_ACCESS_HW_ONLY));
@@ -278,12 +293,6 @@ void BufferQueue::SetSurfaceBufferHebcMetaLocked(sptr<SurfaceBuffer> buffer)
     buffer->SetMetadata(key, values);
 }
 
-void BufferQueue::SetBatchHandle(bool batch)
-{
-    std::unique_lock<std::mutex> lock(mutex_);
-    isBatch_ = batch;
-}
-
 GSError BufferQueue::RequestBufferCheckStatus()
 {
     if (isBatch_) {
@@ -357,8 +366,11 @@ GSError BufferQueue::ReuseBufferForBlockMode(sptr<SurfaceBuffer> &buffer, sptr<B
     BufferRequestConfig &updateConfig, const BufferRequestConfig &config,
     struct IBufferProducer::RequestBufferReturnValue &retval, std::unique_lock<std::mutex> &lock)
 {
-    waitReqCon_.wait_for(lock, std::chrono::milliseconds(config.timeout),
+    auto waitStart = std::chrono::steady_clock::now();
+    requestWaiters_.WaitFor(lock, std::chrono::milliseconds(config.timeout),
         [this]() { return WaitForCondition(); });
+    depthController_.OnRequestWaited(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - waitStart).count());
     if (!GetStatusLocked() && !isBatch_) {
         SURFACE_TRACE_NAME_FMT("Status wrong, status: %d", GetStatusLocked());
         BLOGN_FAILURE_RET(GSERROR_NO_CONSUMER);
@@ -401,15 +413,15 @@ GSError BufferQueue::RequestBufferLocked(const BufferRequestConfig &config, sptr
 
     // check param
     BufferRequestConfig updateConfig = config;
-    updateConfig.usage |= defaultUsage_;
+    updateConfig.usage |= defaultUsage_.load();
     ret = CheckRequestConfig(updateConfig);
     if (ret != GSERROR_OK) {
         BLOGE("CheckRequestConfig ret: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, uniqueId_);
         return SURFACE_ERROR_UNKOWN;
     }
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
     SURFACE_TRACE_NAME_FMT("RequestBuffer name: %s queueId: %" PRIu64 " queueSize: %u reserveSlotNum: %u",
         name_.c_str(), uniqueId_, bufferQueueSize_, detachReserveSlotNum_);
+    depthController_.OnRequest(static_cast<uint32_t>(freeList_.size()));
     // dequeue from free list
     sptr<SurfaceBuffer>& buffer = retval.buffer;
     if (!(isPriorityAlloc_ && (GetUsedSize() < bufferQueueSize_ - detachReserveSlotNum_))
@@ -447,6 +459,29 @@ GSError BufferQueue::RequestBuffer(const BufferRequestConfig &config, sptr<Buffe
     return RequestBufferLocked(config, bedata, retval, lock);
 }
 
+GSError BufferQueue::RequestCachedBuffer(const BufferRequestConfig &config,
+    struct IBufferProducer::RequestBufferReturnValue &retval)
+{
+    if (GetDelegator() != nullptr) {
+        return GSERROR_NO_BUFFER;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    // deleting buffers and extra data only travel in a parcel
+    if (!deletingList_.empty()) {
+        return GSERROR_NO_BUFFER;
+    }
+    sptr<BufferExtraData> bedata = nullptr;
+    GSError ret = RequestBufferLocked(config, bedata, retval, lock, true);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (bedata != nullptr && !bedata->IsEmpty()) {
+        (void)CancelBufferLocked(retval.sequence, bedata);
+        return GSERROR_NO_BUFFER;
+    }
+    return GSERROR_OK;
+}
+
 GSError BufferQueue::SetProducerCacheCleanFlag(bool flag)
 {
     std::unique_lock<std::mutex> lock(mutex_);
@@ -463,7 +498,7 @@ GSError BufferQueue::SetProducerCacheCleanFlag(bool flag)
 
 GSError BufferQueue::SetProducerCacheCleanFlagLocked(bool flag, std::unique_lock<std::mutex> &lock)
 {
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
+    isAllocatingBufferCon_.wait(lock, [this]() { return allocatingBufferCount_ == 0; });
     producerCacheClean_ = flag;
     producerCacheList_.clear();
     return GSERROR_OK;
@@ -486,10 +521,17 @@ GSError BufferQueue::ReallocBufferLocked(const BufferRequestConfig &config,
     auto mapIter = bufferQueueCache_.find(retval.sequence);
     if (mapIter != bufferQueueCache_.end()) {
         isBufferNeedRealloc = mapIter->second.isBufferNeedRealloc;
-        if (isBufferNeedRealloc && mapIter->second.fence != nullptr) {
+        sptr<SyncFence> fence = ResolveReleaseFenceLocked(mapIter->second);
+        if (isBufferNeedRealloc && fence != nullptr) {
+            // wait outside mutex_ like AllocBuffer, cache deletes hold off on allocatingBufferCount_ meanwhile
+            allocatingBufferCount_++;
+            lock.unlock();
             // fence wait time 3000ms
-            int32_t ret = mapIter->second.fence->Wait(3000);
-            if (ret < 0 && mapIter->second.fence->Get() != -1) {
+            int32_t ret = fence->Wait(3000);
+            lock.lock();
+            allocatingBufferCount_--;
+            isAllocatingBufferCon_.notify_all();
+            if (ret < 0 && fence->Get() != -1) {
                 BLOGE("BufferQueue::ReallocBufferLocked WaitFence timeout 3000ms");
                 isBufferNeedRealloc = false;
             }
@@ -571,7 +613,7 @@ GSError BufferQueue::UpdateReuseBufferState(bool needRealloc, sptr<BufferExtraDa
     bool listenerSeqAndFence)
 {
     bufferQueueCache_[retval.sequence].state = BUFFER_STATE_REQUESTED;
-    retval.fence = bufferQueueCache_[retval.sequence].fence;
+    retval.fence = ResolveReleaseFenceLocked(bufferQueueCache_[retval.sequence]);
     bedata = retval.buffer->GetExtraData();
     SetSurfaceBufferHebcMetaLocked(retval.buffer);
     SetSurfaceBufferGlobalAlphaUnlocked(retval.buffer);
@@ -624,11 +666,15 @@ GSError BufferQueue::CancelBufferLocked(uint32_t sequence, sptr<BufferExtraData>
         BLOGE("cache buffer is nullptr, sequence:%{public}u, uniqueId: %{public}" PRIu64 ".", sequence, uniqueId_);
         return SURFACE_ERROR_UNKOWN;
     }
-    mapIter->second.buffer->SetExtraData(bedata);
+    if (bedata == nullptr || !bedata->IsUnchanged()) {
+        mapIter->second.buffer->SetExtraData(bedata);
+    }
     mapIter->second.requestedFromListenerClientPid = 0;
 
-    waitReqCon_.notify_all();
-    waitAttachCon_.notify_all();
+    requestWaiters_.NotifyOne();
+    if (attachWaiterCount_ > 0) {
+        waitAttachCon_.notify_all();
+    }
 
     return GSERROR_OK;
 }
@@ -825,7 +871,7 @@ GSError BufferQueue::ReleaseLastFlushedBuffer(uint32_t sequence)
         return SURFACE_ERROR_BUFFER_STATE_INVALID;
     }
     acquireLastFlushedBufSequence_ = INVALID_SEQUENCE;
-    waitReqCon_.notify_all();
+    requestWaiters_.NotifyOne();
     return GSERROR_OK;
 }
 
@@ -852,12 +898,18 @@ GSError BufferQueue::DoFlushBufferLocked(uint32_t sequence, sptr<BufferExtraData
         return GSERROR_OK;
     }
 
-    mapIter->second.buffer->SetExtraData(bedata);
+    // the producer may have changed the metadata while it held the buffer
+    mapIter->second.buffer->InvalidateMetadataCache();
+    // an unchanged marker means the buffer still has the extra data the producer got with it
+    if (bedata == nullptr || !bedata->IsUnchanged()) {
+        mapIter->second.buffer->SetExtraData(bedata);
+    }
     int32_t supportFastCompose = 0;
     mapIter->second.buffer->GetExtraData()->ExtraGet(
         BUFFER_SUPPORT_FASTCOMPOSE, supportFastCompose);
     bufferSupportFastCompose_ = (bool)supportFastCompose;
-    mapIter->second.buffer->SetSurfaceBufferTransform(transform_);
+    GraphicTransformType transform = transform_.load();
+    mapIter->second.buffer->SetSurfaceBufferTransform(transform);
     SetSingleBufferModeToBuffer(singleBufferMode_, mapIter->second.buffer);
 
     uint64_t usage = static_cast<uint32_t>(mapIter->second.config.usage);
@@ -873,13 +925,14 @@ GSError BufferQueue::DoFlushBufferLocked(uint32_t sequence, sptr<BufferExtraData
     // if failed, avoid to state rollback
     mapIter->second.state = BUFFER_STATE_FLUSHED;
     mapIter->second.fence = fence;
+    mapIter->second.releaseFences = nullptr;
     mapIter->second.damages = config.damages;
     mapIter->second.buffer->SetFlushTimestamp(std::chrono::duration_cast<std::chrono::nanoseconds>(
         std::chrono::steady_clock::now().time_since_epoch()).count());
     dirtyList_.push_back(sequence);
     lastFlusedSequence_ = sequence;
     lastFlusedFence_ = fence;
-    lastFlushedTransform_ = transform_;
+    lastFlushedTransform_ = transform;
     mapIter->second.requestedFromListenerClientPid = 0;
 
     SetDesiredPresentTimestampAndUiTimestamp(sequence, config.desiredPresentTimestamp, config.timestamp);
@@ -953,6 +1006,7 @@ GSError BufferQueue::AcquireBuffer(sptr<SurfaceBuffer> &buffer,
     SURFACE_TRACE_NAME_FMT("AcquireBuffer name: %s queueId: %" PRIu64, name_.c_str(), uniqueId_);
     // dequeue from dirty list
     std::lock_guard<std::mutex> lockGuard(mutex_);
+    depthController_.OnAcquire(static_cast<uint32_t>(dirtyList_.size()));
     GSError ret = PopFromDirtyListLocked(buffer);
     if (ret == GSERROR_OK) {
         uint32_t sequence = buffer->GetSeqNum();
@@ -987,7 +1041,7 @@ GSError BufferQueue::AcquireBuffer(IConsumerSurface::AcquireBufferReturnValue &r
     std::vector<BufferAndFence> dropBuffers;
     {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        std::list<uint32_t>::iterator frontSequence = dirtyList_.begin();
+        auto frontSequence = dirtyList_.begin();
         if (frontSequence == dirtyList_.end()) {
             LogAndTraceAllBufferInBufferQueueCacheLocked();
             return GSERROR_NO_BUFFER;
@@ -999,7 +1053,7 @@ GSError BufferQueue::AcquireBuffer(IConsumerSurface::AcquireBufferReturnValue &r
     dropBuffers.clear();
     {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        std::list<uint32_t>::iterator frontSequence = dirtyList_.begin();
+        auto frontSequence = dirtyList_.begin();
         if (frontSequence == dirtyList_.end()) {
             LogAndTraceAllBufferInBufferQueueCacheLocked();
             return GSERROR_NO_BUFFER;
@@ -1293,15 +1347,15 @@ GSError BufferQueue::ReleaseBufferLocked(sptr<SurfaceBuffer> &buffer, const sptr
 
     mapIter->second.state = BUFFER_STATE_RELEASED;
 
-    // merge surface buffer syncFence and releaseFence
-    auto surfaceBufferSyncFence = mapIter->second.buffer->GetSyncFence();
-    if (fence == nullptr) {
-        mapIter->second.fence = surfaceBufferSyncFence;
-    } else if (surfaceBufferSyncFence != nullptr && surfaceBufferSyncFence->IsValid()) {
-        mapIter->second.fence =
-            SyncFence::MergeFence("SurfaceReleaseFence", surfaceBufferSyncFence, fence);
+    // the surface buffer syncFence and releaseFence stay unmerged here, under mutex_. ResolveReleaseFenceLocked
+    // merges what is still pending once the buffer is handed out again, usually nothing by then
+    auto &element = mapIter->second;
+    element.releaseFences = element.buffer->GetSyncFences();
+    if (element.releaseFences != nullptr) {
+        element.releaseFences->Add(fence);
+        element.fence = nullptr;
     } else {
-        mapIter->second.fence = fence;
+        element.fence = fence == nullptr ? element.buffer->GetSyncFence() : fence;
     }
     mapIter->second.buffer->SetAndMergeSyncFence(nullptr);
     mapIter->second.buffer->SetSingleBufferMode(SingleBufferMode::SINGLE_BUFFER_MODE_NONE);
@@ -1314,11 +1368,25 @@ GSError BufferQueue::ReleaseBufferLocked(sptr<SurfaceBuffer> &buffer, const sptr
     } else {
         freeList_.push_back(sequence);
     }
-    waitReqCon_.notify_all();
-    waitAttachCon_.notify_all();
+    requestWaiters_.NotifyOne();
+    if (attachWaiterCount_ > 0) {
+        waitAttachCon_.notify_all();
+    }
+    uint32_t maxQueueSize = maxQueueSize_ != 0 ? maxQueueSize_ : SURFACE_MAX_QUEUE_SIZE;
+    ApplyQueueDepthDecisionLocked(depthController_.OnRelease(lastConsumeTime_, now, bufferQueueSize_, maxQueueSize),
+        lock);
     return GSERROR_OK;
 }
 
+const sptr<SyncFence> &BufferQueue::ResolveReleaseFenceLocked(BufferElement &element)
+{
+    if (element.releaseFences != nullptr) {
+        element.fence = element.releaseFences->Merge("SurfaceReleaseFence");
+        element.releaseFences = nullptr;
+    }
+    return element.fence;
+}
+
 GSError BufferQueue::AllocBuffer(sptr<SurfaceBuffer> &buffer, const sptr<SurfaceBuffer>& previousBuffer,
     const BufferRequestConfig &config, std::unique_lock<std::mutex> &lock)
 {
@@ -1330,17 +1398,39 @@ GSError BufferQueue::AllocBuffer(sptr<SurfaceBuffer> &buffer, const sptr<Surface
     ScalingMode scalingMode = scalingMode_;
     VideoDimType videoDimType = videoDimType_;
     int32_t connectedPid = connectedPid_;
-    isAllocatingBuffer_ = true;
+    bool isProtected = (config.usage & BUFFER_USAGE_PROTECTED) != 0;
+    allocatingBufferCount_++;
+    reservedSlotCount_++;
     lock.unlock();
-    GSError ret = bufferImpl->Alloc(config, previousBuffer);
+    // alloc, map and dma naming only touch bufferImpl, so other requests, acquire and release keep running meanwhile
+    // a recycled allocation is already mapped and named after this pid
+    bool isRecycled = previousBuffer == nullptr &&
+        BufferRecyclePool::GetInstance().Get(bufferImpl, config, connectedPid);
+    GSError ret = isRecycled ? GSERROR_OK : bufferImpl->Alloc(config, previousBuffer);
+    GSError mapRet = GSERROR_OK;
+    if (ret == GSERROR_OK && !isProtected && !isRecycled) {
+        mapRet = bufferImpl->Map();
+        BufferHandle* bufferHandle = bufferImpl->GetBufferHandle();
+        if (mapRet == GSERROR_OK && connectedPid != 0 && bufferHandle != nullptr) {
+            SURFACE_TRACE_NAME_FMT("AllocBuffer SetDMAName name: %s queueId: %" PRIu64 " connectedPid: %d",
+                name_.c_str(), uniqueId_, connectedPid);
+            ioctl(bufferHandle->fd, DMA_BUF_SET_NAME_A, std::to_string(connectedPid).c_str());
+        }
+    }
     lock.lock();
-    isAllocatingBuffer_ = false;
+    allocatingBufferCount_--;
+    reservedSlotCount_--;
     isAllocatingBufferCon_.notify_all();
     if (ret != GSERROR_OK) {
         BLOGE("Alloc failed, sequence:%{public}u, ret:%{public}d, uniqueId: %{public}" PRIu64 ".",
             sequence, ret, uniqueId_);
         return SURFACE_ERROR_UNKOWN;
     }
+    if (mapRet != GSERROR_OK) {
+        BLOGE("Map failed, seq:%{public}u, ret:%{public}d, uniqueId: %{public}" PRIu64 ".",
+            sequence, mapRet, uniqueId_);
+        return SURFACE_ERROR_UNKOWN;
+    }
 
     bufferImpl->SetSurfaceBufferScalingMode(scalingMode);
     bufferImpl->SetSurfaceBufferVideoDimensionType(videoDimType);
@@ -1352,30 +1442,15 @@ GSError BufferQueue::AllocBuffer(sptr<SurfaceBuffer> &buffer, const sptr<Surface
         .fence = SyncFence::InvalidFence(),
     };
 
-    if (config.usage & BUFFER_USAGE_PROTECTED) {
+    if (isProtected) {
         BLOGD("usage is BUFFER_USAGE_PROTECTED, uniqueId: %{public}" PRIu64 ".", uniqueId_);
-        bufferQueueCache_[sequence] = ele;
-        buffer = bufferImpl;
-        return SURFACE_ERROR_OK;
-    }
-
-    ret = bufferImpl->Map();
-    if (ret == GSERROR_OK) {
-        bufferQueueCache_[sequence] = ele;
-        buffer = bufferImpl;
-    } else {
-        BLOGE("Map failed, seq:%{public}u, ret:%{public}d, uniqueId: %{public}" PRIu64 ".",
-            sequence, ret, uniqueId_);
-        return SURFACE_ERROR_UNKOWN;
     }
-
-    BufferHandle* bufferHandle = bufferImpl->GetBufferHandle();
-    if (connectedPid != 0 && bufferHandle != nullptr) {
-        SURFACE_TRACE_NAME_FMT("AllocBuffer SetDMAName name: %s queueId: %" PRIu64 " connectedPid: %d",
-            name_.c_str(), uniqueId_, connectedPid);
-        ioctl(bufferHandle->fd, DMA_BUF_SET_NAME_A, std::to_string(connectedPid).c_str());
+    bufferQueueCache_[sequence] = ele;
+    LogCacheChangeLocked(sequence);
+    buffer = bufferImpl;
+    if (!isRecycled) {
+        SurfaceMemoryBudget::GetInstance().OnBufferAllocated(bufferImpl->GetSize());
     }
-
     return SURFACE_ERROR_OK;
 }
 
@@ -1395,6 +1470,21 @@ void BufferQueue::OnBufferDeleteForRS(uint32_t sequence)
     }
 }
 
+void BufferQueue::RecycleBufferLocked(const BufferElement &element)
+{
+    // only free buffers, a requested buffer may still be written by the producer
+    if (element.state != BUFFER_STATE_RELEASED) {
+        return;
+    }
+    if (element.releaseFences != nullptr && element.releaseFences->GetStatus() != SIGNALED) {
+        return;
+    }
+    if (element.fence != nullptr && element.fence->IsValid() && element.fence->GetStatus() != SIGNALED) {
+        return;
+    }
+    BufferRecyclePool::GetInstance().Put(element.buffer, element.config, connectedPid_);
+}
+
 void BufferQueue::DeleteFreeListCacheLocked(uint32_t sequence)
 {
     for (auto iter = freeList_.begin(); iter != freeList_.end(); ++iter) {
@@ -1413,11 +1503,14 @@ void BufferQueue::DeleteBufferInCacheNoWaitForAllocatingState(uint32_t sequence)
             it->second.isPreAllocBuffer, sequence, uniqueId_);
         if (it->second.isPreAllocBuffer) {
             bufferQueueCache_.erase(it);
+            LogCacheChangeLocked(sequence);
             DeleteFreeListCacheLocked(sequence);
             return;
         }
         OnBufferDeleteForRS(sequence);
+        RecycleBufferLocked(it->second);
         bufferQueueCache_.erase(it);
+        LogCacheChangeLocked(sequence);
         DeleteFreeListCacheLocked(sequence);
         deletingList_.push_back(sequence);
     }
@@ -1425,7 +1518,7 @@ void BufferQueue::DeleteBufferInCacheNoWaitForAllocatingState(uint32_t sequence)
 
 void BufferQueue::DeleteBufferInCache(uint32_t sequence, std::unique_lock<std::mutex> &lock)
 {
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
+    isAllocatingBufferCon_.wait(lock, [this]() { return allocatingBufferCount_ == 0; });
     DeleteBufferInCacheNoWaitForAllocatingState(sequence);
 }
 
@@ -1442,7 +1535,7 @@ void BufferQueue::DeleteBuffersLocked(int32_t count, std::unique_lock<std::mutex
         return;
     }
 
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
+    isAllocatingBufferCon_.wait(lock, [this]() { return allocatingBufferCount_ == 0; });
     while (!freeList_.empty()) {
         uint32_t seq = freeList_.front();
         DeleteBufferInCacheNoWaitForAllocatingState(seq);
@@ -1473,14 +1566,16 @@ void BufferQueue::DeleteBuffersLocked(int32_t count, std::unique_lock<std::mutex
 }
 
 GSError BufferQueue::AttachBufferUpdateStatus(std::unique_lock<std::mutex> &lock, uint32_t sequence,
-    int32_t timeOut, std::map<uint32_t, BufferElement>::iterator &mapIter)
+    int32_t timeOut, BufferElementTable::iterator &mapIter)
 {
     BufferState state = mapIter->second.state;
     if (state == BUFFER_STATE_RELEASED) {
         mapIter->second.state = BUFFER_STATE_ATTACHED;
     } else {
+        attachWaiterCount_++;
         waitAttachCon_.wait_for(lock, std::chrono::milliseconds(timeOut),
             [&mapIter]() { return (mapIter->second.state == BUFFER_STATE_RELEASED); });
+        attachWaiterCount_--;
         if (mapIter->second.state == BUFFER_STATE_RELEASED) {
             mapIter->second.state = BUFFER_STATE_ATTACHED;
         } else {
@@ -1514,6 +1609,7 @@ void BufferQueue::CleanProducerBySeqNum(const std::vector<uint32_t>& seqNums)
             dirtyList_.remove(*it);
             SURFACE_TRACE_NAME_FMT("CleanProducerBySeqNum: SeqNum=%u", *it);
             bufferQueueCache_.erase(mapIter);
+            LogCacheChangeLocked(*it);
         }
     }
 }
@@ -1559,6 +1655,7 @@ GSError BufferQueue::AttachBufferToQueueLocked(sptr<SurfaceBuffer> buffer, Invok
     }
     AttachBufferUpdateBufferInfo(buffer, needMap);
     bufferQueueCache_[sequence] = ele;
+    LogCacheChangeLocked(sequence);
     return GSERROR_OK;
 }
 
@@ -1587,6 +1684,7 @@ GSError BufferQueue::DetachBufferFromQueueLocked(uint32_t sequence, InvokerType
         }
         OnBufferDeleteForRS(sequence);
         bufferQueueCache_.erase(sequence);
+        LogCacheChangeLocked(sequence);
     } else {
         if (mapIter->second.state != BUFFER_STATE_ACQUIRED) {
             BLOGE("seq: %{public}u, state: %{public}d, uniqueId: %{public}" PRIu64 ".",
@@ -1662,12 +1760,14 @@ GSError BufferQueue::AttachBuffer(sptr<SurfaceBuffer> &buffer, int32_t timeOut)
         if (freeSize >= usedSize - queueSize + 1) {
             DeleteBuffersLocked(usedSize - queueSize + 1, lock);
             bufferQueueCache_[sequence] = ele;
+            LogCacheChangeLocked(sequence);
             return GSERROR_OK;
         } else {
             BLOGN_FAILURE_RET(GSERROR_OUT_OF_RANGE);
         }
     } else {
         bufferQueueCache_[sequence] = ele;
+        LogCacheChangeLocked(sequence);
         return GSERROR_OK;
     }
 }
@@ -1697,6 +1797,7 @@ GSError BufferQueue::DetachBuffer(sptr<SurfaceBuffer> &buffer)
     }
     OnBufferDeleteForRS(sequence);
     bufferQueueCache_.erase(sequence);
+    LogCacheChangeLocked(sequence);
     return GSERROR_OK;
 }
 
@@ -1737,19 +1838,72 @@ GSError BufferQueue::SetQueueSizeLocked(uint32_t queueSize, std::unique_lock<std
             queueSize, detachReserveSlotNum_, uniqueId_);
         return GSERROR_INVALID_ARGUMENTS;
     }
+    isDepthShrinkDeferred_ = false;
     if (bufferQueueSize_ > queueSize) {
         DeleteBuffersLocked(bufferQueueSize_ - queueSize, lock);
     }
     // if increase the queue size, try to wakeup the blocked thread
     if (queueSize > bufferQueueSize_) {
         bufferQueueSize_ = queueSize;
-        waitReqCon_.notify_all();
+        requestWaiters_.NotifyAll();
     } else {
         bufferQueueSize_ = queueSize;
     }
     return GSERROR_OK;
 }
 
+void BufferQueue::ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision decision,
+    std::unique_lock<std::mutex> &lock)
+{
+    if (decision == BufferQueueDepthController::Decision::KEEP && isDepthShrinkDeferred_) {
+        decision = BufferQueueDepthController::Decision::SHRINK;
+    }
+    isDepthShrinkDeferred_ = false;
+    if (decision == BufferQueueDepthController::Decision::KEEP) {
+        return;
+    }
+    // deleting buffers waits for running allocations, a release must not wait for a producer's allocation
+    if (decision == BufferQueueDepthController::Decision::SHRINK && allocatingBufferCount_ > 0) {
+        isDepthShrinkDeferred_ = true;
+        return;
+    }
+    uint32_t queueSize = decision == BufferQueueDepthController::Decision::GROW ?
+        bufferQueueSize_ + 1 : bufferQueueSize_ - 1;
+    SURFACE_TRACE_NAME_FMT("AutoQueueSize %s name: %s queueId: %" PRIu64 " queueSize: %u -> %u",
+        BufferQueueDepthController::DecisionStr(decision), name_.c_str(), uniqueId_, bufferQueueSize_, queueSize);
+    BLOGD("AutoQueueSize %{public}s queueSize: %{public}u -> %{public}u, uniqueId: %{public}" PRIu64 ".",
+        BufferQueueDepthController::DecisionStr(decision), bufferQueueSize_, queueSize, uniqueId_);
+    if (decision == BufferQueueDepthController::Decision::GROW) {
+        bufferQueueSize_ = queueSize;
+        requestWaiters_.NotifyAll();
+        return;
+    }
+    // slots that were never allocated go without freeing anything
+    if (GetUsedSize() > queueSize) {
+        DeleteBuffersLocked(static_cast<int32_t>(GetUsedSize() - queueSize), lock);
+    }
+    bufferQueueSize_ = queueSize;
+}
+
+GSError BufferQueue::SetAutoQueueSize(bool enabled, uint32_t minQueueSize)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!enabled) {
+        depthController_.Disable();
+        isDepthShrinkDeferred_ = false;
+        return GSERROR_OK;
+    }
+    if (minQueueSize == 0 || minQueueSize > SURFACE_MAX_QUEUE_SIZE || minQueueSize <= detachReserveSlotNum_) {
+        BLOGW("invalid minQueueSize: %{public}u, uniqueId: %{public}" PRIu64 ".", minQueueSize, uniqueId_);
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    depthController_.Enable(minQueueSize);
+    if (bufferQueueSize_ < minQueueSize) {
+        return SetQueueSizeLocked(minQueueSize, lock);
+    }
+    return GSERROR_OK;
+}
+
 GSError BufferQueue::SetQueueSize(uint32_t queueSize)
 {
     if (queueSize == 0 || queueSize > SURFACE_MAX_QUEUE_SIZE) {
@@ -1895,35 +2049,32 @@ GSError BufferQueue::SetDefaultWidthAndHeight(int32_t width, int32_t height)
         BLOGW("height is %{public}d, uniqueId: %{public}" PRIu64 ".", height, uniqueId_);
         return GSERROR_INVALID_ARGUMENTS;
     }
+    // setters keep mutex_ so GetProducerInitInfo never sees a width from one call and a height from another
     std::lock_guard<std::mutex> lockGuard(mutex_);
-    defaultWidth_ = width;
-    defaultHeight_ = height;
+    defaultWidth_.store(width);
+    defaultHeight_.store(height);
     return GSERROR_OK;
 }
 
 int32_t BufferQueue::GetDefaultWidth()
 {
-    std::lock_guard<std::mutex> lockGuard(mutex_);
-    return defaultWidth_;
+    return defaultWidth_.load();
 }
 
 int32_t BufferQueue::GetDefaultHeight()
 {
-    std::lock_guard<std::mutex> lockGuard(mutex_);
-    return defaultHeight_;
+    return defaultHeight_.load();
 }
 
 GSError BufferQueue::SetDefaultUsage(uint64_t usage)
 {
-    std::lock_guard<std::mutex> lockGuard(mutex_);
-    defaultUsage_ = usage;
+    defaultUsage_.store(usage);
     return GSERROR_OK;
 }
 
 uint64_t BufferQueue::GetDefaultUsage()
 {
-    std::lock_guard<std::mutex> lockGuard(mutex_);
-    return defaultUsage_;
+    return defaultUsage_.load();
 }
 
 void BufferQueue::OnCleanCacheForBufferInfoMapLocked(sptr<IBufferConsumerListener> listener)
@@ -1935,7 +2086,7 @@ void BufferQueue::OnCleanCacheForBufferInfoMapLocked(sptr<IBufferConsumerListene
     for (auto &[id, element] : bufferQueueCache_) {
         CleanCacheBufferInfo info;
         info.buffer = element.buffer;
-        info.fence = element.fence;
+        info.fence = ResolveReleaseFenceLocked(element);
         info.isAcquired = (element.state == BUFFER_STATE_ACQUIRED);
         bufferInfoMap_.push_back(info);
     }
@@ -1943,11 +2094,17 @@ void BufferQueue::OnCleanCacheForBufferInfoMapLocked(sptr<IBufferConsumerListene
 
 void BufferQueue::ClearLocked(std::unique_lock<std::mutex> &lock, sptr<IBufferConsumerListener> listener)
 {
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
+    isAllocatingBufferCon_.wait(lock, [this]() { return allocatingBufferCount_ == 0; });
     for (auto &[id, _] : bufferQueueCache_) {
         OnBufferDeleteForRS(id);
     }
     OnCleanCacheForBufferInfoMapLocked(listener);
+    // after the listener took its references, buffers it still holds are not recycled
+    for (auto &[sequence, element] : bufferQueueCache_) {
+        RecycleBufferLocked(element);
+        LogCacheChangeLocked(sequence);
+    }
+    preAllocGeneration_++;
     bufferQueueCache_.clear();
     freeList_.clear();
     dirtyList_.clear();
@@ -1972,7 +2129,7 @@ GSError BufferQueue::GoBackground()
     }
     std::unique_lock<std::mutex> lock(mutex_);
     ClearLocked(lock);
-    waitReqCon_.notify_all();
+    requestWaiters_.NotifyAll();
     SetProducerCacheCleanFlagLocked(false, lock);
     return GSERROR_OK;
 }
@@ -2009,7 +2166,7 @@ GSError BufferQueue::CleanCache(bool cleanAll, uint32_t *bufSeqNum)
             MarkBufferReclaimableByIdLocked(*bufSeqNum);
         }
         ClearLocked(lock);
-        waitReqCon_.notify_all();
+        requestWaiters_.NotifyAll();
     }
     if (listener && !bufferInfoMap_.empty()) {
         BLOGE("cleancachetest call OnCleanCacheForBufferInfoMap, name=%{public}s", name_.c_str());
@@ -2023,7 +2180,7 @@ GSError BufferQueue::OnConsumerDied()
 {
     std::unique_lock<std::mutex> lock(mutex_);
     ClearLocked(lock);
-    waitReqCon_.notify_all();
+    requestWaiters_.NotifyAll();
     return GSERROR_OK;
 }
 
@@ -2040,19 +2197,13 @@ GSError BufferQueue::IsSurfaceBufferInCache(uint32_t seqNum, bool &isInCache)
 
 uint64_t BufferQueue::GetUniqueId() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
     return uniqueId_;
 }
 
 GSError BufferQueue::SetTransform(GraphicTransformType transform)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (transform_ == transform) {
-            return GSERROR_OK;
-        }
-
-        transform_ = transform;
+    if (transform_.exchange(transform) == transform) {
+        return GSERROR_OK;
     }
     sptr<IBufferConsumerListener> listener;
     IBufferConsumerListenerClazz *listenerClazz;
@@ -2073,19 +2224,13 @@ GSError BufferQueue::SetTransform(GraphicTransformType transform)
 
 GraphicTransformType BufferQueue::GetTransform() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return transform_;
+    return transform_.load();
 }
 
 GSError BufferQueue::SetTransformHint(GraphicTransformType transformHint, uint64_t producerId)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        if (transformHint_ != transformHint) {
-            transformHint_ = transformHint;
-        } else {
-            return GSERROR_OK;
-        }
+    if (transformHint_.exchange(transformHint) == transformHint) {
+        return GSERROR_OK;
     }
 
     std::map<uint64_t, sptr<IProducerListener>> propertyListeners;
@@ -2113,8 +2258,7 @@ GSError BufferQueue::SetTransformHint(GraphicTransformType transformHint, uint64
 
 GraphicTransformType BufferQueue::GetTransformHint() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return transformHint_;
+    return transformHint_.load();
 }
 
 GSError BufferQueue::SetSurfaceSourceType(OHSurfaceSource sourceType)
@@ -2132,28 +2276,24 @@ OHSurfaceSource BufferQueue::GetSurfaceSourceType() const
 
 GSError BufferQueue::SetHdrWhitePointBrightness(float brightness)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    hdrWhitePointBrightness_ = brightness;
+    hdrWhitePointBrightness_.store(brightness);
     return GSERROR_OK;
 }
 
 GSError BufferQueue::SetSdrWhitePointBrightness(float brightness)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    sdrWhitePointBrightness_ = brightness;
+    sdrWhitePointBrightness_.store(brightness);
     return GSERROR_OK;
 }
 
 float BufferQueue::GetHdrWhitePointBrightness() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return hdrWhitePointBrightness_;
+    return hdrWhitePointBrightness_.load();
 }
 
 float BufferQueue::GetSdrWhitePointBrightness() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return sdrWhitePointBrightness_;
+    return sdrWhitePointBrightness_.load();
 }
 
 GSError BufferQueue::SetSurfaceAppFrameworkType(std::string appFrameworkType)
@@ -2177,8 +2317,7 @@ std::string BufferQueue::GetSurfaceAppFrameworkType() const
 
 GSError BufferQueue::SetBufferHold(bool hold)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    isBufferHold_ = hold;
+    isBufferHold_.store(hold);
     return GSERROR_OK;
 }
 
@@ -2628,7 +2767,6 @@ void BufferQueue::Dump(std::string &result)
     uint64_t totalBufferListSize = 0;
     double memSizeInKB = 0;
 
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
     for (auto it = bufferQueueCache_.begin(); it != bufferQueueCache_.end(); it++) {
         BufferElement element = it->second;
         if (element.buffer != nullptr) {
@@ -2656,7 +2794,8 @@ void BufferQueue::Dump(std::string &result)
     ss << memSizeInKB;
     std::string str = ss.str();
     result.append("\nBufferQueue:\n");
-    result += "      default-size = [" + std::to_string(defaultWidth_) + "x" + std::to_string(defaultHeight_) + "]" +
+    result += "      default-size = [" + std::to_string(defaultWidth_.load()) + "x" +
+        std::to_string(defaultHeight_.load()) + "]" +
         ", FIFO = " + std::to_string(bufferQueueSize_) +
         ", name = " + name_ +
         ", uniqueId = " + std::to_string(uniqueId_) +
@@ -2664,10 +2803,24 @@ void BufferQueue::Dump(std::string &result)
         ", freeBufferListLen = " + std::to_string(freeList_.size()) +
         ", dirtyBufferListLen = " + std::to_string(dirtyList_.size()) +
         ", totalBuffersMemSize = " + str + "(KiB)" +
-        ", hdrWhitePointBrightness = " + std::to_string(hdrWhitePointBrightness_) +
-        ", sdrWhitePointBrightness = " + std::to_string(sdrWhitePointBrightness_) +
-        ", lockLastFlushedBuffer seq = " + std::to_string(acquireLastFlushedBufSequence_) + "\n";
-
+        ", hdrWhitePointBrightness = " + std::to_string(hdrWhitePointBrightness_.load()) +
+        ", sdrWhitePointBrightness = " + std::to_string(sdrWhitePointBrightness_.load()) +
+        ", lockLastFlushedBuffer seq = " + std::to_string(acquireLastFlushedBufSequence_) +
+        ", reallocAvoided = " + std::to_string(reallocAvoidedCount_) +
+        ", reallocFallback = " + std::to_string(reallocFallbackCount_) + "\n";
+
+    result.append("      requestWaiters: ");
+    requestWaiters_.Dump(result);
+    result.append("\n");
+    result.append("      recyclePool: ");
+    BufferRecyclePool::GetInstance().Dump(result);
+    result.append("\n");
+    result.append("      memoryBudget: ");
+    SurfaceMemoryBudget::GetInstance().Dump(result);
+    result.append("\n");
+    result.append("      autoQueueSize: ");
+    depthController_.Dump(result);
+    result.append("\n");
     result.append("      bufferQueueCache:\n");
     DumpCache(result);
 }
@@ -2711,7 +2864,7 @@ void BufferQueue::SetStatus(bool status)
 {
     std::lock_guard<std::mutex> lockGuard(mutex_);
     isValidStatus_ = status;
-    waitReqCon_.notify_all();
+    requestWaiters_.NotifyAll();
 }
 
 uint32_t BufferQueue::GetAvailableBufferCount()
@@ -2794,10 +2947,119 @@ GSError BufferQueue::AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, sptr<Buff
                 }
             }
             bufferQueueCache_.erase(sequence);
+            LogCacheChangeLocked(sequence);
+            return ret;
+        }
+    }
+    CallConsumerListener();
+    return ret;
+}
+
+GSError BufferQueue::FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata, sptr<SyncFence> fence,
+    const BufferFlushConfigWithDamages &flushConfig, const BufferRequestConfig &requestConfig,
+    sptr<BufferExtraData> &requestBedata, struct IBufferProducer::RequestBufferReturnValue &retval,
+    GSError &requestRet)
+{
+    SURFACE_TRACE_NAME_FMT("FlushAndRequestBuffer name: %s queueId: %" PRIu64 " sequence: %u",
+        name_.c_str(), uniqueId_, sequence);
+    if (GetDelegator() != nullptr) {
+        GSError ret = FlushBuffer(sequence, bedata, fence, flushConfig);
+        if (ret == GSERROR_OK) {
+            requestRet = RequestBuffer(requestConfig, requestBedata, retval);
+        }
+        return ret;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        GSError ret = FlushBufferImprovedLocked(sequence, bedata, fence, flushConfig, lock);
+        if (ret != GSERROR_OK) {
+            if (ret == SURFACE_ERROR_CONSUMER_UNREGISTER_LISTENER) {
+                (void)CancelBufferLocked(sequence, bedata);
+            }
             return ret;
         }
+        // the consumer is only told about the flush after the lock is dropped, so the request must not wait here.
+        // like a request from the release listener it only pops the free list, GSERROR_NO_BUFFER tells the
+        // client to fall back to a normal request. a listener mode request that bails after taking the deleting
+        // buffers would lose them, so pending deletes go through the normal request too
+        if (!deletingList_.empty()) {
+            requestRet = GSERROR_NO_BUFFER;
+        } else {
+            requestRet = RequestBufferLocked(requestConfig, requestBedata, retval, lock, true);
+        }
     }
     CallConsumerListener();
+    return GSERROR_OK;
+}
+
+GSError BufferQueue::RequestBuffers(const BufferRequestConfig &config, std::vector<sptr<BufferExtraData>> &bedata,
+    std::vector<struct IBufferProducer::RequestBufferReturnValue> &retvalues)
+{
+    SURFACE_TRACE_NAME_FMT("RequestBuffers name: %s queueId: %" PRIu64 " count: %zu",
+        name_.c_str(), uniqueId_, retvalues.size());
+    if (bedata.size() < retvalues.size()) {
+        retvalues.clear();
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    GSError ret = GSERROR_OK;
+    if (GetDelegator() != nullptr) {
+        for (size_t i = 0; i < retvalues.size(); ++i) {
+            ret = RequestBuffer(config, bedata[i], retvalues[i]);
+            if (ret != GSERROR_OK) {
+                retvalues.resize(i);
+                break;
+            }
+        }
+        return ret;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    isBatch_ = true;
+    for (size_t i = 0; i < retvalues.size(); ++i) {
+        ret = RequestBufferLocked(config, bedata[i], retvalues[i], lock);
+        if (ret != GSERROR_OK) {
+            retvalues.resize(i);
+            break;
+        }
+    }
+    isBatch_ = false;
+    return ret;
+}
+
+GSError BufferQueue::FlushBuffers(const std::vector<uint32_t> &sequences,
+    const std::vector<sptr<BufferExtraData>> &bedata, const std::vector<sptr<SyncFence>> &fences,
+    const std::vector<BufferFlushConfigWithDamages> &configs)
+{
+    SURFACE_TRACE_NAME_FMT("FlushBuffers name: %s queueId: %" PRIu64 " count: %zu",
+        name_.c_str(), uniqueId_, sequences.size());
+    if (bedata.size() < sequences.size() || fences.size() < sequences.size() || configs.size() < sequences.size()) {
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    GSError ret = GSERROR_OK;
+    if (GetDelegator() != nullptr) {
+        for (size_t i = 0; i < sequences.size() && ret == GSERROR_OK; ++i) {
+            ret = FlushBuffer(sequences[i], bedata[i], fences[i], configs[i]);
+        }
+        return ret;
+    }
+    size_t flushedCount = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (; flushedCount < sequences.size(); ++flushedCount) {
+            sptr<BufferExtraData> data = bedata[flushedCount];
+            ret = FlushBufferImprovedLocked(sequences[flushedCount], data, fences[flushedCount],
+                configs[flushedCount], lock);
+            if (ret != GSERROR_OK) {
+                if (ret == SURFACE_ERROR_CONSUMER_UNREGISTER_LISTENER) {
+                    (void)CancelBufferLocked(sequences[flushedCount], data);
+                }
+                break;
+            }
+        }
+    }
+    // one notification per buffer, as if each had been flushed on its own
+    for (size_t i = 0; i < flushedCount; ++i) {
+        CallConsumerListener();
+    }
     return ret;
 }
 
@@ -2822,7 +3084,7 @@ GSError BufferQueue::GetLastFlushedDesiredPresentTimeStamp(int64_t &lastFlushedD
 GSError BufferQueue::GetFrontDesiredPresentTimeStamp(int64_t &desiredPresentTimeStamp, bool &isAutoTimeStamp)
 {
     std::lock_guard<std::mutex> lockGuard(mutex_);
-    std::list<uint32_t>::iterator frontSequence = dirtyList_.begin();
+    auto frontSequence = dirtyList_.begin();
     if (frontSequence == dirtyList_.end()) {
         return GSERROR_NO_BUFFER;
     }
@@ -2896,23 +3158,55 @@ GSError BufferQueue::SetFixedRotation(int32_t fixedRotation)
     return GSERROR_OK;
 }
 
-void BufferQueue::AllocBuffers(const BufferRequestConfig &config, uint32_t allocBufferCount,
-    std::map<uint32_t, sptr<SurfaceBuffer>> &surfaceBufferCache)
+GSError BufferQueue::PreAllocBufferTask(const BufferRequestConfig &config, uint64_t generation)
 {
-    SURFACE_TRACE_NAME_FMT("AllocBuffers allocBufferCount %u width %d height %d format %d usage %" PRIu64 "",
-        allocBufferCount, config.width, config.height, config.format, config.usage);
-    for (uint32_t i = 0; i < allocBufferCount; i++) {
-        sptr<SurfaceBuffer> bufferImpl = new SurfaceBufferImpl();
-        uint32_t sequence = bufferImpl->GetSeqNum();
-
-        GSError ret = bufferImpl->Alloc(config);
+    sptr<SurfaceBuffer> bufferImpl = nullptr;
+    GSError ret = GSERROR_OK;
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        if (generation != preAllocGeneration_) {
+            ret = GSERROR_NO_BUFFER;
+        }
+    }
+    if (ret == GSERROR_OK) {
+        bufferImpl = new SurfaceBufferImpl();
+        SURFACE_TRACE_NAME_FMT("PreAllocBuffer width %d height %d format %d usage %" PRIu64 " id: %u",
+            config.width, config.height, config.format, config.usage, bufferImpl->GetSeqNum());
+        ret = bufferImpl->Alloc(config);
         if (ret != GSERROR_OK) {
             BLOGE("Alloc failed, sequence:%{public}u, ret:%{public}d, uniqueId: %{public}" PRIu64 ".",
-                sequence, ret, uniqueId_);
-            continue;
+                bufferImpl->GetSeqNum(), ret, uniqueId_);
         }
-        surfaceBufferCache[sequence] = bufferImpl;
     }
+
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    reservedSlotCount_--;
+    if (ret == GSERROR_OK && generation != preAllocGeneration_) {
+        ret = GSERROR_NO_BUFFER;
+    } else if (ret == GSERROR_OK && bufferQueueCache_.size() >= bufferQueueSize_ - detachReserveSlotNum_) {
+        BLOGW("CacheSize: %{public}zu, QueueSize: %{public}u, queId: %{public}" PRIu64,
+            bufferQueueCache_.size(), bufferQueueSize_, uniqueId_);
+        ret = SURFACE_ERROR_BUFFER_QUEUE_FULL;
+    } else if (ret == GSERROR_OK) {
+        uint32_t sequence = bufferImpl->GetSeqNum();
+        BufferElement ele = {
+            .buffer = bufferImpl,
+            .state = BUFFER_STATE_RELEASED,
+            .isDeleting = false,
+            .config = config,
+            .fence = SyncFence::InvalidFence(),
+            .isPreAllocBuffer = true,
+        };
+        bufferQueueCache_[sequence] = ele;
+        LogCacheChangeLocked(sequence);
+        freeList_.push_back(sequence);
+        SurfaceMemoryBudget::GetInstance().OnBufferAllocated(bufferImpl->GetSize());
+    }
+    // either a free buffer or a reserved slot just became available to a blocked requester
+    requestWaiters_.NotifyOne();
+    preAllocPendingCount_--;
+    isAllocatingBufferCon_.notify_all();
+    return ret;
 }
 
 GSError BufferQueue::PreAllocBuffers(const BufferRequestConfig &config, uint32_t allocBufferCount)
@@ -2922,45 +3216,99 @@ GSError BufferQueue::PreAllocBuffers(const BufferRequestConfig &config, uint32_t
         return GSERROR_INVALID_ARGUMENTS;
     }
     BufferRequestConfig updateConfig = config;
+    uint64_t generation = 0;
     {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        SURFACE_TRACE_NAME_FMT("PreAllocBuffers bufferQueueSize %u cacheSize %u allocBufferCount %u usage%" PRIu64 "",
-            bufferQueueSize_, bufferQueueCache_.size(), allocBufferCount, config.usage);
-        if (allocBufferCount > bufferQueueSize_ - detachReserveSlotNum_ - bufferQueueCache_.size()) {
-            allocBufferCount = bufferQueueSize_ - detachReserveSlotNum_ - bufferQueueCache_.size();
-        }
-        updateConfig.usage |= defaultUsage_;
+        uint32_t usedSize = GetUsedSize();
+        SURFACE_TRACE_NAME_FMT("PreAllocBuffers bufferQueueSize %u usedSize %u allocBufferCount %u usage%" PRIu64 "",
+            bufferQueueSize_, usedSize, allocBufferCount, config.usage);
+        uint32_t maxSize = bufferQueueSize_ - detachReserveSlotNum_;
+        allocBufferCount = std::min(allocBufferCount, maxSize > usedSize ? maxSize - usedSize : 0);
+        updateConfig.usage |= defaultUsage_.load();
+        // the slots are taken now, so requests arriving before the buffers are ready wait for them
+        reservedSlotCount_ += allocBufferCount;
+        preAllocPendingCount_ += allocBufferCount;
+        generation = preAllocGeneration_;
     }
     if (allocBufferCount == 0) {
         return SURFACE_ERROR_BUFFER_QUEUE_FULL;
     }
 
-    std::map<uint32_t, sptr<SurfaceBuffer>> surfaceBufferCache;
-    AllocBuffers(updateConfig, allocBufferCount, surfaceBufferCache);
-    {
-        std::lock_guard<std::mutex> lockGuard(mutex_);
-        for (auto iter = surfaceBufferCache.begin(); iter != surfaceBufferCache.end(); ++iter) {
-            if (bufferQueueCache_.size() >= bufferQueueSize_ - detachReserveSlotNum_) {
-                BLOGW("CacheSize: %{public}zu, QueueSize: %{public}u, allocBufferCount: %{public}zu,"
-                   " queId: %{public}" PRIu64, bufferQueueCache_.size(), bufferQueueSize_,
-                   surfaceBufferCache.size(), uniqueId_);
-                return SURFACE_ERROR_BUFFER_QUEUE_FULL;
+    // the caller only queues the work, buffers reach the free list as each allocation completes.
+    // a task that runs after the queue is gone has nothing to fill and is dropped
+    wptr<BufferQueue> weakQueue = this;
+    for (uint32_t i = 0; i < allocBufferCount; i++) {
+        BufferAllocWorker::GetInstance().Post([weakQueue, updateConfig, generation]() {
+            sptr<BufferQueue> queue = weakQueue.promote();
+            if (queue == nullptr) {
+                return GSERROR_NO_BUFFER;
             }
-            BufferElement ele = {
-                .buffer = iter->second,
-                .state = BUFFER_STATE_RELEASED,
-                .isDeleting = false,
-                .config = updateConfig,
-                .fence = SyncFence::InvalidFence(),
-                .isPreAllocBuffer = true,
-            };
-            bufferQueueCache_[iter->first] = ele;
-            freeList_.push_back(iter->first);
-        }
+            return queue->PreAllocBufferTask(updateConfig, generation);
+        });
     }
     return GSERROR_OK;
 }
 
+void BufferQueue::CollectMemoryUsage(SurfaceMemoryBudget::QueueUsage &usage,
+    std::vector<SurfaceMemoryBudget::ReclaimCandidate> &candidates)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    usage.uniqueId = uniqueId_;
+    usage.name = name_;
+    usage.bytes = 0;
+    usage.bufferCount = static_cast<uint32_t>(bufferQueueCache_.size());
+    usage.lastActiveTime = 0;
+    size_t firstCandidate = candidates.size();
+    for (auto &[sequence, element] : bufferQueueCache_) {
+        if (element.buffer == nullptr) {
+            continue;
+        }
+        usage.bytes += element.buffer->GetSize();
+        usage.lastActiveTime = std::max(usage.lastActiveTime, element.lastAcquireTime);
+        // the last flushed buffer handed out by AcquireLastFlushedBuffer is held by that client until it is released
+        if (element.state != BUFFER_STATE_RELEASED || element.isDeleting ||
+            sequence == acquireLastFlushedBufSequence_) {
+            continue;
+        }
+        SurfaceMemoryBudget::ReclaimCandidate candidate = {
+            .queue = this,
+            .sequence = sequence,
+            .size = element.buffer->GetSize(),
+            .lastAcquireTime = element.lastAcquireTime,
+            .isLastFrame = sequence == lastFlusedSequence_,
+        };
+        candidates.push_back(candidate);
+    }
+    for (size_t i = firstCandidate; i < candidates.size(); i++) {
+        candidates[i].queueLastActiveTime = usage.lastActiveTime;
+    }
+}
+
+uint32_t BufferQueue::ReclaimFreeBuffer(uint32_t sequence)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    auto it = bufferQueueCache_.find(sequence);
+    // the budget never waits for allocations, it skips the queue instead. the last flushed buffer may have been
+    // acquired since the candidates were collected
+    if (it == bufferQueueCache_.end() || it->second.state != BUFFER_STATE_RELEASED || it->second.buffer == nullptr ||
+        allocatingBufferCount_ > 0 || sequence == acquireLastFlushedBufSequence_) {
+        return 0;
+    }
+    uint32_t size = it->second.buffer->GetSize();
+    SURFACE_TRACE_NAME_FMT("ReclaimFreeBuffer name: %s queueId: %" PRIu64 " seq: %u size: %u",
+        name_.c_str(), uniqueId_, sequence, size);
+    bool isPreAllocBuffer = it->second.isPreAllocBuffer;
+    OnBufferDeleteForRS(sequence);
+    bufferQueueCache_.erase(it);
+    LogCacheChangeLocked(sequence);
+    DeleteFreeListCacheLocked(sequence);
+    if (!isPreAllocBuffer) {
+        deletingList_.push_back(sequence);
+    }
+    requestWaiters_.NotifyOne();
+    return size;
+}
+
 void BufferQueue::MarkBufferReclaimableByIdLocked(uint32_t sequence)
 {
     auto it = bufferQueueCache_.find(sequence);
@@ -3076,7 +3424,7 @@ void BufferQueue::SetLppBufferConfig(sptr<SurfaceBuffer> &buffer, std::vector<Re
     if (MetadataHelper::ConvertMetadataToVec(crop, cropRect) == GSERROR_OK) {
         buffer->SetMetadata(OHOS::HDI::Display::Graphic::Common::V1_0::ATTRKEY_CROP_REGION, cropRect);
     }
-    buffer->SetSurfaceBufferTransform(transform_);
+    buffer->SetSurfaceBufferTransform(transform_.load());
 }
 
 bool BufferQueue::CheckLppFenceLocked()
@@ -3095,7 +3443,7 @@ bool BufferQueue::CheckLppFenceLocked()
             continue;
         }
         int32_t bufferState = mapIter->second.state;
-        auto fence = mapIter->second.fence;
+        auto fence = ResolveReleaseFenceLocked(mapIter->second);
         bool isUnreleasableFence = bufferState == BUFFER_STATE_ACQUIRED ||
             (bufferState == BUFFER_STATE_RELEASED && fence != nullptr && fence->Get() != -1 && fence->Wait(0) != 0);
         if (isUnreleasableFence) {
@@ -3263,6 +3611,43 @@ GSError BufferQueue::SyncProducerCache(std::map<uint32_t, sptr<SurfaceBuffer>>&
     return GSERROR_OK;
 }
  
+GSError BufferQueue::SyncProducerCacheDelta(uint64_t generation, IBufferProducer::ProducerCacheDelta &delta)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    delta.generation = cacheGeneration_;
+    delta.isFull = generation == 0 || generation > cacheGeneration_ ||
+        cacheGeneration_ - generation > CACHE_CHANGE_LOG_SIZE;
+    if (delta.isFull) {
+        for (auto& [seqNum, element] : bufferQueueCache_) {
+            if (element.buffer != nullptr) {
+                delta.buffers[seqNum] = element.buffer;
+            }
+        }
+        return GSERROR_OK;
+    }
+    // a sequence touched several times is reported once, as what the cache holds now
+    for (uint64_t change = generation + 1; change <= cacheGeneration_; change++) {
+        uint32_t sequence = cacheChangeLog_[change % CACHE_CHANGE_LOG_SIZE];
+        if (delta.buffers.count(sequence) != 0 || std::find(delta.removedSequences.begin(),
+            delta.removedSequences.end(), sequence) != delta.removedSequences.end()) {
+            continue;
+        }
+        auto it = bufferQueueCache_.find(sequence);
+        if (it != bufferQueueCache_.end() && it->second.buffer != nullptr) {
+            delta.buffers[sequence] = it->second.buffer;
+        } else {
+            delta.removedSequences.push_back(sequence);
+        }
+    }
+    return GSERROR_OK;
+}
+
+void BufferQueue::LogCacheChangeLocked(uint32_t sequence)
+{
+    cacheGeneration_++;
+    cacheChangeLog_[cacheGeneration_ % CACHE_CHANGE_LOG_SIZE] = sequence;
+}
+
 GSError BufferQueue::SetSingleBufferMode(SingleBufferMode singleBufferMode)
 {
     std::lock_guard<std::mutex> lockGuard(mutex_);
@@ -3286,7 +3671,7 @@ GSError BufferQueue::CleanReleasedBuffers(std::vector<uint32_t> &cleanedSeqNums)
             return GSERROR_OK;
         }
         CleanReleasedBuffersLocked(lock, cleanedSeqNums);
-        waitReqCon_.notify_all();
+        requestWaiters_.NotifyAll();
     }
     if (cleanedSeqNums.empty()) {
         return GSERROR_OK;
@@ -3311,7 +3696,7 @@ GSError BufferQueue::CleanReleasedBuffers(std::vector<uint32_t> &cleanedSeqNums)
 
 void BufferQueue::CleanReleasedBuffersLocked(std::unique_lock<std::mutex> &lock, std::vector<uint32_t> &cleanedSeqNums)
 {
-    isAllocatingBufferCon_.wait(lock, [this]() { return !isAllocatingBuffer_; });
+    isAllocatingBufferCon_.wait(lock, [this]() { return allocatingBufferCount_ == 0; });
     for (auto it = freeList_.begin(); it != freeList_.end();) {
         auto sequence = *it;
         if (sequence == lastFlusedSequence_ || sequence == acquireLastFlushedBufSequence_) {
@@ -3322,6 +3707,7 @@ void BufferQueue::CleanReleasedBuffersLocked(std::unique_lock<std::mutex> &lock,
         MarkBufferReclaimableByIdLocked(sequence);
         OnBufferDeleteForRS(sequence);
         bufferQueueCache_.erase(sequence);
+        LogCacheChangeLocked(sequence);
         it = freeList_.erase(it);
     }
 }
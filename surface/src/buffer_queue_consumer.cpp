@@ -438,6 +438,13 @@ GSError BufferQueueConsumer::GetMaxQueueSize(uint32_t &queueSize) const
     }
     return bufferQueue_->GetMaxQueueSize(queueSize);
 }
+GSError BufferQueueConsumer::SetAutoQueueSize(bool enabled, uint32_t minQueueSize)
+{
+    if (bufferQueue_ == nullptr) {
+        return SURFACE_ERROR_UNKOWN;
+    }
+    return bufferQueue_->SetAutoQueueSize(enabled, minQueueSize);
+}
 GSError BufferQueueConsumer::SetLppDrawSource(bool isShbSource, bool isRsSource)
 {
     if (bufferQueue_ == nullptr) {
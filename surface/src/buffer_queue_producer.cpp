@@ -15,6 +15,7 @@
 
 #include "buffer_queue_producer.h"
 
+#include <chrono>
 #include <cinttypes>
 #include <csignal>
 #include <limits>
@@ -31,92 +32,166 @@
 #include "sync_fence.h"
 
 #define BUFFER_PRODUCER_API_FUNC_PAIR(apiSequenceNum, func) \
-    {apiSequenceNum, [](BufferQueueProducer *that, MessageParcel &arguments, MessageParcel &reply, \
-        MessageOption &option){return that->func(arguments, reply, option);}} \
+    table[apiSequenceNum] = {&BufferQueueProducer::func, #func}
 
 namespace OHOS {
 namespace {
 constexpr int32_t BUFFER_MATRIX_SIZE = 16;
 constexpr uint64_t MAXIMUM_INVALID_ID = std::numeric_limits<uint64_t>::max();
+// a sync call waits at most this long for the oneway flushes the producer sent before it
+constexpr int32_t ASYNC_FLUSH_WAIT_TIMEOUT_MS = 1000;
+constexpr const char *PRODUCER_COMMAND_STATS_PARAMETER = "persist.graphic.surface.producer_command_stats";
+
+// sends the release callbacks over the control channel, the producer's own listener is the fallback
+class ControlChannelReleaseListener : public ProducerListenerStub {
+public:
+    ControlChannelReleaseListener(const sptr<IProducerListener> &listener, const sptr<SurfaceControlChannel> &channel)
+        : listener_(listener), channel_(channel) {}
+    ~ControlChannelReleaseListener() override = default;
+
+    GSError OnBufferReleased() override
+    {
+        SurfaceControlRecord record;
+        record.type = SurfaceControlRecordType::RELEASE;
+        if (channel_->Send(record) == GSERROR_OK) {
+            return GSERROR_OK;
+        }
+        return listener_->OnBufferReleased();
+    }
+    GSError OnBufferReleasedWithSequenceAndFence(uint32_t sequence, const sptr<SyncFence> &fence) override
+    {
+        SurfaceControlRecord record;
+        record.type = SurfaceControlRecordType::RELEASE;
+        record.sequence = sequence;
+        record.hasSequence = true;
+        if (channel_->Send(record, fence != nullptr ? fence->Get() : -1) == GSERROR_OK) {
+            return GSERROR_OK;
+        }
+        return listener_->OnBufferReleasedWithSequenceAndFence(sequence, fence);
+    }
+    GSError OnBufferReleasedWithFence(const sptr<SurfaceBuffer> &buffer, const sptr<SyncFence> &fence) override
+    {
+        return listener_->OnBufferReleasedWithFence(buffer, fence);
+    }
+    GSError OnPropertyChange(const SurfaceProperty &property) override
+    {
+        return listener_->OnPropertyChange(property);
+    }
+    GSError OnLayerStateChanged(LayerStateChange state) override
+    {
+        return listener_->OnLayerStateChanged(state);
+    }
+    void ResetReleaseFunc() override
+    {
+        listener_->ResetReleaseFunc();
+    }
+
+private:
+    sptr<IProducerListener> listener_;
+    sptr<SurfaceControlChannel> channel_;
+};
+
+// a request carries the extra data encoding the client reads after its config, older clients send nothing
+bool ReadPackedExtraDataFlag(MessageParcel &arguments)
+{
+    uint32_t version = 0;
+    return arguments.ReadUint32(version) && version >= PACKED_EXTRA_DATA_VERSION;
+}
+
+GSError WriteExtraData(MessageParcel &parcel, const sptr<BufferExtraData> &bedata, bool isPacked)
+{
+    return isPacked ? bedata->WritePackedToParcel(parcel) : bedata->WriteToParcel(parcel);
+}
 } // namespace
 
-const std::map<uint32_t, std::function<int32_t(BufferQueueProducer *that, MessageParcel &arguments,
-    MessageParcel &reply, MessageOption &option)>> BufferQueueProducer::memberFuncMap_ = {
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_INIT_INFO, GetProducerInitInfoRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_BUFFER, RequestBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_BUFFERS, RequestBuffersRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CANCEL_BUFFER, CancelBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_FLUSH_BUFFER, FlushBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_FLUSH_BUFFERS, FlushBuffersRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ATTACH_BUFFER, AttachBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DETACH_BUFFER, DetachBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_QUEUE_SIZE, GetQueueSizeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_QUEUE_SIZE, SetQueueSizeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_NAME, GetNameRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_DEFAULT_WIDTH, GetDefaultWidthRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_DEFAULT_HEIGHT, GetDefaultHeightRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_DEFAULT_USAGE, GetDefaultUsageRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_UNIQUE_ID, GetUniqueIdRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CLEAN_CACHE, CleanCacheRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REGISTER_RELEASE_LISTENER, RegisterReleaseListenerRemote),
+constexpr BufferQueueProducer::RemoteFuncTable BufferQueueProducer::BuildRemoteFuncTable()
+{
+    RemoteFuncTable table = {};
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_INIT_INFO, GetProducerInitInfoRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_BUFFER, RequestBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_BUFFERS, RequestBuffersRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CANCEL_BUFFER, CancelBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_FLUSH_BUFFER, FlushBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_FLUSH_BUFFERS, FlushBuffersRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ATTACH_BUFFER, AttachBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DETACH_BUFFER, DetachBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_QUEUE_SIZE, GetQueueSizeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_QUEUE_SIZE, SetQueueSizeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_NAME, GetNameRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_DEFAULT_WIDTH, GetDefaultWidthRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_DEFAULT_HEIGHT, GetDefaultHeightRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_DEFAULT_USAGE, GetDefaultUsageRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_UNIQUE_ID, GetUniqueIdRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CLEAN_CACHE, CleanCacheRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REGISTER_RELEASE_LISTENER, RegisterReleaseListenerRemote);
     BUFFER_PRODUCER_API_FUNC_PAIR(
-        BUFFER_PRODUCER_REGISTER_RELEASE_LISTENER_BACKUP, RegisterReleaseListenerBackupRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TRANSFORM, SetTransformRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_NAMEANDUNIQUEDID, GetNameAndUniqueIdRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DISCONNECT, DisconnectRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CONNECT, ConnectRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SCALING_MODE, SetScalingModeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_METADATA, SetMetaDataRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_METADATASET, SetMetaDataSetRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TUNNEL_HANDLE, SetTunnelHandleRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GO_BACKGROUND, GoBackgroundRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_PRESENT_TIMESTAMP, GetPresentTimestampRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_UNREGISTER_RELEASE_LISTENER, UnRegisterReleaseListenerRemote),
+        BUFFER_PRODUCER_REGISTER_RELEASE_LISTENER_BACKUP, RegisterReleaseListenerBackupRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TRANSFORM, SetTransformRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_NAMEANDUNIQUEDID, GetNameAndUniqueIdRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DISCONNECT, DisconnectRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CONNECT, ConnectRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SCALING_MODE, SetScalingModeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_METADATA, SetMetaDataRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_METADATASET, SetMetaDataSetRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TUNNEL_HANDLE, SetTunnelHandleRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GO_BACKGROUND, GoBackgroundRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_PRESENT_TIMESTAMP, GetPresentTimestampRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_UNREGISTER_RELEASE_LISTENER, UnRegisterReleaseListenerRemote);
     BUFFER_PRODUCER_API_FUNC_PAIR(
-        BUFFER_PRODUCER_UNREGISTER_RELEASE_LISTENER_BACKUP, UnRegisterReleaseListenerBackupRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_LAST_FLUSHED_BUFFER, GetLastFlushedBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_TRANSFORM, GetTransformRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ATTACH_BUFFER_TO_QUEUE, AttachBufferToQueueRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DETACH_BUFFER_FROM_QUEUE, DetachBufferFromQueueRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_DEFAULT_USAGE, SetDefaultUsageRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_TRANSFORMHINT, GetTransformHintRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TRANSFORMHINT, SetTransformHintRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_BUFFER_HOLD, SetBufferHoldRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_BUFFER_NAME, SetBufferNameRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SCALING_MODEV2, SetScalingModeV2Remote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_VIDEO_DIMENSION_TYPE, SetVideoDimensionTypeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_VIDEO_DIMENSION_TYPE, GetVideoDimensionTypeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SOURCE_TYPE, SetSurfaceSourceTypeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_SOURCE_TYPE, GetSurfaceSourceTypeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_APP_FRAMEWORK_TYPE, SetSurfaceAppFrameworkTypeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_APP_FRAMEWORK_TYPE, GetSurfaceAppFrameworkTypeRemote),
+        BUFFER_PRODUCER_UNREGISTER_RELEASE_LISTENER_BACKUP, UnRegisterReleaseListenerBackupRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_LAST_FLUSHED_BUFFER, GetLastFlushedBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_TRANSFORM, GetTransformRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ATTACH_BUFFER_TO_QUEUE, AttachBufferToQueueRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DETACH_BUFFER_FROM_QUEUE, DetachBufferFromQueueRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_DEFAULT_USAGE, SetDefaultUsageRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_TRANSFORMHINT, GetTransformHintRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TRANSFORMHINT, SetTransformHintRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_BUFFER_HOLD, SetBufferHoldRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_BUFFER_NAME, SetBufferNameRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SCALING_MODEV2, SetScalingModeV2Remote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_VIDEO_DIMENSION_TYPE, SetVideoDimensionTypeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_VIDEO_DIMENSION_TYPE, GetVideoDimensionTypeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SOURCE_TYPE, SetSurfaceSourceTypeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_SOURCE_TYPE, GetSurfaceSourceTypeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_APP_FRAMEWORK_TYPE, SetSurfaceAppFrameworkTypeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_APP_FRAMEWORK_TYPE, GetSurfaceAppFrameworkTypeRemote);
     BUFFER_PRODUCER_API_FUNC_PAIR(
-        BUFFER_PRODUCER_SET_HDRWHITEPOINTBRIGHTNESS, SetHdrWhitePointBrightnessRemote),
+        BUFFER_PRODUCER_SET_HDRWHITEPOINTBRIGHTNESS, SetHdrWhitePointBrightnessRemote);
     BUFFER_PRODUCER_API_FUNC_PAIR(
-        BUFFER_PRODUCER_SET_SDRWHITEPOINTBRIGHTNESS, SetSdrWhitePointBrightnessRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ACQUIRE_LAST_FLUSHED_BUFFER, AcquireLastFlushedBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_RELEASE_LAST_FLUSHED_BUFFER, ReleaseLastFlushedBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_GLOBALALPHA, SetGlobalAlphaRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_REQUESTBUFFER_NOBLOCKMODE, SetRequestBufferNoblockModeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_AND_DETACH_BUFFER, RequestAndDetachBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ATTACH_AND_FLUSH_BUFFER, AttachAndFlushBufferRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_ROTATING_BUFFERS_NUMBER, GetRotatingBuffersNumberRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_ROTATING_BUFFERS_NUMBER, SetRotatingBuffersNumberRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_FRAME_GRAVITY, SetFrameGravityRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_FIXED_ROTATION, SetFixedRotationRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DISCONNECT_STRICTLY, DisconnectStrictlyRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CONNECT_STRICTLY, ConnectStrictlyRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REGISTER_PROPERTY_LISTENER, RegisterPropertyListenerRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_UNREGISTER_PROPERTY_LISTENER, UnRegisterPropertyListenerRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_PRE_ALLOC_BUFFERS, PreAllocBuffersRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_LPP_FD, SetLppShareFdRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_ALPHA_TYPE, SetAlphaTypeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_BUFFER_REALLOC_FLAG, SetBufferReallocFlagRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SYNC_PRODUCER_CACHE, SyncProducerCacheRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TUNNEL_LAYER_INFO, SetTunnelLayerInfoRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SINGLE_BUFFER_MODE, SetSingleBufferModeRemote),
-    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CLEAN_RELEASED_BUFFERS, CleanReleasedBuffersRemote),
-};
+        BUFFER_PRODUCER_SET_SDRWHITEPOINTBRIGHTNESS, SetSdrWhitePointBrightnessRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ACQUIRE_LAST_FLUSHED_BUFFER, AcquireLastFlushedBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_RELEASE_LAST_FLUSHED_BUFFER, ReleaseLastFlushedBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_GLOBALALPHA, SetGlobalAlphaRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_REQUESTBUFFER_NOBLOCKMODE, SetRequestBufferNoblockModeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_AND_DETACH_BUFFER, RequestAndDetachBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_ATTACH_AND_FLUSH_BUFFER, AttachAndFlushBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_GET_ROTATING_BUFFERS_NUMBER, GetRotatingBuffersNumberRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_ROTATING_BUFFERS_NUMBER, SetRotatingBuffersNumberRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_FRAME_GRAVITY, SetFrameGravityRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_FIXED_ROTATION, SetFixedRotationRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_DISCONNECT_STRICTLY, DisconnectStrictlyRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CONNECT_STRICTLY, ConnectStrictlyRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REGISTER_PROPERTY_LISTENER, RegisterPropertyListenerRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_UNREGISTER_PROPERTY_LISTENER, UnRegisterPropertyListenerRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_PRE_ALLOC_BUFFERS, PreAllocBuffersRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_LPP_FD, SetLppShareFdRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_ALPHA_TYPE, SetAlphaTypeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_BUFFER_REALLOC_FLAG, SetBufferReallocFlagRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SYNC_PRODUCER_CACHE, SyncProducerCacheRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_TUNNEL_LAYER_INFO, SetTunnelLayerInfoRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SET_SINGLE_BUFFER_MODE, SetSingleBufferModeRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_CLEAN_RELEASED_BUFFERS, CleanReleasedBuffersRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SETUP_CONTROL_CHANNEL, SetupControlChannelRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_FLUSH_AND_REQUEST_BUFFER, FlushAndRequestBufferRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_FLUSH_BUFFER_ASYNC, FlushBufferAsyncRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_REQUEST_BUFFER_AFTER_ASYNC_FLUSH,
+        RequestBufferAfterAsyncFlushRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_WAIT_ASYNC_FLUSH, WaitAsyncFlushRemote);
+    BUFFER_PRODUCER_API_FUNC_PAIR(BUFFER_PRODUCER_SYNC_PRODUCER_CACHE_DELTA, SyncProducerCacheDeltaRemote);
+    return table;
+}
+
+const BufferQueueProducer::RemoteFuncTable BufferQueueProducer::remoteFuncTable_ = BuildRemoteFuncTable();
 
 BufferQueueProducer::BufferQueueProducer(sptr<BufferQueue> bufferQueue)
     : producerSurfaceDeathRecipient_(new ProducerSurfaceDeathRecipient(this))
@@ -126,10 +201,14 @@ BufferQueueProducer::BufferQueueProducer(sptr<BufferQueue> bufferQueue)
         bufferQueue_->GetName(name_);
         uniqueId_ = bufferQueue_->GetUniqueId();
     }
+    if (GetBoolParameter(PRODUCER_COMMAND_STATS_PARAMETER, "0")) {
+        commandStats_ = std::make_unique<ProducerCommandStats>(remoteFuncTable_.size());
+    }
 }
 
 BufferQueueProducer::~BufferQueueProducer()
 {
+    StopControlChannel();
     (void)CheckIsAlive();
     magicNum_ = 0;
     if (token_ && producerSurfaceDeathRecipient_) {
@@ -159,26 +238,42 @@ int32_t BufferQueueProducer::OnRemoteRequest(uint32_t code, MessageParcel &argum
     if (!CheckIsAlive()) {
         return ERR_NULL_OBJECT;
     }
-    auto it = memberFuncMap_.find(code);
-    if (it == memberFuncMap_.end()) {
+    DrainControlChannel();
+    if (code >= remoteFuncTable_.size() || remoteFuncTable_[code].func == nullptr) {
         BLOGE("cannot process %{public}u", code);
         return IPCObjectStub::OnRemoteRequest(code, arguments, reply, option);
     }
 
-    if (it->second == nullptr) {
-        BLOGE("memberFuncMap_[%{public}u] is nullptr", code);
-        return ERR_NONE;
-    }
-
     auto remoteDescriptor = arguments.ReadInterfaceToken();
     if (GetDescriptor() != remoteDescriptor) {
         return ERR_INVALID_STATE;
     }
 
-    auto ret = it->second(this, arguments, reply, option);
+    RemoteFunc func = remoteFuncTable_[code].func;
+    if (commandStats_ == nullptr) {
+        return (this->*func)(arguments, reply, option);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int32_t ret = (this->*func)(arguments, reply, option);
+    commandStats_->Record(code, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
     return ret;
 }
 
+const char *BufferQueueProducer::GetRemoteFuncName(uint32_t code)
+{
+    return code < remoteFuncTable_.size() ? remoteFuncTable_[code].name : nullptr;
+}
+
+void BufferQueueProducer::DumpCommandStats(std::string &result)
+{
+    if (commandStats_ == nullptr) {
+        return;
+    }
+    result += "      producer commands of " + name_ + ":\n";
+    commandStats_->Dump(result, GetRemoteFuncName);
+}
+
 int32_t BufferQueueProducer::RequestBufferRemote(MessageParcel &arguments, MessageParcel &reply, MessageOption &option)
 {
     RequestBufferReturnValue retval;
@@ -201,27 +296,38 @@ int32_t BufferQueueProducer::RequestBufferRemote(MessageParcel &arguments, Messa
     if (!ReadRequestConfig(arguments, config)) {
         return GSERROR_BINDER;
     }
+    bool isPackedExtraData = ReadPackedExtraDataFlag(arguments);
 
     GSError sRet = RequestBuffer(config, bedataimpl, retval);
+    if (WriteRequestBufferReply(reply, sRet, retval, bedataimpl, isPackedExtraData) != ERR_NONE) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
+
+    if (isActiveGame) {
+        endTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        Rosen::FrameReport::GetInstance().SetDequeueBufferTime(name_, (endTimeNs - startTimeNs));
+    }
+
+    return ERR_NONE;
+}
+
+int32_t BufferQueueProducer::WriteRequestBufferReply(MessageParcel &reply, GSError sRet,
+    const RequestBufferReturnValue &retval, const sptr<BufferExtraData> &bedata, bool isPackedExtraData)
+{
     if (!reply.WriteInt32(sRet)) {
         return IPC_STUB_WRITE_PARCEL_ERR;
     }
     if (sRet == GSERROR_OK &&
         (WriteSurfaceBufferImpl(reply, retval.sequence, retval.buffer) != GSERROR_OK ||
         (retval.buffer != nullptr && !reply.WriteUint64(retval.buffer->GetBufferRequestConfig().usage)) ||
-        bedataimpl->WriteToParcel(reply) != GSERROR_OK || !retval.fence->WriteToMessageParcel(reply) ||
+        WriteExtraData(reply, bedata, isPackedExtraData) != GSERROR_OK ||
+        !retval.fence->WriteToMessageParcel(reply) ||
         !reply.WriteUInt32Vector(retval.deletingBuffers))) {
         return IPC_STUB_WRITE_PARCEL_ERR;
     } else if (sRet != GSERROR_OK && !reply.WriteBool(retval.isConnected)) {
         return IPC_STUB_WRITE_PARCEL_ERR;
     }
-
-    if (isActiveGame) {
-        endTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::steady_clock::now().time_since_epoch()).count();
-        Rosen::FrameReport::GetInstance().SetDequeueBufferTime(name_, (endTimeNs - startTimeNs));
-    }
-
     return ERR_NONE;
 }
 
@@ -237,6 +343,7 @@ int32_t BufferQueueProducer::RequestBuffersRemote(MessageParcel &arguments, Mess
     if (!ReadRequestConfig(arguments, config)) {
         return GSERROR_BINDER;
     }
+    bool isPackedExtraData = ReadPackedExtraDataFlag(arguments);
     if (num == 0 || num > SURFACE_MAX_QUEUE_SIZE) {
         return ERR_NONE;
     }
@@ -260,7 +367,7 @@ int32_t BufferQueueProducer::RequestBuffersRemote(MessageParcel &arguments, Mess
             if (WriteSurfaceBufferImpl(reply, retvalues[i].sequence, retvalues[i].buffer) != GSERROR_OK ||
                 (retvalues[i].buffer != nullptr &&
                     !reply.WriteUint64(retvalues[i].buffer->GetBufferRequestConfig().usage)) ||
-                bedataimpls[i]->WriteToParcel(reply) != GSERROR_OK ||
+                WriteExtraData(reply, bedataimpls[i], isPackedExtraData) != GSERROR_OK ||
                 !retvalues[i].fence->WriteToMessageParcel(reply) ||
                 !reply.WriteUInt32Vector(retvalues[i].deletingBuffers)) {
                 return IPC_STUB_WRITE_PARCEL_ERR;
@@ -300,6 +407,10 @@ int32_t BufferQueueProducer::GetProducerInitInfoRemote(MessageParcel &arguments,
     if (!reply.WriteInt32((result && sRet == GSERROR_OK) ? GSERROR_OK : SURFACE_ERROR_UNKOWN)) {
         return IPC_STUB_WRITE_PARCEL_ERR;
     }
+    // trails the result so older clients that stop reading there are unaffected
+    if (!reply.WriteUint32(PACKED_CONFIG_VERSION) || !reply.WriteUint32(PACKED_EXTRA_DATA_VERSION)) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
     return ERR_NONE;
 }
 
@@ -1266,21 +1377,10 @@ int32_t BufferQueueProducer::RequestAndDetachBufferRemote(MessageParcel &argumen
     if (!ReadRequestConfig(arguments, config)) {
         return GSERROR_BINDER;
     }
+    bool isPackedExtraData = ReadPackedExtraDataFlag(arguments);
 
     GSError sRet = RequestAndDetachBuffer(config, bedataimpl, retval);
-    if (!reply.WriteInt32(sRet)) {
-        return IPC_STUB_WRITE_PARCEL_ERR;
-    }
-    if (sRet == GSERROR_OK &&
-        (WriteSurfaceBufferImpl(reply, retval.sequence, retval.buffer) != GSERROR_OK ||
-        (retval.buffer != nullptr && !reply.WriteUint64(retval.buffer->GetBufferRequestConfig().usage)) ||
-        bedataimpl->WriteToParcel(reply) != GSERROR_OK || !retval.fence->WriteToMessageParcel(reply) ||
-        !reply.WriteUInt32Vector(retval.deletingBuffers))) {
-        return IPC_STUB_WRITE_PARCEL_ERR;
-    } else if (sRet != GSERROR_OK && !reply.WriteBool(retval.isConnected)) {
-        return IPC_STUB_WRITE_PARCEL_ERR;
-    }
-    return ERR_NONE;
+    return WriteRequestBufferReply(reply, sRet, retval, bedataimpl, isPackedExtraData);
 }
 
 void BufferQueueProducer::ReportQueueBufferTimeIfNeeded(int64_t startTimeNs)
@@ -1345,6 +1445,150 @@ int32_t BufferQueueProducer::AttachAndFlushBufferRemote(MessageParcel &arguments
     return ERR_NONE;
 }
 
+int32_t BufferQueueProducer::FlushAndRequestBufferRemote(MessageParcel &arguments,
+    MessageParcel &reply, MessageOption &option)
+{
+    int32_t connectedPid = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connectedPid = connectedPid_;
+    }
+    bool isActiveGame = Rosen::FrameReport::GetInstance().IsActiveGameWithPid(connectedPid);
+    int64_t startTimeNs = 0;
+    if (isActiveGame) {
+        startTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t sequence = 0;
+    if (!arguments.ReadUint32(sequence)) {
+        return GSERROR_BINDER;
+    }
+    sptr<BufferExtraData> bedataimpl = new BufferExtraDataImpl;
+    if (bedataimpl->ReadFromParcel(arguments) != GSERROR_OK) {
+        return ERR_INVALID_REPLY;
+    }
+    sptr<SyncFence> fence = SyncFence::ReadFromMessageParcel(arguments);
+    BufferFlushConfigWithDamages flushConfig;
+    if (ReadFlushConfig(arguments, flushConfig) != GSERROR_OK) {
+        return ERR_INVALID_REPLY;
+    }
+    BufferRequestConfig requestConfig = {};
+    if (!ReadRequestConfig(arguments, requestConfig)) {
+        return GSERROR_BINDER;
+    }
+    bool isPackedExtraData = ReadPackedExtraDataFlag(arguments);
+
+    RequestBufferReturnValue retval;
+    sptr<BufferExtraData> requestBedata = new BufferExtraDataImpl;
+    GSError requestRet = GSERROR_OK;
+    GSError sRet = FlushAndRequestBuffer(sequence, bedataimpl, fence, flushConfig, requestConfig, requestBedata,
+        retval, requestRet);
+    if (!reply.WriteInt32(sRet)) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
+    if (sRet != GSERROR_OK) {
+        return ERR_NONE;
+    }
+    if (isActiveGame) {
+        Rosen::FrameReport::GetInstance().SetFlushBufferSequence(sequence);
+        ReportQueueBufferTimeIfNeeded(startTimeNs);
+    }
+    return WriteRequestBufferReply(reply, requestRet, retval, requestBedata, isPackedExtraData);
+}
+
+int32_t BufferQueueProducer::FlushBufferAsyncRemote(MessageParcel &arguments,
+    MessageParcel &reply, MessageOption &option)
+{
+    uint64_t session = 0;
+    uint64_t serial = 0;
+    if (!arguments.ReadUint64(session) || !arguments.ReadUint64(serial)) {
+        return GSERROR_BINDER;
+    }
+    // the rest of the parcel is a FlushBuffer, nobody reads the reply of a oneway call
+    MessageParcel flushReply;
+    int32_t sRet = FlushBufferRemote(arguments, flushReply, option);
+    if (sRet == ERR_NONE && !flushReply.ReadInt32(sRet)) {
+        sRet = GSERROR_BINDER;
+    }
+    if (sRet != GSERROR_OK) {
+        BLOGW("async FlushBuffer serial: %{public}" PRIu64 " ret: %{public}d, uniqueId: %{public}" PRIu64 ".",
+            serial, sRet, uniqueId_);
+    }
+    {
+        std::lock_guard<std::mutex> lockGuard(asyncFlushMutex_);
+        if (asyncFlushSession_ != session) {
+            asyncFlushSession_ = session;
+            asyncFlushError_ = GSERROR_OK;
+        }
+        asyncFlushSerial_ = serial;
+        if (sRet != GSERROR_OK && asyncFlushError_ == GSERROR_OK) {
+            asyncFlushError_ = static_cast<GSError>(sRet);
+        }
+    }
+    asyncFlushCon_.notify_all();
+    return ERR_NONE;
+}
+
+GSError BufferQueueProducer::WaitAsyncFlush(uint64_t session, uint64_t serial)
+{
+    std::unique_lock<std::mutex> lock(asyncFlushMutex_);
+    if (serial == 0) {
+        // the probe of SetFlushBufferAsyncMode, a new session starts without the state of the last one
+        if (asyncFlushSession_ != session) {
+            asyncFlushSession_ = session;
+            asyncFlushSerial_ = 0;
+            asyncFlushError_ = GSERROR_OK;
+        }
+        return GSERROR_OK;
+    }
+    bool isDone = asyncFlushCon_.wait_for(lock, std::chrono::milliseconds(ASYNC_FLUSH_WAIT_TIMEOUT_MS),
+        [this, session, serial]() { return asyncFlushSession_ == session && asyncFlushSerial_ >= serial; });
+    if (!isDone) {
+        // the flush may be lost, the producer must not take the ordering for granted
+        BLOGE("async FlushBuffer serial: %{public}" PRIu64 " not arrived in %{public}d ms, uniqueId: %{public}" PRIu64
+            ".", serial, ASYNC_FLUSH_WAIT_TIMEOUT_MS, uniqueId_);
+        return GSERROR_BINDER;
+    }
+    GSError ret = asyncFlushError_;
+    asyncFlushError_ = GSERROR_OK;
+    return ret;
+}
+
+int32_t BufferQueueProducer::RequestBufferAfterAsyncFlushRemote(MessageParcel &arguments,
+    MessageParcel &reply, MessageOption &option)
+{
+    uint64_t session = 0;
+    uint64_t serial = 0;
+    if (!arguments.ReadUint64(session) || !arguments.ReadUint64(serial)) {
+        return GSERROR_BINDER;
+    }
+    GSError flushRet = WaitAsyncFlush(session, serial);
+    if (flushRet != GSERROR_OK) {
+        // the producer handles the error of its flush like the synchronous FlushBuffer result
+        if (!reply.WriteInt32(flushRet) || !reply.WriteBool(false)) {
+            return IPC_STUB_WRITE_PARCEL_ERR;
+        }
+        return ERR_NONE;
+    }
+    // the rest of the parcel is a RequestBuffer
+    return RequestBufferRemote(arguments, reply, option);
+}
+
+int32_t BufferQueueProducer::WaitAsyncFlushRemote(MessageParcel &arguments,
+    MessageParcel &reply, MessageOption &option)
+{
+    uint64_t session = 0;
+    uint64_t serial = 0;
+    if (!arguments.ReadUint64(session) || !arguments.ReadUint64(serial)) {
+        return GSERROR_BINDER;
+    }
+    if (!reply.WriteInt32(WaitAsyncFlush(session, serial))) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
+    return ERR_NONE;
+}
+
 int32_t BufferQueueProducer::GetRotatingBuffersNumberRemote(MessageParcel &arguments,
     MessageParcel &reply, MessageOption &option)
 {
@@ -1458,6 +1702,31 @@ GSError BufferQueueProducer::AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, s
     return bufferQueue_->AttachAndFlushBuffer(buffer, bedata, fence, config, needMap);
 }
 
+GSError BufferQueueProducer::FlushAndRequestBuffer(uint32_t sequence, sptr<BufferExtraData> bedata,
+    sptr<SyncFence> fence, BufferFlushConfigWithDamages &flushConfig, const BufferRequestConfig &requestConfig,
+    sptr<BufferExtraData> &requestBedata, RequestBufferReturnValue &retval, GSError &requestRet)
+{
+    if (bufferQueue_ == nullptr) {
+        return SURFACE_ERROR_UNKOWN;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (isDisconnectStrictly_) {
+            BLOGW("connected failed because buffer queue is disconnect strictly, uniqueId: %{public}" PRIu64 ".",
+                uniqueId_);
+            return GSERROR_CONSUMER_DISCONNECTED;
+        }
+    }
+    retval.isConnected = false;
+    requestRet = Connect();
+    if (requestRet != SURFACE_ERROR_OK) {
+        return bufferQueue_->FlushBuffer(sequence, bedata, fence, flushConfig);
+    }
+    retval.isConnected = true;
+    return bufferQueue_->FlushAndRequestBuffer(sequence, bedata, fence, flushConfig, requestConfig, requestBedata,
+        retval, requestRet);
+}
+
 int32_t BufferQueueProducer::PreAllocBuffersRemote(MessageParcel &arguments,
     MessageParcel &reply, MessageOption &option)
 {
@@ -1523,15 +1792,7 @@ GSError BufferQueueProducer::RequestBuffers(const BufferRequestConfig &config,
     if (ret != SURFACE_ERROR_OK) {
         return ret;
     }
-    bufferQueue_->SetBatchHandle(true);
-    for (size_t i = 0; i < retvalues.size(); ++i) {
-        ret = bufferQueue_->RequestBuffer(config, bedata[i], retvalues[i]);
-        if (ret != GSERROR_OK) {
-            retvalues.resize(i);
-            break;
-        }
-    }
-    bufferQueue_->SetBatchHandle(false);
+    ret = bufferQueue_->RequestBuffers(config, bedata, retvalues);
     if (retvalues.size() == 0) {
         retvalues.resize(1);
         retvalues[0].isConnected = true;
@@ -1589,13 +1850,9 @@ GSError BufferQueueProducer::FlushBuffers(const std::vector<uint32_t> &sequences
             return GSERROR_CONSUMER_DISCONNECTED;
         }
     }
-    GSError ret;
-    for (size_t i = 0; i < sequences.size(); ++i) {
-        ret = bufferQueue_->FlushBuffer(sequences[i], bedata[i], fences[i], configs[i]);
-        if (ret != GSERROR_OK) {
-            BLOGE("FlushBuffer failed: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, uniqueId_);
-            return ret;
-        }
+    GSError ret = bufferQueue_->FlushBuffers(sequences, bedata, fences, configs);
+    if (ret != GSERROR_OK) {
+        BLOGE("FlushBuffers failed: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, uniqueId_);
     }
     return ret;
 }
@@ -1781,7 +2038,20 @@ GSError BufferQueueProducer::RegisterReleaseListener(sptr<IProducerListener> lis
     } else {
         SetListenerSeqAndFenceCallingPid(0);
     }
-    return bufferQueue_->RegisterProducerReleaseListener(listener, isOnReleaseBufferWithSequenceAndFence);
+    std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+    releaseListener_ = listener;
+    isOnReleaseBufferWithSequenceAndFence_ = isOnReleaseBufferWithSequenceAndFence;
+    return RegisterReleaseListenerInner(listener, isOnReleaseBufferWithSequenceAndFence, controlChannel_);
+}
+
+GSError BufferQueueProducer::RegisterReleaseListenerInner(const sptr<IProducerListener> &listener,
+    bool isOnReleaseBufferWithSequenceAndFence, const sptr<SurfaceControlChannel> &channel)
+{
+    sptr<IProducerListener> queueListener = listener;
+    if (channel != nullptr) {
+        queueListener = new ControlChannelReleaseListener(listener, channel);
+    }
+    return bufferQueue_->RegisterProducerReleaseListener(queueListener, isOnReleaseBufferWithSequenceAndFence);
 }
 
 GSError BufferQueueProducer::RegisterReleaseListenerBackup(sptr<IProducerListener> listener)
@@ -1797,6 +2067,11 @@ GSError BufferQueueProducer::UnRegisterReleaseListener()
     if (bufferQueue_ == nullptr) {
         return GSERROR_INVALID_ARGUMENTS;
     }
+    {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        releaseListener_ = nullptr;
+        isOnReleaseBufferWithSequenceAndFence_ = false;
+    }
     return bufferQueue_->UnRegisterProducerReleaseListener();
 }
 
@@ -1926,9 +2201,13 @@ GSError BufferQueueProducer::GetNameAndUniqueId(std::string& name, uint64_t& uni
 }
 
 GSError BufferQueueProducer::Connect()
+{
+    return ConnectByPid(GetCallingPid());
+}
+
+GSError BufferQueueProducer::ConnectByPid(int32_t callingPid)
 {
     std::lock_guard<std::mutex> lock(mutex_);
-    auto callingPid = GetCallingPid();
     if (connectedPid_ != 0 && connectedPid_ != callingPid) {
         BLOGW("connected by: %{public}d, request by: %{public}d , uniqueId: %{public}" PRIu64 ".",
             connectedPid_, callingPid, uniqueId_);
@@ -2283,6 +2562,38 @@ int32_t BufferQueueProducer::SyncProducerCacheRemote(MessageParcel &arguments, M
     return ret;
 }
 
+GSError BufferQueueProducer::SyncProducerCacheDelta(uint64_t generation, ProducerCacheDelta &delta)
+{
+    if (bufferQueue_ == nullptr) {
+        return SURFACE_ERROR_UNKOWN;
+    }
+    return bufferQueue_->SyncProducerCacheDelta(generation, delta);
+}
+
+int32_t BufferQueueProducer::SyncProducerCacheDeltaRemote(MessageParcel &arguments, MessageParcel &reply,
+    MessageOption &option)
+{
+    uint64_t generation = arguments.ReadUint64();
+    ProducerCacheDelta delta;
+    GSError ret = SyncProducerCacheDelta(generation, delta);
+    if (!reply.WriteInt32(ret)) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
+    if (ret != GSERROR_OK) {
+        return ERR_NONE;
+    }
+    if (!reply.WriteUint64(delta.generation) || !reply.WriteBool(delta.isFull) ||
+        !reply.WriteUInt32Vector(delta.removedSequences) || !reply.WriteUint32(delta.buffers.size())) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
+    for (auto& [seqNum, buffer] : delta.buffers) {
+        if (WriteSurfaceBufferImpl(reply, seqNum, buffer) != GSERROR_OK) {
+            return IPC_STUB_WRITE_PARCEL_ERR;
+        }
+    }
+    return ERR_NONE;
+}
+
 int32_t BufferQueueProducer::CleanReleasedBuffersRemote(
     MessageParcel &arguments, MessageParcel &reply, MessageOption &option)
 {
@@ -2351,4 +2662,166 @@ GSError BufferQueueProducer::CleanProducerBySeqNum(const std::vector<uint32_t>&
     bufferQueue_->CleanProducerBySeqNum(seqNums);
     return SURFACE_ERROR_OK;
 }
+
+int32_t BufferQueueProducer::SetupControlChannelRemote(MessageParcel &arguments,
+    MessageParcel &reply, MessageOption &option)
+{
+    sptr<SurfaceControlChannel> channel = SurfaceControlChannel::ReadFromMessageParcel(arguments);
+    GSError sRet = GSERROR_INVALID_ARGUMENTS;
+    if (channel != nullptr) {
+        sRet = SetupControlChannel(channel, GetCallingPid());
+    }
+    if (!reply.WriteInt32(sRet)) {
+        return IPC_STUB_WRITE_PARCEL_ERR;
+    }
+    return ERR_NONE;
+}
+
+GSError BufferQueueProducer::SetupControlChannel(const sptr<SurfaceControlChannel> &channel, int32_t callingPid)
+{
+    if (bufferQueue_ == nullptr) {
+        return SURFACE_ERROR_UNKOWN;
+    }
+    StopControlChannel();
+    std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+    controlChannel_ = channel;
+    controlChannelPid_ = callingPid;
+    hasControlChannel_ = true;
+    controlChannelThread_ = std::thread(ControlChannelLoop, wptr<BufferQueueProducer>(this), channel);
+    if (releaseListener_ != nullptr) {
+        (void)RegisterReleaseListenerInner(releaseListener_, isOnReleaseBufferWithSequenceAndFence_, channel);
+    }
+    BLOGI("control channel set up by %{public}d, uniqueId: %{public}" PRIu64 ".", callingPid, uniqueId_);
+    return GSERROR_OK;
+}
+
+void BufferQueueProducer::StopControlChannel()
+{
+    sptr<SurfaceControlChannel> channel = nullptr;
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+        channel = controlChannel_;
+        controlChannel_ = nullptr;
+        hasControlChannel_ = false;
+        thread = std::move(controlChannelThread_);
+    }
+    // a listener still wrapping the channel falls back to binder once it is shut down
+    if (channel != nullptr) {
+        channel->Shutdown();
+    }
+    if (!thread.joinable()) {
+        return;
+    }
+    if (thread.get_id() == std::this_thread::get_id()) {
+        thread.detach();
+    } else {
+        thread.join();
+    }
+}
+
+void BufferQueueProducer::ControlChannelLoop(wptr<BufferQueueProducer> producer,
+    sptr<SurfaceControlChannel> channel)
+{
+    while (!channel->IsClosed()) {
+        channel->Wait(-1);
+        sptr<BufferQueueProducer> that = producer.promote();
+        if (that == nullptr) {
+            break;
+        }
+        that->DrainControlChannel();
+    }
+}
+
+void BufferQueueProducer::DrainControlChannel()
+{
+    if (!hasControlChannel_.load()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lockGuard(controlChannelMutex_);
+    if (controlChannel_ == nullptr) {
+        return;
+    }
+    SurfaceControlRecord record;
+    int32_t fenceFd = -1;
+    while (controlChannel_->Receive(record, fenceFd) == GSERROR_OK) {
+        HandleControlRecordLocked(record, fenceFd);
+    }
+}
+
+void BufferQueueProducer::HandleControlRecordLocked(const SurfaceControlRecord &record, int32_t fenceFd)
+{
+    sptr<SyncFence> fence = fenceFd >= 0 ? new SyncFence(fenceFd) : SyncFence::InvalidFence();
+    switch (record.type) {
+        case SurfaceControlRecordType::REQUEST: {
+            RequestBufferFromChannelLocked(record);
+            break;
+        }
+        case SurfaceControlRecordType::FLUSH: {
+            FlushBufferFromChannelLocked(record, fence);
+            break;
+        }
+        default: {
+            BLOGW("unexpected control record: %{public}u, uniqueId: %{public}" PRIu64 ".",
+                static_cast<uint32_t>(record.type), uniqueId_);
+            break;
+        }
+    }
+}
+
+void BufferQueueProducer::FlushBufferFromChannelLocked(const SurfaceControlRecord &record,
+    const sptr<SyncFence> &fence)
+{
+    // same frame report as FlushBufferRemote, games flushing over the channel are reported like over binder
+    int64_t startTimeNs = 0;
+    int32_t connectedPid = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connectedPid = connectedPid_;
+    }
+    bool isActiveGame = Rosen::FrameReport::GetInstance().IsActiveGameWithPid(connectedPid);
+    if (isActiveGame) {
+        startTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    BufferFlushConfigWithDamages config;
+    config.damages.assign(record.damages, record.damages + record.damageCount);
+    config.timestamp = record.timestamp;
+    config.desiredPresentTimestamp = record.desiredPresentTimestamp;
+    GSError ret = FlushBuffer(record.sequence, new BufferExtraDataImpl, fence, config);
+    if (ret != GSERROR_OK) {
+        BLOGW("FlushBuffer from control channel failed: %{public}d, sequence: %{public}u, "
+            "uniqueId: %{public}" PRIu64 ".", ret, record.sequence, uniqueId_);
+    }
+
+    if (isActiveGame) {
+        int64_t endTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        Rosen::FrameReport::GetInstance().SetQueueBufferTime(GetUniqueId(), name_, (endTimeNs - startTimeNs));
+        Rosen::FrameReport::GetInstance().SetFlushBufferSequence(record.sequence);
+        Rosen::FrameReport::GetInstance().Report(name_);
+    }
+}
+
+void BufferQueueProducer::RequestBufferFromChannelLocked(const SurfaceControlRecord &record)
+{
+    SurfaceControlRecord reply;
+    reply.type = SurfaceControlRecordType::REQUEST_REPLY;
+    reply.id = record.id;
+    RequestBufferReturnValue retval;
+    GSError ret = ConnectByPid(controlChannelPid_);
+    if (ret == GSERROR_OK) {
+        ret = bufferQueue_->RequestCachedBuffer(record.config, retval);
+    }
+    reply.status = ret;
+    int32_t fenceFd = -1;
+    if (ret == GSERROR_OK) {
+        reply.sequence = retval.sequence;
+        fenceFd = retval.fence != nullptr ? retval.fence->Get() : -1;
+    }
+    if (controlChannel_->Send(reply, fenceFd) != GSERROR_OK && ret == GSERROR_OK) {
+        (void)bufferQueue_->CancelBuffer(retval.sequence, new BufferExtraDataImpl);
+    }
+}
 }; // namespace OHOS
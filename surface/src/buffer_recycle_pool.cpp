@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "buffer_recycle_pool.h"
+
+#include <cinttypes>
+#include <cstdlib>
+#include <pthread.h>
+#include <unistd.h>
+#include <parameters.h>
+
+#include "buffer_log.h"
+#include "surface_buffer_impl.h"
+#include "surface_trace.h"
+
+namespace OHOS {
+namespace {
+// off unless a product opts in, see Put for what a recycled buffer must not still be shared with
+constexpr uint64_t DEFAULT_MAX_KB = 0;
+constexpr uint64_t KB = 1024;
+}
+
+BufferRecyclePool& BufferRecyclePool::GetInstance()
+{
+    static BufferRecyclePool instance;
+    return instance;
+}
+
+BufferRecyclePool::BufferRecyclePool()
+{
+    // 0 turns the pool off
+    maxBytes_ = std::strtoull(system::GetParameter("persist.graphic.buffer_recycle_pool.max_kb",
+        std::to_string(DEFAULT_MAX_KB)).c_str(), nullptr, 10) * KB; // 10: decimal
+}
+
+BufferRecyclePool::~BufferRecyclePool()
+{
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        isStopped_ = true;
+    }
+    sweepCon_.notify_all();
+    if (sweepThread_.joinable()) {
+        sweepThread_.join();
+    }
+    // the process is exiting and the display buffer service may already be gone, the fds go with the process
+}
+
+bool BufferRecyclePool::IsSameShape(const BufferRequestConfig& lhs, const BufferRequestConfig& rhs)
+{
+    return lhs.width == rhs.width && lhs.height == rhs.height && lhs.format == rhs.format && lhs.usage == rhs.usage;
+}
+
+bool BufferRecyclePool::Put(const sptr<SurfaceBuffer>& buffer, const BufferRequestConfig& config, int32_t ownerPid)
+{
+    // the caller's reference must be the last one, anyone else could still read or write the memory.
+    // references held by a remote producer are invisible here, it may not have handled the delete yet,
+    // so only buffers of a producer living in this process are taken
+    if (maxBytes_ == 0 || buffer == nullptr || (ownerPid != 0 && ownerPid != getpid()) ||
+        buffer->GetSptrRefCount() != 1 ||
+        (config.usage & BUFFER_USAGE_PROTECTED) != 0 || buffer->IsReclaimed()) {
+        return false;
+    }
+    BufferHandle* handle = buffer->GetBufferHandle();
+    if (handle == nullptr || handle->size <= 0 || static_cast<uint64_t>(handle->size) > maxBytes_) {
+        return false;
+    }
+    // metadata lives on the allocation, the next owner must start without it
+    std::vector<uint32_t> keys;
+    if (buffer->ListMetadataKeys(keys) == GSERROR_OK) {
+        for (uint32_t key : keys) {
+            if (buffer->EraseMetadataKey(key) != GSERROR_OK) {
+                return false;
+            }
+        }
+    }
+    SURFACE_TRACE_NAME_FMT("BufferRecyclePool Put width %d height %d format %d usage %" PRIu64 " size %d",
+        config.width, config.height, config.format, config.usage, handle->size);
+    Entry entry = {
+        .handle = static_cast<SurfaceBufferImpl*>(buffer.GetRefPtr())->TakeBufferHandle(),
+        .config = config,
+        .ownerPid = ownerPid,
+        .size = static_cast<uint32_t>(handle->size),
+        .putTime = std::chrono::steady_clock::now(),
+    };
+    std::vector<BufferHandle*> freed;
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        EvictLocked(entry.putTime, entry.size, freed);
+        stats_.bytes += entry.size;
+        entries_.push_back(entry);
+        stats_.count = static_cast<uint32_t>(entries_.size());
+        if (!sweepThread_.joinable()) {
+            sweepThread_ = std::thread([this]() { SweepLoop(); });
+        }
+    }
+    sweepCon_.notify_one();
+    for (BufferHandle* freedHandle : freed) {
+        SurfaceBufferImpl::FreeTakenBufferHandle(freedHandle);
+    }
+    return true;
+}
+
+bool BufferRecyclePool::Get(const sptr<SurfaceBuffer>& buffer, const BufferRequestConfig& config, int32_t ownerPid)
+{
+    if (maxBytes_ == 0 || buffer == nullptr || (config.usage & BUFFER_USAGE_PROTECTED) != 0) {
+        return false;
+    }
+    BufferHandle* handle = nullptr;
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        // newest first, it is the most likely to still be warm in the caches
+        for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+            if (it->ownerPid == ownerPid && IsSameShape(it->config, config)) {
+                handle = it->handle;
+                stats_.bytes -= it->size;
+                entries_.erase(std::next(it).base());
+                break;
+            }
+        }
+        stats_.count = static_cast<uint32_t>(entries_.size());
+        if (handle == nullptr) {
+            stats_.misses++;
+            return false;
+        }
+        stats_.hits++;
+    }
+    SURFACE_TRACE_NAME_FMT("BufferRecyclePool Get width %d height %d format %d usage %" PRIu64,
+        config.width, config.height, config.format, config.usage);
+    static_cast<SurfaceBufferImpl*>(buffer.GetRefPtr())->AdoptBufferHandle(config, handle);
+    return true;
+}
+
+void BufferRecyclePool::Clear()
+{
+    std::vector<BufferHandle*> freed;
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        for (auto &entry : entries_) {
+            freed.push_back(entry.handle);
+        }
+        stats_.evictions += entries_.size();
+        entries_.clear();
+        stats_.bytes = 0;
+        stats_.count = 0;
+    }
+    for (BufferHandle* handle : freed) {
+        SurfaceBufferImpl::FreeTakenBufferHandle(handle);
+    }
+}
+
+BufferRecyclePool::Stats BufferRecyclePool::GetStats()
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    return stats_;
+}
+
+void BufferRecyclePool::Dump(std::string& result)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    result += "hits = " + std::to_string(stats_.hits) +
+        ", misses = " + std::to_string(stats_.misses) +
+        ", evictions = " + std::to_string(stats_.evictions) +
+        ", count = " + std::to_string(stats_.count) +
+        ", bytes = " + std::to_string(stats_.bytes) +
+        ", maxBytes = " + std::to_string(maxBytes_);
+}
+
+void BufferRecyclePool::EvictLocked(std::chrono::steady_clock::time_point now, uint64_t incomingBytes,
+    std::vector<BufferHandle*>& freed)
+{
+    while (!entries_.empty() && (now - entries_.front().putTime >= MAX_AGE ||
+        stats_.bytes + incomingBytes > maxBytes_)) {
+        freed.push_back(entries_.front().handle);
+        stats_.bytes -= entries_.front().size;
+        stats_.evictions++;
+        entries_.pop_front();
+    }
+    stats_.count = static_cast<uint32_t>(entries_.size());
+}
+
+void BufferRecyclePool::SweepLoop()
+{
+    pthread_setname_np(pthread_self(), "BufferRecycle");
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!isStopped_) {
+        if (entries_.empty()) {
+            sweepCon_.wait(lock, [this]() { return isStopped_ || !entries_.empty(); });
+            continue;
+        }
+        auto deadline = entries_.front().putTime + MAX_AGE;
+        if (sweepCon_.wait_until(lock, deadline, [this]() { return isStopped_; })) {
+            break;
+        }
+        std::vector<BufferHandle*> freed;
+        EvictLocked(std::chrono::steady_clock::now(), 0, freed);
+        if (freed.empty()) {
+            continue;
+        }
+        lock.unlock();
+        for (BufferHandle* handle : freed) {
+            SurfaceBufferImpl::FreeTakenBufferHandle(handle);
+        }
+        lock.lock();
+    }
+}
+} // namespace OHOS
@@ -30,6 +30,187 @@
 namespace OHOS {
 namespace {
 constexpr size_t BLOCK_SIZE = 1024 * 1024; // 1 MB block size
+// a packed config starts with a tag no legacy writer sends: a negative width, a damage count above
+// SURFACE_PARCEL_SIZE_LIMIT. The low 16 bits carry the version
+constexpr uint32_t PACKED_TAG_MASK = 0xFFFF0000;
+constexpr uint32_t PACKED_VERSION_MASK = 0x0000FFFF;
+constexpr uint32_t REQUEST_CONFIG_PACKED_TAG = 0xC5520000;
+constexpr uint32_t FLUSH_CONFIG_PACKED_TAG = 0x45460000;
+// count, four varints per rect, timestamp and present time
+constexpr size_t PACKED_FLUSH_CONFIG_MAX_SIZE = VARINT_MAX_BYTES * (3 + 4 * SURFACE_PARCEL_SIZE_LIMIT);
+// a frame rarely damages more rects than fit here, larger configs use the heap
+constexpr size_t PACKED_FLUSH_CONFIG_STACK_SIZE = 512;
+
+struct PackedRequestConfig {
+    int32_t width;
+    int32_t height;
+    int32_t strideAlignment;
+    int32_t format;
+    uint64_t usage;
+    int32_t timeout;
+    int32_t colorGamut;
+    int32_t transform;
+    int32_t reserved;
+};
+
+uint64_t ZigZagEncode(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); // 63: sign bit
+}
+
+int64_t ZigZagDecode(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+bool GetVarintInt32(const uint8_t *&in, const uint8_t *end, int64_t base, int32_t &value)
+{
+    int64_t delta = 0;
+    if (!GetVarint(in, end, delta) || delta > INT32_MAX || delta < INT32_MIN) {
+        return false;
+    }
+    int64_t result = base + delta;
+    if (result > INT32_MAX || result < INT32_MIN) {
+        return false;
+    }
+    value = static_cast<int32_t>(result);
+    return true;
+}
+
+void CheckRequestConfigEnums(BufferRequestConfig &config)
+{
+    if (config.colorGamut < GRAPHIC_COLOR_GAMUT_INVALID || config.colorGamut > GRAPHIC_COLOR_GAMUT_DISPLAY_BT2020) {
+        config.colorGamut = GRAPHIC_COLOR_GAMUT_INVALID;
+    }
+    if (config.transform < GRAPHIC_ROTATE_NONE || config.transform > GRAPHIC_ROTATE_BUTT) {
+        config.transform = GRAPHIC_ROTATE_BUTT;
+    }
+}
+
+bool ReadPackedRequestConfig(MessageParcel &parcel, uint32_t version, BufferRequestConfig &config)
+{
+    if (version != PACKED_CONFIG_VERSION) {
+        BLOGE("ReadRequestConfig unknown version %{public}u", version);
+        return false;
+    }
+    const uint8_t *data = parcel.ReadBuffer(sizeof(PackedRequestConfig));
+    if (data == nullptr) {
+        BLOGE("ReadRequestConfig read packed config fail.");
+        return false;
+    }
+    PackedRequestConfig packed;
+    if (memcpy_s(&packed, sizeof(packed), data, sizeof(packed)) != EOK) {
+        return false;
+    }
+    config.width = packed.width;
+    config.height = packed.height;
+    config.strideAlignment = packed.strideAlignment;
+    config.format = packed.format;
+    config.usage = packed.usage;
+    config.timeout = packed.timeout;
+    config.colorGamut = static_cast<GraphicColorGamut>(packed.colorGamut);
+    config.transform = static_cast<GraphicTransformType>(packed.transform);
+    CheckRequestConfigEnums(config);
+    return true;
+}
+
+GSError ReadPackedFlushConfig(MessageParcel &parcel, uint32_t version, BufferFlushConfigWithDamages &config)
+{
+    uint32_t size = 0;
+    if (version != PACKED_CONFIG_VERSION || !parcel.ReadUint32(size) || size > PACKED_FLUSH_CONFIG_MAX_SIZE) {
+        BLOGE("ReadFlushConfig bad packed header, version: %{public}u size: %{public}u", version, size);
+        return GSERROR_BINDER;
+    }
+    const uint8_t *in = parcel.ReadBuffer(size);
+    if (in == nullptr) {
+        BLOGE("ReadFlushConfig read packed config failed");
+        return GSERROR_BINDER;
+    }
+    const uint8_t *end = in + size;
+    int64_t count = 0;
+    if (!GetVarint(in, end, count) || count <= 0 || count > SURFACE_PARCEL_SIZE_LIMIT) {
+        BLOGE("ReadFlushConfig bad packed count");
+        return GSERROR_BINDER;
+    }
+    config.damages.clear();
+    config.damages.reserve(static_cast<size_t>(count));
+    // x and y are deltas to the previous rect, rects of one frame are usually close to each other
+    Rect previous = {};
+    for (int64_t i = 0; i < count; i++) {
+        Rect rect;
+        if (!GetVarintInt32(in, end, previous.x, rect.x) || !GetVarintInt32(in, end, previous.y, rect.y) ||
+            !GetVarintInt32(in, end, 0, rect.w) || !GetVarintInt32(in, end, 0, rect.h)) {
+            BLOGE("ReadFlushConfig read packed rect failed");
+            return GSERROR_BINDER;
+        }
+        config.damages.emplace_back(rect);
+        previous = rect;
+    }
+    int64_t presentDelta = 0;
+    if (!GetVarint(in, end, config.timestamp) || !GetVarint(in, end, presentDelta) || in != end) {
+        BLOGE("ReadFlushConfig read packed timestamp failed");
+        return GSERROR_BINDER;
+    }
+    config.desiredPresentTimestamp = static_cast<int64_t>(
+        static_cast<uint64_t>(config.timestamp) + static_cast<uint64_t>(presentDelta));
+    return GSERROR_OK;
+}
+
+GSError WritePackedFlushConfig(MessageParcel &parcel, const BufferFlushConfigWithDamages &config)
+{
+    size_t maxSize = VARINT_MAX_BYTES * (3 + 4 * config.damages.size()); // 3: count and times, 4: varints per rect
+    uint8_t stackBlob[PACKED_FLUSH_CONFIG_STACK_SIZE];
+    std::vector<uint8_t> heapBlob;
+    uint8_t *blob = stackBlob;
+    if (maxSize > sizeof(stackBlob)) {
+        heapBlob.resize(maxSize);
+        blob = heapBlob.data();
+    }
+    uint8_t *out = PutVarint(blob, static_cast<int64_t>(config.damages.size()));
+    Rect previous = {};
+    for (const auto &rect : config.damages) {
+        out = PutVarint(out, static_cast<int64_t>(rect.x) - previous.x);
+        out = PutVarint(out, static_cast<int64_t>(rect.y) - previous.y);
+        out = PutVarint(out, rect.w);
+        out = PutVarint(out, rect.h);
+        previous = rect;
+    }
+    out = PutVarint(out, config.timestamp);
+    // wraps like the reader, a present time far from the timestamp still round-trips
+    out = PutVarint(out, static_cast<int64_t>(
+        static_cast<uint64_t>(config.desiredPresentTimestamp) - static_cast<uint64_t>(config.timestamp)));
+    uint32_t size = static_cast<uint32_t>(out - blob);
+    if (!parcel.WriteUint32(FLUSH_CONFIG_PACKED_TAG | PACKED_CONFIG_VERSION) || !parcel.WriteUint32(size) ||
+        !parcel.WriteBuffer(blob, size)) {
+        return GSERROR_BINDER;
+    }
+    return GSERROR_OK;
+}
+}
+
+uint8_t *PutVarint(uint8_t *out, int64_t signedValue)
+{
+    uint64_t value = ZigZagEncode(signedValue);
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7; // 7: bits per byte
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+bool GetVarint(const uint8_t *&in, const uint8_t *end, int64_t &signedValue)
+{
+    uint64_t value = 0;
+    for (uint32_t shift = 0; shift < 64 && in < end; shift += 7) { // 64: bits, 7: bits per byte
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            signedValue = ZigZagDecode(value);
+            return true;
+        }
+    }
+    return false;
 }
 
 GSError WriteFileDescriptor(MessageParcel &parcel, int32_t fd)
@@ -59,7 +240,15 @@ bool GetBoolParameter(const std::string &name, const std::string &defaultValue)
 
 bool ReadRequestConfig(MessageParcel &parcel, BufferRequestConfig &config)
 {
-    bool parcelRead = !parcel.ReadInt32(config.width) || !parcel.ReadInt32(config.height) ||
+    if (!parcel.ReadInt32(config.width)) {
+        BLOGE("parcel read fail.");
+        return false;
+    }
+    uint32_t head = static_cast<uint32_t>(config.width);
+    if ((head & PACKED_TAG_MASK) == REQUEST_CONFIG_PACKED_TAG) {
+        return ReadPackedRequestConfig(parcel, head & PACKED_VERSION_MASK, config);
+    }
+    bool parcelRead = !parcel.ReadInt32(config.height) ||
                       !parcel.ReadInt32(config.strideAlignment) || !parcel.ReadInt32(config.format) ||
                       !parcel.ReadUint64(config.usage) || !parcel.ReadInt32(config.timeout);
     if (parcelRead) {
@@ -73,21 +262,36 @@ bool ReadRequestConfig(MessageParcel &parcel, BufferRequestConfig &config)
         return false;
     }
     config.colorGamut = static_cast<GraphicColorGamut>(colorGamutVal);
-    if (config.colorGamut < GRAPHIC_COLOR_GAMUT_INVALID || config.colorGamut > GRAPHIC_COLOR_GAMUT_DISPLAY_BT2020) {
-        config.colorGamut = GRAPHIC_COLOR_GAMUT_INVALID;
-    }
     int32_t transformVal = 0;
     if (!parcel.ReadInt32(transformVal)) {
         BLOGE("parcel read transform fail.");
         return false;
     }
     config.transform = static_cast<GraphicTransformType>(transformVal);
-    if (config.transform < GRAPHIC_ROTATE_NONE || config.transform > GRAPHIC_ROTATE_BUTT) {
-        config.transform = GRAPHIC_ROTATE_BUTT;
-    }
+    CheckRequestConfigEnums(config);
     return true;
 }
 
+GSError WritePackedRequestConfig(MessageParcel &parcel, const BufferRequestConfig &config)
+{
+    PackedRequestConfig packed = {
+        .width = config.width,
+        .height = config.height,
+        .strideAlignment = config.strideAlignment,
+        .format = config.format,
+        .usage = config.usage,
+        .timeout = config.timeout,
+        .colorGamut = static_cast<int32_t>(config.colorGamut),
+        .transform = static_cast<int32_t>(config.transform),
+        .reserved = 0,
+    };
+    if (!parcel.WriteInt32(static_cast<int32_t>(REQUEST_CONFIG_PACKED_TAG | PACKED_CONFIG_VERSION)) ||
+        !parcel.WriteBuffer(&packed, sizeof(packed))) {
+        return GSERROR_BINDER;
+    }
+    return GSERROR_OK;
+}
+
 GSError ReadFlushConfig(MessageParcel &parcel, BufferFlushConfigWithDamages &config)
 {
     uint32_t size = 0;
@@ -95,6 +299,9 @@ GSError ReadFlushConfig(MessageParcel &parcel, BufferFlushConfigWithDamages &con
         BLOGE("ReadFlushConfig read size failed");
         return GSERROR_BINDER;
     }
+    if ((size & PACKED_TAG_MASK) == FLUSH_CONFIG_PACKED_TAG) {
+        return ReadPackedFlushConfig(parcel, size & PACKED_VERSION_MASK, config);
+    }
     if (size == 0) {
         BLOGE("ReadFlushConfig size is 0");
         return GSERROR_BINDER;
@@ -121,13 +328,17 @@ GSError ReadFlushConfig(MessageParcel &parcel, BufferFlushConfigWithDamages &con
     return GSERROR_OK;
 }
 
-GSError WriteFlushConfig(MessageParcel &parcel, BufferFlushConfigWithDamages const & config)
+GSError WriteFlushConfig(MessageParcel &parcel, BufferFlushConfigWithDamages const & config, bool isPacked)
 {
     uint32_t size = config.damages.size();
     if (size > SURFACE_PARCEL_SIZE_LIMIT) {
         BLOGE("WriteFlushConfig size more than limit, size: %{public}u", size);
         return GSERROR_INVALID_ARGUMENTS;
     }
+    // the legacy reader rejects an empty damage list, keep it on the legacy path to fail the same way
+    if (isPacked && size > 0) {
+        return WritePackedFlushConfig(parcel, config);
+    }
     if (!parcel.WriteUint32(size)) {
         return GSERROR_BINDER;
     }
@@ -418,7 +418,14 @@ void ConsumerSurface::Dump(std::string& result) const
     if (consumer_ == nullptr) {
         return;
     }
-    return consumer_->Dump(result);
+    // the dumpend round only closes the memory summary, the producer has nothing to add there
+    static const std::string dumpEndFlag = "dumpend";
+    bool isDumpEnd = result.size() >= dumpEndFlag.size() &&
+        result.compare(result.size() - dumpEndFlag.size(), dumpEndFlag.size(), dumpEndFlag) == 0;
+    consumer_->Dump(result);
+    if (!isDumpEnd && producer_ != nullptr) {
+        producer_->DumpCommandStats(result);
+    }
 }
 
 void ConsumerSurface::DumpCurrentFrameLayer() const
@@ -790,6 +797,13 @@ GSError ConsumerSurface::GetMaxQueueSize(uint32_t &queueSize) const
     }
     return consumer_->GetMaxQueueSize(queueSize);
 }
+GSError ConsumerSurface::SetAutoQueueSize(bool enabled, uint32_t minQueueSize)
+{
+    if (consumer_ == nullptr) {
+        return SURFACE_ERROR_UNKOWN;
+    }
+    return consumer_->SetAutoQueueSize(enabled, minQueueSize);
+}
 GSError ConsumerSurface::SetLppDrawSource(bool isShbSource, bool isRsSource)
 {
     if (consumer_ == nullptr) {
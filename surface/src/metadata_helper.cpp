@@ -14,6 +14,9 @@
  */
 
 #include "metadata_helper.h"
+
+#include <cstring>
+
 #include "buffer_log.h"
 
 #include "v2_2/buffer_handle_meta_key_type.h"
@@ -223,6 +226,35 @@ GSError MetadataHelper::GetCropRectMetadata(const sptr<SurfaceBuffer>& buffer, B
     return ConvertVecToMetadata(cropRect, crop);
 }
 
+GSError MetadataHelper::GetLayerMetadata(const sptr<SurfaceBuffer>& buffer, LayerMetadata& metadata)
+{
+    if (buffer == nullptr) {
+        return GSERROR_NO_BUFFER;
+    }
+
+    enum { COLORSPACE_INFO, HDR_METADATA_TYPE, CROP_REGION, HDR_STATIC_METADATA, HDR_DYNAMIC_METADATA };
+    static const std::vector<uint32_t> keys = {
+        ATTRKEY_COLORSPACE_INFO,
+        ATTRKEY_HDR_METADATA_TYPE,
+        ATTRKEY_CROP_REGION,
+        ATTRKEY_HDR_STATIC_METADATA,
+        ATTRKEY_HDR_DYNAMIC_METADATA,
+    };
+    std::vector<std::vector<uint8_t>> values;
+    auto ret = buffer->GetMetadataBatch(keys, values);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    metadata.hasColorSpaceInfo =
+        ConvertVecToMetadata(values[COLORSPACE_INFO], metadata.colorSpaceInfo) == GSERROR_OK;
+    metadata.hasHdrMetadataType =
+        ConvertVecToMetadata(values[HDR_METADATA_TYPE], metadata.hdrMetadataType) == GSERROR_OK;
+    metadata.hasCropRect = ConvertVecToMetadata(values[CROP_REGION], metadata.cropRect) == GSERROR_OK;
+    metadata.hdrStaticMetadata = std::move(values[HDR_STATIC_METADATA]);
+    metadata.hdrDynamicMetadata = std::move(values[HDR_DYNAMIC_METADATA]);
+    return GSERROR_OK;
+}
+
 GSError MetadataHelper::SetROIMetadata(sptr<SurfaceBuffer>& buffer, const std::vector<uint8_t>& roiMetadata)
 {
     if (buffer == nullptr) {
@@ -277,18 +309,145 @@ GSError MetadataHelper::GetSDRDynamicMetadata(const sptr<SurfaceBuffer>& buffer,
 #ifdef RS_ENABLE_TV_PQ_METADATA
 using namespace OHOS::HDI::Display::Graphic::Common::V2_1;
 
-GSError MetadataHelper::UpdateTVMetadataField(sptr<SurfaceBuffer>& buffer, OnSetFieldsFunc func)
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetSceneTag(
+    unsigned char value)
 {
-    if (buffer == nullptr) {
+    fields_.sceneTag = value;
+    dirtyFields_ |= FIELD_SCENE_TAG;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetUIFrameCount(
+    unsigned char value)
+{
+    fields_.uiFrameCnt = value;
+    dirtyFields_ |= FIELD_UI_FRAME_COUNT;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoFrameCount(
+    unsigned char value)
+{
+    fields_.vidFrameCnt = value;
+    dirtyFields_ |= FIELD_VIDEO_FRAME_COUNT;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoFrameRate(
+    unsigned char value)
+{
+    fields_.vidFps = value;
+    dirtyFields_ |= FIELD_VIDEO_FRAME_RATE;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoDecoderHigh(
+    unsigned short vidVdhWidth, unsigned short vidVdhHeight)
+{
+    fields_.vidVdhWidth = vidVdhWidth;
+    fields_.vidVdhHeight = vidVdhHeight;
+    dirtyFields_ |= FIELD_VIDEO_DECODER_HIGH;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoTVScaleMode(
+    unsigned char value)
+{
+    fields_.scaleMode = value;
+    dirtyFields_ |= FIELD_SCALE_MODE;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoTVDpPixelFormat(
+    unsigned int value)
+{
+    fields_.dpPixFmt = value;
+    dirtyFields_ |= FIELD_DP_PIXEL_FORMAT;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoColorimetryHdr(
+    unsigned char hdr, unsigned char colorimetry)
+{
+    fields_.colorimetry = colorimetry;
+    fields_.hdr = hdr;
+    dirtyFields_ |= FIELD_COLORIMETRY_HDR;
+    return *this;
+}
+
+MetadataHelper::TvPQMetadataTransaction& MetadataHelper::TvPQMetadataTransaction::SetVideoTVInfo(
+    const TvVideoWindow& tvVideoWindow)
+{
+    fields_.vidWinX = tvVideoWindow.x;
+    fields_.vidWinY = tvVideoWindow.y;
+    fields_.vidWinWidth = tvVideoWindow.width;
+    fields_.vidWinHeight = tvVideoWindow.height;
+    fields_.vidWinSize = tvVideoWindow.size;
+    dirtyFields_ |= FIELD_VIDEO_WINDOW;
+    return *this;
+}
+
+void MetadataHelper::TvPQMetadataTransaction::ApplyTo(TvPQMetadata& tvMetadata) const
+{
+    if (dirtyFields_ & FIELD_SCENE_TAG) {
+        tvMetadata.sceneTag = fields_.sceneTag;
+    }
+    if (dirtyFields_ & FIELD_UI_FRAME_COUNT) {
+        tvMetadata.uiFrameCnt = fields_.uiFrameCnt;
+    }
+    if (dirtyFields_ & FIELD_VIDEO_FRAME_COUNT) {
+        tvMetadata.vidFrameCnt = fields_.vidFrameCnt;
+    }
+    if (dirtyFields_ & FIELD_VIDEO_FRAME_RATE) {
+        tvMetadata.vidFps = fields_.vidFps;
+    }
+    if (dirtyFields_ & FIELD_VIDEO_DECODER_HIGH) {
+        tvMetadata.vidVdhWidth = fields_.vidVdhWidth;
+        tvMetadata.vidVdhHeight = fields_.vidVdhHeight;
+    }
+    if (dirtyFields_ & FIELD_SCALE_MODE) {
+        tvMetadata.scaleMode = fields_.scaleMode;
+    }
+    if (dirtyFields_ & FIELD_DP_PIXEL_FORMAT) {
+        tvMetadata.dpPixFmt = fields_.dpPixFmt;
+    }
+    if (dirtyFields_ & FIELD_COLORIMETRY_HDR) {
+        tvMetadata.colorimetry = fields_.colorimetry;
+        tvMetadata.hdr = fields_.hdr;
+    }
+    if (dirtyFields_ & FIELD_VIDEO_WINDOW) {
+        tvMetadata.vidWinX = fields_.vidWinX;
+        tvMetadata.vidWinY = fields_.vidWinY;
+        tvMetadata.vidWinWidth = fields_.vidWinWidth;
+        tvMetadata.vidWinHeight = fields_.vidWinHeight;
+        tvMetadata.vidWinSize = fields_.vidWinSize;
+    }
+}
+
+GSError MetadataHelper::TvPQMetadataTransaction::Commit()
+{
+    if (buffer_ == nullptr) {
         BLOGE("invalid buffer!");
         return GSERROR_NO_BUFFER;
     }
-    TvPQMetadata tvMetadata;
-    if (GetVideoTVMetadata(buffer, tvMetadata) != GSERROR_OK) {
+    if (dirtyFields_ == 0) {
+        return GSERROR_OK;
+    }
+    TvPQMetadata current;
+    bool exists = GetVideoTVMetadata(buffer_, current) == GSERROR_OK;
+    if (!exists) {
         BLOGD("tvMetadata not exist, reset data");
-        (void)memset_s(&tvMetadata, sizeof(tvMetadata), 0, sizeof(tvMetadata));
+        (void)memset_s(&current, sizeof(current), 0, sizeof(current));
+    }
+    TvPQMetadata tvMetadata = current;
+    ApplyTo(tvMetadata);
+    BLOGD("tvMetadata fields = 0x%{public}x, sceneTag = %{public}u, vidFps = %{public}u, hdr = %{public}u",
+        dirtyFields_, tvMetadata.sceneTag, tvMetadata.vidFps, tvMetadata.hdr);
+    dirtyFields_ = 0;
+    if (exists && memcmp(&current, &tvMetadata, sizeof(TvPQMetadata)) == 0) {
+        return GSERROR_OK;
     }
-    func(tvMetadata);
+    sptr<SurfaceBuffer> buffer = buffer_;
     return SetVideoTVMetadata(buffer, tvMetadata);
 }
 
@@ -326,85 +485,49 @@ GSError MetadataHelper::GetVideoTVMetadata(const sptr<SurfaceBuffer>& buffer, Tv
 
 GSError MetadataHelper::SetSceneTag(sptr<SurfaceBuffer>& buffer, unsigned char value)
 {
-    return UpdateTVMetadataField(buffer, [value](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.sceneTag = value;
-        BLOGD("tvMetadata sceneTag = %{public}u", tvPQMetadata.sceneTag);
-    });
+    return TvPQMetadataTransaction(buffer).SetSceneTag(value).Commit();
 }
 
 GSError MetadataHelper::SetUIFrameCount(sptr<SurfaceBuffer>& buffer, unsigned char value)
 {
-    return UpdateTVMetadataField(buffer, [value](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.uiFrameCnt = value;
-        BLOGD("tvMetadata uiFrameCnt = %{public}u", tvPQMetadata.uiFrameCnt);
-    });
+    return TvPQMetadataTransaction(buffer).SetUIFrameCount(value).Commit();
 }
 
 GSError MetadataHelper::SetVideoFrameCount(sptr<SurfaceBuffer>& buffer, unsigned char value)
 {
-    return UpdateTVMetadataField(buffer, [value](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.vidFrameCnt = value;
-        BLOGD("tvMetadata vidFrameCnt = %{public}u", tvPQMetadata.vidFrameCnt);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoFrameCount(value).Commit();
 }
 
 GSError MetadataHelper::SetVideoFrameRate(sptr<SurfaceBuffer>& buffer, unsigned char value)
 {
-    return UpdateTVMetadataField(buffer, [value](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.vidFps = value;
-        BLOGD("tvMetadata vidFps = %{public}u", tvPQMetadata.vidFps);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoFrameRate(value).Commit();
 }
 
 GSError MetadataHelper::SetVideoTVInfo(sptr<SurfaceBuffer>& buffer, const TvVideoWindow& tvVideoWindow)
 {
-    return UpdateTVMetadataField(buffer, [tvVideoWindow](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.vidWinX = tvVideoWindow.x;
-        tvPQMetadata.vidWinY = tvVideoWindow.y;
-        tvPQMetadata.vidWinWidth = tvVideoWindow.width;
-        tvPQMetadata.vidWinHeight = tvVideoWindow.height;
-        tvPQMetadata.vidWinSize = tvVideoWindow.size;
-        BLOGD("tvMetadata vid_win = (%{public}u, %{public}u, %{public}u, %{public}u), size = %{public}u",
-            tvPQMetadata.vidWinX, tvPQMetadata.vidWinY, tvPQMetadata.vidWinWidth, tvPQMetadata.vidWinHeight,
-            tvPQMetadata.vidWinSize);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoTVInfo(tvVideoWindow).Commit();
 }
 
 GSError MetadataHelper::SetVideoDecoderHigh(sptr<SurfaceBuffer>& buffer, unsigned short vidVdhWidth,
     unsigned short vidVdhHeight)
 {
-    return UpdateTVMetadataField(buffer, [vidVdhWidth, vidVdhHeight](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.vidVdhWidth = vidVdhWidth;
-        tvPQMetadata.vidVdhHeight = vidVdhHeight;
-        BLOGD("tvPQMetadata vidVdhWidth = %{public}u, tvPQMetadata vidVdhHeight = %{public}u",
-            tvPQMetadata.vidVdhWidth, tvPQMetadata.vidVdhHeight);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoDecoderHigh(vidVdhWidth, vidVdhHeight).Commit();
 }
 
 GSError MetadataHelper::SetVideoTVScaleMode(sptr<SurfaceBuffer>& buffer, unsigned char value)
 {
-    return UpdateTVMetadataField(buffer, [value](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.scaleMode = value;
-        BLOGD("tvMetadata scaleMode = %{public}u", tvPQMetadata.scaleMode);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoTVScaleMode(value).Commit();
 }
 
 GSError MetadataHelper::SetVideoTVDpPixelFormat(sptr<SurfaceBuffer>& buffer, unsigned int value)
 {
-    return UpdateTVMetadataField(buffer, [value](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.dpPixFmt = value;
-        BLOGD("tvMetadata dpPixFmt = %{public}u", tvPQMetadata.dpPixFmt);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoTVDpPixelFormat(value).Commit();
 }
 
 GSError MetadataHelper::SetVideoColorimetryHdr(sptr<SurfaceBuffer>& buffer, unsigned char hdr,
     unsigned char colorimetry)
 {
-    return UpdateTVMetadataField(buffer, [hdr, colorimetry](TvPQMetadata &tvPQMetadata) {
-        tvPQMetadata.colorimetry = colorimetry;
-        tvPQMetadata.hdr = hdr;
-        BLOGD("Colorimetry = %{public}u, HDR = %{public}u", tvPQMetadata.colorimetry, tvPQMetadata.hdr);
-    });
+    return TvPQMetadataTransaction(buffer).SetVideoColorimetryHdr(hdr, colorimetry).Commit();
 }
 
 GSError MetadataHelper::EraseVideoTVInfoKey(sptr<SurfaceBuffer>& buffer)
@@ -125,9 +125,10 @@ OHNativeWindow* CreateNativeWindowFromSurface(void* pSurface)
     nativeWindow->surface->SetWindowConfig(windowConfig);
 
     NativeObjectReference(nativeWindow);
+    // takes the surface's cache, which has to happen before the window can be found through SurfaceUtils
+    nativeWindow->surface->SetWptrNativeWindowToPSurface(nativeWindow);
     auto utils = SurfaceUtils::GetInstance();
     utils->AddNativeWindow(nativeWindow->surface->GetUniqueId(), nativeWindow);
-    nativeWindow->surface->SetWptrNativeWindowToPSurface(nativeWindow);
     auto &apsPlugin = OHOS::ISurfaceApsPlugin::LoadPlugin();
     if (apsPlugin != nullptr) {
         uint32_t queueSize = apsPlugin->InitSurface(nativeWindow->surface->GetName());
@@ -182,22 +183,7 @@ void DestroyNativeWindowBuffer(OHNativeWindowBuffer* buffer)
 
 static void NativeWindowAddToCache(OHNativeWindow *window, OHOS::SurfaceBuffer *sfbuffer, OHNativeWindowBuffer **buffer)
 {
-    uint32_t seqNum = sfbuffer->GetSeqNum();
-
-    std::lock_guard<std::mutex> lockGuard(window->mutex_);
-    auto iter = window->bufferCache_.find(seqNum);
-    if (iter == window->bufferCache_.end()) {
-        OHNativeWindowBuffer *nwBuffer = new OHNativeWindowBuffer();
-        nwBuffer->sfbuffer = sfbuffer;
-        nwBuffer->uiTimestamp = window->uiTimestamp;
-        *buffer = nwBuffer;
-        // Add to cache
-        NativeObjectReference(nwBuffer);
-        window->bufferCache_[seqNum] = nwBuffer;
-    } else {
-        *buffer = iter->second;
-        (*buffer)->uiTimestamp = window->uiTimestamp;
-    }
+    *buffer = window->bufferCache_->GetNativeWindowBuffer(window, sfbuffer, window->uiTimestamp);
 }
 
 bool IsNativeObjectAvailable(void *obj)
@@ -710,8 +696,9 @@ int32_t CreateNativeWindowFromSurfaceId(uint64_t surfaceId, OHNativeWindow **win
     }
 
     NativeObjectReference(nativeWindow);
-    utils->AddNativeWindow(nativeWindow->surface->GetUniqueId(), nativeWindow);
+    // takes the surface's cache, which has to happen before the window can be found through SurfaceUtils
     nativeWindow->surface->SetWptrNativeWindowToPSurface(nativeWindow);
+    utils->AddNativeWindow(nativeWindow->surface->GetUniqueId(), nativeWindow);
     *window = nativeWindow;
     return OHOS::GSERROR_OK;
 }
@@ -1193,7 +1180,8 @@ int32_t NativeWindowPreAllocBuffers(OHNativeWindow *window, uint32_t allocBuffer
     return OHOS::SURFACE_ERROR_OK;
 }
 
-NativeWindow::NativeWindow() : NativeWindowMagic(NATIVE_OBJECT_MAGIC_WINDOW), surface(nullptr)
+NativeWindow::NativeWindow() : NativeWindowMagic(NATIVE_OBJECT_MAGIC_WINDOW), surface(nullptr),
+    bufferCache_(new OHOS::ProducerBufferCache())
 {
 }
 
@@ -1205,14 +1193,10 @@ NativeWindow::~NativeWindow()
         utils->RemoveNativeWindow(surface->GetUniqueId());
     }
 
-    {
-        std::lock_guard<std::mutex> lockGuard(mutex_);
-        for (auto &[seqNum, buffer] : bufferCache_) {
-            NativeObjectUnreference(buffer);
-        }
-        surface = nullptr;
-        bufferCache_.clear();
-    }
+    // the producer surface keeps its buffers, only the NativeWindowBuffers handed out by this window go
+    bufferCache_->ClearNativeWindowBuffers(this);
+    surface = nullptr;
+    bufferCache_ = nullptr;
     std::call_once(appFrameworkTypeOnceFlag_, [] {});
     if (appFrameworkType_ != nullptr) {
         delete[] appFrameworkType_;
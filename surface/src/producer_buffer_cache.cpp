@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "producer_buffer_cache.h"
+
+#include <algorithm>
+
+#include "native_window.h"
+
+namespace OHOS {
+void ProducerBufferCache::ReleaseWindowBuffers(Entry &entry)
+{
+    for (auto &windowBuffer : entry.windowBuffers) {
+        NativeObjectUnreference(windowBuffer.nativeWindowBuffer);
+    }
+    entry.windowBuffers.clear();
+}
+
+ProducerBufferCache::~ProducerBufferCache()
+{
+    Clear();
+}
+
+sptr<SurfaceBuffer> ProducerBufferCache::Find(uint32_t sequence) const
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    auto it = entries_.find(sequence);
+    return it == entries_.end() ? nullptr : it->second.buffer;
+}
+
+bool ProducerBufferCache::Contains(uint32_t sequence) const
+{
+    return Find(sequence) != nullptr;
+}
+
+void ProducerBufferCache::Insert(uint32_t sequence, const sptr<SurfaceBuffer> &buffer)
+{
+    if (buffer == nullptr) {
+        EraseBuffer(sequence);
+        return;
+    }
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    Entry &entry = entries_[sequence];
+    if (entry.buffer == nullptr) {
+        bufferCount_++;
+    }
+    entry.buffer = buffer;
+}
+
+void ProducerBufferCache::EraseBuffer(uint32_t sequence)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    auto it = entries_.find(sequence);
+    if (it == entries_.end() || it->second.buffer == nullptr) {
+        return;
+    }
+    it->second.buffer = nullptr;
+    bufferCount_--;
+    if (it->second.windowBuffers.empty()) {
+        entries_.erase(it);
+    }
+}
+
+void ProducerBufferCache::ClearBuffers()
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        it->second.buffer = nullptr;
+        if (it->second.windowBuffers.empty()) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    bufferCount_ = 0;
+}
+
+void ProducerBufferCache::Erase(uint32_t sequence)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    auto it = entries_.find(sequence);
+    if (it == entries_.end()) {
+        return;
+    }
+    if (it->second.buffer != nullptr) {
+        bufferCount_--;
+    }
+    ReleaseWindowBuffers(it->second);
+    entries_.erase(it);
+}
+
+void ProducerBufferCache::Clear()
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    for (auto &[sequence, entry] : entries_) {
+        ReleaseWindowBuffers(entry);
+    }
+    entries_.clear();
+    bufferCount_ = 0;
+}
+
+void ProducerBufferCache::ClearNativeWindowBuffers(const void *window)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto &windowBuffers = it->second.windowBuffers;
+        for (auto wbIt = windowBuffers.begin(); wbIt != windowBuffers.end();) {
+            if (wbIt->window == window) {
+                NativeObjectUnreference(wbIt->nativeWindowBuffer);
+                wbIt = windowBuffers.erase(wbIt);
+            } else {
+                ++wbIt;
+            }
+        }
+        if (it->second.buffer == nullptr && windowBuffers.empty()) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+size_t ProducerBufferCache::Size() const
+{
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    return bufferCount_;
+}
+
+NativeWindowBuffer *ProducerBufferCache::GetNativeWindowBuffer(const void *window,
+    const sptr<SurfaceBuffer> &buffer, int64_t uiTimestamp)
+{
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    Entry &entry = entries_[buffer->GetSeqNum()];
+    auto it = std::find_if(entry.windowBuffers.begin(), entry.windowBuffers.end(),
+        [window](const WindowBuffer &windowBuffer) { return windowBuffer.window == window; });
+    if (it == entry.windowBuffers.end()) {
+        NativeWindowBuffer *nativeWindowBuffer = new NativeWindowBuffer();
+        nativeWindowBuffer->sfbuffer = buffer;
+        // the cache's reference, dropped when the queue deletes the buffer or the window goes away
+        NativeObjectReference(nativeWindowBuffer);
+        it = entry.windowBuffers.insert(entry.windowBuffers.end(), { window, nativeWindowBuffer });
+    }
+    it->nativeWindowBuffer->uiTimestamp = uiTimestamp;
+    return it->nativeWindowBuffer;
+}
+} // namespace OHOS
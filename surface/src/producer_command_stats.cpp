@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "producer_command_stats.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace OHOS {
+namespace {
+constexpr int64_t NS_PER_US = 1000;
+constexpr uint32_t PERMILLE = 1000;
+}
+
+ProducerCommandStats::ProducerCommandStats(size_t commandCount)
+    : commandCount_(commandCount), commands_(std::make_unique<Command[]>(commandCount)) {}
+
+void ProducerCommandStats::Record(uint32_t code, int64_t latencyNs)
+{
+    if (code >= commandCount_ || latencyNs < 0) {
+        return;
+    }
+    Command &command = commands_[code];
+    uint64_t ns = static_cast<uint64_t>(latencyNs);
+    command.count.fetch_add(1, std::memory_order_relaxed);
+    command.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t maxNs = command.maxNs.load(std::memory_order_relaxed);
+    while (ns > maxNs && !command.maxNs.compare_exchange_weak(maxNs, ns, std::memory_order_relaxed)) {
+    }
+    size_t bucket = 0;
+    for (int64_t us = latencyNs / NS_PER_US; us > 1 && bucket + 1 < HISTOGRAM_BUCKETS; us >>= 1) {
+        bucket++;
+    }
+    command.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+ProducerCommandStats::Snapshot ProducerCommandStats::GetSnapshot(uint32_t code) const
+{
+    Snapshot snapshot;
+    if (code >= commandCount_) {
+        return snapshot;
+    }
+    const Command &command = commands_[code];
+    snapshot.count = command.count.load(std::memory_order_relaxed);
+    snapshot.totalNs = command.totalNs.load(std::memory_order_relaxed);
+    snapshot.maxNs = command.maxNs.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        snapshot.histogram[i] = command.histogram[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+int64_t ProducerCommandStats::GetPercentileUs(const Snapshot &snapshot, uint32_t permille)
+{
+    // the fields are read one by one while calls go on, count from the histogram itself
+    uint64_t total = 0;
+    for (uint64_t calls : snapshot.histogram) {
+        total += calls;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = (total * permille + PERMILLE - 1) / PERMILLE;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += snapshot.histogram[i];
+        if (seen >= target) {
+            return int64_t(1) << (i + 1);
+        }
+    }
+    return int64_t(1) << HISTOGRAM_BUCKETS;
+}
+
+void ProducerCommandStats::Dump(std::string &result,
+    const std::function<const char *(uint32_t code)> &getName) const
+{
+    std::vector<std::pair<uint32_t, Snapshot>> called;
+    for (uint32_t code = 0; code < commandCount_; code++) {
+        Snapshot snapshot = GetSnapshot(code);
+        if (snapshot.count != 0) {
+            called.emplace_back(code, snapshot);
+        }
+    }
+    std::sort(called.begin(), called.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.second.totalNs > rhs.second.totalNs;
+    });
+    for (const auto &[code, snapshot] : called) {
+        const char *name = getName != nullptr ? getName(code) : nullptr;
+        result += "        " + (name != nullptr ? std::string(name) : std::to_string(code)) +
+            ": count = " + std::to_string(snapshot.count) +
+            ", total = " + std::to_string(snapshot.totalNs / NS_PER_US) + "us" +
+            ", avg = " + std::to_string(snapshot.totalNs / snapshot.count / NS_PER_US) + "us" +
+            ", p50 <= " + std::to_string(GetPercentileUs(snapshot, 500)) + "us" + // 500: p50
+            ", p99 <= " + std::to_string(GetPercentileUs(snapshot, 990)) + "us" + // 990: p99
+            ", max = " + std::to_string(snapshot.maxNs / NS_PER_US) + "us\n";
+    }
+}
+} // namespace OHOS
@@ -153,6 +153,13 @@ GSError ProducerSurface::RequestBufferLocked(sptr<SurfaceBuffer>& buffer,
     BLOGW("hiperf_surface RequestBuffer %{public}lx %{public}u %{public}u %{public}u",
         config.usage, config.format, config.width, config.height);
 #endif
+    return HandleRequestBufferResultLocked(ret, bedataimpl, retval, buffer, fence, config);
+}
+
+GSError ProducerSurface::HandleRequestBufferResultLocked(GSError ret, sptr<BufferExtraData>& bedataimpl,
+    IBufferProducer::RequestBufferReturnValue& retval, sptr<SurfaceBuffer>& buffer, sptr<SyncFence>& fence,
+    BufferRequestConfig& config)
+{
     if (ret != GSERROR_OK) {
         if (ret == GSERROR_NO_CONSUMER) {
             CleanCacheLocked(false);
@@ -195,44 +202,81 @@ GSError ProducerSurface::RequestBuffer(sptr<SurfaceBuffer>& buffer,
 
 GSError ProducerSurface::SetMetadataValue(sptr<SurfaceBuffer>& buffer)
 {
-    GSError ret = GSERROR_OK;
-    std::vector<uint8_t> metaData;
-    std::string value = GetUserData("ATTRKEY_COLORSPACE_INFO");
-    if (!value.empty()) {
-        ret = MetadataHelper::SetColorSpaceType(buffer, static_cast<CM_ColorSpaceType>(atoi(value.c_str())));
-        if (ret != GSERROR_OK) {
-            return ret;
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> metadata;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lockGuard(lockMutex_);
+        generation = userMetadataGeneration_;
+        if (generation == 0) {
+            return GSERROR_OK;
+        }
+        if (buffer == nullptr) {
+            return userMetadata_.empty() ? GSERROR_OK : GSERROR_NO_BUFFER;
+        }
+        // the buffer already carries this generation, nothing changed since it was pushed
+        if (buffer->GetAppliedMetadataGeneration() == generation) {
+            return GSERROR_OK;
         }
+        metadata.assign(userMetadata_.begin(), userMetadata_.end());
     }
-    value = GetUserData("OH_HDR_DYNAMIC_METADATA");
-    if (!value.empty()) {
-        metaData.resize(value.size());
-        metaData.assign(value.begin(), value.end());
-        ret = MetadataHelper::SetHDRDynamicMetadata(buffer, metaData);
+    if (!metadata.empty()) {
+        GSError ret = buffer->SetMetadataBatch(metadata);
         if (ret != GSERROR_OK) {
             return ret;
         }
     }
-    value = GetUserData("OH_HDR_STATIC_METADATA");
-    if (!value.empty()) {
-        metaData.resize(value.size());
-        metaData.assign(value.begin(), value.end());
-        ret = MetadataHelper::SetHDRStaticMetadata(buffer, metaData);
-        if (ret != GSERROR_OK) {
-            return ret;
+    buffer->SetAppliedMetadataGeneration(generation);
+    return GSERROR_OK;
+}
+
+void ProducerSurface::UpdateUserMetadataLocked(const std::string& key, const std::string& val)
+{
+    uint32_t attrKey = 0;
+    std::vector<uint8_t> value;
+    GSError ret = GSERROR_OK;
+    if (key == "ATTRKEY_COLORSPACE_INFO") {
+        attrKey = ATTRKEY_COLORSPACE_INFO;
+        if (!val.empty()) {
+            CM_ColorSpaceInfo colorSpaceInfo;
+            MetadataHelper::ConvertColorSpaceTypeToInfo(static_cast<CM_ColorSpaceType>(atoi(val.c_str())),
+                colorSpaceInfo);
+            ret = MetadataHelper::ConvertMetadataToVec(colorSpaceInfo, value);
+        }
+    } else if (key == "OH_HDR_DYNAMIC_METADATA") {
+        attrKey = ATTRKEY_HDR_DYNAMIC_METADATA;
+        value.assign(val.begin(), val.end());
+    } else if (key == "OH_HDR_STATIC_METADATA") {
+        attrKey = ATTRKEY_HDR_STATIC_METADATA;
+        value.assign(val.begin(), val.end());
+    } else if (key == "OH_HDR_METADATA_TYPE") {
+        attrKey = ATTRKEY_HDR_METADATA_TYPE;
+        if (!val.empty()) {
+            ret = MetadataHelper::ConvertMetadataToVec(static_cast<CM_HDR_Metadata_Type>(atoi(val.c_str())), value);
         }
+    } else {
+        return;
     }
-    value = GetUserData("OH_HDR_METADATA_TYPE");
-    if (!value.empty()) {
-        ret = MetadataHelper::SetHDRMetadataType(buffer, static_cast<CM_HDR_Metadata_Type>(atoi(value.c_str())));
+    if (ret != GSERROR_OK) {
+        BLOGW("convert %{public}s failed, ret: %{public}d, uniqueId: %{public}" PRIu64 ".",
+            key.c_str(), ret, queueId_);
+        value.clear();
     }
-    return ret;
+    if (value.empty()) {
+        userMetadata_.erase(attrKey);
+    } else {
+        userMetadata_[attrKey] = std::move(value);
+    }
+    // process-wide, so a buffer attached from another surface never looks up to date by accident
+    static std::atomic<uint64_t> nextGeneration = 0;
+    userMetadataGeneration_ = ++nextGeneration;
 }
 
 void ProducerSurface::SetBufferConfigLocked(sptr<BufferExtraData>& bedataimpl,
     IBufferProducer::RequestBufferReturnValue& retval, BufferRequestConfig& config)
 {
     if (retval.buffer != nullptr) {
+        // the consumer may have changed the metadata while it held the buffer
+        retval.buffer->InvalidateMetadataCache();
         retval.buffer->SetSurfaceBufferColorGamut(config.colorGamut);
         retval.buffer->SetSurfaceBufferTransform(config.transform);
         retval.buffer->SetExtraData(bedataimpl);
@@ -244,17 +288,7 @@ void ProducerSurface::DeleteCacheBufferLocked(sptr<BufferExtraData>& bedataimpl,
 {
     for (auto it = retval.deletingBuffers.begin(); it != retval.deletingBuffers.end(); it++) {
         uint32_t seqNum = static_cast<uint32_t>(*it);
-        bufferProducerCache_.erase(seqNum);
-        auto spNativeWindow = wpNativeWindow_.promote();
-        if (spNativeWindow != nullptr) {
-            std::lock_guard<std::mutex> lockGuard(spNativeWindow->mutex_);
-            auto& bufferCache = spNativeWindow->bufferCache_;
-            auto iter = bufferCache.find(seqNum);
-            if (iter != bufferCache.end()) {
-                NativeObjectUnreference(iter->second);
-                bufferCache.erase(iter);
-            }
-        }
+        bufferProducerCache_->Erase(seqNum);
     }
 }
 
@@ -263,7 +297,7 @@ GSError ProducerSurface::AddCacheLocked(sptr<BufferExtraData>& bedataimpl,
 {
     // add cache
     if (retval.buffer != nullptr) {
-        bufferProducerCache_[retval.sequence] = retval.buffer;
+        bufferProducerCache_->Insert(retval.sequence, retval.buffer);
         if (bufferName_ != "") {
             int fd = retval.buffer->GetFileDescriptor();
             if (fd > 0) {
@@ -283,17 +317,17 @@ GSError ProducerSurface::AddCacheLocked(sptr<BufferExtraData>& bedataimpl,
             }
         }
     } else {
-        auto it = bufferProducerCache_.find(retval.sequence);
-        if (it == bufferProducerCache_.end()) {
-            GSError syncRet = SyncProducerCacheLocked();
+        sptr<SurfaceBuffer> cachedBuffer = bufferProducerCache_->Find(retval.sequence);
+        if (cachedBuffer == nullptr) {
+            GSError syncRet = SyncProducerCacheLocked(retval.sequence);
             if (syncRet != GSERROR_OK) {
                 DeleteCacheBufferLocked(bedataimpl, retval, config);
                 BLOGE("sync cache failed, ret: %{public}d, buffer(%{public}u), uniqueId: %{public}" PRIu64 ".",
                     syncRet, retval.sequence, queueId_);
                 return syncRet;
             }
-            it = bufferProducerCache_.find(retval.sequence);
-            if (it == bufferProducerCache_.end()) {
+            cachedBuffer = bufferProducerCache_->Find(retval.sequence);
+            if (cachedBuffer == nullptr) {
                 DeleteCacheBufferLocked(bedataimpl, retval, config);
                 BLOGE("cache not find buffer(%{public}u) after sync, uniqueId: %{public}" PRIu64 ".",
                     retval.sequence, queueId_);
@@ -301,7 +335,7 @@ GSError ProducerSurface::AddCacheLocked(sptr<BufferExtraData>& bedataimpl,
             }
             BLOGI("sync cache success uniqueId: %{public}" PRIu64 ".", queueId_);
         }
-        retval.buffer = it->second;
+        retval.buffer = cachedBuffer;
     }
     SetBufferConfigLocked(bedataimpl, retval, config);
     DeleteCacheBufferLocked(bedataimpl, retval, config);
@@ -316,12 +350,12 @@ GSError ProducerSurface::AddCacheLocked(sptr<SurfaceBuffer>& attachedBuffer)
         return SURFACE_ERROR_UNKOWN;
     }
     auto sequence = attachedBuffer->GetSeqNum();
-    auto it = bufferProducerCache_.find(sequence);
-    if (it == bufferProducerCache_.end()) {
-        if (GetQueueSize() <= static_cast<uint32_t>(bufferProducerCache_.size())) {
-            bufferProducerCache_.clear();
+    if (!bufferProducerCache_->Contains(sequence)) {
+        if (GetQueueSize() <= static_cast<uint32_t>(bufferProducerCache_->Size())) {
+            bufferProducerCache_->ClearBuffers();
+            producerCacheGeneration_ = 0;
         }
-        bufferProducerCache_[sequence] = attachedBuffer;
+        bufferProducerCache_->Insert(sequence, attachedBuffer);
     }
     return SURFACE_ERROR_OK;
 }
@@ -329,35 +363,49 @@ GSError ProducerSurface::AddCacheLocked(sptr<SurfaceBuffer>& attachedBuffer)
 GSError ProducerSurface::RequestBuffers(std::vector<sptr<SurfaceBuffer>>& buffers,
     std::vector<sptr<SyncFence>>& fences, BufferRequestConfig& config)
 {
-    if (producer_ == nullptr) {
+    return RequestBuffers(buffers, fences, config, SURFACE_MAX_QUEUE_SIZE);
+}
+
+GSError ProducerSurface::RequestBuffers(std::vector<sptr<SurfaceBuffer>>& buffers,
+    std::vector<sptr<SyncFence>>& fences, BufferRequestConfig& config, uint32_t count)
+{
+    if (producer_ == nullptr || count == 0 || count > SURFACE_MAX_QUEUE_SIZE) {
         return GSERROR_INVALID_ARGUMENTS;
     }
-    std::vector<IBufferProducer::RequestBufferReturnValue> retvalues;
-    retvalues.resize(SURFACE_MAX_QUEUE_SIZE);
-    std::vector<sptr<BufferExtraData>> bedataimpls;
-    for (size_t i = 0; i < retvalues.size(); ++i) {
-        sptr<BufferExtraData> bedataimpl = new BufferExtraDataImpl;
-        bedataimpls.emplace_back(bedataimpl);
-    }
     std::lock_guard<std::mutex> lockGuard(mutex_);
+    auto &retvalues = batchRetvalues_;
+    auto &bedataimpls = batchExtraData_;
+    retvalues.resize(count);
+    bedataimpls.resize(count);
+    for (auto &bedataimpl : bedataimpls) {
+        if (bedataimpl == nullptr) {
+            bedataimpl = new BufferExtraDataImpl;
+        }
+    }
     GSError ret = producer_->RequestBuffers(config, bedataimpls, retvalues);
     if (ret != GSERROR_NO_BUFFER && ret != GSERROR_OK) {
         /**
          * if server is connected, but result is failed.
          * client needs to synchronize status.
          */
-        if (retvalues[0].isConnected) {
+        if (!retvalues.empty() && retvalues[0].isConnected) {
             isDisconnected_ = false;
         }
+        retvalues.clear();
         BLOGD("RequestBuffers ret: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, queueId_);
         return ret;
     }
     isDisconnected_ = false;
+    buffers.reserve(buffers.size() + retvalues.size());
+    fences.reserve(fences.size() + retvalues.size());
     for (size_t i = 0; i < retvalues.size(); ++i) {
         AddCacheLocked(bedataimpls[i], retvalues[i], config);
         buffers.emplace_back(retvalues[i].buffer);
         fences.emplace_back(retvalues[i].fence);
+        // now owned by the buffer, the slot gets a new object next time, the others are reused
+        bedataimpls[i] = nullptr;
     }
+    retvalues.clear();
     return GSERROR_OK;
 }
 
@@ -490,12 +538,12 @@ GSError ProducerSurface::AttachBufferToQueue(sptr<SurfaceBuffer> buffer)
     auto ret = producer_->AttachBufferToQueue(buffer);
     if (ret == GSERROR_OK) {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        if (bufferProducerCache_.find(buffer->GetSeqNum()) != bufferProducerCache_.end()) {
+        if (bufferProducerCache_->Contains(buffer->GetSeqNum())) {
             BLOGE("Attach buffer %{public}u, uniqueId: %{public}" PRIu64 ".",
                 buffer->GetSeqNum(), queueId_);
             return SURFACE_ERROR_BUFFER_IS_INCACHE;
         }
-        bufferProducerCache_[buffer->GetSeqNum()] = buffer;
+        bufferProducerCache_->Insert(buffer->GetSeqNum(), buffer);
     }
     return ret;
 }
@@ -509,12 +557,11 @@ GSError ProducerSurface::DetachBufferFromQueue(sptr<SurfaceBuffer> buffer, bool
     auto ret = producer_->DetachBufferFromQueue(buffer);
     if (ret == GSERROR_OK) {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        auto it = bufferProducerCache_.find(buffer->GetSeqNum());
-        if (it == bufferProducerCache_.end()) {
+        if (!bufferProducerCache_->Contains(buffer->GetSeqNum())) {
             BLOGE("Detach buffer %{public}u, uniqueId: %{public}" PRIu64 ".", buffer->GetSeqNum(), queueId_);
             return SURFACE_ERROR_BUFFER_NOT_INCACHE;
         }
-        bufferProducerCache_.erase(it);
+        bufferProducerCache_->EraseBuffer(buffer->GetSeqNum());
     }
     return ret;
 }
@@ -739,6 +786,7 @@ GSError ProducerSurface::SetUserData(const std::string& key, const std::string&
     }
 
     userData_[key] = val;
+    UpdateUserMetadataLocked(key, val);
     auto iter = onUserDataChange_.begin();
     while (iter != onUserDataChange_.end()) {
         if (iter->second != nullptr) {
@@ -877,14 +925,14 @@ GSError ProducerSurface::OnBufferReleasedWithSequenceAndFence(uint32_t sequence,
     OnReleaseFuncWithSequenceAndFence funcWithSequenceAndFence = nullptr;
     {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        auto iter = bufferProducerCache_.find(sequence);
-        if (iter == bufferProducerCache_.end()) {
+        buffer = bufferProducerCache_->Find(sequence);
+        if (buffer == nullptr) {
             BLOGE("OnBufferReleasedWithSequenceAndFence cache not find buffer(%{public}u),"
                 "uniqueId: %{public}" PRIu64 ".",
                 sequence, queueId_);
             return GSERROR_NO_BUFFER;
         }
-        if (SetMetadataValue(iter->second) != GSERROR_OK) {
+        if (SetMetadataValue(buffer) != GSERROR_OK) {
             BLOGD("SetMetadataValue fail, uniqueId: %{public}" PRIu64 ".", queueId_);
         }
 
@@ -898,7 +946,6 @@ GSError ProducerSurface::OnBufferReleasedWithSequenceAndFence(uint32_t sequence,
                 funcWithSequenceAndFence = funcWithSequenceAndFence_;
             }
         }
-        buffer = iter->second;
     }
     
     if (funcWithSequenceAndFence != nullptr) {
@@ -987,25 +1034,18 @@ bool ProducerSurface::IsRemote()
 
 void ProducerSurface::CleanAllLocked(uint32_t *bufSeqNum)
 {
-    if (bufSeqNum && bufferProducerCache_.find(*bufSeqNum) != bufferProducerCache_.end()) {
+    sptr<SurfaceBuffer> cachedBuffer = bufSeqNum ? bufferProducerCache_->Find(*bufSeqNum) : nullptr;
+    if (cachedBuffer != nullptr) {
         std::lock_guard<std::mutex> lockGuard(preCacheBufferMutex_);
-        preCacheBuffer_ = bufferProducerCache_[*bufSeqNum];
+        preCacheBuffer_ = cachedBuffer;
         flushBufferCountAfterCleanCache_ = 0;
         if (preCacheBuffer_ != nullptr) {
             SURFACE_TRACE_NAME_FMT("ReleasePreCacheBuffer: bufId=%" PRIu64 ", bufSeqNum=%u",
                 preCacheBuffer_->GetBufferId(), preCacheBuffer_->GetSeqNum());
         }
     }
-    bufferProducerCache_.clear();
-    auto spNativeWindow = wpNativeWindow_.promote();
-    if (spNativeWindow != nullptr) {
-        std::lock_guard<std::mutex> lockGuard(spNativeWindow->mutex_);
-        auto& bufferCache = spNativeWindow->bufferCache_;
-        for (auto& [seqNum, buffer] : bufferCache) {
-            NativeObjectUnreference(buffer);
-        }
-        bufferCache.clear();
-    }
+    bufferProducerCache_->Clear();
+    producerCacheGeneration_ = 0;
 }
 
 GSError ProducerSurface::CleanCacheLocked(bool cleanAll)
@@ -1245,6 +1285,9 @@ GSError ProducerSurface::SetWptrNativeWindowToPSurface(void* nativeWindow)
     }
     NativeWindow *nw = reinterpret_cast<NativeWindow *>(nativeWindow);
     std::lock_guard<std::mutex> lockGuard(mutex_);
+    // the window hands out wrappers from this cache, so deleting a buffer drops both in one place.
+    // it is called before the window is published, nothing else reads bufferCache_ yet
+    nw->bufferCache_ = bufferProducerCache_;
     wpNativeWindow_ = nw;
     return GSERROR_OK;
 }
@@ -1394,6 +1437,22 @@ GSError ProducerSurface::SetSingleBufferMode(SingleBufferMode mode)
     return producer_->SetSingleBufferMode(mode);
 }
 
+GSError ProducerSurface::EnableControlChannel()
+{
+    if (producer_ == nullptr) {
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    return producer_->EnableControlChannel();
+}
+
+GSError ProducerSurface::SetFlushBufferAsyncMode(bool isAsync)
+{
+    if (producer_ == nullptr) {
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    return producer_->SetFlushBufferAsyncMode(isAsync);
+}
+
 GSError ProducerSurface::SetRequestBufferNoblockMode(bool noblock)
 {
     if (producer_ == nullptr) {
@@ -1407,16 +1466,14 @@ GSError ProducerSurface::UpdateCacheLocked(sptr<BufferExtraData>& bedataimpl,
 {
     // add cache
     if (retval.buffer == nullptr) {
-        auto it = bufferProducerCache_.find(retval.sequence);
-        if (it == bufferProducerCache_.end()) {
+        retval.buffer = bufferProducerCache_->Find(retval.sequence);
+        if (retval.buffer == nullptr) {
             DeleteCacheBufferLocked(bedataimpl, retval, config);
             BLOGE("cache not find buffer(%{public}u), uniqueId: %{public}" PRIu64 ".", retval.sequence, queueId_);
             return SURFACE_ERROR_UNKOWN;
-        } else {
-            retval.buffer = it->second;
         }
     }
-    bufferProducerCache_.erase(retval.sequence);
+    bufferProducerCache_->EraseBuffer(retval.sequence);
     SetBufferConfigLocked(bedataimpl, retval, config);
     DeleteCacheBufferLocked(bedataimpl, retval, config);
     return SURFACE_ERROR_OK;
@@ -1458,6 +1515,56 @@ GSError ProducerSurface::RequestAndDetachBuffer(sptr<SurfaceBuffer>& buffer, spt
     return ret;
 }
 
+GSError ProducerSurface::FlushAndRequestBuffer(sptr<SurfaceBuffer>& buffer, const sptr<SyncFence>& fence,
+    BufferFlushConfigWithDamages& flushConfig, sptr<SurfaceBuffer>& nextBuffer, sptr<SyncFence>& nextFence,
+    BufferRequestConfig& requestConfig)
+{
+    if (buffer == nullptr || fence == nullptr || producer_ == nullptr) {
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    sptr<BufferExtraData> bedata = buffer->GetExtraData();
+    if (bedata == nullptr) {
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    BufferRequestConfig updateConfig = requestConfig;
+    if (gameUpscaleProcessor_ != nullptr) {
+        gameUpscaleProcessor_(&updateConfig.width, &updateConfig.height);
+    }
+    nextBuffer = nullptr;
+
+    // like FlushBuffer, mutex_ is not held across the call: an in-process consumer may release synchronously,
+    // and OnBufferReleasedWithSequenceAndFence takes mutex_
+    IBufferProducer::RequestBufferReturnValue retval;
+    sptr<BufferExtraData> bedataimpl = new BufferExtraDataImpl;
+    GSError requestRet = GSERROR_OK;
+    GSError ret = producer_->FlushAndRequestBuffer(buffer->GetSeqNum(), bedata, fence, flushConfig, updateConfig,
+        bedataimpl, retval, requestRet);
+    if (ret == GSERROR_NOT_SUPPORT) {
+        ret = FlushBuffer(buffer, fence, flushConfig);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        return RequestBufferLocked(nextBuffer, nextFence, updateConfig);
+    }
+    bool traceTag = IsTagEnabled(HITRACE_TAG_GRAPHIC_AGP);
+    AcquireFenceTracker::TrackFence(fence, traceTag);
+    if (ret != GSERROR_OK) {
+        if (ret == GSERROR_NO_CONSUMER) {
+            CleanCache();
+        }
+        BLOGD("FlushAndRequestBuffer flush ret: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, queueId_);
+        return ret;
+    }
+    ReleasePreCacheBuffer(0);
+    std::lock_guard<std::mutex> lockGuard(mutex_);
+    if (requestRet == GSERROR_NO_BUFFER) {
+        // the queue had no free buffer to hand out without blocking, request the usual way
+        return RequestBufferLocked(nextBuffer, nextFence, updateConfig);
+    }
+    return HandleRequestBufferResultLocked(requestRet, bedataimpl, retval, nextBuffer, nextFence, updateConfig);
+}
+
 GSError ProducerSurface::AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, const sptr<SyncFence>& fence,
                                               BufferFlushConfig& config, bool needMap)
 {
@@ -1478,12 +1585,12 @@ GSError ProducerSurface::AttachAndFlushBuffer(sptr<SurfaceBuffer>& buffer, const
     auto ret = producer_->AttachAndFlushBuffer(buffer, bedata, fence, configWithDamages, needMap);
     if (ret == GSERROR_OK) {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        if (bufferProducerCache_.find(buffer->GetSeqNum()) != bufferProducerCache_.end()) {
+        if (bufferProducerCache_->Contains(buffer->GetSeqNum())) {
             BLOGE("Attach buffer %{public}u, uniqueId: %{public}" PRIu64 ".",
                 buffer->GetSeqNum(), queueId_);
             return SURFACE_ERROR_BUFFER_IS_INCACHE;
         }
-        bufferProducerCache_[buffer->GetSeqNum()] = buffer;
+        bufferProducerCache_->Insert(buffer->GetSeqNum(), buffer);
         ReleasePreCacheBuffer(0);
     } else if (ret == GSERROR_NO_CONSUMER) {
         CleanCache();
@@ -1698,23 +1805,38 @@ GSError ProducerSurface::SetGameUpscaleProcessor(GameUpscaleProcessor processor)
     return GSERROR_OK;
 }
 
-GSError ProducerSurface::SyncProducerCacheLocked()
+GSError ProducerSurface::SyncProducerCacheLocked(uint32_t sequence)
 {
     if (producer_ == nullptr) {
         BLOGE("producer_ is nullptr, uniqueId: %{public}" PRIu64 ".", queueId_);
         return GSERROR_INVALID_ARGUMENTS;
     }
-    std::map<uint32_t, sptr<SurfaceBuffer>> buffers;
-    GSError ret = producer_->SyncProducerCache(buffers);
+    IBufferProducer::ProducerCacheDelta delta;
+    GSError ret = producer_->SyncProducerCacheDelta(producerCacheGeneration_, delta);
+    if (ret == GSERROR_OK && !delta.isFull && delta.buffers.find(sequence) == delta.buffers.end()) {
+        // the queue did not change the buffer since the last sync, this side dropped it, only a full sync has it
+        delta = {};
+        ret = producer_->SyncProducerCacheDelta(0, delta);
+    }
+    if (ret == SURFACE_ERROR_NOT_SUPPORT) {
+        delta.isFull = true;
+        ret = producer_->SyncProducerCache(delta.buffers);
+    }
     if (ret != GSERROR_OK) {
         BLOGE("SyncProducerCache failed, ret: %{public}d, uniqueId: %{public}" PRIu64 ".", ret, queueId_);
         return ret;
     }
-    std::string str = "SyncProducerCache uniqueId:" + std::to_string(queueId_);
-    for (auto& [seqNum, buffer] : buffers) {
+    std::string str = "SyncProducerCache uniqueId:" + std::to_string(queueId_) +
+        (delta.isFull ? " full" : " delta");
+    for (uint32_t seqNum : delta.removedSequences) {
+        str += " removed:" + std::to_string(seqNum);
+        bufferProducerCache_->EraseBuffer(seqNum);
+    }
+    for (auto& [seqNum, buffer] : delta.buffers) {
         str += " seqNum:" + std::to_string(seqNum);
-        bufferProducerCache_[seqNum] = buffer;
+        bufferProducerCache_->Insert(seqNum, buffer);
     }
+    producerCacheGeneration_ = delta.generation;
     BLOGI("%{public}s", str.c_str());
     return GSERROR_OK;
 }
@@ -1731,19 +1853,8 @@ GSError ProducerSurface::CleanReleasedBuffers(std::vector<uint32_t> &cleanedSeqN
 
     {
         std::lock_guard<std::mutex> lockGuard(mutex_);
-        auto spNativeWindow = wpNativeWindow_.promote();
         for (const auto &seqNum : cleanedSeqNums) {
-            bufferProducerCache_.erase(seqNum);
-            if (spNativeWindow == nullptr) {
-                continue;
-            }
-            std::lock_guard<std::mutex> lockGuard(spNativeWindow->mutex_);
-            auto it = spNativeWindow->bufferCache_.find(seqNum);
-            if (it == spNativeWindow->bufferCache_.end()) {
-                continue;
-            }
-            NativeObjectUnreference(it->second);
-            spNativeWindow->bufferCache_.erase(it);
+            bufferProducerCache_->Erase(seqNum);
         }
     }
     return ret;
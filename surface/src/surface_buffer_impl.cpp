@@ -15,6 +15,8 @@
 
 #include "surface_buffer_impl.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <dlfcn.h>
 #include <mutex>
@@ -39,8 +41,55 @@ static std::mutex g_seqNumMutex;
 static constexpr uint32_t PID_BIT = 16;
 static constexpr uint32_t MAX_SEQUENCE_NUM = 0xFFFF;
 static constexpr uint64_t NEXTID_MASK_48BIT = 0XFFFFFFFFFFFF;
-static uint64_t g_nextId = 0;
-static std::bitset<MAX_SEQUENCE_NUM> g_seqBitset(0);
+static std::atomic<uint64_t> g_nextId = 0;
+static std::mutex g_memMgrMutex;
+
+// one bit per sequence number in use, searched a 64-bit word at a time
+class SequenceBitmap {
+public:
+    SequenceBitmap()
+    {
+        // MAX_SEQUENCE_NUM itself is not a valid sequence number, keep its bit set so it is never handed out
+        words_[WORD_COUNT - 1] = ~0ULL << (MAX_SEQUENCE_NUM % WORD_BITS);
+    }
+
+    bool Test(uint32_t seqNum) const
+    {
+        return (words_[seqNum / WORD_BITS] & (1ULL << (seqNum % WORD_BITS))) != 0;
+    }
+
+    void Set(uint32_t seqNum)
+    {
+        words_[seqNum / WORD_BITS] |= 1ULL << (seqNum % WORD_BITS);
+    }
+
+    void Reset(uint32_t seqNum)
+    {
+        words_[seqNum / WORD_BITS] &= ~(1ULL << (seqNum % WORD_BITS));
+    }
+
+    // first clear bit at or after start, wrapping around, MAX_SEQUENCE_NUM if every bit is set
+    uint32_t FindFirstClear(uint32_t start) const
+    {
+        uint32_t index = start / WORD_BITS;
+        // bits below start in the first word are only looked at after wrapping around
+        uint64_t word = words_[index] | ((1ULL << (start % WORD_BITS)) - 1);
+        for (uint32_t i = 0; i <= WORD_COUNT; i++) {
+            if (word != ~0ULL) {
+                return index * WORD_BITS + static_cast<uint32_t>(__builtin_ctzll(~word));
+            }
+            index = (index + 1) % WORD_COUNT;
+            word = words_[index];
+        }
+        return MAX_SEQUENCE_NUM;
+    }
+
+private:
+    static constexpr uint32_t WORD_BITS = 64;
+    static constexpr uint32_t WORD_COUNT = (MAX_SEQUENCE_NUM + WORD_BITS) / WORD_BITS;
+    uint64_t words_[WORD_COUNT] = {};
+};
+static SequenceBitmap g_seqBitmap;
 class DisplayBufferDiedRecipient : public OHOS::IRemoteObject::DeathRecipient {
 public:
     DisplayBufferDiedRecipient() = default;
@@ -103,15 +152,13 @@ SurfaceBufferImpl::SurfaceBufferImpl()
         sequenceNumber_ = (static_cast<uint32_t>(getpid()) & 0xFFFF) << PID_BIT;
         sequence_number_++;
         sequenceNumber_ |= (GenerateSequenceNumber(sequence_number_) & MAX_SEQUENCE_NUM);
-
-        g_nextId++;
-        // 0xFFFF is pid mask. 48 is pid offset.bufferId_ high 16bit is pid, low 16bit is Auto-increment id
-        bufferId_ = ((static_cast<uint64_t>(getpid()) & 0xFFFF) << 48);
-        bufferId_ |= (g_nextId & NEXTID_MASK_48BIT);
-
-        InitMemMgrMembers();
     }
-    metaDataCache_.clear();
+    published_.seqNum.store(sequenceNumber_, std::memory_order_release);
+    // 0xFFFF is pid mask. 48 is pid offset.bufferId_ high 16bit is pid, low 16bit is Auto-increment id
+    bufferId_ = ((static_cast<uint64_t>(getpid()) & 0xFFFF) << 48);
+    bufferId_ |= ((g_nextId.fetch_add(1) + 1) & NEXTID_MASK_48BIT);
+    InitMemMgrMembers();
+    ClearMetadataCacheLocked();
     bedata_ = new BufferExtraDataImpl;
 
     BLOGD("SurfaceBufferImpl ctor, seq: %{public}u", sequenceNumber_);
@@ -120,29 +167,23 @@ SurfaceBufferImpl::SurfaceBufferImpl()
 uint32_t SurfaceBufferImpl::GenerateSequenceNumber(uint32_t& seqNum)
 {
     uint32_t startSeqNum = seqNum;
-    seqNum %= MAX_SEQUENCE_NUM;
-    for (; seqNum <= MAX_SEQUENCE_NUM; ++seqNum) {
-        if (seqNum == MAX_SEQUENCE_NUM) {
-            seqNum = 0;
-        }
-
-        if (!g_seqBitset.test(seqNum)) {
-            g_seqBitset.set(seqNum);
-            break;
-        }
-
-        if (seqNum == (startSeqNum - 1) % MAX_SEQUENCE_NUM) {
-            BLOGE("SurfaceBufferImpl GenerateSequenceNumber failed, no idle seq");
-            seqNum = startSeqNum;
-            break;
-        }
-    }
-
+    uint32_t found = g_seqBitmap.FindFirstClear(seqNum % MAX_SEQUENCE_NUM);
+    if (found == MAX_SEQUENCE_NUM) {
+        BLOGE("SurfaceBufferImpl GenerateSequenceNumber failed, no idle seq");
+        seqNum = startSeqNum;
+        return seqNum;
+    }
+    g_seqBitmap.Set(found);
+    seqNum = found;
     return seqNum;
 }
 
 void SurfaceBufferImpl::InitMemMgrMembers()
 {
+    if (initMemMgrSucceed_.load()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_memMgrMutex);
     if (initMemMgrSucceed_.load()) {
         return;
     }
@@ -180,7 +221,7 @@ void SurfaceBufferImpl::InitMemMgrMembers()
 
 SurfaceBufferImpl::SurfaceBufferImpl(uint32_t seqNum)
 {
-    metaDataCache_.clear();
+    ClearMetadataCacheLocked();
     bufferDtorCb_ = nullptr;
     if (IsReclaimed()) {
         TryResumeIfNeeded();
@@ -189,16 +230,16 @@ SurfaceBufferImpl::SurfaceBufferImpl(uint32_t seqNum)
         std::lock_guard<std::mutex> lock(g_seqNumMutex);
         sequenceNumber_ = seqNum;
         if ((sequenceNumber_ & MAX_SEQUENCE_NUM) < MAX_SEQUENCE_NUM && (sequenceNumber_ >> PID_BIT) == getpid()) {
-            if (g_seqBitset.test(sequenceNumber_ & MAX_SEQUENCE_NUM)) {
+            if (g_seqBitmap.Test(sequenceNumber_ & MAX_SEQUENCE_NUM)) {
                 isSeqNumExist_.store(true);
             }
-            g_seqBitset.set(sequenceNumber_ & MAX_SEQUENCE_NUM);
+            g_seqBitmap.Set(sequenceNumber_ & MAX_SEQUENCE_NUM);
         }
-        g_nextId++;
-        // 0xFFFF is pid mask. 48 is pid offset.bufferId_ high 16bit is pid, low 16bit is Auto-increment id
-        bufferId_ = ((static_cast<uint64_t>(getpid()) & 0xFFFF) << 48);
-        bufferId_ |= (g_nextId & NEXTID_MASK_48BIT);
     }
+    published_.seqNum.store(sequenceNumber_, std::memory_order_release);
+    // 0xFFFF is pid mask. 48 is pid offset.bufferId_ high 16bit is pid, low 16bit is Auto-increment id
+    bufferId_ = ((static_cast<uint64_t>(getpid()) & 0xFFFF) << 48);
+    bufferId_ |= ((g_nextId.fetch_add(1) + 1) & NEXTID_MASK_48BIT);
     bedata_ = new BufferExtraDataImpl;
     BLOGD("SurfaceBufferImpl ctor, seq: %{public}u", sequenceNumber_);
 }
@@ -211,7 +252,7 @@ SurfaceBufferImpl::~SurfaceBufferImpl()
         std::lock_guard<std::mutex> lock(g_seqNumMutex);
         if ((sequenceNumber_ & MAX_SEQUENCE_NUM) < MAX_SEQUENCE_NUM && (sequenceNumber_ >> PID_BIT) == getpid() &&
             !isSeqNumExist_) {
-            g_seqBitset.reset(sequenceNumber_ & MAX_SEQUENCE_NUM);
+            g_seqBitmap.Reset(sequenceNumber_ & MAX_SEQUENCE_NUM);
         }
     }
     FreeBufferHandleLocked();
@@ -255,6 +296,7 @@ GSError SurfaceBufferImpl::Alloc(const BufferRequestConfig& config, const sptr<S
         SURFACE_TRACE_NAME_FMT("Alloc buffer");
         dRet = displayBuffer->AllocMem(info, handle_);
     }
+    PublishHandleFieldsLocked();
     if (dRet == GRAPHIC_DISPLAY_SUCCESS && handle_ != nullptr) {
         dRet = displayBuffer->RegisterBuffer(*handle_);
         if (dRet != GRAPHIC_DISPLAY_SUCCESS && dRet != GRAPHIC_DISPLAY_NOT_SUPPORT) {
@@ -380,29 +422,61 @@ GSError SurfaceBufferImpl::InvalidateCache()
 
 void SurfaceBufferImpl::FreeBufferHandleLocked()
 {
-    metaDataCache_.clear();
+    ClearMetadataCacheLocked();
     if (handle_) {
         SURFACE_TRACE_NAME_FMT("FreeBufferHandle buffer_size: %d", handle_->size);
-        IDisplayBufferSptr displayBuffer = GetDisplayBuffer();
-        if (displayBuffer == nullptr) {
-            FreeBufferHandle(handle_);
-            handle_ = nullptr;
-            return;
-        }
-        if (handle_->virAddr != nullptr) {
-            displayBuffer->Unmap(*handle_);
-            handle_->virAddr = nullptr;
-        }
-        displayBuffer->FreeMem(*handle_);
+        FreeTakenBufferHandle(handle_);
         handle_ = nullptr;
+        PublishHandleFieldsLocked();
+    }
+}
+
+void SurfaceBufferImpl::FreeTakenBufferHandle(BufferHandle* handle)
+{
+    if (handle == nullptr) {
+        return;
     }
+    IDisplayBufferSptr displayBuffer = GetDisplayBuffer();
+    if (displayBuffer == nullptr) {
+        FreeBufferHandle(handle);
+        return;
+    }
+    if (handle->virAddr != nullptr) {
+        displayBuffer->Unmap(*handle);
+        handle->virAddr = nullptr;
+    }
+    displayBuffer->FreeMem(*handle);
+}
+
+BufferHandle* SurfaceBufferImpl::TakeBufferHandle()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ClearMetadataCacheLocked();
+    BufferHandle* handle = handle_;
+    handle_ = nullptr;
+    PublishHandleFieldsLocked();
+    return handle;
+}
+
+void SurfaceBufferImpl::AdoptBufferHandle(const BufferRequestConfig& config, BufferHandle* handle)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    FreeBufferHandleLocked();
+    // the handle is still registered and mapped from the allocation it was taken from
+    handle_ = handle;
+    PublishHandleFieldsLocked();
+    surfaceBufferColorGamut_ = static_cast<GraphicColorGamut>(config.colorGamut);
+    transform_ = static_cast<GraphicTransformType>(config.transform);
+    surfaceBufferWidth_ = config.width;
+    surfaceBufferHeight_ = config.height;
+    bufferRequestConfig_ = config;
+    RecordOriginalBufferHandleFields();
 }
 
 // return BufferHandle* is dangerous, need to refactor
 BufferHandle* SurfaceBufferImpl::GetBufferHandle() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return handle_;
+    return published_.handle.load(std::memory_order_acquire);
 }
 
 void SurfaceBufferImpl::SetSurfaceBufferColorGamut(const GraphicColorGamut& colorGamut)
@@ -415,8 +489,7 @@ void SurfaceBufferImpl::SetSurfaceBufferColorGamut(const GraphicColorGamut& colo
 
 GraphicColorGamut SurfaceBufferImpl::GetSurfaceBufferColorGamut() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return surfaceBufferColorGamut_;
+    return surfaceBufferColorGamut_.load(std::memory_order_relaxed);
 }
 
 void SurfaceBufferImpl::SetSurfaceBufferTransform(const GraphicTransformType& transform)
@@ -429,8 +502,7 @@ void SurfaceBufferImpl::SetSurfaceBufferTransform(const GraphicTransformType& tr
 
 GraphicTransformType SurfaceBufferImpl::GetSurfaceBufferTransform() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return transform_;
+    return transform_.load(std::memory_order_relaxed);
 }
 
 int32_t SurfaceBufferImpl::GetSurfaceBufferWidth() const
@@ -459,56 +531,32 @@ void SurfaceBufferImpl::SetSurfaceBufferHeight(int32_t height)
 
 int32_t SurfaceBufferImpl::GetWidth() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_ARGUMENT;
-    }
-    return handle_->width;
+    return published_.width.load(std::memory_order_relaxed);
 }
 
 int32_t SurfaceBufferImpl::GetHeight() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_ARGUMENT;
-    }
-    return handle_->height;
+    return published_.height.load(std::memory_order_relaxed);
 }
 
 int32_t SurfaceBufferImpl::GetStride() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_ARGUMENT;
-    }
-    return handle_->stride;
+    return published_.stride.load(std::memory_order_relaxed);
 }
 
 int32_t SurfaceBufferImpl::GetFormat() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_ARGUMENT;
-    }
-    return handle_->format;
+    return published_.format.load(std::memory_order_relaxed);
 }
 
 uint64_t SurfaceBufferImpl::GetUsage() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_USAGE;
-    }
-    return handle_->usage;
+    return published_.usage.load(std::memory_order_relaxed);
 }
 
 uint64_t SurfaceBufferImpl::GetPhyAddr() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_PHYADDR;
-    }
-    return handle_->phyAddr;
+    return published_.phyAddr.load(std::memory_order_relaxed);
 }
 
 void* SurfaceBufferImpl::GetVirAddr()
@@ -526,20 +574,12 @@ void* SurfaceBufferImpl::GetVirAddr()
 
 int32_t SurfaceBufferImpl::GetFileDescriptor() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_ARGUMENT;
-    }
-    return handle_->fd;
+    return published_.fd.load(std::memory_order_relaxed);
 }
 
 uint32_t SurfaceBufferImpl::GetSize() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (handle_ == nullptr) {
-        return INVALID_SIZE;
-    }
-    return handle_->size;
+    return published_.size.load(std::memory_order_relaxed);
 }
 
 GSError SurfaceBufferImpl::GetPlanesInfo(void** planesInfo)
@@ -594,6 +634,7 @@ void SurfaceBufferImpl::SetBufferHandle(BufferHandle* handle)
     FreeBufferHandleLocked();
 
     handle_ = handle;
+    PublishHandleFieldsLocked();
     IDisplayBufferSptr displayBuffer = GetDisplayBuffer();
     if (displayBuffer == nullptr) {
         return;
@@ -681,7 +722,7 @@ GSError SurfaceBufferImpl::WriteBufferProperty(MessageParcel& parcel)
         !parcel.WriteUint64(bufferRequestConfig_.usage) || !parcel.WriteInt32(bufferRequestConfig_.timeout) ||
         !parcel.WriteUint32(static_cast<uint32_t>(bufferRequestConfig_.colorGamut)) ||
         !parcel.WriteUint32(static_cast<uint32_t>(bufferRequestConfig_.transform)) ||
-        !parcel.WriteUint32(scalingMode_) || !parcel.WriteUint32(transform_);
+        !parcel.WriteUint32(scalingMode_) || !parcel.WriteUint32(transform_.load());
     if (ret) {
         BLOGE("parcel write fail, seq: %{public}u.", sequenceNumber_);
         return SURFACE_ERROR_UNKOWN;
@@ -734,6 +775,8 @@ GSError SurfaceBufferImpl::ReadFromMessageParcel(MessageParcel &parcel,
     SetBufferHandle(handle);
     if (handle != nullptr) {
         std::lock_guard<std::mutex> lock(mutex_);
+        // a buffer read again from a parcel keeps nothing it cached about the previous handle
+        ClearMetadataCacheLocked();
         if (!parcel.ReadBool(hasOriginalFields_) ||
             !parcel.ReadInt32(originalWidth_) ||
             !parcel.ReadInt32(originalHeight_) ||
@@ -754,8 +797,7 @@ OH_NativeBuffer* SurfaceBufferImpl::SurfaceBufferToNativeBuffer()
 
 uint32_t SurfaceBufferImpl::GetSeqNum() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return sequenceNumber_;
+    return published_.seqNum.load(std::memory_order_relaxed);
 }
 
 GSError SurfaceBufferImpl::CheckBufferConfig(int32_t width, int32_t height,
@@ -788,17 +830,29 @@ GSError SurfaceBufferImpl::SetMetadata(uint32_t key, const std::vector<uint8_t>&
     if (handle_ == nullptr) {
         return GSERROR_NOT_INIT;
     }
+    return SetMetadataLocked(*displayBuffer, key, value, enableCache);
+}
 
+GSError SurfaceBufferImpl::SetMetadataLocked(HDI::Display::Buffer::V1_4::IDisplayBuffer& displayBuffer, uint32_t key,
+    const std::vector<uint8_t>& value, bool enableCache)
+{
     if (enableCache && MetaDataCachedLocked(key, value)) {
         return GSERROR_OK;
     }
 
-    auto dRet = displayBuffer->SetMetadata(*handle_, key, value);
+    // even a failed set may have left a value behind
+    metaDataAbsentKeys_.erase(key);
+    auto dRet = displayBuffer.SetMetadata(*handle_, key, value);
     if (dRet == GRAPHIC_DISPLAY_SUCCESS) {
         // cache metaData
         if (enableCache) {
             metaDataCache_[key] = value;
         }
+        metaDataReadCache_[key] = value;
+        if (isMetaDataKeysCached_ && std::find(metaDataKeys_.begin(), metaDataKeys_.end(), key) ==
+            metaDataKeys_.end()) {
+            metaDataKeys_.push_back(key);
+        }
         return GSERROR_OK;
     }
     BLOGE("SetMetadata Failed with %{public}d", dRet);
@@ -819,13 +873,82 @@ GSError SurfaceBufferImpl::GetMetadata(uint32_t key, std::vector<uint8_t>& value
     if (handle_ == nullptr) {
         return GSERROR_NOT_INIT;
     }
-    auto dRet = displayBuffer->GetMetadata(*handle_, key, value);
+    return GetMetadataLocked(*displayBuffer, key, value);
+}
+
+GSError SurfaceBufferImpl::GetMetadataLocked(HDI::Display::Buffer::V1_4::IDisplayBuffer& displayBuffer, uint32_t key,
+    std::vector<uint8_t>& value)
+{
+    auto iter = metaDataReadCache_.find(key);
+    if (iter != metaDataReadCache_.end()) {
+        value = iter->second;
+        return GSERROR_OK;
+    }
+    if (metaDataAbsentKeys_.count(key) != 0) {
+        return GSERROR_HDI_ERROR;
+    }
+    auto dRet = displayBuffer.GetMetadata(*handle_, key, value);
     if (dRet == GRAPHIC_DISPLAY_SUCCESS) {
+        metaDataReadCache_[key] = value;
         return GSERROR_OK;
     }
+    // only a key the allocation does not have is remembered, any other failure may pass on the next call
+    if (dRet == GRAPHIC_DISPLAY_NOT_SUPPORT) {
+        metaDataAbsentKeys_.insert(key);
+    }
     return GSERROR_HDI_ERROR;
 }
 
+GSError SurfaceBufferImpl::SetMetadataBatch(const std::vector<std::pair<uint32_t, std::vector<uint8_t>>>& metadata,
+    bool enableCache)
+{
+    for (const auto& [key, value] : metadata) {
+        if (key == 0 || key >= HDI::Display::Graphic::Common::V1_1::ATTRKEY_END) {
+            return GSERROR_INVALID_ARGUMENTS;
+        }
+    }
+    IDisplayBufferSptr displayBuffer = GetOrResetDisplayBuffer();
+    if (displayBuffer == nullptr) {
+        return GSERROR_INTERNAL;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handle_ == nullptr) {
+        return GSERROR_NOT_INIT;
+    }
+    for (const auto& [key, value] : metadata) {
+        GSError ret = SetMetadataLocked(*displayBuffer, key, value, enableCache);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+    }
+    return GSERROR_OK;
+}
+
+GSError SurfaceBufferImpl::GetMetadataBatch(const std::vector<uint32_t>& keys,
+    std::vector<std::vector<uint8_t>>& values)
+{
+    values.assign(keys.size(), {});
+    IDisplayBufferSptr displayBuffer = GetOrResetDisplayBuffer();
+    if (displayBuffer == nullptr) {
+        return GSERROR_INTERNAL;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handle_ == nullptr) {
+        return GSERROR_NOT_INIT;
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] == 0 || keys[i] >= HDI::Display::Graphic::Common::V1_1::ATTRKEY_END) {
+            continue;
+        }
+        if (GetMetadataLocked(*displayBuffer, keys[i], values[i]) != GSERROR_OK) {
+            values[i].clear();
+        }
+    }
+    return GSERROR_OK;
+}
+
 GSError SurfaceBufferImpl::ListMetadataKeys(std::vector<uint32_t>& keys)
 {
     IDisplayBufferSptr displayBuffer = GetOrResetDisplayBuffer();
@@ -837,8 +960,14 @@ GSError SurfaceBufferImpl::ListMetadataKeys(std::vector<uint32_t>& keys)
     if (handle_ == nullptr) {
         return GSERROR_NOT_INIT;
     }
+    if (isMetaDataKeysCached_) {
+        keys = metaDataKeys_;
+        return GSERROR_OK;
+    }
     auto dRet = displayBuffer->ListMetadataKeys(*handle_, keys);
     if (dRet == GRAPHIC_DISPLAY_SUCCESS) {
+        metaDataKeys_ = keys;
+        isMetaDataKeysCached_ = true;
         return GSERROR_OK;
     }
     BLOGE("ListMetadataKeys Failed with %{public}d", dRet);
@@ -862,12 +991,48 @@ GSError SurfaceBufferImpl::EraseMetadataKey(uint32_t key)
     auto dRet = displayBuffer->EraseMetadataKey(*handle_, key);
     if (dRet == GRAPHIC_DISPLAY_SUCCESS) {
         metaDataCache_.erase(key);
+        metaDataReadCache_.erase(key);
+        metaDataAbsentKeys_.insert(key);
+        metaDataKeys_.erase(std::remove(metaDataKeys_.begin(), metaDataKeys_.end(), key), metaDataKeys_.end());
+        // the erased key may be one the producer pushed
+        appliedMetadataGeneration_ = 0;
         return GSERROR_OK;
     }
+    metaDataAbsentKeys_.erase(key);
     BLOGD("EraseMetadataKey Failed with %{public}d", dRet);
     return GSERROR_HDI_ERROR;
 }
 
+void SurfaceBufferImpl::InvalidateMetadataCache()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // metaDataCache_ stays, it only skips repeated sets of the same value
+    metaDataReadCache_.clear();
+    metaDataAbsentKeys_.clear();
+    metaDataKeys_.clear();
+    isMetaDataKeysCached_ = false;
+}
+
+uint64_t SurfaceBufferImpl::GetAppliedMetadataGeneration() const
+{
+    return appliedMetadataGeneration_.load();
+}
+
+void SurfaceBufferImpl::SetAppliedMetadataGeneration(uint64_t generation)
+{
+    appliedMetadataGeneration_ = generation;
+}
+
+void SurfaceBufferImpl::ClearMetadataCacheLocked()
+{
+    metaDataCache_.clear();
+    metaDataReadCache_.clear();
+    metaDataAbsentKeys_.clear();
+    metaDataKeys_.clear();
+    isMetaDataKeysCached_ = false;
+    appliedMetadataGeneration_ = 0;
+}
+
 void SurfaceBufferImpl::SetCropMetadata(const Rect& crop)
 {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -1022,19 +1187,45 @@ void SurfaceBufferImpl::SetAndMergeSyncFence(const sptr<SyncFence>& syncFence)
     if (syncFence == nullptr) {
         return;
     }
-    if (syncFence_ != nullptr && syncFence_->IsValid()) {
-        syncFence_ = SyncFence::MergeFence("SurfaceBufferSyncFence", syncFence_, syncFence);
+    if (syncFences_ != nullptr) {
+        syncFences_->Add(syncFence);
+    } else if (syncFence_ != nullptr && syncFence_->IsValid()) {
+        // merged only once someone needs a single fence, by then most members have signaled and are dropped
+        syncFences_ = new FenceSet();
+        syncFences_->Add(syncFence_);
+        syncFences_->Add(syncFence);
     } else {
         syncFence_ = syncFence;
     }
 }
 
+void SurfaceBufferImpl::MergeSyncFencesLocked() const
+{
+    if (syncFences_ != nullptr) {
+        syncFence_ = syncFences_->Merge("SurfaceBufferSyncFence");
+        syncFences_ = nullptr;
+    }
+}
+
 sptr<SyncFence> SurfaceBufferImpl::GetSyncFence() const
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    MergeSyncFencesLocked();
     return syncFence_;
 }
 
+sptr<FenceSet> SurfaceBufferImpl::GetSyncFences() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    sptr<FenceSet> fences = new FenceSet();
+    if (syncFences_ != nullptr) {
+        fences->Add(syncFences_);
+    } else {
+        fences->Add(syncFence_);
+    }
+    return fences->GetSize() == 0 ? nullptr : fences;
+}
+
 uint64_t SurfaceBufferImpl::GetBufferId() const
 {
     return bufferId_;
@@ -1119,8 +1310,8 @@ GSError SurfaceBufferImpl::WriteAllPropertiesToMessageParcel(MessageParcel& parc
         }
     }
 
-    if (!parcel.WriteUint32(static_cast<uint32_t>(surfaceBufferColorGamut_)) ||
-        !parcel.WriteUint32(static_cast<uint32_t>(transform_)) ||
+    if (!parcel.WriteUint32(static_cast<uint32_t>(surfaceBufferColorGamut_.load())) ||
+        !parcel.WriteUint32(static_cast<uint32_t>(transform_.load())) ||
         !parcel.WriteUint32(static_cast<uint32_t>(scalingMode_))) {
         BLOGE("%{public}s: write color/transform info failed, seq: %{public}u", __func__, sequenceNumber_);
         return GSERROR_API_FAILED;
@@ -1142,6 +1333,7 @@ GSError SurfaceBufferImpl::WriteAllPropertiesToMessageParcel(MessageParcel& parc
         return GSERROR_API_FAILED;
     }
 
+    MergeSyncFencesLocked();
     if (!parcel.WriteBool(syncFence_ != nullptr)) {
         BLOGE("%{public}s: write sync fence flag failed, seq: %{public}u", __func__, sequenceNumber_);
         return GSERROR_API_FAILED;
@@ -1171,6 +1363,7 @@ GSError SurfaceBufferImpl::ReadAllPropertiesFromMessageParcel(MessageParcel &par
             BLOGE("%{public}s: read basic info failed", __func__);
             return GSERROR_API_FAILED;
         }
+        published_.seqNum.store(sequenceNumber_, std::memory_order_release);
     }
 
     bool hasHandle = false;
@@ -1192,6 +1385,7 @@ GSError SurfaceBufferImpl::ReadAllPropertiesFromMessageParcel(MessageParcel &par
         handle_ = nullptr;
     }
     std::lock_guard<std::mutex> lock(mutex_);
+    ClearMetadataCacheLocked();
     uint32_t colorGamut = 0;
     uint32_t transform = 0;
     uint32_t scalingMode = 0;
@@ -1226,6 +1420,7 @@ GSError SurfaceBufferImpl::ReadAllPropertiesFromMessageParcel(MessageParcel &par
         BLOGE("%{public}s: read sync fence flag failed", __func__);
         return GSERROR_API_FAILED;
     }
+    syncFences_ = nullptr;
     if (hasSyncFence) {
         syncFence_ = SyncFence::ReadFromMessageParcel(parcel, readSafeFdFunc);
         if (syncFence_ == nullptr) {
@@ -1248,6 +1443,31 @@ GSError SurfaceBufferImpl::ReadAllPropertiesFromMessageParcel(MessageParcel &par
     return GSERROR_OK;
 }
 
+void SurfaceBufferImpl::PublishHandleFieldsLocked()
+{
+    if (handle_ == nullptr) {
+        published_.width.store(INVALID_ARGUMENT, std::memory_order_relaxed);
+        published_.height.store(INVALID_ARGUMENT, std::memory_order_relaxed);
+        published_.stride.store(INVALID_ARGUMENT, std::memory_order_relaxed);
+        published_.format.store(INVALID_ARGUMENT, std::memory_order_relaxed);
+        published_.usage.store(INVALID_USAGE, std::memory_order_relaxed);
+        published_.phyAddr.store(INVALID_PHYADDR, std::memory_order_relaxed);
+        published_.fd.store(INVALID_ARGUMENT, std::memory_order_relaxed);
+        published_.size.store(INVALID_SIZE, std::memory_order_relaxed);
+    } else {
+        published_.width.store(handle_->width, std::memory_order_relaxed);
+        published_.height.store(handle_->height, std::memory_order_relaxed);
+        published_.stride.store(handle_->stride, std::memory_order_relaxed);
+        published_.format.store(handle_->format, std::memory_order_relaxed);
+        published_.usage.store(handle_->usage, std::memory_order_relaxed);
+        published_.phyAddr.store(handle_->phyAddr, std::memory_order_relaxed);
+        published_.fd.store(handle_->fd, std::memory_order_relaxed);
+        published_.size.store(static_cast<uint32_t>(handle_->size), std::memory_order_relaxed);
+    }
+    // release, whoever loads the pointer also sees what was written to the handle before
+    published_.handle.store(handle_, std::memory_order_release);
+}
+
 void SurfaceBufferImpl::RecordOriginalBufferHandleFields()
 {
     if (handle_ == nullptr) {
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "surface_control_channel.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <message_parcel.h>
+#include <securec.h>
+
+#include "buffer_log.h"
+
+namespace OHOS {
+namespace {
+constexpr size_t RECORD_ALIGN = 64;
+
+void CloseFd(int32_t& fd)
+{
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+}
+
+size_t SurfaceControlChannel::SharedSize(uint32_t capacity)
+{
+    size_t headerSize = (sizeof(SharedHeader) + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+    return headerSize + sizeof(SurfaceControlRecord) * capacity * 2; // 2: one ring per direction
+}
+
+SurfaceControlChannel::SurfaceControlChannel(Role role, uint32_t capacity, int32_t memFd, void* shared,
+    size_t sharedSize, const int32_t doorbells[2], int32_t socketFd)
+    : role_(role), capacity_(capacity), memFd_(memFd), header_(static_cast<SharedHeader*>(shared)),
+      sharedSize_(sharedSize), doorbells_{doorbells[0], doorbells[1]}, socketFd_(socketFd)
+{
+}
+
+SurfaceControlChannel::~SurfaceControlChannel()
+{
+    if (header_ != nullptr) {
+        munmap(header_, sharedSize_);
+        header_ = nullptr;
+    }
+    CloseFd(memFd_);
+    CloseFd(doorbells_[0]);
+    CloseFd(doorbells_[1]);
+    CloseFd(socketFd_);
+}
+
+GSError SurfaceControlChannel::CreatePair(sptr<SurfaceControlChannel>& producerEnd,
+    sptr<SurfaceControlChannel>& queueEnd, uint32_t capacity)
+{
+    if (capacity == 0 || capacity > MAX_CAPACITY) {
+        return GSERROR_INVALID_ARGUMENTS;
+    }
+    size_t sharedSize = SharedSize(capacity);
+    int32_t memFd = memfd_create("surface_control_channel", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memFd < 0) {
+        BLOGE("memfd_create failed, errno: %{public}d", errno);
+        return GSERROR_API_FAILED;
+    }
+    int32_t doorbells[2] = { -1, -1 };
+    int32_t sockets[2] = { -1, -1 };
+    auto cleanup = [&memFd, &doorbells, &sockets]() {
+        CloseFd(memFd);
+        CloseFd(doorbells[0]);
+        CloseFd(doorbells[1]);
+        CloseFd(sockets[0]);
+        CloseFd(sockets[1]);
+    };
+    // the size can no longer change under the queue once it has checked it
+    if (ftruncate(memFd, static_cast<off_t>(sharedSize)) != 0 ||
+        fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        BLOGE("memfd setup failed, errno: %{public}d", errno);
+        cleanup();
+        return GSERROR_API_FAILED;
+    }
+    doorbells[0] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    doorbells[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (doorbells[0] < 0 || doorbells[1] < 0 ||
+        socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        BLOGE("eventfd or socketpair failed, errno: %{public}d", errno);
+        cleanup();
+        return GSERROR_API_FAILED;
+    }
+    void* shared = mmap(nullptr, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (shared == MAP_FAILED) {
+        BLOGE("mmap failed, errno: %{public}d", errno);
+        cleanup();
+        return GSERROR_API_FAILED;
+    }
+    SharedHeader* header = new (shared) SharedHeader();
+    header->magic = MAGIC;
+    header->version = VERSION;
+    header->capacity = capacity;
+    header->recordSize = sizeof(SurfaceControlRecord);
+    munmap(shared, sharedSize);
+
+    int32_t queueDoorbells[2] = { dup(doorbells[0]), dup(doorbells[1]) };
+    int32_t queueMemFd = dup(memFd);
+    queueEnd = Attach(Role::QUEUE, queueMemFd, queueDoorbells, sockets[1]);
+    producerEnd = Attach(Role::PRODUCER, memFd, doorbells, sockets[0]);
+    if (queueEnd == nullptr || producerEnd == nullptr) {
+        queueEnd = nullptr;
+        producerEnd = nullptr;
+        return GSERROR_API_FAILED;
+    }
+    return GSERROR_OK;
+}
+
+sptr<SurfaceControlChannel> SurfaceControlChannel::Attach(Role role, int32_t memFd, const int32_t doorbells[2],
+    int32_t socketFd)
+{
+    int32_t fds[] = { memFd, doorbells[0], doorbells[1], socketFd };
+    auto cleanup = [&fds]() {
+        for (int32_t& fd : fds) {
+            CloseFd(fd);
+        }
+    };
+    for (int32_t fd : fds) {
+        if (fd < 0) {
+            cleanup();
+            return nullptr;
+        }
+    }
+    struct stat memStat = {};
+    if (fstat(memFd, &memStat) != 0 || memStat.st_size < static_cast<off_t>(sizeof(SharedHeader))) {
+        BLOGE("control channel memory is too small");
+        cleanup();
+        return nullptr;
+    }
+    size_t fileSize = static_cast<size_t>(memStat.st_size);
+    void* shared = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (shared == MAP_FAILED) {
+        BLOGE("mmap failed, errno: %{public}d", errno);
+        cleanup();
+        return nullptr;
+    }
+    const SharedHeader* header = static_cast<const SharedHeader*>(shared);
+    uint32_t capacity = header->capacity;
+    if (header->magic != MAGIC || header->version != VERSION || header->recordSize != sizeof(SurfaceControlRecord) ||
+        capacity == 0 || capacity > MAX_CAPACITY || SharedSize(capacity) > fileSize) {
+        BLOGE("control channel header mismatch, version: %{public}u, capacity: %{public}u",
+            header->version, capacity);
+        munmap(shared, fileSize);
+        cleanup();
+        return nullptr;
+    }
+    return new SurfaceControlChannel(role, capacity, memFd, shared, fileSize, doorbells, socketFd);
+}
+
+GSError SurfaceControlChannel::WriteToMessageParcel(MessageParcel& parcel) const
+{
+    if (!parcel.WriteFileDescriptor(memFd_) || !parcel.WriteFileDescriptor(doorbells_[0]) ||
+        !parcel.WriteFileDescriptor(doorbells_[1]) || !parcel.WriteFileDescriptor(socketFd_)) {
+        return GSERROR_BINDER;
+    }
+    return GSERROR_OK;
+}
+
+sptr<SurfaceControlChannel> SurfaceControlChannel::ReadFromMessageParcel(MessageParcel& parcel)
+{
+    int32_t memFd = parcel.ReadFileDescriptor();
+    int32_t doorbells[2] = { parcel.ReadFileDescriptor(), parcel.ReadFileDescriptor() };
+    int32_t socketFd = parcel.ReadFileDescriptor();
+    return Attach(Role::QUEUE, memFd, doorbells, socketFd);
+}
+
+SurfaceControlRecord* SurfaceControlChannel::Records(uint32_t ring) const
+{
+    size_t headerSize = (sizeof(SharedHeader) + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+    auto base = reinterpret_cast<uint8_t*>(header_) + headerSize;
+    return reinterpret_cast<SurfaceControlRecord*>(base) + static_cast<size_t>(ring) * capacity_;
+}
+
+GSError SurfaceControlChannel::SendFence(int32_t fenceFd)
+{
+    char data = 0;
+    struct iovec iov = { .iov_base = &data, .iov_len = sizeof(data) };
+    char control[CMSG_SPACE(sizeof(int32_t))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int32_t));
+    if (memcpy_s(CMSG_DATA(cmsg), sizeof(int32_t), &fenceFd, sizeof(int32_t)) != EOK) {
+        return GSERROR_API_FAILED;
+    }
+    ssize_t ret = TEMP_FAILURE_RETRY(sendmsg(socketFd_, &msg, MSG_DONTWAIT | MSG_NOSIGNAL));
+    if (ret != static_cast<ssize_t>(sizeof(data))) {
+        if (errno == EAGAIN) {
+            return GSERROR_NO_BUFFER;
+        }
+        isBroken_ = true;
+        return GSERROR_NO_CONSUMER;
+    }
+    return GSERROR_OK;
+}
+
+int32_t SurfaceControlChannel::ReceiveFence()
+{
+    char data = 0;
+    struct iovec iov = { .iov_base = &data, .iov_len = sizeof(data) };
+    char control[CMSG_SPACE(sizeof(int32_t))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t ret = TEMP_FAILURE_RETRY(recvmsg(socketFd_, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC));
+    if (ret != static_cast<ssize_t>(sizeof(data))) {
+        return -1;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int32_t))) {
+        return -1;
+    }
+    int32_t fd = -1;
+    if (memcpy_s(&fd, sizeof(fd), CMSG_DATA(cmsg), sizeof(int32_t)) != EOK) {
+        CloseFd(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void SurfaceControlChannel::RingDoorbell(uint32_t ring)
+{
+    uint64_t value = 1;
+    (void)TEMP_FAILURE_RETRY(write(doorbells_[ring], &value, sizeof(value)));
+}
+
+GSError SurfaceControlChannel::Send(const SurfaceControlRecord& record, int32_t fenceFd)
+{
+    if (IsClosed()) {
+        return GSERROR_NO_CONSUMER;
+    }
+    std::lock_guard<std::mutex> lockGuard(sendMutex_);
+    uint32_t ring = SendRing();
+    uint32_t tail = header_->tails[ring].tail.load(std::memory_order_relaxed);
+    uint32_t head = header_->heads[ring].head.load(std::memory_order_acquire);
+    if (tail - head >= capacity_) {
+        return GSERROR_NO_BUFFER;
+    }
+    if (fenceFd >= 0) {
+        GSError ret = SendFence(fenceFd);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+    }
+    SurfaceControlRecord* slot = Records(ring) + tail % capacity_;
+    *slot = record;
+    slot->hasFence = fenceFd >= 0;
+    // seq_cst against the reader's isSleeping store, one of the two always sees the other
+    header_->tails[ring].tail.store(tail + 1);
+    if (header_->heads[ring].isSleeping.load() != 0 && header_->heads[ring].isSleeping.exchange(0) != 0) {
+        RingDoorbell(ring);
+    }
+    return GSERROR_OK;
+}
+
+GSError SurfaceControlChannel::Receive(SurfaceControlRecord& record, int32_t& fenceFd)
+{
+    fenceFd = -1;
+    if (isBroken_) {
+        return GSERROR_NO_CONSUMER;
+    }
+    uint32_t ring = ReceiveRing();
+    uint32_t head = header_->heads[ring].head.load(std::memory_order_relaxed);
+    uint32_t tail = header_->tails[ring].tail.load(std::memory_order_acquire);
+    if (head == tail) {
+        return GSERROR_NO_ENTRY;
+    }
+    if (tail - head > capacity_) {
+        BLOGE("control channel index broken, head: %{public}u, tail: %{public}u", head, tail);
+        isBroken_ = true;
+        return GSERROR_INTERNAL;
+    }
+    record = Records(ring)[head % capacity_];
+    header_->heads[ring].head.store(head + 1, std::memory_order_release);
+    if (record.hasFence) {
+        fenceFd = ReceiveFence();
+        if (fenceFd < 0) {
+            BLOGE("control channel fence missing, sequence: %{public}u", record.sequence);
+            isBroken_ = true;
+            return GSERROR_INTERNAL;
+        }
+    }
+    if (record.damageCount > SurfaceControlRecord::MAX_DAMAGES) {
+        record.damageCount = SurfaceControlRecord::MAX_DAMAGES;
+    }
+    return GSERROR_OK;
+}
+
+void SurfaceControlChannel::Wait(int32_t timeoutMs)
+{
+    if (IsClosed()) {
+        return;
+    }
+    uint32_t ring = ReceiveRing();
+    header_->heads[ring].isSleeping.store(1);
+    if (header_->tails[ring].tail.load() != header_->heads[ring].head.load(std::memory_order_relaxed)) {
+        header_->heads[ring].isSleeping.store(0);
+        return;
+    }
+    // events 0 on the socket still reports the hangup, and the pending fences do not wake us
+    struct pollfd fds[] = {
+        { .fd = doorbells_[ring], .events = POLLIN, .revents = 0 },
+        { .fd = socketFd_, .events = 0, .revents = 0 },
+    };
+    int ret = TEMP_FAILURE_RETRY(poll(fds, sizeof(fds) / sizeof(fds[0]), timeoutMs));
+    header_->heads[ring].isSleeping.store(0);
+    if (ret <= 0) {
+        return;
+    }
+    if ((fds[0].revents & POLLIN) != 0) {
+        uint64_t value = 0;
+        (void)TEMP_FAILURE_RETRY(read(doorbells_[ring], &value, sizeof(value)));
+    }
+    if ((fds[1].revents & (POLLHUP | POLLERR)) != 0) {
+        isBroken_ = true;
+    }
+}
+
+void SurfaceControlChannel::Shutdown()
+{
+    isShutdown_ = true;
+    RingDoorbell(ReceiveRing());
+}
+
+bool SurfaceControlChannel::IsClosed() const
+{
+    return isShutdown_ || isBroken_;
+}
+} // namespace OHOS
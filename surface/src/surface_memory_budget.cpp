@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "surface_memory_budget.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <parameters.h>
+
+#include "buffer_alloc_worker.h"
+#include "buffer_log.h"
+#include "buffer_queue.h"
+#include "buffer_recycle_pool.h"
+#include "surface_trace.h"
+
+namespace OHOS {
+namespace {
+constexpr uint64_t KB = 1024;
+constexpr uint64_t LOW_WATERMARK_PERCENT = 80;
+constexpr uint64_t PERCENT = 100;
+constexpr int64_t NS_PER_MS = 1000000;
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+SurfaceMemoryBudget& SurfaceMemoryBudget::GetInstance()
+{
+    // never destroyed, queues held by other statics unregister during exit
+    static SurfaceMemoryBudget *instance = new SurfaceMemoryBudget();
+    return *instance;
+}
+
+SurfaceMemoryBudget::SurfaceMemoryBudget()
+{
+    uint64_t highKb = std::strtoull(
+        system::GetParameter("persist.graphic.surface_memory_budget.high_kb", "0").c_str(), nullptr, 10); // 10: decimal
+    uint64_t lowKb = std::strtoull(
+        system::GetParameter("persist.graphic.surface_memory_budget.low_kb", "0").c_str(), nullptr, 10); // 10: decimal
+    SetWatermarks(highKb * KB, lowKb * KB);
+}
+
+void SurfaceMemoryBudget::SetWatermarks(uint64_t highWatermark, uint64_t lowWatermark)
+{
+    if (lowWatermark == 0 || lowWatermark > highWatermark) {
+        lowWatermark = highWatermark / PERCENT * LOW_WATERMARK_PERCENT;
+    }
+    highWatermark_ = highWatermark;
+    lowWatermark_ = lowWatermark;
+    std::lock_guard<std::mutex> lockGuard(statsMutex_);
+    stats_.highWatermark = highWatermark;
+    stats_.lowWatermark = lowWatermark;
+}
+
+void SurfaceMemoryBudget::RegisterQueue(BufferQueue *queue)
+{
+    std::lock_guard<std::mutex> lockGuard(registryMutex_);
+    queues_.push_back(wptr<BufferQueue>(queue));
+}
+
+void SurfaceMemoryBudget::UnregisterQueue(BufferQueue *queue)
+{
+    std::lock_guard<std::mutex> lockGuard(registryMutex_);
+    auto it = std::find_if(queues_.begin(), queues_.end(), [queue](const wptr<BufferQueue> &weakQueue) {
+        return weakQueue.GetRefPtr() == queue;
+    });
+    if (it != queues_.end()) {
+        *it = queues_.back();
+        queues_.pop_back();
+    }
+}
+
+void SurfaceMemoryBudget::OnBufferAllocated(uint32_t size)
+{
+    uint64_t estimated = estimatedBytes_.fetch_add(size) + size;
+    uint64_t highWatermark = highWatermark_.load();
+    if (highWatermark == 0 || estimated < highWatermark) {
+        return;
+    }
+    // frees are not counted, so a pass also brings the estimate back to the real usage
+    if (NowNs() - lastPassTime_.load() < MIN_PASS_INTERVAL_MS * NS_PER_MS || isPassPending_.exchange(true)) {
+        return;
+    }
+    BufferAllocWorker::GetInstance().Post([this]() {
+        Reclaim(lowWatermark_.load());
+        isPassPending_ = false;
+        return GSERROR_OK;
+    });
+}
+
+void SurfaceMemoryBudget::SortCandidates(std::vector<ReclaimCandidate> &candidates, int64_t now)
+{
+    // the last frame of a queue that is still active may be shown again, leave it alone
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [now](const ReclaimCandidate &candidate) {
+        return candidate.isLastFrame && now - candidate.queueLastActiveTime < IDLE_RECLAIM_MS * NS_PER_MS;
+    }), candidates.end());
+    std::sort(candidates.begin(), candidates.end(), [](const ReclaimCandidate &lhs, const ReclaimCandidate &rhs) {
+        if (lhs.isLastFrame != rhs.isLastFrame) {
+            return !lhs.isLastFrame;
+        }
+        if (lhs.isLastFrame) {
+            return lhs.queueLastActiveTime < rhs.queueLastActiveTime;
+        }
+        if (lhs.lastAcquireTime != rhs.lastAcquireTime) {
+            return lhs.lastAcquireTime < rhs.lastAcquireTime;
+        }
+        return lhs.queueLastActiveTime < rhs.queueLastActiveTime;
+    });
+}
+
+std::vector<sptr<BufferQueue>> SurfaceMemoryBudget::PromoteQueues()
+{
+    std::lock_guard<std::mutex> lockGuard(registryMutex_);
+    std::vector<sptr<BufferQueue>> queues;
+    queues.reserve(queues_.size());
+    for (const auto &weakQueue : queues_) {
+        // fails for a queue whose last ref is gone and that is waiting in UnregisterQueue
+        sptr<BufferQueue> queue = weakQueue.promote();
+        if (queue != nullptr) {
+            queues.push_back(queue);
+        }
+    }
+    return queues;
+}
+
+uint64_t SurfaceMemoryBudget::Reclaim(uint64_t targetBytes)
+{
+    std::lock_guard<std::mutex> passLockGuard(passMutex_);
+    std::vector<sptr<BufferQueue>> queues = PromoteQueues();
+    std::vector<ReclaimCandidate> candidates;
+    uint64_t totalBytes = 0;
+    for (const sptr<BufferQueue> &queue : queues) {
+        QueueUsage usage;
+        queue->CollectMemoryUsage(usage, candidates);
+        totalBytes += usage.bytes;
+    }
+    uint64_t poolBytes = BufferRecyclePool::GetInstance().GetStats().bytes;
+    totalBytes += poolBytes;
+    SURFACE_TRACE_NAME_FMT("SurfaceMemoryBudget Reclaim total %" PRIu64 " target %" PRIu64 " candidates %zu",
+        totalBytes, targetBytes, candidates.size());
+
+    uint64_t freedBytes = 0;
+    uint64_t freedBuffers = 0;
+    if (totalBytes > targetBytes && poolBytes > 0) {
+        // pooled allocations serve nobody yet, they go first
+        BufferRecyclePool::GetInstance().Clear();
+        freedBytes += poolBytes;
+    }
+    if (totalBytes > targetBytes + freedBytes) {
+        SortCandidates(candidates, NowNs());
+        for (const ReclaimCandidate &candidate : candidates) {
+            if (totalBytes <= targetBytes + freedBytes) {
+                break;
+            }
+            uint32_t size = candidate.queue->ReclaimFreeBuffer(candidate.sequence);
+            if (size > 0) {
+                freedBytes += size;
+                freedBuffers++;
+            }
+        }
+    }
+    if (freedBytes > 0) {
+        BLOGI("SurfaceMemoryBudget reclaimed %{public}" PRIu64 " bytes, %{public}" PRIu64 " buffers, "
+            "usage %{public}" PRIu64 " target %{public}" PRIu64, freedBytes, freedBuffers, totalBytes, targetBytes);
+    }
+    uint64_t remainingBytes = totalBytes > freedBytes ? totalBytes - freedBytes : 0;
+    estimatedBytes_ = remainingBytes;
+    lastPassTime_ = NowNs();
+
+    std::lock_guard<std::mutex> statsLockGuard(statsMutex_);
+    stats_.lastCountedBytes = totalBytes;
+    stats_.queueCount = static_cast<uint32_t>(queues.size());
+    stats_.reclaimPasses++;
+    stats_.reclaimedBuffers += freedBuffers;
+    stats_.reclaimedBytes += freedBytes;
+    return freedBytes;
+}
+
+std::vector<SurfaceMemoryBudget::QueueUsage> SurfaceMemoryBudget::GetQueueUsage()
+{
+    std::vector<sptr<BufferQueue>> queues = PromoteQueues();
+    std::vector<QueueUsage> usages(queues.size());
+    std::vector<ReclaimCandidate> candidates;
+    for (size_t i = 0; i < queues.size(); i++) {
+        queues[i]->CollectMemoryUsage(usages[i], candidates);
+    }
+    return usages;
+}
+
+SurfaceMemoryBudget::Stats SurfaceMemoryBudget::GetStats()
+{
+    std::lock_guard<std::mutex> lockGuard(statsMutex_);
+    Stats stats = stats_;
+    stats.estimatedBytes = estimatedBytes_.load();
+    return stats;
+}
+
+void SurfaceMemoryBudget::Dump(std::string &result)
+{
+    Stats stats = GetStats();
+    result += "high = " + std::to_string(stats.highWatermark) +
+        ", low = " + std::to_string(stats.lowWatermark) +
+        ", estimated = " + std::to_string(stats.estimatedBytes) +
+        ", lastCounted = " + std::to_string(stats.lastCountedBytes) +
+        ", queues = " + std::to_string(stats.queueCount) +
+        ", passes = " + std::to_string(stats.reclaimPasses) +
+        ", reclaimedBuffers = " + std::to_string(stats.reclaimedBuffers) +
+        ", reclaimedBytes = " + std::to_string(stats.reclaimedBytes);
+}
+} // namespace OHOS
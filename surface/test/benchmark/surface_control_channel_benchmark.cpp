@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <thread>
+
+#include <benchmark/benchmark.h>
+
+#include "surface_control_channel.h"
+
+namespace OHOS {
+namespace {
+constexpr int32_t READER_WAIT_MS = 100; // only a fallback, the writer rings the doorbell
+
+// one record sent and received on the same thread, the cost of the ring alone
+void BM_SendReceive(benchmark::State &state)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    if (SurfaceControlChannel::CreatePair(producerEnd, queueEnd) != GSERROR_OK) {
+        state.SkipWithError("CreatePair failed");
+        return;
+    }
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::FLUSH;
+    SurfaceControlRecord received;
+    int32_t receivedFd = -1;
+    for (auto _ : state) {
+        record.sequence++;
+        if (producerEnd->Send(record) != GSERROR_OK || queueEnd->Receive(received, receivedFd) != GSERROR_OK ||
+            received.sequence != record.sequence) {
+            state.SkipWithError("record lost");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SendReceive);
+
+// records streamed to a reader thread sleeping in Wait, every record must arrive in order
+void BM_Stream(benchmark::State &state)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    if (SurfaceControlChannel::CreatePair(producerEnd, queueEnd) != GSERROR_OK) {
+        state.SkipWithError("CreatePair failed");
+        return;
+    }
+    const uint32_t recordCount = static_cast<uint32_t>(state.range(0));
+    std::atomic<bool> isInOrder = true;
+    for (auto _ : state) {
+        std::thread reader([&queueEnd, &isInOrder, recordCount]() {
+            SurfaceControlRecord received;
+            int32_t receivedFd = -1;
+            uint32_t next = 0;
+            while (next < recordCount) {
+                if (queueEnd->Receive(received, receivedFd) != GSERROR_OK) {
+                    queueEnd->Wait(READER_WAIT_MS);
+                    continue;
+                }
+                if (received.sequence != next) {
+                    isInOrder = false;
+                }
+                next++;
+            }
+        });
+        SurfaceControlRecord record;
+        record.type = SurfaceControlRecordType::FLUSH;
+        for (uint32_t i = 0; i < recordCount;) {
+            record.sequence = i;
+            if (producerEnd->Send(record) == GSERROR_OK) {
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        reader.join();
+    }
+    if (!isInOrder) {
+        state.SkipWithError("records out of order");
+    }
+    state.SetItemsProcessed(state.iterations() * recordCount);
+}
+BENCHMARK(BM_Stream)->Arg(200000)->Unit(benchmark::kMillisecond)->UseRealTime(); // 200000: records per run
+} // namespace
+} // namespace OHOS
+
+BENCHMARK_MAIN();
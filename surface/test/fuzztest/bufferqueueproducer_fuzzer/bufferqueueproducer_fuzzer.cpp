@@ -195,8 +195,11 @@ namespace OHOS {
         MessageParcel reply;
         MessageOption option;
         bqp->OnRemoteRequest(code, arguments, reply, option);
-        for (auto iter : bqp->memberFuncMap_) {
-            iter.second(reinterpret_cast<BufferQueueProducer*>(bqp.GetRefPtr()), arguments, reply, option);
+        BufferQueueProducer *producer = reinterpret_cast<BufferQueueProducer*>(bqp.GetRefPtr());
+        for (const auto &entry : bqp->remoteFuncTable_) {
+            if (entry.func != nullptr) {
+                (producer->*entry.func)(arguments, reply, option);
+            }
         }
     }
 
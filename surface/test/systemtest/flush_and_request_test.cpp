@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <gtest/gtest.h>
+#include <iservice_registry.h>
+#include <surface.h>
+#include "accesstoken_kit.h"
+#include "iconsumer_surface.h"
+#include "nativetoken_kit.h"
+#include "token_setproc.h"
+
+using namespace testing;
+using namespace testing::ext;
+
+namespace OHOS::Rosen {
+namespace {
+constexpr uint32_t FRAME_COUNT = 300;
+
+// forwards to the real proxy and counts the transactions that leave the process
+class CountingRemoteObject : public IRemoteObject {
+public:
+    explicit CountingRemoteObject(const sptr<IRemoteObject> &remote)
+        : IRemoteObject(remote->GetInterfaceDescriptor()), remote_(remote) {}
+    ~CountingRemoteObject() override = default;
+
+    int32_t GetObjectRefCount() override
+    {
+        return remote_->GetObjectRefCount();
+    }
+
+    int SendRequest(uint32_t code, MessageParcel &data, MessageParcel &reply, MessageOption &option) override
+    {
+        transactions_++;
+        return remote_->SendRequest(code, data, reply, option);
+    }
+
+    bool IsProxyObject() const override
+    {
+        return true;
+    }
+
+    bool AddDeathRecipient(const sptr<DeathRecipient> &recipient) override
+    {
+        return remote_->AddDeathRecipient(recipient);
+    }
+
+    bool RemoveDeathRecipient(const sptr<DeathRecipient> &recipient) override
+    {
+        return remote_->RemoveDeathRecipient(recipient);
+    }
+
+    int Dump(int fd, const std::vector<std::u16string> &args) override
+    {
+        return remote_->Dump(fd, args);
+    }
+
+    uint64_t GetTransactions() const
+    {
+        return transactions_.load();
+    }
+
+    void ResetTransactions()
+    {
+        transactions_ = 0;
+    }
+
+private:
+    sptr<IRemoteObject> remote_;
+    std::atomic<uint64_t> transactions_ = 0;
+};
+
+struct FrameResult {
+    int64_t ret = GSERROR_OK;
+    uint64_t separateTransactions = 0;
+    int64_t separateNs = 0;
+    uint64_t combinedTransactions = 0;
+    int64_t combinedNs = 0;
+};
+}
+
+class FlushAndRequestTest : public testing::Test, public IBufferConsumerListenerClazz {
+public:
+    static void SetUpTestCase();
+    void OnBufferAvailable() override;
+    pid_t ChildProcessMain();
+    static GSError RunSeparate(sptr<Surface> &pSurface, const sptr<CountingRemoteObject> &counter,
+        FrameResult &result);
+    static GSError RunCombined(sptr<Surface> &pSurface, const sptr<CountingRemoteObject> &counter,
+        FrameResult &result);
+
+    static inline sptr<IConsumerSurface> cSurface = nullptr;
+    static inline int32_t pipeMain[2] = {};
+    static inline int32_t pipeChild[2] = {};
+    static inline int32_t ipcSystemAbilityID = 34157;
+    static inline BufferRequestConfig requestConfig = {};
+    static inline BufferFlushConfigWithDamages flushConfig = {};
+};
+
+void FlushAndRequestTest::SetUpTestCase()
+{
+    requestConfig = {
+        .width = 0x100,  // small
+        .height = 0x100, // small
+        .strideAlignment = 0x8,
+        .format = GRAPHIC_PIXEL_FMT_RGBA_8888,
+        .usage = BUFFER_USAGE_CPU_READ | BUFFER_USAGE_CPU_WRITE | BUFFER_USAGE_MEM_DMA,
+        .timeout = 3000, // 3000ms: the consumer releases right away, this only guards a stuck test
+    };
+    flushConfig.damages.push_back({ .w = 0x100, .h = 0x100 });
+}
+
+void FlushAndRequestTest::OnBufferAvailable()
+{
+    sptr<SurfaceBuffer> buffer = nullptr;
+    sptr<SyncFence> fence = nullptr;
+    int64_t timestamp = 0;
+    std::vector<Rect> damages;
+    if (cSurface->AcquireBuffer(buffer, fence, timestamp, damages) == GSERROR_OK) {
+        cSurface->ReleaseBuffer(buffer, SyncFence::InvalidFence());
+    }
+}
+
+static inline GSError OnBufferRelease(sptr<SurfaceBuffer> &buffer)
+{
+    return GSERROR_OK;
+}
+
+static int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+GSError FlushAndRequestTest::RunSeparate(sptr<Surface> &pSurface, const sptr<CountingRemoteObject> &counter,
+    FrameResult &result)
+{
+    sptr<SurfaceBuffer> buffer = nullptr;
+    sptr<SyncFence> fence = nullptr;
+    GSError ret = pSurface->RequestBuffer(buffer, fence, requestConfig);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    counter->ResetTransactions();
+    int64_t start = NowNs();
+    for (uint32_t i = 0; i < FRAME_COUNT; i++) {
+        ret = pSurface->FlushBuffer(buffer, SyncFence::InvalidFence(), flushConfig);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        ret = pSurface->RequestBuffer(buffer, fence, requestConfig);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+    }
+    result.separateNs = NowNs() - start;
+    result.separateTransactions = counter->GetTransactions();
+    return pSurface->FlushBuffer(buffer, SyncFence::InvalidFence(), flushConfig);
+}
+
+GSError FlushAndRequestTest::RunCombined(sptr<Surface> &pSurface, const sptr<CountingRemoteObject> &counter,
+    FrameResult &result)
+{
+    sptr<SurfaceBuffer> buffer = nullptr;
+    sptr<SyncFence> fence = nullptr;
+    GSError ret = pSurface->RequestBuffer(buffer, fence, requestConfig);
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    counter->ResetTransactions();
+    int64_t start = NowNs();
+    for (uint32_t i = 0; i < FRAME_COUNT; i++) {
+        sptr<SurfaceBuffer> nextBuffer = nullptr;
+        ret = pSurface->FlushAndRequestBuffer(buffer, SyncFence::InvalidFence(), flushConfig,
+            nextBuffer, fence, requestConfig);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        buffer = nextBuffer;
+    }
+    result.combinedNs = NowNs() - start;
+    result.combinedTransactions = counter->GetTransactions();
+    return pSurface->FlushBuffer(buffer, SyncFence::InvalidFence(), flushConfig);
+}
+
+pid_t FlushAndRequestTest::ChildProcessMain()
+{
+    pipe(pipeMain);
+    pipe(pipeChild);
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    int64_t data;
+    read(pipeMain[0], &data, sizeof(data));
+
+    sptr<IRemoteObject> robj = nullptr;
+    while (true) {
+        auto sam = SystemAbilityManagerClient::GetInstance().GetSystemAbilityManager();
+        robj = sam->GetSystemAbility(ipcSystemAbilityID);
+        if (robj != nullptr) {
+            break;
+        }
+        sleep(0);
+    }
+    sptr<CountingRemoteObject> counter = new CountingRemoteObject(robj);
+    auto producer = iface_cast<IBufferProducer>(counter);
+    auto pSurface = Surface::CreateSurfaceAsProducer(producer);
+    pSurface->RegisterReleaseListener(OnBufferRelease);
+
+    FrameResult result;
+    result.ret = RunSeparate(pSurface, counter, result);
+    if (result.ret == GSERROR_OK) {
+        result.ret = RunCombined(pSurface, counter, result);
+    }
+    write(pipeChild[1], &result, sizeof(result));
+    read(pipeMain[0], &data, sizeof(data));
+    pSurface->UnRegisterReleaseListener();
+    close(pipeMain[0]);
+    close(pipeMain[1]);
+    close(pipeChild[0]);
+    close(pipeChild[1]);
+    exit(0);
+    return 0;
+}
+
+/*
+* Function: FlushAndRequestBuffer
+* Type: Performance
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. produce FRAME_COUNT frames in another process with FlushBuffer and RequestBuffer
+*                  2. produce FRAME_COUNT frames with FlushAndRequestBuffer
+*                  3. print the transactions and latency per frame, check that the second loop needs one
+*                     transaction per frame
+ */
+HWTEST_F(FlushAndRequestTest, FrameIpc001, TestSize.Level1)
+{
+    auto pid = ChildProcessMain();
+    ASSERT_GE(pid, 0);
+
+    uint64_t tokenId;
+    const char *perms[2];
+    perms[0] = "ohos.permission.DISTRIBUTED_DATASYNC";
+    perms[1] = "ohos.permission.CAMERA";
+    NativeTokenInfoParams infoInstance = {
+        .dcapsNum = 0,
+        .permsNum = 2,
+        .aclsNum = 0,
+        .dcaps = NULL,
+        .perms = perms,
+        .acls = NULL,
+        .processName = "dcamera_client_demo",
+        .aplStr = "system_basic",
+    };
+    tokenId = GetAccessTokenId(&infoInstance);
+    SetSelfTokenID(tokenId);
+    int32_t rett = Security::AccessToken::AccessTokenKit::ReloadNativeTokenInfo();
+    ASSERT_EQ(rett, Security::AccessToken::RET_SUCCESS);
+    cSurface = IConsumerSurface::Create("FlushAndRequestTest");
+    cSurface->RegisterConsumerListener(this);
+    auto producer = cSurface->GetProducer();
+    auto sam = SystemAbilityManagerClient::GetInstance().GetSystemAbilityManager();
+    sam->AddSystemAbility(ipcSystemAbilityID, producer->AsObject());
+
+    int64_t data = 0;
+    write(pipeMain[1], &data, sizeof(data));
+    FrameResult result;
+    read(pipeChild[0], &result, sizeof(result));
+
+    printf("FlushBuffer + RequestBuffer: %.2f ipc/frame, %.1f us/frame\n",
+        static_cast<double>(result.separateTransactions) / FRAME_COUNT,
+        result.separateNs / 1000.0 / FRAME_COUNT); // 1000.0: ns to us
+    printf("FlushAndRequestBuffer: %.2f ipc/frame, %.1f us/frame\n",
+        static_cast<double>(result.combinedTransactions) / FRAME_COUNT,
+        result.combinedNs / 1000.0 / FRAME_COUNT); // 1000.0: ns to us
+
+    //close resource
+    write(pipeMain[1], &data, sizeof(data));
+    close(pipeMain[0]);
+    close(pipeMain[1]);
+    close(pipeChild[0]);
+    close(pipeChild[1]);
+    sam->RemoveSystemAbility(ipcSystemAbilityID);
+    int32_t ret = 0;
+    do {
+        ret = waitpid(pid, nullptr, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    ASSERT_EQ(result.ret, GSERROR_OK);
+    ASSERT_EQ(result.separateTransactions, 2 * FRAME_COUNT); // 2: FlushBuffer and RequestBuffer
+    ASSERT_EQ(result.combinedTransactions, FRAME_COUNT);
+}
+}
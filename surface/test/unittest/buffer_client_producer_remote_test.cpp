@@ -991,4 +991,36 @@ HWTEST_F(BufferClientProducerRemoteTest, SetSingleBufferMode001, TestSize.Level0
     GSError ret = bp->SetSingleBufferMode(SingleBufferMode::SINGLE_BUFFER_MODE_TO_SINGLE);
     ASSERT_NE(ret, GSERROR_BINDER);
 }
+
+/*
+ * Function: SetFlushBufferAsyncMode and FlushBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. enable the async flush mode and flush a buffer the queue does not know
+ *                  2. check FlushBuffer returns ok and the next RequestBuffer returns the flush error
+ *                  3. flush the requested buffer asynchronously and check the request after it succeeds
+ */
+HWTEST_F(BufferClientProducerRemoteTest, FlushBufferAsync001, TestSize.Level0)
+{
+    // earlier cases leave flushed buffers behind, make room for the requests below
+    ASSERT_EQ(bp->SetQueueSize(SURFACE_MAX_QUEUE_SIZE), OHOS::GSERROR_OK);
+    ASSERT_EQ(bp->SetFlushBufferAsyncMode(true), OHOS::GSERROR_OK);
+    sptr<SyncFence> acquireFence = SyncFence::INVALID_FENCE;
+    GSError ret = bp->FlushBuffer(0xFFFFFFFF, bedata, acquireFence, flushConfig);
+    ASSERT_EQ(ret, OHOS::GSERROR_OK);
+
+    IBufferProducer::RequestBufferReturnValue retval;
+    ret = bp->RequestBuffer(requestConfig, bedata, retval);
+    ASSERT_EQ(ret, OHOS::SURFACE_ERROR_BUFFER_NOT_INCACHE);
+
+    ret = bp->RequestBuffer(requestConfig, bedata, retval);
+    ASSERT_EQ(ret, OHOS::GSERROR_OK);
+    ret = bp->FlushBuffer(retval.sequence, bedata, acquireFence, flushConfig);
+    ASSERT_EQ(ret, OHOS::GSERROR_OK);
+    // a sync call after the oneway flush sees its result
+    ret = bp->CancelBuffer(retval.sequence, bedata);
+    ASSERT_EQ(ret, OHOS::SURFACE_ERROR_BUFFER_STATE_INVALID);
+    ASSERT_EQ(bp->SetFlushBufferAsyncMode(false), OHOS::GSERROR_OK);
+}
 }
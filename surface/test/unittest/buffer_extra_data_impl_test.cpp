@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+
+#include <message_parcel.h>
+
+#include "buffer_extra_data_impl.h"
+
+using namespace testing;
+using namespace testing::ext;
+
+namespace OHOS::Rosen {
+class BufferExtraDataImplTest : public testing::Test {
+public:
+    static void FillExtraData(BufferExtraDataImpl &bedata)
+    {
+        bedata.ExtraSet("timeStamp", static_cast<int64_t>(INT64_MIN));
+        bedata.ExtraSet("dataSize", INT32_MAX);
+        bedata.ExtraSet("isKeyFrame", 1);
+        bedata.ExtraSet("customRatio", 0.5); // 0.5: any double
+        bedata.ExtraSet("customName", std::string("frame"));
+    }
+
+    static void CheckExtraData(const BufferExtraDataImpl &bedata)
+    {
+        int64_t timestamp = 0;
+        int32_t dataSize = 0;
+        int32_t isKeyFrame = 0;
+        double ratio = 0;
+        std::string name;
+        ASSERT_EQ(bedata.ExtraGet("timeStamp", timestamp), GSERROR_OK);
+        ASSERT_EQ(timestamp, INT64_MIN);
+        ASSERT_EQ(bedata.ExtraGet("dataSize", dataSize), GSERROR_OK);
+        ASSERT_EQ(dataSize, INT32_MAX);
+        ASSERT_EQ(bedata.ExtraGet("isKeyFrame", isKeyFrame), GSERROR_OK);
+        ASSERT_EQ(isKeyFrame, 1);
+        ASSERT_EQ(bedata.ExtraGet("customRatio", ratio), GSERROR_OK);
+        ASSERT_EQ(ratio, 0.5); // 0.5: any double
+        ASSERT_EQ(bedata.ExtraGet("customName", name), GSERROR_OK);
+        ASSERT_EQ(name, "frame");
+    }
+};
+
+/*
+ * Function: WriteToParcel, WritePackedToParcel and ReadFromParcel
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. write well known and custom keys with the legacy and the packed encoding
+ *                  2. check that ReadFromParcel reads both back and the packed parcel is the smaller one
+ */
+HWTEST_F(BufferExtraDataImplTest, PackedRoundTrip001, TestSize.Level0)
+{
+    BufferExtraDataImpl bedata;
+    FillExtraData(bedata);
+    MessageParcel legacyParcel;
+    ASSERT_EQ(bedata.WriteToParcel(legacyParcel), GSERROR_OK);
+    MessageParcel packedParcel;
+    ASSERT_EQ(bedata.WritePackedToParcel(packedParcel), GSERROR_OK);
+    ASSERT_LT(packedParcel.GetDataSize(), legacyParcel.GetDataSize());
+
+    for (MessageParcel *parcel : { &legacyParcel, &packedParcel }) {
+        BufferExtraDataImpl readData;
+        ASSERT_EQ(readData.ReadFromParcel(*parcel), GSERROR_OK);
+        ASSERT_FALSE(readData.IsUnchanged());
+        CheckExtraData(readData);
+    }
+
+    BufferExtraDataImpl emptyData;
+    MessageParcel emptyParcel;
+    ASSERT_EQ(emptyData.WritePackedToParcel(emptyParcel), GSERROR_OK);
+    BufferExtraDataImpl readData;
+    FillExtraData(readData);
+    ASSERT_EQ(readData.ReadFromParcel(emptyParcel), GSERROR_OK);
+    ASSERT_TRUE(readData.IsEmpty());
+}
+
+/*
+ * Function: WriteUnchangedToParcel and ReadFromParcel
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. read the unchanged marker into an object holding data
+ *                  2. check that it reads as unchanged and empty, and that the next real data clears the flag
+ */
+HWTEST_F(BufferExtraDataImplTest, Unchanged001, TestSize.Level0)
+{
+    BufferExtraDataImpl readData;
+    FillExtraData(readData);
+    MessageParcel unchangedParcel;
+    ASSERT_EQ(BufferExtraDataImpl::WriteUnchangedToParcel(unchangedParcel), GSERROR_OK);
+    ASSERT_EQ(readData.ReadFromParcel(unchangedParcel), GSERROR_OK);
+    ASSERT_TRUE(readData.IsUnchanged());
+    ASSERT_TRUE(readData.IsEmpty());
+
+    BufferExtraDataImpl bedata;
+    FillExtraData(bedata);
+    MessageParcel packedParcel;
+    ASSERT_EQ(bedata.WritePackedToParcel(packedParcel), GSERROR_OK);
+    ASSERT_EQ(readData.ReadFromParcel(packedParcel), GSERROR_OK);
+    ASSERT_FALSE(readData.IsUnchanged());
+    CheckExtraData(readData);
+}
+
+/*
+ * Function: GetVersion
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. set and read extra data
+ *                  2. check that every object and every change get a new version, writing a parcel does not
+ */
+HWTEST_F(BufferExtraDataImplTest, Version001, TestSize.Level0)
+{
+    BufferExtraDataImpl bedata;
+    ASSERT_NE(bedata.GetVersion(), 0u);
+    uint64_t version = bedata.GetVersion();
+    ASSERT_EQ(bedata.ExtraSet("dataSize", 1), GSERROR_OK);
+    ASSERT_NE(bedata.GetVersion(), version);
+    version = bedata.GetVersion();
+    MessageParcel parcel;
+    ASSERT_EQ(bedata.WritePackedToParcel(parcel), GSERROR_OK);
+    ASSERT_EQ(bedata.GetVersion(), version);
+    ASSERT_EQ(bedata.ExtraSet("dataSize", 2), GSERROR_OK); // 2: another value
+    ASSERT_NE(bedata.GetVersion(), version);
+
+    BufferExtraDataImpl readData;
+    ASSERT_EQ(readData.ReadFromParcel(parcel), GSERROR_OK);
+    ASSERT_NE(readData.GetVersion(), 0u);
+    ASSERT_NE(readData.GetVersion(), bedata.GetVersion());
+}
+
+/*
+ * Function: ReadFromParcel and ExtraGet
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. read a truncated packed blob and an unknown magic
+ *                  2. check that both fail and leave no data behind, and that ExtraGet reports type and key errors
+ */
+HWTEST_F(BufferExtraDataImplTest, ReadError001, TestSize.Level0)
+{
+    BufferExtraDataImpl bedata;
+    FillExtraData(bedata);
+    MessageParcel packedParcel;
+    ASSERT_EQ(bedata.WritePackedToParcel(packedParcel), GSERROR_OK);
+    int32_t magic = 0;
+    ASSERT_TRUE(packedParcel.ReadInt32(magic));
+
+    BufferExtraDataImpl readData;
+    uint8_t blob[] = { 2, 2, 1 }; // 2: one entry, timeStamp as i64 but the value is missing
+    MessageParcel truncated;
+    ASSERT_TRUE(truncated.WriteInt32(magic) && truncated.WriteUint32(sizeof(blob)));
+    ASSERT_TRUE(truncated.WriteBuffer(blob, sizeof(blob)));
+    FillExtraData(readData);
+    ASSERT_NE(readData.ReadFromParcel(truncated), GSERROR_OK);
+    ASSERT_TRUE(readData.IsEmpty());
+
+    MessageParcel badMagic;
+    ASSERT_TRUE(badMagic.WriteInt32(magic + 1));
+    FillExtraData(readData);
+    ASSERT_NE(readData.ReadFromParcel(badMagic), GSERROR_OK);
+    ASSERT_TRUE(readData.IsEmpty());
+
+    std::string value;
+    ASSERT_EQ(bedata.ExtraGet("dataSize", value), GSERROR_TYPE_ERROR);
+    ASSERT_EQ(bedata.ExtraGet("noSuchKey", value), GSERROR_NO_ENTRY);
+}
+}
@@ -1951,4 +1951,167 @@ HWTEST_F(BufferQueueProducerTest, SetLppShareFd_CheckLppCallerSuccess, TestSize.
     GSError ret = bqp_->SetLppShareFd(fd, state);
     ASSERT_EQ(ret, GSERROR_TYPE_ERROR);
 }
+
+/*
+* Function: OnRemoteRequest and DumpCommandStats
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. enable the command stats and send commands through OnRemoteRequest
+*                  2. check that every command code maps to its handler and unknown codes are refused
+*                  3. check the counts and that the dump names the command
+ */
+HWTEST_F(BufferQueueProducerTest, CommandStats001, TestSize.Level0)
+{
+    for (uint32_t code = 0; code < BufferQueueProducer::remoteFuncTable_.size(); code++) {
+        ASSERT_NE(BufferQueueProducer::remoteFuncTable_[code].func, nullptr);
+        ASSERT_NE(BufferQueueProducer::remoteFuncTable_[code].name, nullptr);
+    }
+    std::string result;
+    bqp_->DumpCommandStats(result);
+    ASSERT_TRUE(result.empty());
+
+    bqp_->commandStats_ = std::make_unique<ProducerCommandStats>(BufferQueueProducer::remoteFuncTable_.size());
+    constexpr uint32_t calls = 3;
+    for (uint32_t i = 0; i < calls; i++) {
+        MessageParcel arguments;
+        MessageParcel reply;
+        MessageOption option;
+        ASSERT_TRUE(arguments.WriteInterfaceToken(IBufferProducer::GetDescriptor()));
+        ASSERT_EQ(bqp_->OnRemoteRequest(IBufferProducer::BUFFER_PRODUCER_GET_QUEUE_SIZE, arguments, reply, option),
+            ERR_NONE);
+        ASSERT_EQ(reply.ReadInt32(), static_cast<int32_t>(SURFACE_DEFAULT_QUEUE_SIZE));
+    }
+    MessageParcel arguments;
+    MessageParcel reply;
+    MessageOption option;
+    ASSERT_NE(bqp_->OnRemoteRequest(IBufferProducer::BUFFER_PRODUCER_BUTT, arguments, reply, option), ERR_NONE);
+
+    ProducerCommandStats::Snapshot snapshot =
+        bqp_->commandStats_->GetSnapshot(IBufferProducer::BUFFER_PRODUCER_GET_QUEUE_SIZE);
+    ASSERT_EQ(snapshot.count, calls);
+    ASSERT_GE(ProducerCommandStats::GetPercentileUs(snapshot, 990), 1); // 990: p99
+    ASSERT_EQ(bqp_->commandStats_->GetSnapshot(IBufferProducer::BUFFER_PRODUCER_REQUEST_BUFFER).count, 0u);
+    bqp_->DumpCommandStats(result);
+    ASSERT_NE(result.find("GetQueueSizeRemote: count = 3"), std::string::npos);
+    ASSERT_EQ(result.find("RequestBufferRemote"), std::string::npos);
+}
+
+static GSError SyncProducerCacheDeltaThroughParcel(const sptr<BufferQueueProducer> &bqp, uint64_t generation,
+    IBufferProducer::ProducerCacheDelta &delta, uint32_t &handleCount)
+{
+    MessageParcel arguments;
+    MessageParcel reply;
+    MessageOption option;
+    if (!arguments.WriteUint64(generation) ||
+        bqp->SyncProducerCacheDeltaRemote(arguments, reply, option) != ERR_NONE) {
+        return GSERROR_BINDER;
+    }
+    GSError ret = static_cast<GSError>(reply.ReadInt32());
+    if (ret != GSERROR_OK) {
+        return ret;
+    }
+    if (!reply.ReadUint64(delta.generation) || !reply.ReadBool(delta.isFull) ||
+        !reply.ReadUInt32Vector(&delta.removedSequences) || !reply.ReadUint32(handleCount)) {
+        return GSERROR_BINDER;
+    }
+    for (uint32_t i = 0; i < handleCount; i++) {
+        uint32_t sequence = 0;
+        sptr<SurfaceBuffer> buffer = nullptr;
+        ret = ReadSurfaceBufferImpl(reply, sequence, buffer);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        delta.buffers[sequence] = buffer;
+    }
+    return GSERROR_OK;
+}
+
+/*
+* Function: SyncProducerCacheDeltaRemote
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. sync the producer cache in full, then let the consumer attach and detach a buffer
+*                  2. check that each sync after that sends only the changed buffer's handle or sequence
+*                  3. check that a generation the change log no longer reaches gets the whole cache again
+ */
+HWTEST_F(BufferQueueProducerTest, SyncProducerCacheDelta001, TestSize.Level0)
+{
+    IBufferProducer::RequestBufferReturnValue retval1;
+    IBufferProducer::RequestBufferReturnValue retval2;
+    ASSERT_EQ(bqp_->RequestBuffer(requestConfig, bedata_, retval1), GSERROR_OK);
+    ASSERT_EQ(bqp_->RequestBuffer(requestConfig, bedata_, retval2), GSERROR_OK);
+
+    IBufferProducer::ProducerCacheDelta delta;
+    uint32_t handleCount = 0;
+    ASSERT_EQ(SyncProducerCacheDeltaThroughParcel(bqp_, 0, delta, handleCount), GSERROR_OK);
+    ASSERT_TRUE(delta.isFull);
+    ASSERT_EQ(handleCount, 2u);
+    uint64_t generation = delta.generation;
+
+    sptr<SurfaceBuffer> buffer = SurfaceBuffer::Create();
+    ASSERT_EQ(buffer->Alloc(requestConfig), GSERROR_OK);
+    ASSERT_EQ(bq_->AttachBufferToQueue(buffer, InvokerType::CONSUMER_INVOKER), GSERROR_OK);
+    delta = {};
+    ASSERT_EQ(SyncProducerCacheDeltaThroughParcel(bqp_, generation, delta, handleCount), GSERROR_OK);
+    ASSERT_FALSE(delta.isFull);
+    ASSERT_EQ(handleCount, 1u);
+    ASSERT_EQ(delta.buffers.count(buffer->GetSeqNum()), 1u);
+    ASSERT_TRUE(delta.removedSequences.empty());
+    generation = delta.generation;
+
+    ASSERT_EQ(bq_->DetachBufferFromQueue(buffer, InvokerType::CONSUMER_INVOKER, false), GSERROR_OK);
+    delta = {};
+    ASSERT_EQ(SyncProducerCacheDeltaThroughParcel(bqp_, generation, delta, handleCount), GSERROR_OK);
+    ASSERT_FALSE(delta.isFull);
+    ASSERT_EQ(handleCount, 0u);
+    ASSERT_EQ(delta.removedSequences, std::vector<uint32_t>({ buffer->GetSeqNum() }));
+    generation = delta.generation;
+
+    // every attach and detach is one change, overrun the log
+    for (uint64_t i = 0; i < BufferQueue::CACHE_CHANGE_LOG_SIZE; i++) {
+        ASSERT_EQ(bq_->AttachBufferToQueue(buffer, InvokerType::CONSUMER_INVOKER), GSERROR_OK);
+        ASSERT_EQ(bq_->DetachBufferFromQueue(buffer, InvokerType::CONSUMER_INVOKER, false), GSERROR_OK);
+    }
+    delta = {};
+    ASSERT_EQ(SyncProducerCacheDeltaThroughParcel(bqp_, generation, delta, handleCount), GSERROR_OK);
+    ASSERT_TRUE(delta.isFull);
+    ASSERT_EQ(handleCount, 2u);
+    ASSERT_EQ(delta.buffers.count(retval1.sequence), 1u);
+    ASSERT_EQ(delta.buffers.count(retval2.sequence), 1u);
+}
+
+/*
+* Function: WaitAsyncFlush
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. leave the async flush state of one producer session with a high serial and an error
+*                  2. probe with a new session and check that its serials and errors start from scratch
+*                  3. check that waiting for a serial that never arrives fails instead of returning ok
+ */
+HWTEST_F(BufferQueueProducerTest, WaitAsyncFlush001, TestSize.Level0)
+{
+    uint64_t oldSession = 1;
+    uint64_t newSession = 2;
+    ASSERT_EQ(bqp_->WaitAsyncFlush(oldSession, 0), GSERROR_OK);
+    {
+        std::lock_guard<std::mutex> lockGuard(bqp_->asyncFlushMutex_);
+        bqp_->asyncFlushSerial_ = 5; // 5: flushes the old session sent
+        bqp_->asyncFlushError_ = GSERROR_NO_CONSUMER;
+    }
+    ASSERT_EQ(bqp_->WaitAsyncFlush(newSession, 0), GSERROR_OK);
+    ASSERT_EQ(bqp_->asyncFlushSession_, newSession);
+    ASSERT_EQ(bqp_->asyncFlushSerial_, 0u);
+    ASSERT_EQ(bqp_->asyncFlushError_, GSERROR_OK);
+
+    ASSERT_EQ(bqp_->WaitAsyncFlush(newSession, 1), GSERROR_BINDER);
+    {
+        std::lock_guard<std::mutex> lockGuard(bqp_->asyncFlushMutex_);
+        bqp_->asyncFlushSerial_ = 1;
+    }
+    ASSERT_EQ(bqp_->WaitAsyncFlush(newSession, 1), GSERROR_OK);
+    ASSERT_EQ(bqp_->WaitAsyncFlush(oldSession, 1), GSERROR_BINDER);
+}
 }
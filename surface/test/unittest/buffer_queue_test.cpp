@@ -15,7 +15,9 @@
 #include <fcntl.h>
 #include <map>
 #include <surface.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 #include "buffer_consumer_listener.h"
@@ -23,9 +25,11 @@
 #include "buffer_producer_listener.h"
 #define PRIVATE PUBLIC
 #include "buffer_queue.h"
+#include "buffer_recycle_pool.h"
 #undef PRIVATE
 #include "consumer_surface.h"
 #include "delegator_adapter.h"
+#include "fence_set.h"
 #include "producer_surface_delegator.h"
 #include "remote_object_mock.h"
 #include "sync_fence.h"
@@ -120,6 +124,16 @@ public:
     std::vector<CleanCacheBufferInfo> bufferInfos;
 };
 
+class CountingConsumerListener : public IBufferConsumerListener {
+public:
+    void OnBufferAvailable() override
+    {
+        availableCount++;
+    }
+
+    uint32_t availableCount = 0;
+};
+
 // Mock functions for DelegatorAdapter::funcMap_ override
 uintptr_t MockConsumerCreate() { return 0x11; }
 bool MockSetConsumerClient(uintptr_t, sptr<IRemoteObject>) { return true; }
@@ -128,6 +142,13 @@ GSError MockDequeueBuffer(uintptr_t, const BufferRequestConfig&, sptr<BufferExtr
     struct IBufferProducer::RequestBufferReturnValue&) { return GSERROR_BINDER; }
 GSError MockQueueBuffer(uintptr_t, sptr<SurfaceBuffer>&, int32_t) { return GSERROR_BINDER; }
 void MockConsumerDestroy(uintptr_t) {}
+
+// PreAllocBuffers only queues the allocations, wait for them before looking at the cache
+void WaitPreAllocDone(BufferQueue *bq)
+{
+    std::unique_lock<std::mutex> lock(bq->mutex_);
+    bq->isAllocatingBufferCon_.wait(lock, [bq]() { return bq->preAllocPendingCount_ == 0; });
+}
 }
 
 class LayerStateChangedProducerListenerTest : public ProducerListenerStub {
@@ -1462,7 +1483,7 @@ HWTEST_F(BufferQueueTest, NotifyLayerStateChanged001, TestSize.Level0)
  */
 HWTEST_F(BufferQueueTest, PreAllocBuffers001, TestSize.Level0)
 {
-    BufferQueue *bqTmp = new BufferQueue("testTmp");
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
     EXPECT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK);
     BufferRequestConfig requestConfigTmp = {
         .width = 0x0,
@@ -1519,7 +1540,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers001, TestSize.Level0)
  */
 HWTEST_F(BufferQueueTest, PreAllocBuffers002, TestSize.Level0)
 {
-    BufferQueue *bqTmp = new BufferQueue("testTmp");
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
     EXPECT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK);
     BufferRequestConfig requestConfigTmp = {
         .width = 0x100,
@@ -1530,6 +1551,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers002, TestSize.Level0)
     uint32_t allocBufferCount = 3;
     GSError ret = bqTmp->PreAllocBuffers(requestConfigTmp, allocBufferCount);
     ASSERT_EQ(ret, OHOS::GSERROR_OK);
+    WaitPreAllocDone(bqTmp);
     ASSERT_EQ((bqTmp->bufferQueueCache_).size(), 3);
     bqTmp = nullptr;
 }
@@ -1546,7 +1568,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers002, TestSize.Level0)
  */
 HWTEST_F(BufferQueueTest, PreAllocBuffers003, TestSize.Level0)
 {
-    BufferQueue *bqTmp = new BufferQueue("testTmp");
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
     EXPECT_EQ(bqTmp->SetQueueSize(1), GSERROR_OK);
     BufferRequestConfig requestConfigTmp = {
         .width = 0x100,
@@ -1557,6 +1579,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers003, TestSize.Level0)
     uint32_t allocBufferCount = 3;
     GSError ret = bqTmp->PreAllocBuffers(requestConfigTmp, allocBufferCount);
     ASSERT_EQ(ret, OHOS::GSERROR_OK);
+    WaitPreAllocDone(bqTmp);
     ASSERT_EQ((bqTmp->bufferQueueCache_).size(), 1);
     bqTmp = nullptr;
 }
@@ -1572,7 +1595,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers003, TestSize.Level0)
  */
 HWTEST_F(BufferQueueTest, PreAllocBuffers004, TestSize.Level0)
 {
-    BufferQueue *bqTmp = new BufferQueue("testTmp");
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
     EXPECT_EQ(bqTmp->SetQueueSize(1), GSERROR_OK);
     BufferRequestConfig requestConfigTmp = {
         .width = 0x100,
@@ -1611,6 +1634,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers004, TestSize.Level0)
         requestConfigTmp.usage = bufferUsage;
         GSError ret = bqTmp->PreAllocBuffers(requestConfigTmp, allocBufferCount);
         ASSERT_EQ(ret, OHOS::GSERROR_OK);
+        WaitPreAllocDone(bqTmp);
         ASSERT_EQ((bqTmp->bufferQueueCache_).size(), 1);
         bqTmp = nullptr;      
     }
@@ -1628,7 +1652,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers004, TestSize.Level0)
  */
 HWTEST_F(BufferQueueTest, PreAllocBuffers005, TestSize.Level0)
 {
-    BufferQueue *bqTmp = new BufferQueue("testTmp");
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
     // max queue size为64
     EXPECT_EQ(bqTmp->SetQueueSize(64), GSERROR_OK);
     BufferRequestConfig requestConfigTmp = {
@@ -1640,6 +1664,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers005, TestSize.Level0)
     uint32_t allocBufferCount = 65;
     GSError ret = bqTmp->PreAllocBuffers(requestConfigTmp, allocBufferCount);
     ASSERT_EQ(ret, OHOS::GSERROR_OK);
+    WaitPreAllocDone(bqTmp);
     ASSERT_EQ((bqTmp->bufferQueueCache_).size(), 64);
     bqTmp = nullptr;
 }
@@ -1655,7 +1680,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers005, TestSize.Level0)
  */
 HWTEST_F(BufferQueueTest, PreAllocBuffers006, TestSize.Level0)
 {
-    BufferQueue *bqTmp = new BufferQueue("testTmp");
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
     EXPECT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK);
 
     uint64_t defaultUsage = BUFFER_USAGE_CPU_READ;
@@ -1670,6 +1695,7 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers006, TestSize.Level0)
     uint32_t allocBufferCount = 3;
     GSError ret = bqTmp->PreAllocBuffers(requestConfigTmp, allocBufferCount);
     ASSERT_EQ(ret, OHOS::GSERROR_OK);
+    WaitPreAllocDone(bqTmp);
     ASSERT_EQ((bqTmp->bufferQueueCache_).size(), 3);
 
     uint64_t expectedUsage = requestConfigTmp.usage | defaultUsage;
@@ -1681,6 +1707,61 @@ HWTEST_F(BufferQueueTest, PreAllocBuffers006, TestSize.Level0)
     bqTmp = nullptr;
 }
 
+/*
+ * Function: PreAllocBuffers
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: fill the queue with PreAllocBuffers
+ *                  2. operation: request a buffer right away, before the background allocation is known to be done
+ *                  3. result: the request gets the pre-allocated buffer instead of failing or allocating a new one
+ */
+HWTEST_F(BufferQueueTest, PreAllocBuffers007, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    EXPECT_EQ(bqTmp->SetQueueSize(1), GSERROR_OK);
+    BufferRequestConfig config = requestConfig;
+    config.timeout = 1000; // 1000ms: far longer than one allocation
+    ASSERT_EQ(bqTmp->PreAllocBuffers(config, 1), GSERROR_OK);
+    {
+        std::lock_guard<std::mutex> lockGuard(bqTmp->mutex_);
+        ASSERT_EQ(bqTmp->GetUsedSize(), 1u);
+    }
+
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(bqTmp->RequestBuffer(config, bedata, retval), GSERROR_OK);
+    WaitPreAllocDone(bqTmp.GetRefPtr());
+    ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 1u);
+    ASSERT_NE(bqTmp->bufferQueueCache_.find(retval.sequence), bqTmp->bufferQueueCache_.end());
+    ASSERT_EQ(bqTmp->reservedSlotCount_, 0u);
+}
+
+/*
+ * Function: PreAllocBuffers
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: start PreAllocBuffers on a queue
+ *                  2. operation: drop the last ref to the queue while the allocations are still queued
+ *                  3. result: the queue is destroyed without waiting for them, the late tasks find it gone
+ */
+HWTEST_F(BufferQueueTest, PreAllocBuffers008, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testTmp");
+    EXPECT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK);
+    ASSERT_EQ(bqTmp->PreAllocBuffers(requestConfig, 3), GSERROR_OK);
+    wptr<BufferQueue> weakQueue = bqTmp;
+    bqTmp = nullptr;
+
+    // a task running right now holds the queue, it goes away once that task returns
+    for (int32_t i = 0; i < 100 && weakQueue.promote() != nullptr; i++) { // 100 * 10ms: far longer than one allocation
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(weakQueue.promote(), nullptr);
+}
+
 /*
  * Function: MarkBufferReclaimableByIdLocked
  * Type: Function
@@ -3607,4 +3688,928 @@ HWTEST_F(BufferQueueTest, DoFlushBufferLocked001, TestSize.Level0)
     auto ret = bufferqueue->DoFlushBuffer(seq, bedata, syncFence, flushConfig);
     ASSERT_EQ(ret, GSERROR_OK);
 }
+
+/*
+ * Function: SequenceSlotTable and SequenceList
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. insert sequences out of order and check iteration stays ascending
+ *                  2. erase other entries and check references stay valid
+ *                  3. push past the list capacity, erase and remove from the middle, check fifo order
+ */
+HWTEST_F(BufferQueueTest, SequenceSlotTable001, TestSize.Level0)
+{
+    SequenceSlotTable<BufferElement, SURFACE_MAX_QUEUE_SIZE> table;
+    std::vector<uint32_t> sequences = {30, 10, 20, 50, 40};
+    for (auto seq : sequences) {
+        table[seq].state = BUFFER_STATE_REQUESTED;
+    }
+    ASSERT_EQ(table.size(), sequences.size());
+    uint32_t last = 0;
+    for (const auto &[seq, ele] : table) {
+        ASSERT_GT(seq, last);
+        ASSERT_EQ(ele.state, BUFFER_STATE_REQUESTED);
+        last = seq;
+    }
+    BufferElement &element = table[20];
+    auto it = table.find(20);
+    table.erase(10);
+    table.erase(30);
+    table[60].state = BUFFER_STATE_FLUSHED;
+    ASSERT_EQ(&it->second, &element);
+    ASSERT_EQ((++it)->first, 40u);
+    ASSERT_EQ(table.find(10), table.end());
+    it = table.erase(table.find(40));
+    ASSERT_EQ(it->first, 50u);
+    table.clear();
+    ASSERT_TRUE(table.empty());
+
+    SequenceList<2> list = {1, 2};
+    list.push_back(3);
+    list.push_back(4);
+    list.pop_front();
+    for (auto iter = list.begin(); iter != list.end(); ++iter) {
+        if (*iter == 3) {
+            iter = list.erase(iter);
+            ASSERT_EQ(*iter, 4u);
+            break;
+        }
+    }
+    list.push_back(2);
+    list.remove(2);
+    ASSERT_EQ(list.size(), 1u);
+    ASSERT_EQ(list.front(), 4u);
+}
+
+/*
+ * Function: RequestBuffer, FlushBuffer, AcquireBuffer and ReleaseBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. run the request->flush->acquire->release cycle many times on a warmed-up queue
+ *                  2. print the average cost of one cycle
+ */
+HWTEST_F(BufferQueueTest, ReqFluAcqRelCycleCost001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testCycleCost");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    constexpr int32_t warmUpCount = 100;
+    constexpr int32_t cycleCount = 100000;
+    auto cycle = [&bqTmp]() {
+        IBufferProducer::RequestBufferReturnValue retval;
+        GSError ret = bqTmp->RequestBuffer(requestConfig, bedata, retval);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        ret = bqTmp->FlushBuffer(retval.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        sptr<SurfaceBuffer> buffer;
+        sptr<SyncFence> fence;
+        int64_t bufferTimestamp = 0;
+        std::vector<Rect> bufferDamages;
+        ret = bqTmp->AcquireBuffer(buffer, fence, bufferTimestamp, bufferDamages);
+        if (ret != GSERROR_OK) {
+            return ret;
+        }
+        return bqTmp->ReleaseBuffer(buffer, SyncFence::INVALID_FENCE);
+    };
+    for (int32_t i = 0; i < warmUpCount; i++) {
+        ASSERT_EQ(cycle(), GSERROR_OK);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < cycleCount; i++) {
+        ASSERT_EQ(cycle(), GSERROR_OK);
+    }
+    auto end = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+    std::cout << "Request->Flush->Acquire->Release cycle costs: " << duration.count() / cycleCount << "ns" << std::endl;
+}
+
+/*
+ * Function: PopFromFreeListLocked
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. fill the free list with buffers of two sizes
+ *                  2. request each size and check the matching buffer is reused without realloc
+ *                  3. check acquireLastFlushedBufSequence_ is still skipped and the counters show in Dump
+ */
+HWTEST_F(BufferQueueTest, PopFromFreeListLocked001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testFreeListIndex");
+    BufferRequestConfig smallConfig = requestConfig;
+    BufferRequestConfig largeConfig = requestConfig;
+    largeConfig.width = 0x200;
+    largeConfig.height = 0x200;
+    uint32_t seqs[] = {10, 11, 12, 13};
+    for (uint32_t i = 0; i < 4; i++) {
+        bqTmp->bufferQueueCache_[seqs[i]].buffer = new SurfaceBufferImpl(seqs[i]);
+        bqTmp->bufferQueueCache_[seqs[i]].state = BUFFER_STATE_RELEASED;
+        bqTmp->bufferQueueCache_[seqs[i]].config = (i % 2 == 0) ? smallConfig : largeConfig;
+        bqTmp->freeList_.push_back(seqs[i]);
+    }
+    bqTmp->acquireLastFlushedBufSequence_ = 11;
+
+    sptr<SurfaceBuffer> buffer;
+    ASSERT_EQ(bqTmp->PopFromFreeListLocked(buffer, largeConfig), GSERROR_OK);
+    ASSERT_EQ(buffer->GetSeqNum(), 13u);
+    ASSERT_EQ(bqTmp->PopFromFreeListLocked(buffer, smallConfig), GSERROR_OK);
+    ASSERT_EQ(buffer->GetSeqNum(), 10u);
+    ASSERT_EQ(bqTmp->reallocAvoidedCount_, 2u);
+    ASSERT_EQ(bqTmp->freeList_.size(), 2u);
+
+    bqTmp->freeList_.remove(12);
+    bqTmp->freeList_.push_back(12);
+    ASSERT_EQ(bqTmp->PopFromFreeListLocked(buffer, smallConfig), GSERROR_OK);
+    ASSERT_EQ(buffer->GetSeqNum(), 12u);
+    ASSERT_EQ(bqTmp->PopFromFreeListLocked(buffer, largeConfig), GSERROR_NO_BUFFER);
+    ASSERT_EQ(bqTmp->reallocAvoidedCount_, 3u);
+
+    std::string result;
+    bqTmp->Dump(result);
+    ASSERT_NE(result.find("reallocAvoided = 3"), std::string::npos);
+}
+
+/*
+ * Function: AcquireBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. run several producer threads doing request->flush against one consumer thread
+ *                  2. the consumer acquires and releases until every producer is done
+ *                  3. print the average and worst AcquireBuffer cost seen by the consumer
+ */
+HWTEST_F(BufferQueueTest, AcquireContentionCost001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testContention");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    constexpr uint32_t producerCount = 4;
+    constexpr int32_t framesPerProducer = 2000;
+    ASSERT_EQ(bqTmp->SetQueueSize(producerCount * 2), GSERROR_OK);
+    BufferRequestConfig config = requestConfig;
+    config.timeout = 100; // 100ms: blocked producers wait for the consumer to release
+
+    std::atomic<uint32_t> runningProducers = producerCount;
+    std::vector<std::thread> producers;
+    for (uint32_t i = 0; i < producerCount; i++) {
+        producers.emplace_back([&bqTmp, &config, &runningProducers]() {
+            for (int32_t frame = 0; frame < framesPerProducer; frame++) {
+                IBufferProducer::RequestBufferReturnValue retval;
+                sptr<BufferExtraData> extraData = new BufferExtraDataImpl;
+                if (bqTmp->RequestBuffer(config, extraData, retval) != GSERROR_OK) {
+                    continue;
+                }
+                bqTmp->FlushBuffer(retval.sequence, extraData, SyncFence::INVALID_FENCE, flushConfig);
+            }
+            runningProducers--;
+        });
+    }
+
+    int64_t totalCost = 0;
+    int64_t maxCost = 0;
+    int64_t acquireCount = 0;
+    while (true) {
+        bool producersDone = runningProducers.load() == 0;
+        sptr<SurfaceBuffer> buffer;
+        sptr<SyncFence> fence;
+        int64_t bufferTimestamp = 0;
+        std::vector<Rect> bufferDamages;
+        auto start = std::chrono::steady_clock::now();
+        GSError ret = bqTmp->AcquireBuffer(buffer, fence, bufferTimestamp, bufferDamages);
+        auto cost = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (ret != GSERROR_OK) {
+            if (producersDone) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        totalCost += cost;
+        maxCost = std::max(maxCost, cost);
+        acquireCount++;
+        EXPECT_EQ(bqTmp->ReleaseBuffer(buffer, SyncFence::INVALID_FENCE), GSERROR_OK);
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    ASSERT_GT(acquireCount, 0);
+    std::cout << producerCount << " producers, " << acquireCount << " acquires, AcquireBuffer costs: avg "
+        << totalCost / acquireCount << "ns, max " << maxCost << "ns" << std::endl;
+}
+
+/*
+ * Function: ReuseBufferForBlockMode
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. block two producer threads on a queue with one buffer
+ *                  2. release the buffer once and check only one waiter gets it
+ *                  3. check the other waiter times out and both waits show in the waiter stats
+ */
+HWTEST_F(BufferQueueTest, RequestWaiterHandoff001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testWaiterHandoff");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(1), GSERROR_OK);
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_EQ(bqTmp->FlushBuffer(retval.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig), GSERROR_OK);
+
+    BufferRequestConfig config = requestConfig;
+    config.timeout = 500; // 500ms: long enough for the release below, short enough for the loser to time out
+    std::atomic<int32_t> gotBuffer = 0;
+    std::vector<std::thread> producers;
+    for (int32_t i = 0; i < 2; i++) {
+        producers.emplace_back([&bqTmp, &config, &gotBuffer]() {
+            IBufferProducer::RequestBufferReturnValue waitRetval;
+            sptr<BufferExtraData> extraData = new BufferExtraDataImpl;
+            if (bqTmp->RequestBuffer(config, extraData, waitRetval) == GSERROR_OK) {
+                gotBuffer++;
+            }
+        });
+    }
+    for (int32_t i = 0; i < 100; i++) { // 100: wait at most 1s for both producers to block
+        {
+            std::lock_guard<std::mutex> lockGuard(bqTmp->mutex_);
+            if (bqTmp->requestWaiters_.Size() == 2) {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    sptr<SurfaceBuffer> buffer;
+    sptr<SyncFence> fence;
+    int64_t bufferTimestamp = 0;
+    std::vector<Rect> bufferDamages;
+    ASSERT_EQ(bqTmp->AcquireBuffer(buffer, fence, bufferTimestamp, bufferDamages), GSERROR_OK);
+    ASSERT_EQ(bqTmp->ReleaseBuffer(buffer, SyncFence::INVALID_FENCE), GSERROR_OK);
+    for (auto &producer : producers) {
+        producer.join();
+    }
+    ASSERT_EQ(gotBuffer.load(), 1);
+    ASSERT_EQ(bqTmp->requestWaiters_.GetStats().waits, 2u);
+    ASSERT_EQ(bqTmp->requestWaiters_.GetStats().timeouts, 1u);
+
+    std::string result;
+    bqTmp->Dump(result);
+    ASSERT_NE(result.find("requestWaiters: waits = 2, timeouts = 1"), std::string::npos);
+}
+
+/*
+ * Function: GoBackground and RequestBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: one queue drops a free buffer with GoBackground
+ *                  2. operation: another queue of the same pid requests a buffer of the same config
+ *                  3. result: the allocation comes from BufferRecyclePool, mapped and without a new AllocMem
+ */
+HWTEST_F(BufferQueueTest, RecyclePoolReuse001, TestSize.Level0)
+{
+    BufferRecyclePool &pool = BufferRecyclePool::GetInstance();
+    uint64_t maxBytes = pool.maxBytes_;
+    pool.maxBytes_ = 64 * 1024 * 1024; // 64MB, the pool is off by default
+    pool.Clear();
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    sptr<BufferQueue> bqOld = new BufferQueue("testRecycleOld");
+    bqOld->RegisterConsumerListener(listener);
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(bqOld->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_EQ(bqOld->CancelBuffer(retval.sequence, bedata), GSERROR_OK);
+    retval.buffer = nullptr;
+    ASSERT_EQ(bqOld->GoBackground(), GSERROR_OK);
+    ASSERT_EQ(pool.GetStats().count, 1u);
+
+    uint64_t hits = pool.GetStats().hits;
+    sptr<BufferQueue> bqNew = new BufferQueue("testRecycleNew");
+    bqNew->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqNew->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_EQ(pool.GetStats().hits, hits + 1);
+    ASSERT_EQ(pool.GetStats().count, 0u);
+    ASSERT_NE(retval.buffer, nullptr);
+    ASSERT_NE(retval.buffer->GetVirAddr(), nullptr);
+    ASSERT_EQ(retval.buffer->GetWidth(), requestConfig.width);
+    pool.maxBytes_ = maxBytes;
+}
+
+/*
+ * Function: GoBackground
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a queue whose producer is another process holds a free buffer
+ *                  2. operation: the queue drops it with GoBackground
+ *                  3. result: the pool does not take it, the remote producer may still map the buffer
+ */
+HWTEST_F(BufferQueueTest, RecyclePoolReuse002, TestSize.Level0)
+{
+    BufferRecyclePool &pool = BufferRecyclePool::GetInstance();
+    uint64_t maxBytes = pool.maxBytes_;
+    pool.maxBytes_ = 64 * 1024 * 1024; // 64MB, the pool is off by default
+    pool.Clear();
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    sptr<BufferQueue> bqTmp = new BufferQueue("testRecycleRemote");
+    bqTmp->RegisterConsumerListener(listener);
+    bqTmp->connectedPid_ = getpid() + 1;
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval.sequence, bedata), GSERROR_OK);
+    retval.buffer = nullptr;
+    ASSERT_EQ(bqTmp->GoBackground(), GSERROR_OK);
+    ASSERT_EQ(pool.GetStats().count, 0u);
+    pool.maxBytes_ = maxBytes;
+}
+
+/*
+ * Function: CollectMemoryUsage and ReclaimFreeBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a queue holds one cancelled buffer and one buffer that was just flushed and released
+ *                  2. operation: collect the reclaim candidates, sort them and reclaim the first one
+ *                  3. result: usage counts both buffers, the last frame of the active queue is kept and the
+ *                     cancelled buffer is freed and reported to the producer
+ */
+HWTEST_F(BufferQueueTest, MemoryBudgetReclaim001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testMemoryBudget");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    IBufferProducer::RequestBufferReturnValue shown;
+    IBufferProducer::RequestBufferReturnValue cancelled;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, shown), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, cancelled), GSERROR_OK);
+    ASSERT_EQ(bqTmp->FlushBuffer(shown.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(cancelled.sequence, bedata), GSERROR_OK);
+    sptr<SurfaceBuffer> buffer;
+    sptr<SyncFence> fence;
+    int64_t bufferTimestamp = 0;
+    std::vector<Rect> bufferDamages;
+    ASSERT_EQ(bqTmp->AcquireBuffer(buffer, fence, bufferTimestamp, bufferDamages), GSERROR_OK);
+    ASSERT_EQ(bqTmp->ReleaseBuffer(buffer, SyncFence::INVALID_FENCE), GSERROR_OK);
+    uint32_t bufferSize = buffer->GetSize();
+
+    SurfaceMemoryBudget::QueueUsage usage;
+    std::vector<SurfaceMemoryBudget::ReclaimCandidate> candidates;
+    bqTmp->CollectMemoryUsage(usage, candidates);
+    ASSERT_EQ(usage.uniqueId, bqTmp->GetUniqueId());
+    ASSERT_EQ(usage.bufferCount, 2u);
+    ASSERT_EQ(usage.bytes, 2 * static_cast<uint64_t>(bufferSize));
+    ASSERT_EQ(candidates.size(), 2u);
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    SurfaceMemoryBudget::SortCandidates(candidates, now);
+    ASSERT_EQ(candidates.size(), 1u);
+    ASSERT_EQ(candidates[0].sequence, cancelled.sequence);
+
+    ASSERT_EQ(bqTmp->ReclaimFreeBuffer(cancelled.sequence), bufferSize);
+    ASSERT_EQ(bqTmp->ReclaimFreeBuffer(cancelled.sequence), 0u);
+    ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 1u);
+    ASSERT_NE(std::find(bqTmp->deletingList_.begin(), bqTmp->deletingList_.end(), cancelled.sequence),
+        bqTmp->deletingList_.end());
+}
+
+/*
+ * Function: CollectMemoryUsage and ReclaimFreeBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a client holds the last flushed buffer with AcquireLastFlushedBuffer
+ *                  2. operation: collect and sort the candidates as if the queue had been idle past IDLE_RECLAIM_MS,
+ *                     then try to reclaim the held buffer
+ *                  3. result: the held buffer is no candidate and is not freed until the client releases it
+ */
+HWTEST_F(BufferQueueTest, MemoryBudgetReclaim002, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testMemoryBudgetLastFlushed");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    IBufferProducer::RequestBufferReturnValue shown;
+    IBufferProducer::RequestBufferReturnValue cancelled;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, shown), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, cancelled), GSERROR_OK);
+    ASSERT_EQ(bqTmp->FlushBuffer(shown.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(cancelled.sequence, bedata), GSERROR_OK);
+    sptr<SurfaceBuffer> buffer;
+    sptr<SyncFence> fence;
+    int64_t bufferTimestamp = 0;
+    std::vector<Rect> bufferDamages;
+    ASSERT_EQ(bqTmp->AcquireBuffer(buffer, fence, bufferTimestamp, bufferDamages), GSERROR_OK);
+    ASSERT_EQ(bqTmp->ReleaseBuffer(buffer, SyncFence::INVALID_FENCE), GSERROR_OK);
+    sptr<SurfaceBuffer> lastFlushed;
+    float matrix[16]; // 16: transform matrix size
+    ASSERT_EQ(bqTmp->AcquireLastFlushedBuffer(lastFlushed, fence, matrix, 16, false), GSERROR_OK); // 16: matrix size
+    ASSERT_EQ(lastFlushed->GetSeqNum(), shown.sequence);
+
+    SurfaceMemoryBudget::QueueUsage usage;
+    std::vector<SurfaceMemoryBudget::ReclaimCandidate> candidates;
+    bqTmp->CollectMemoryUsage(usage, candidates);
+    ASSERT_EQ(usage.bufferCount, 2u);
+    ASSERT_EQ(candidates.size(), 1u);
+    int64_t idleNow = usage.lastActiveTime + (SurfaceMemoryBudget::IDLE_RECLAIM_MS + 1) * 1000 * 1000; // ms to ns
+    SurfaceMemoryBudget::SortCandidates(candidates, idleNow);
+    ASSERT_EQ(candidates.size(), 1u);
+    ASSERT_EQ(candidates[0].sequence, cancelled.sequence);
+
+    ASSERT_EQ(bqTmp->ReclaimFreeBuffer(shown.sequence), 0u);
+    ASSERT_NE(bqTmp->bufferQueueCache_.find(shown.sequence), bqTmp->bufferQueueCache_.end());
+    ASSERT_EQ(bqTmp->ReleaseLastFlushedBuffer(shown.sequence), GSERROR_OK);
+    ASSERT_EQ(bqTmp->ReclaimFreeBuffer(shown.sequence), lastFlushed->GetSize());
+}
+
+/*
+ * Function: GetQueueUsage
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: create one queue owned by an sptr and one only held by a raw pointer
+ *                  2. operation: list the queues of the budget, then drop the sptr and list them again
+ *                  3. result: only the owned queue is listed, and only while it is alive
+ */
+HWTEST_F(BufferQueueTest, MemoryBudgetRegistry001, TestSize.Level0)
+{
+    auto isListed = [](uint64_t uniqueId) {
+        std::vector<SurfaceMemoryBudget::QueueUsage> usages = SurfaceMemoryBudget::GetInstance().GetQueueUsage();
+        return std::any_of(usages.begin(), usages.end(), [uniqueId](const SurfaceMemoryBudget::QueueUsage &usage) {
+            return usage.uniqueId == uniqueId;
+        });
+    };
+    sptr<BufferQueue> owned = new BufferQueue("testMemoryBudgetOwned");
+    BufferQueue *raw = new BufferQueue("testMemoryBudgetRaw");
+    uint64_t ownedId = owned->GetUniqueId();
+    ASSERT_TRUE(isListed(ownedId));
+    ASSERT_FALSE(isListed(raw->GetUniqueId()));
+
+    owned = nullptr;
+    ASSERT_FALSE(isListed(ownedId));
+    delete raw;
+}
+
+/*
+ * Function: BufferQueueDepthController
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: enable the controller with min queue size 2
+ *                  2. operation: feed one window where producers block with no backlog, then one window where every
+ *                     request finds two free buffers and the consumer keeps up
+ *                  3. result: the first window grows the queue, the second shrinks it, nothing is decided mid-window
+ */
+HWTEST_F(BufferQueueTest, QueueDepthController001, TestSize.Level0)
+{
+    BufferQueueDepthController controller;
+    ASSERT_EQ(controller.OnRelease(0, 0, 3, 8), BufferQueueDepthController::Decision::KEEP);
+    controller.Enable(2);
+    int64_t now = 0;
+    int64_t frameNs = 16000000; // 16ms per frame
+    for (uint32_t i = 0; i < BufferQueueDepthController::WINDOW_FRAMES; i++) {
+        controller.OnRequest(0);
+        controller.OnRequestWaited(BufferQueueDepthController::BLOCKED_THRESHOLD_NS);
+        controller.OnAcquire(1);
+        now += frameNs;
+        auto decision = controller.OnRelease(frameNs * 2, now, 3, 8); // 2: consumer holds two frames
+        if (i + 1 < BufferQueueDepthController::WINDOW_FRAMES) {
+            ASSERT_EQ(decision, BufferQueueDepthController::Decision::KEEP);
+        } else {
+            ASSERT_EQ(decision, BufferQueueDepthController::Decision::GROW);
+        }
+    }
+    for (uint32_t i = 0; i < BufferQueueDepthController::WINDOW_FRAMES; i++) {
+        controller.OnRequest(2);
+        controller.OnRequestWaited(0);
+        controller.OnAcquire(0);
+        now += frameNs;
+        auto decision = controller.OnRelease(frameNs / 2, now, 4, 8); // 2: consumer holds half a frame
+        if (i + 1 == BufferQueueDepthController::WINDOW_FRAMES) {
+            ASSERT_EQ(decision, BufferQueueDepthController::Decision::SHRINK);
+        }
+    }
+    for (uint32_t i = 0; i < BufferQueueDepthController::WINDOW_FRAMES; i++) {
+        controller.OnRequest(2);
+        now += frameNs;
+        // already at the minimum
+        ASSERT_EQ(controller.OnRelease(frameNs / 2, now, 2, 8), BufferQueueDepthController::Decision::KEEP);
+    }
+    std::string result;
+    controller.Dump(result);
+    ASSERT_NE(result.find("grows = 1, shrinks = 1"), std::string::npos);
+}
+
+/*
+ * Function: SetAutoQueueSize
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a queue of size 3 with two free buffers
+ *                  2. operation: enable auto queue size with invalid and valid minimums and apply a shrink and a grow
+ *                  3. result: invalid minimums are rejected, the shrink frees one free buffer, the grow only
+ *                     raises the size
+ */
+HWTEST_F(BufferQueueTest, SetAutoQueueSize001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testAutoQueueSize");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK);
+    ASSERT_EQ(bqTmp->SetAutoQueueSize(true, 0), GSERROR_INVALID_ARGUMENTS);
+    ASSERT_EQ(bqTmp->SetAutoQueueSize(true, SURFACE_MAX_QUEUE_SIZE + 1), GSERROR_INVALID_ARGUMENTS);
+    ASSERT_EQ(bqTmp->SetAutoQueueSize(true, 2), GSERROR_OK);
+    ASSERT_TRUE(bqTmp->depthController_.IsEnabled());
+
+    IBufferProducer::RequestBufferReturnValue retval1;
+    IBufferProducer::RequestBufferReturnValue retval2;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval1), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval2), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval1.sequence, bedata), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval2.sequence, bedata), GSERROR_OK);
+    {
+        std::unique_lock<std::mutex> lock(bqTmp->mutex_);
+        bqTmp->ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision::SHRINK, lock);
+        // two buffers fit in two slots, nothing to free
+        ASSERT_EQ(bqTmp->bufferQueueSize_, 2u);
+        ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 2u);
+        bqTmp->ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision::SHRINK, lock);
+        ASSERT_EQ(bqTmp->bufferQueueSize_, 1u);
+        ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 1u);
+        bqTmp->ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision::GROW, lock);
+        ASSERT_EQ(bqTmp->bufferQueueSize_, 2u);
+        ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 1u);
+    }
+    ASSERT_EQ(bqTmp->SetAutoQueueSize(false, 0), GSERROR_OK);
+    ASSERT_FALSE(bqTmp->depthController_.IsEnabled());
+}
+
+/*
+ * Function: SetAutoQueueSize
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a queue of size 3 with three free buffers and a producer allocating
+ *                  2. operation: apply a shrink, then a keep once the allocation is done
+ *                  3. result: the shrink returns at once and is deferred, the next release applies it
+ */
+HWTEST_F(BufferQueueTest, SetAutoQueueSize002, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testAutoQueueSizeDeferred");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK);
+    ASSERT_EQ(bqTmp->SetAutoQueueSize(true, 2), GSERROR_OK);
+    IBufferProducer::RequestBufferReturnValue retvals[3];
+    for (auto &retval : retvals) {
+        ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    }
+    for (auto &retval : retvals) {
+        ASSERT_EQ(bqTmp->CancelBuffer(retval.sequence, bedata), GSERROR_OK);
+    }
+
+    std::unique_lock<std::mutex> lock(bqTmp->mutex_);
+    bqTmp->allocatingBufferCount_++;
+    bqTmp->ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision::SHRINK, lock);
+    ASSERT_TRUE(bqTmp->isDepthShrinkDeferred_);
+    ASSERT_EQ(bqTmp->bufferQueueSize_, 3u);
+    ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 3u);
+
+    bqTmp->allocatingBufferCount_--;
+    bqTmp->ApplyQueueDepthDecisionLocked(BufferQueueDepthController::Decision::KEEP, lock);
+    ASSERT_FALSE(bqTmp->isDepthShrinkDeferred_);
+    ASSERT_EQ(bqTmp->bufferQueueSize_, 2u);
+    ASSERT_EQ(bqTmp->bufferQueueCache_.size(), 2u);
+}
+
+/*
+ * Function: FlushAndRequestBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a queue of size 2 with one requested and one free buffer
+ *                  2. operation: flush the requested buffer and request the next one in one call, twice
+ *                  3. result: the first call hands out the free buffer, the second one flushes but finds no buffer,
+ *                     a queue without consumer listener takes the buffer back
+ */
+HWTEST_F(BufferQueueTest, FlushAndRequestBuffer001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testFlushAndRequest");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(2), GSERROR_OK);
+    IBufferProducer::RequestBufferReturnValue retval1;
+    IBufferProducer::RequestBufferReturnValue retval2;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval1), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval2), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval2.sequence, bedata), GSERROR_OK);
+
+    IBufferProducer::RequestBufferReturnValue retval;
+    sptr<BufferExtraData> requestBedata = new BufferExtraDataImpl;
+    GSError requestRet = GSERROR_OK;
+    ASSERT_EQ(bqTmp->FlushAndRequestBuffer(retval1.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig,
+        requestConfig, requestBedata, retval, requestRet), GSERROR_OK);
+    ASSERT_EQ(requestRet, GSERROR_OK);
+    ASSERT_EQ(retval.sequence, retval2.sequence);
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retval1.sequence].state, BUFFER_STATE_FLUSHED);
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retval2.sequence].state, BUFFER_STATE_REQUESTED);
+
+    // both buffers are out, the request would have to wait for the consumer
+    ASSERT_EQ(bqTmp->FlushAndRequestBuffer(retval2.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig,
+        requestConfig, requestBedata, retval, requestRet), GSERROR_OK);
+    ASSERT_EQ(requestRet, GSERROR_NO_BUFFER);
+    ASSERT_EQ(bqTmp->dirtyList_.size(), 2u);
+
+    sptr<BufferQueue> bqNoListener = new BufferQueue("testFlushAndRequestNoListener");
+    bqNoListener->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqNoListener->RequestBuffer(requestConfig, bedata, retval1), GSERROR_OK);
+    ASSERT_EQ(bqNoListener->UnregisterConsumerListener(), GSERROR_OK);
+    ASSERT_EQ(bqNoListener->FlushAndRequestBuffer(retval1.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig,
+        requestConfig, requestBedata, retval, requestRet), SURFACE_ERROR_CONSUMER_UNREGISTER_LISTENER);
+    ASSERT_EQ(bqNoListener->freeList_.size(), 1u);
+}
+
+/*
+ * Function: FlushAndRequestBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a full queue whose only free buffer is held as the last flushed buffer
+ *                  2. operation: flush and request with a long request timeout
+ *                  3. result: the flush is done and the request returns GSERROR_NO_BUFFER right away instead of
+ *                     waiting before the consumer heard of the flush
+ */
+HWTEST_F(BufferQueueTest, FlushAndRequestBuffer002, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testFlushAndRequestLastFlushed");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(2), GSERROR_OK);
+    IBufferProducer::RequestBufferReturnValue retval1;
+    IBufferProducer::RequestBufferReturnValue retval2;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval1), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval2), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval2.sequence, bedata), GSERROR_OK);
+    bqTmp->acquireLastFlushedBufSequence_ = retval2.sequence;
+
+    BufferRequestConfig config = requestConfig;
+    config.timeout = 3000; // 3000ms: a blocking request would be noticed
+    IBufferProducer::RequestBufferReturnValue retval;
+    sptr<BufferExtraData> requestBedata = new BufferExtraDataImpl;
+    GSError requestRet = GSERROR_OK;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(bqTmp->FlushAndRequestBuffer(retval1.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig,
+        config, requestBedata, retval, requestRet), GSERROR_OK);
+    ASSERT_EQ(requestRet, GSERROR_NO_BUFFER);
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(config.timeout));
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retval1.sequence].state, BUFFER_STATE_FLUSHED);
+    ASSERT_EQ(bqTmp->freeList_.size(), 1u);
+}
+
+/*
+ * Function: FlushAndRequestBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a free buffer is reclaimed, so its delete is pending, and the producer cache is
+ *                     being cleaned
+ *                  2. operation: flush and request, then request normally
+ *                  3. result: the combined request is skipped and the pending delete reaches the producer with
+ *                     the normal request
+ */
+HWTEST_F(BufferQueueTest, FlushAndRequestBuffer003, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testFlushAndRequestDeleting");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(3), GSERROR_OK); // 3: one buffer to flush, one to reclaim, one to request
+    IBufferProducer::RequestBufferReturnValue retval1;
+    IBufferProducer::RequestBufferReturnValue retval2;
+    IBufferProducer::RequestBufferReturnValue retval3;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval1), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval2), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval3), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval2.sequence, bedata), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval3.sequence, bedata), GSERROR_OK);
+    ASSERT_GT(bqTmp->ReclaimFreeBuffer(retval3.sequence), 0u);
+    ASSERT_EQ(bqTmp->SetProducerCacheCleanFlag(true), GSERROR_OK);
+
+    IBufferProducer::RequestBufferReturnValue retval;
+    sptr<BufferExtraData> requestBedata = new BufferExtraDataImpl;
+    GSError requestRet = GSERROR_OK;
+    ASSERT_EQ(bqTmp->FlushAndRequestBuffer(retval1.sequence, bedata, SyncFence::INVALID_FENCE, flushConfig,
+        requestConfig, requestBedata, retval, requestRet), GSERROR_OK);
+    ASSERT_EQ(requestRet, GSERROR_NO_BUFFER);
+    ASSERT_TRUE(retval.deletingBuffers.empty());
+    ASSERT_EQ(bqTmp->deletingList_.size(), 1u);
+
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, requestBedata, retval), GSERROR_OK);
+    ASSERT_EQ(retval.deletingBuffers.size(), 1u);
+    ASSERT_EQ(retval.deletingBuffers[0], retval3.sequence);
+    ASSERT_TRUE(bqTmp->deletingList_.empty());
+}
+
+/*
+ * Function: RequestCachedBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: an empty queue of size 2
+ *                  2. operation: request cached buffers before any is allocated, after one is cancelled and
+ *                     while a reclaimed buffer's delete is pending
+ *                  3. result: nothing is allocated, the cancelled buffer is handed out, and nothing is handed out
+ *                     while the delete still has to reach the producer
+ */
+HWTEST_F(BufferQueueTest, RequestCachedBuffer001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testRequestCachedBuffer");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(2), GSERROR_OK); // 2: one buffer to hand out, one to reclaim
+    // extra data set on a cached buffer only travels in a parcel, so the buffers are cancelled without any
+    sptr<BufferExtraData> emptyBedata = new BufferExtraDataImpl;
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(bqTmp->RequestCachedBuffer(requestConfig, retval), GSERROR_NO_BUFFER);
+    ASSERT_EQ(bqTmp->GetUsedSize(), 0u);
+
+    IBufferProducer::RequestBufferReturnValue retval1;
+    IBufferProducer::RequestBufferReturnValue retval2;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval1), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval2), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval1.sequence, emptyBedata), GSERROR_OK);
+    ASSERT_EQ(bqTmp->RequestCachedBuffer(requestConfig, retval), GSERROR_OK);
+    ASSERT_EQ(retval.sequence, retval1.sequence);
+    ASSERT_EQ(retval.buffer, nullptr);
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retval1.sequence].state, BUFFER_STATE_REQUESTED);
+
+    ASSERT_EQ(bqTmp->CancelBuffer(retval1.sequence, emptyBedata), GSERROR_OK);
+    ASSERT_EQ(bqTmp->CancelBuffer(retval2.sequence, emptyBedata), GSERROR_OK);
+    ASSERT_GT(bqTmp->ReclaimFreeBuffer(retval2.sequence), 0u);
+    ASSERT_EQ(bqTmp->RequestCachedBuffer(requestConfig, retval), GSERROR_NO_BUFFER);
+    ASSERT_EQ(bqTmp->deletingList_.size(), 1u);
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retval1.sequence].state, BUFFER_STATE_RELEASED);
+}
+
+/*
+ * Function: RequestBuffers and FlushBuffers
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: a queue of size 4
+ *                  2. operation: request 6 buffers in one batch, flush them in one batch, then flush a batch
+ *                     with a buffer the queue does not know
+ *                  3. result: the batch is cut to the 4 buffers the queue has, the consumer hears of every flushed
+ *                     buffer, the bad batch flushes the buffers before the unknown one
+ */
+HWTEST_F(BufferQueueTest, BatchRequestAndFlush001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testBatchRequestAndFlush");
+    sptr<CountingConsumerListener> listener = new CountingConsumerListener();
+    sptr<IBufferConsumerListener> listenerBase = listener;
+    bqTmp->RegisterConsumerListener(listenerBase);
+    ASSERT_EQ(bqTmp->SetQueueSize(4), GSERROR_OK);
+
+    constexpr size_t batchSize = 6;
+    std::vector<IBufferProducer::RequestBufferReturnValue> retvalues(batchSize);
+    std::vector<sptr<BufferExtraData>> bedatas(batchSize);
+    ASSERT_EQ(bqTmp->RequestBuffers(requestConfig, bedatas, retvalues), GSERROR_NO_BUFFER);
+    ASSERT_EQ(retvalues.size(), 4u);
+    ASSERT_FALSE(bqTmp->isBatch_);
+
+    std::vector<uint32_t> sequences;
+    std::vector<sptr<SyncFence>> fences(retvalues.size(), SyncFence::InvalidFence());
+    std::vector<BufferFlushConfigWithDamages> configs(retvalues.size(), flushConfig);
+    for (const auto &retval : retvalues) {
+        ASSERT_NE(retval.buffer, nullptr);
+        sequences.emplace_back(retval.sequence);
+    }
+    ASSERT_EQ(bqTmp->FlushBuffers(sequences, bedatas, fences, configs), GSERROR_OK);
+    ASSERT_EQ(listener->availableCount, 4u);
+    ASSERT_EQ(bqTmp->dirtyList_.size(), 4u);
+
+    for (size_t i = 0; i < sequences.size(); i++) {
+        sptr<SurfaceBuffer> buffer = nullptr;
+        sptr<SyncFence> fence = nullptr;
+        ASSERT_EQ(bqTmp->AcquireBuffer(buffer, fence, timestamp, damages), GSERROR_OK);
+        ASSERT_EQ(bqTmp->ReleaseBuffer(buffer, SyncFence::InvalidFence()), GSERROR_OK);
+    }
+    retvalues.resize(2); // 2: a batch of two
+    ASSERT_EQ(bqTmp->RequestBuffers(requestConfig, bedatas, retvalues), GSERROR_OK);
+    ASSERT_EQ(retvalues.size(), 2u);
+    sequences = { retvalues[0].sequence, 0xFFFF, retvalues[1].sequence }; // 0xFFFF: not in the queue
+    fences.resize(sequences.size(), SyncFence::InvalidFence());
+    configs.resize(sequences.size(), flushConfig);
+    ASSERT_NE(bqTmp->FlushBuffers(sequences, bedatas, fences, configs), GSERROR_OK);
+    ASSERT_EQ(listener->availableCount, 5u);
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retvalues[0].sequence].state, BUFFER_STATE_FLUSHED);
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retvalues[1].sequence].state, BUFFER_STATE_REQUESTED);
+}
+
+// an eventfd polls like a sync file, writing to it signals the fence
+static sptr<SyncFence> CreateEventFence()
+{
+    return new SyncFence(eventfd(0, EFD_CLOEXEC));
+}
+
+static void SignalEventFence(const sptr<SyncFence> &fence)
+{
+    uint64_t one = 1;
+    ASSERT_EQ(write(fence->Get(), &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+}
+
+/*
+ * Function: ReleaseBuffer and RequestBuffer
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. preSetUp: an acquired buffer carrying its own sync fence
+ *                  2. operation: release it with a release fence, signal both fences, request it again
+ *                  3. result: release keeps both fences unmerged, the request gets an invalid fence and no merge
+ *                     is issued
+ */
+HWTEST_F(BufferQueueTest, LazyReleaseFence001, TestSize.Level0)
+{
+    sptr<BufferQueue> bqTmp = new BufferQueue("testLazyReleaseFence");
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    bqTmp->RegisterConsumerListener(listener);
+    ASSERT_EQ(bqTmp->SetQueueSize(1), GSERROR_OK);
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_EQ(bqTmp->FlushBuffer(retval.sequence, bedata, SyncFence::InvalidFence(), flushConfig), GSERROR_OK);
+    sptr<SurfaceBuffer> buffer = nullptr;
+    sptr<SyncFence> fence = nullptr;
+    ASSERT_EQ(bqTmp->AcquireBuffer(buffer, fence, timestamp, damages), GSERROR_OK);
+
+    uint64_t mergeCount = FenceSet::GetMergeCount();
+    sptr<SyncFence> syncFence = CreateEventFence();
+    sptr<SyncFence> releaseFence = CreateEventFence();
+    buffer->SetAndMergeSyncFence(syncFence);
+    ASSERT_EQ(bqTmp->ReleaseBuffer(buffer, releaseFence), GSERROR_OK);
+    auto &element = bqTmp->bufferQueueCache_[retval.sequence];
+    ASSERT_NE(element.releaseFences, nullptr);
+    ASSERT_EQ(element.releaseFences->GetSize(), 2u);
+    ASSERT_EQ(element.fence, nullptr);
+
+    SignalEventFence(syncFence);
+    SignalEventFence(releaseFence);
+    ASSERT_EQ(bqTmp->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_NE(retval.fence, nullptr);
+    ASSERT_FALSE(retval.fence->IsValid());
+    ASSERT_EQ(bqTmp->bufferQueueCache_[retval.sequence].releaseFences, nullptr);
+    ASSERT_EQ(FenceSet::GetMergeCount(), mergeCount);
+}
+
+/*
+ * Function: ReleaseBuffer and RequestBuffer
+ * Type: Performance
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. compose 4 layers for 300 frames, each layer buffer gets a sync fence from the compositor
+ *                     and a release fence, both signal before the layer draws its next frame
+ *                  2. print the merge ioctls per frame the eager merges issued against the ones FenceSet issues
+ */
+HWTEST_F(BufferQueueTest, LazyReleaseFenceBenchmark001, TestSize.Level1)
+{
+    constexpr uint32_t layerCount = 4;
+    constexpr uint32_t frameCount = 300;
+    std::vector<sptr<BufferQueue>> layers;
+    for (uint32_t i = 0; i < layerCount; i++) {
+        layers.push_back(new BufferQueue("testLazyReleaseFenceBenchmark" + std::to_string(i)));
+        sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+        layers.back()->RegisterConsumerListener(listener);
+    }
+    uint64_t eagerMerges = 0;
+    uint64_t mergeCount = FenceSet::GetMergeCount();
+    std::map<uint64_t, bool> hasSyncFence;
+    for (uint32_t frame = 0; frame < frameCount; frame++) {
+        std::vector<sptr<SyncFence>> frameFences;
+        for (auto &layer : layers) {
+            IBufferProducer::RequestBufferReturnValue retval;
+            ASSERT_EQ(layer->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+            ASSERT_EQ(layer->FlushBuffer(retval.sequence, bedata, SyncFence::InvalidFence(), flushConfig),
+                GSERROR_OK);
+            sptr<SurfaceBuffer> buffer = nullptr;
+            sptr<SyncFence> fence = nullptr;
+            ASSERT_EQ(layer->AcquireBuffer(buffer, fence, timestamp, damages), GSERROR_OK);
+            frameFences.push_back(CreateEventFence());
+            frameFences.push_back(CreateEventFence());
+            buffer->SetAndMergeSyncFence(frameFences[frameFences.size() - 2]); // 2: the sync fence
+            ASSERT_EQ(layer->ReleaseBuffer(buffer, frameFences.back()), GSERROR_OK);
+            // the eager path merged into a valid buffer fence, then merged the buffer fence with the release fence
+            bool &bufferHasFence = hasSyncFence[buffer->GetBufferId()];
+            eagerMerges += (bufferHasFence ? 1 : 0) + 1;
+            bufferHasFence = true;
+        }
+        for (const auto &fence : frameFences) {
+            SignalEventFence(fence);
+        }
+    }
+    uint64_t lazyMerges = FenceSet::GetMergeCount() - mergeCount;
+    printf("%u layers: eager %.2f merge ioctls/frame, FenceSet %.2f merge ioctls/frame\n", layerCount,
+        static_cast<double>(eagerMerges) / frameCount, static_cast<double>(lazyMerges) / frameCount);
+    ASSERT_LT(lazyMerges, eagerMerges);
+}
 } // namespace OHOS::Rosen
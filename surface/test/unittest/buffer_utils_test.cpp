@@ -16,6 +16,7 @@
 
 #include <thread>
 #include <chrono>
+#include <cstdio>
 #include <unistd.h>
 #include <fstream>
 
@@ -445,4 +446,125 @@ HWTEST_F(BufferUtilsTest, WriteSurfaceBufferImplWithAllProperties003, TestSize.L
     ASSERT_EQ(crop.w, 30);
     ASSERT_EQ(crop.h, 40);
 }
+
+static BufferFlushConfigWithDamages MakeFlushConfig(uint32_t rectCount)
+{
+    BufferFlushConfigWithDamages config = {
+        .timestamp = 1000000007, // 1000000007: any timestamp
+        .desiredPresentTimestamp = 1000016674, // 1000016674: one frame later
+    };
+    for (uint32_t i = 0; i < rectCount; i++) {
+        int32_t offset = static_cast<int32_t>(i * 16); // 16: tile size
+        config.damages.push_back({ .x = offset, .y = -offset, .w = 16, .h = 16 }); // 16: tile size
+    }
+    return config;
+}
+
+/*
+ * Function: WriteFlushConfig and ReadFlushConfig
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. write flush configs with the legacy and the packed encoding
+ *                  2. check that ReadFlushConfig reads both back unchanged, also at the int32 and int64 limits
+ *                  3. check that an unknown version and a truncated blob are rejected
+ */
+HWTEST_F(BufferUtilsTest, PackedFlushConfig001, TestSize.Level0)
+{
+    BufferFlushConfigWithDamages config = MakeFlushConfig(16); // 16: rects
+    config.damages.push_back({ .x = INT32_MIN, .y = INT32_MAX, .w = INT32_MAX, .h = 0 });
+    config.damages.push_back({ .x = INT32_MAX, .y = INT32_MIN, .w = -1, .h = INT32_MIN });
+    for (bool isPacked : { false, true }) {
+        MessageParcel parcel;
+        ASSERT_EQ(WriteFlushConfig(parcel, config, isPacked), GSERROR_OK);
+        BufferFlushConfigWithDamages readConfig;
+        ASSERT_EQ(ReadFlushConfig(parcel, readConfig), GSERROR_OK);
+        ASSERT_EQ(readConfig.damages, config.damages);
+        ASSERT_EQ(readConfig.timestamp, config.timestamp);
+        ASSERT_EQ(readConfig.desiredPresentTimestamp, config.desiredPresentTimestamp);
+    }
+    config.timestamp = INT64_MIN;
+    config.desiredPresentTimestamp = INT64_MAX;
+    MessageParcel limitParcel;
+    ASSERT_EQ(WriteFlushConfig(limitParcel, config, true), GSERROR_OK);
+    BufferFlushConfigWithDamages readConfig;
+    ASSERT_EQ(ReadFlushConfig(limitParcel, readConfig), GSERROR_OK);
+    ASSERT_EQ(readConfig.timestamp, INT64_MIN);
+    ASSERT_EQ(readConfig.desiredPresentTimestamp, INT64_MAX);
+
+    MessageParcel packedParcel;
+    ASSERT_EQ(WriteFlushConfig(packedParcel, config, true), GSERROR_OK);
+    uint32_t head = 0;
+    ASSERT_TRUE(packedParcel.ReadUint32(head));
+    MessageParcel badVersion;
+    ASSERT_TRUE(badVersion.WriteUint32(head + 1));
+    ASSERT_EQ(ReadFlushConfig(badVersion, readConfig), GSERROR_BINDER);
+    uint8_t blob[] = { 2, 0, 0, 2 }; // 2: one rect, which stops before its h
+    MessageParcel truncated;
+    ASSERT_TRUE(truncated.WriteUint32(head) && truncated.WriteUint32(sizeof(blob)));
+    ASSERT_TRUE(truncated.WriteBuffer(blob, sizeof(blob)));
+    ASSERT_EQ(ReadFlushConfig(truncated, readConfig), GSERROR_BINDER);
+}
+
+/*
+ * Function: WriteRequestConfig and ReadRequestConfig
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. write a request config with the legacy and the packed encoding
+ *                  2. check that ReadRequestConfig reads both back unchanged and an unknown version is rejected
+ */
+HWTEST_F(BufferUtilsTest, PackedRequestConfig001, TestSize.Level0)
+{
+    BufferRequestConfig config = requestConfig;
+    config.colorGamut = GRAPHIC_COLOR_GAMUT_DCI_P3;
+    config.transform = GRAPHIC_ROTATE_90;
+    for (bool isPacked : { false, true }) {
+        MessageParcel parcel;
+        ASSERT_EQ(WriteRequestConfig(parcel, config, isPacked), GSERROR_OK);
+        BufferRequestConfig readConfig;
+        ASSERT_TRUE(ReadRequestConfig(parcel, readConfig));
+        ASSERT_EQ(readConfig, config);
+    }
+    MessageParcel packedParcel;
+    ASSERT_EQ(WriteRequestConfig(packedParcel, config, true), GSERROR_OK);
+    int32_t head = 0;
+    ASSERT_TRUE(packedParcel.ReadInt32(head));
+    ASSERT_LT(head, 0);
+    MessageParcel badVersion;
+    ASSERT_TRUE(badVersion.WriteInt32(head + 1));
+    BufferRequestConfig readConfig;
+    ASSERT_FALSE(ReadRequestConfig(badVersion, readConfig));
+}
+
+/*
+ * Function: WriteFlushConfig and ReadFlushConfig
+ * Type: Performance
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. encode and decode flush configs of 1, 16 and 256 rects with both encodings
+ *                  2. print the parcel size and the time per round trip
+ */
+HWTEST_F(BufferUtilsTest, PackedFlushConfigBenchmark001, TestSize.Level1)
+{
+    constexpr uint32_t loops = 20000;
+    for (uint32_t rectCount : { 1, 16, 256 }) {
+        BufferFlushConfigWithDamages config = MakeFlushConfig(rectCount);
+        for (bool isPacked : { false, true }) {
+            size_t parcelSize = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < loops; i++) {
+                MessageParcel parcel;
+                ASSERT_EQ(WriteFlushConfig(parcel, config, isPacked), GSERROR_OK);
+                parcelSize = parcel.GetDataSize();
+                BufferFlushConfigWithDamages readConfig;
+                ASSERT_EQ(ReadFlushConfig(parcel, readConfig), GSERROR_OK);
+            }
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            printf("%s %u rects: %zu bytes, %.0f ns/op\n", isPacked ? "packed" : "legacy", rectCount, parcelSize,
+                static_cast<double>(ns) / loops);
+        }
+    }
+}
 }
\ No newline at end of file
@@ -2798,6 +2798,42 @@ HWTEST_F(ConsumerSurfaceTest, SetMaxQueueSizeAndGetMaxQueueSize001, TestSize.Lev
     cSurface = nullptr;
 }
 
+/*
+* Function: SetAutoQueueSize
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. call SetAutoQueueSize with invalid and valid minimums, SetQueueSize in between
+*                  2. check ret and that the queue's auto sizing follows
+*/
+HWTEST_F(ConsumerSurfaceTest, SetAutoQueueSize001, TestSize.Level0)
+{
+    auto cSurface = IConsumerSurface::Create();
+    sptr<IBufferConsumerListener> cListener = new BufferConsumerListener();
+    cSurface->RegisterConsumerListener(cListener);
+    sptr<ConsumerSurface> qs = static_cast<ConsumerSurface*>(cSurface.GetRefPtr());
+    sptr<BufferQueue> queue = qs->consumer_->bufferQueue_;
+
+    ASSERT_EQ(cSurface->SetAutoQueueSize(true, 0), OHOS::GSERROR_INVALID_ARGUMENTS);
+    ASSERT_EQ(cSurface->SetAutoQueueSize(true, SURFACE_MAX_QUEUE_SIZE + 1), OHOS::GSERROR_INVALID_ARGUMENTS);
+    ASSERT_FALSE(queue->depthController_.IsEnabled());
+    ASSERT_EQ(cSurface->SetAutoQueueSize(true, 2), OHOS::GSERROR_OK);
+    ASSERT_TRUE(queue->depthController_.IsEnabled());
+    ASSERT_EQ(cSurface->SetQueueSize(4), OHOS::GSERROR_OK);
+    ASSERT_EQ(cSurface->GetQueueSize(), 4);
+    ASSERT_TRUE(queue->depthController_.IsEnabled());
+    ASSERT_EQ(cSurface->SetAutoQueueSize(false, 0), OHOS::GSERROR_OK);
+    ASSERT_FALSE(queue->depthController_.IsEnabled());
+    ASSERT_EQ(cSurface->GetQueueSize(), 4);
+
+    sptr<BufferQueueConsumer> consumer = qs->consumer_;
+    qs->consumer_ = nullptr;
+    ASSERT_EQ(qs->SetAutoQueueSize(true, 2), OHOS::SURFACE_ERROR_UNKOWN);
+    qs->consumer_ = consumer;
+    qs = nullptr;
+    cSurface = nullptr;
+}
+
 /*
  * Function: GetAlphaType
  * Type: Function
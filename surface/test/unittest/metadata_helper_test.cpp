@@ -450,6 +450,45 @@ HWTEST_F(MetadataManagerTest, AdaptiveFOVMetadataTest, Function | SmallTest | Le
     ASSERT_EQ(MetadataHelper::GetAdaptiveFOVMetadata(nullBuffer_, metadataGet), GSERROR_NO_BUFFER);
 }
 
+/*
+* Function: MetadataManagerTest
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: test GetLayerMetadata returns what the single key setters wrote
+*/
+HWTEST_F(MetadataManagerTest, LayerMetadataTest, Function | SmallTest | Level1)
+{
+    sptr<SurfaceBuffer> buffer = new SurfaceBufferImpl(0);
+    ASSERT_EQ(buffer->Alloc(requestConfig), GSERROR_OK);
+
+    MetadataHelper::LayerMetadata metadata;
+    ASSERT_EQ(MetadataHelper::GetLayerMetadata(buffer, metadata), GSERROR_OK);
+    ASSERT_FALSE(metadata.hasColorSpaceInfo);
+    ASSERT_FALSE(metadata.hasHdrMetadataType);
+    ASSERT_TRUE(metadata.hdrDynamicMetadata.empty());
+
+    auto retSet = MetadataHelper::SetColorSpaceType(buffer, CM_BT2020_HLG_FULL);
+    ASSERT_TRUE(retSet == GSERROR_OK || retSet == GSERROR_HDI_ERROR);
+    if (retSet == GSERROR_OK) {
+        ASSERT_EQ(MetadataHelper::SetHDRMetadataType(buffer, CM_VIDEO_HLG), GSERROR_OK);
+        std::vector<uint8_t> hdrDynamicMetadata = {1, 2, 3, 4};
+        ASSERT_EQ(MetadataHelper::SetHDRDynamicMetadata(buffer, hdrDynamicMetadata), GSERROR_OK);
+
+        ASSERT_EQ(MetadataHelper::GetLayerMetadata(buffer, metadata), GSERROR_OK);
+        ASSERT_TRUE(metadata.hasColorSpaceInfo);
+        CM_ColorSpaceType colorSpaceType;
+        ASSERT_EQ(MetadataHelper::ConvertColorSpaceInfoToType(metadata.colorSpaceInfo, colorSpaceType), GSERROR_OK);
+        ASSERT_EQ(colorSpaceType, CM_BT2020_HLG_FULL);
+        ASSERT_TRUE(metadata.hasHdrMetadataType);
+        ASSERT_EQ(metadata.hdrMetadataType, CM_VIDEO_HLG);
+        ASSERT_EQ(metadata.hdrDynamicMetadata, hdrDynamicMetadata);
+        ASSERT_TRUE(metadata.hdrStaticMetadata.empty());
+    }
+
+    ASSERT_EQ(MetadataHelper::GetLayerMetadata(nullBuffer_, metadata), GSERROR_NO_BUFFER);
+}
+
 #ifdef RS_ENABLE_TV_PQ_METADATA
 /*
  * Function: MetadataManagerTest
@@ -654,6 +693,110 @@ HWTEST_F(MetadataManagerTest, EraseVideoTVInfoKeyTest, Function | SmallTest | Le
     ASSERT_NE(MetadataHelper::GetVideoTVMetadata(buffer_, tvPQMetadata), GSERROR_OK);
 }
 
+/*
+ * Function: MetadataManagerTest
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: test TvPQMetadataTransaction commits several fields at once
+ */
+HWTEST_F(MetadataManagerTest, TvPQMetadataTransactionTest, Function | SmallTest | Level1)
+{
+    ASSERT_EQ(MetadataHelper::SetSceneTag(buffer_, 5), GSERROR_OK);
+    TvVideoWindow tvVideoWindow = {10, 20, 1920, 1080, 2};
+    GSError ret = MetadataHelper::TvPQMetadataTransaction(buffer_)
+        .SetVideoFrameCount(7)
+        .SetVideoFrameRate(60)
+        .SetVideoTVInfo(tvVideoWindow)
+        .SetVideoColorimetryHdr(2, 3)
+        .Commit();
+    ASSERT_EQ(ret, GSERROR_OK);
+
+    TvPQMetadata tvPQMetadata;
+    ASSERT_EQ(MetadataHelper::GetVideoTVMetadata(buffer_, tvPQMetadata), GSERROR_OK);
+    // fields outside the transaction are kept
+    ASSERT_EQ(tvPQMetadata.sceneTag, 5);
+    ASSERT_EQ(tvPQMetadata.vidFrameCnt, 7);
+    ASSERT_EQ(tvPQMetadata.vidFps, 60);
+    ASSERT_EQ(tvPQMetadata.vidWinWidth, 1920);
+    ASSERT_EQ(tvPQMetadata.vidWinSize, 2);
+    ASSERT_EQ(tvPQMetadata.hdr, 2);
+    ASSERT_EQ(tvPQMetadata.colorimetry, 3);
+
+    sptr<SurfaceBuffer> bufferPtr = nullptr;
+    ASSERT_EQ(MetadataHelper::TvPQMetadataTransaction(bufferPtr).SetSceneTag(1).Commit(), GSERROR_NO_BUFFER);
+    ASSERT_EQ(MetadataHelper::TvPQMetadataTransaction(buffer_).Commit(), GSERROR_OK);
+}
+
+class MetadataCallCountBuffer : public SurfaceBufferImpl {
+public:
+    MetadataCallCountBuffer() : SurfaceBufferImpl(0) {}
+
+    GSError SetMetadata(uint32_t key, const std::vector<uint8_t>& value, bool enableCache = true) override
+    {
+        setCount++;
+        return SurfaceBufferImpl::SetMetadata(key, value, enableCache);
+    }
+
+    GSError GetMetadata(uint32_t key, std::vector<uint8_t>& value) override
+    {
+        getCount++;
+        return SurfaceBufferImpl::GetMetadata(key, value);
+    }
+
+    uint32_t setCount = 0;
+    uint32_t getCount = 0;
+};
+
+/*
+ * Function: MetadataManagerTest
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: count the metadata calls of one TV video frame, per field setters against a transaction
+ */
+HWTEST_F(MetadataManagerTest, TvPQMetadataTransactionCallCountTest, Function | SmallTest | Level1)
+{
+    sptr<MetadataCallCountBuffer> countBuffer = new MetadataCallCountBuffer();
+    ASSERT_EQ(countBuffer->Alloc(requestConfig), GSERROR_OK);
+    sptr<SurfaceBuffer> buffer = countBuffer;
+    constexpr uint32_t frames = 100;
+    TvVideoWindow tvVideoWindow = {0, 0, 1920, 1080, 1};
+
+    for (uint32_t i = 0; i < frames; i++) {
+        unsigned char frame = static_cast<unsigned char>(i);
+        ASSERT_EQ(MetadataHelper::SetVideoFrameCount(buffer, frame), GSERROR_OK);
+        ASSERT_EQ(MetadataHelper::SetVideoFrameRate(buffer, 60), GSERROR_OK);
+        ASSERT_EQ(MetadataHelper::SetVideoTVInfo(buffer, tvVideoWindow), GSERROR_OK);
+        ASSERT_EQ(MetadataHelper::SetVideoDecoderHigh(buffer, 1920, 1080), GSERROR_OK);
+        ASSERT_EQ(MetadataHelper::SetVideoTVScaleMode(buffer, 1), GSERROR_OK);
+        ASSERT_EQ(MetadataHelper::SetVideoTVDpPixelFormat(buffer, 1), GSERROR_OK);
+        ASSERT_EQ(MetadataHelper::SetVideoColorimetryHdr(buffer, 1, 1), GSERROR_OK);
+    }
+    uint32_t setterCalls = countBuffer->getCount + countBuffer->setCount;
+    countBuffer->getCount = 0;
+    countBuffer->setCount = 0;
+
+    for (uint32_t i = 0; i < frames; i++) {
+        GSError ret = MetadataHelper::TvPQMetadataTransaction(buffer)
+            .SetVideoFrameCount(static_cast<unsigned char>(i))
+            .SetVideoFrameRate(60)
+            .SetVideoTVInfo(tvVideoWindow)
+            .SetVideoDecoderHigh(1920, 1080)
+            .SetVideoTVScaleMode(1)
+            .SetVideoTVDpPixelFormat(1)
+            .SetVideoColorimetryHdr(1, 1)
+            .Commit();
+        ASSERT_EQ(ret, GSERROR_OK);
+    }
+    uint32_t transactionCalls = countBuffer->getCount + countBuffer->setCount;
+    printf("TV PQ metadata calls per frame: setters %.1f, transaction %.1f\n",
+        static_cast<double>(setterCalls) / frames, static_cast<double>(transactionCalls) / frames);
+    ASSERT_LE(countBuffer->getCount, frames);
+    ASSERT_LE(countBuffer->setCount, frames);
+    ASSERT_LT(transactionCalls, setterCalls);
+}
+
 /*
  * Function: MetadataManagerTest
  * Type: Function
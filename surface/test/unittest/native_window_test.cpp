@@ -3367,4 +3367,86 @@ HWTEST_F(NativeWindowTest, SetAppFrameworkType_BoundaryLength001, TestSize.Level
     ASSERT_EQ(strlen(validStr), maxLen);
     ASSERT_EQ(0, strncmp(validStr, typeGet, maxLen));
 }
+
+/*
+* Function: OH_NativeWindow_NativeWindowRequestBuffer and OH_NativeWindow_CleanCache
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. request a buffer through a window on a producer surface
+*                  2. check that the window and the surface share one cache, that a buffer the producer forgets
+*                     keeps its NativeWindowBuffer and that CleanCache drops both
+ */
+HWTEST_F(NativeWindowTest, SharedBufferCache001, TestSize.Level0)
+{
+    sptr<OHOS::IConsumerSurface> cSurfaceTmp = IConsumerSurface::Create();
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    cSurfaceTmp->RegisterConsumerListener(listener);
+    sptr<OHOS::IBufferProducer> producerTmp = cSurfaceTmp->GetProducer();
+    sptr<OHOS::Surface> pSurfaceTmp = Surface::CreateSurfaceAsProducer(producerTmp);
+    NativeWindow *nativeWindowTmp = OH_NativeWindow_CreateNativeWindow(&pSurfaceTmp);
+    ASSERT_NE(nativeWindowTmp, nullptr);
+    SetNativeWindowConfig(nativeWindowTmp);
+
+    NativeWindowBuffer *nativeWindowBuffer = nullptr;
+    int fenceFd = -1;
+    ASSERT_EQ(OH_NativeWindow_NativeWindowRequestBuffer(nativeWindowTmp, &nativeWindowBuffer, &fenceFd),
+        GSERROR_OK);
+    sptr<ProducerBufferCache> cache = nativeWindowTmp->bufferCache_;
+    uint32_t sequence = nativeWindowBuffer->sfbuffer->GetSeqNum();
+    ASSERT_EQ(cache->Size(), 1);
+    ASSERT_EQ(cache->Find(sequence), nativeWindowBuffer->sfbuffer);
+    ASSERT_EQ(cache->GetNativeWindowBuffer(nativeWindowTmp, nativeWindowBuffer->sfbuffer, 0), nativeWindowBuffer);
+
+    cache->EraseBuffer(sequence);
+    ASSERT_EQ(cache->Size(), 0);
+    ASSERT_FALSE(cache->Contains(sequence));
+    ASSERT_EQ(cache->GetNativeWindowBuffer(nativeWindowTmp, nativeWindowBuffer->sfbuffer, 0), nativeWindowBuffer);
+    cache->Insert(sequence, nativeWindowBuffer->sfbuffer);
+    ASSERT_EQ(cache->Size(), 1);
+
+    ASSERT_EQ(OH_NativeWindow_CleanCache(nativeWindowTmp), GSERROR_OK);
+    ASSERT_EQ(cache->Size(), 0);
+    ASSERT_EQ(cache->entries_.size(), 0);
+    OH_NativeWindow_DestroyNativeWindow(nativeWindowTmp);
+}
+
+/*
+* Function: OH_NativeWindow_DestroyNativeWindow
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. create two windows on one producer surface and let both hand out a wrapper for one buffer
+*                  2. destroy the first window and check that the wrapper of the second one is still cached and valid
+ */
+HWTEST_F(NativeWindowTest, SharedBufferCache002, TestSize.Level0)
+{
+    sptr<OHOS::IConsumerSurface> cSurfaceTmp = IConsumerSurface::Create();
+    sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+    cSurfaceTmp->RegisterConsumerListener(listener);
+    sptr<OHOS::IBufferProducer> producerTmp = cSurfaceTmp->GetProducer();
+    sptr<OHOS::Surface> pSurfaceTmp = Surface::CreateSurfaceAsProducer(producerTmp);
+    NativeWindow *firstWindow = OH_NativeWindow_CreateNativeWindow(&pSurfaceTmp);
+    NativeWindow *secondWindow = OH_NativeWindow_CreateNativeWindow(&pSurfaceTmp);
+    ASSERT_NE(firstWindow, nullptr);
+    ASSERT_NE(secondWindow, nullptr);
+    ASSERT_EQ(firstWindow->bufferCache_, secondWindow->bufferCache_);
+    SetNativeWindowConfig(firstWindow);
+
+    NativeWindowBuffer *firstBuffer = nullptr;
+    int fenceFd = -1;
+    ASSERT_EQ(OH_NativeWindow_NativeWindowRequestBuffer(firstWindow, &firstBuffer, &fenceFd), GSERROR_OK);
+    sptr<SurfaceBuffer> sfbuffer = firstBuffer->sfbuffer;
+    sptr<ProducerBufferCache> cache = secondWindow->bufferCache_;
+    NativeWindowBuffer *secondBuffer = cache->GetNativeWindowBuffer(secondWindow, sfbuffer, 0);
+    ASSERT_NE(secondBuffer, nullptr);
+    ASSERT_NE(secondBuffer, firstBuffer);
+    ASSERT_EQ(OH_NativeWindow_NativeWindowAbortBuffer(firstWindow, firstBuffer), GSERROR_OK);
+
+    OH_NativeWindow_DestroyNativeWindow(firstWindow);
+    ASSERT_EQ(cache->GetNativeWindowBuffer(secondWindow, sfbuffer, 0), secondBuffer);
+    ASSERT_EQ(secondBuffer->sfbuffer, sfbuffer);
+    ASSERT_EQ(cache->entries_[sfbuffer->GetSeqNum()].windowBuffers.size(), 1u);
+    OH_NativeWindow_DestroyNativeWindow(secondWindow);
+}
 }
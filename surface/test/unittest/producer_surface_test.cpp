@@ -4626,25 +4626,27 @@ HWTEST_F(ProducerSurfaceTest, PreCacheBuffer005, TestSize.Level0)
     std::vector<BufferFlushConfigWithDamages> configs;
 
     PrepareForFlushBuffers(1, pSurfaceTmp, buffers, fences, configs);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 1);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 1);
     uint32_t invalidBufferId = 9999;
     sptr<SurfaceBuffer> invalidBuffer = nullptr;
-    if (pSurfaceTmp->bufferProducerCache_.find(invalidBufferId) == pSurfaceTmp->bufferProducerCache_.end()) {
-        pSurfaceTmp->bufferProducerCache_[invalidBufferId] = invalidBuffer;
+    if (!pSurfaceTmp->bufferProducerCache_->Contains(invalidBufferId)) {
+        pSurfaceTmp->bufferProducerCache_->Insert(invalidBufferId, invalidBuffer);
     } else {
-        pSurfaceTmp->bufferProducerCache_[++invalidBufferId] = invalidBuffer;
+        pSurfaceTmp->bufferProducerCache_->Insert(++invalidBufferId, invalidBuffer);
     }
+    // a null buffer is not cached, so there is nothing to keep back
+    EXPECT_FALSE(pSurfaceTmp->bufferProducerCache_->Contains(invalidBufferId));
 
     pSurfaceTmp->CleanAllLocked(&invalidBufferId);
     EXPECT_TRUE(pSurfaceTmp->preCacheBuffer_ == nullptr);
-    EXPECT_EQ(pSurfaceTmp->flushBufferCountAfterCleanCache_, 0);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 0);
+    EXPECT_EQ(pSurfaceTmp->flushBufferCountAfterCleanCache_, -1);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 0);
 
     buffers.clear();
     fences.clear();
     configs.clear();
     PrepareForFlushBuffers(1, pSurfaceTmp, buffers, fences, configs);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 1);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 1);
     uint32_t validBufferId = buffers[0]->GetSeqNum();
     pSurfaceTmp->CleanAllLocked(&validBufferId);
     EXPECT_TRUE(pSurfaceTmp->preCacheBuffer_ != nullptr);
@@ -4704,14 +4706,14 @@ HWTEST_F(ProducerSurfaceTest, PreCacheBuffer007, TestSize.Level0)
     std::vector<BufferFlushConfigWithDamages> configs;
 
     PrepareForFlushBuffers(3, pSurfaceTmp, buffers, fences, configs);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 3);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 3);
 
     uint32_t invalidBufferId = 9999;
     sptr<SurfaceBuffer> invalidBuffer = nullptr;
-    if (pSurfaceTmp->bufferProducerCache_.find(invalidBufferId) == pSurfaceTmp->bufferProducerCache_.end()) {
-        pSurfaceTmp->bufferProducerCache_[invalidBufferId] = invalidBuffer;
+    if (!pSurfaceTmp->bufferProducerCache_->Contains(invalidBufferId)) {
+        pSurfaceTmp->bufferProducerCache_->Insert(invalidBufferId, invalidBuffer);
     } else {
-        pSurfaceTmp->bufferProducerCache_[++invalidBufferId] = invalidBuffer;
+        pSurfaceTmp->bufferProducerCache_->Insert(++invalidBufferId, invalidBuffer);
     }
 
     pSurfaceTmp->CleanAllLocked(&invalidBufferId);
@@ -4826,7 +4828,7 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache001, TestSize.Level0)
     sptr<IBufferProducer> producer = nullptr;
     sptr<ProducerSurface> pSurfaceTmp = new ProducerSurface(producer);
     pSurfaceTmp->Init();
-    GSError ret = pSurfaceTmp->SyncProducerCacheLocked();
+    GSError ret = pSurfaceTmp->SyncProducerCacheLocked(0);
     EXPECT_EQ(ret, GSERROR_INVALID_ARGUMENTS);
 }
 
@@ -4858,14 +4860,14 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache002, TestSize.Level0)
     EXPECT_EQ(ret, GSERROR_OK);
     EXPECT_TRUE(buffer2 != nullptr);
     
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 2);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 2);
     
-    pSurfaceTmp->bufferProducerCache_.clear();
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 0);
+    pSurfaceTmp->bufferProducerCache_->ClearBuffers();
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 0);
     
-    ret = pSurfaceTmp->SyncProducerCacheLocked();
+    ret = pSurfaceTmp->SyncProducerCacheLocked(buffer1->GetSeqNum());
     EXPECT_EQ(ret, GSERROR_OK);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 2);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 2);
 }
 
 /*
@@ -4891,8 +4893,8 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache003, TestSize.Level0)
     EXPECT_TRUE(buffer1 != nullptr);
     
     uint32_t seqNum = buffer1->GetSeqNum();
-    pSurfaceTmp->bufferProducerCache_.clear();
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 0);
+    pSurfaceTmp->bufferProducerCache_->ClearBuffers();
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 0);
     
     IBufferProducer::RequestBufferReturnValue retval;
     retval.sequence = seqNum;
@@ -4901,7 +4903,7 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache003, TestSize.Level0)
     
     ret = pSurfaceTmp->AddCacheLocked(bedataimpl, retval, requestConfig);
     EXPECT_EQ(ret, GSERROR_OK);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 1);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 1);
     EXPECT_TRUE(retval.buffer != nullptr);
     EXPECT_EQ(retval.buffer->GetSeqNum(), seqNum);
 }
@@ -4929,8 +4931,8 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache004, TestSize.Level0)
     
     GSError ret = pSurfaceTmp->AddCacheLocked(bedataimpl, retval, requestConfig);
     EXPECT_EQ(ret, GSERROR_OK);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 1);
-    EXPECT_TRUE(pSurfaceTmp->bufferProducerCache_.find(12345) != pSurfaceTmp->bufferProducerCache_.end());
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 1);
+    EXPECT_TRUE(pSurfaceTmp->bufferProducerCache_->Contains(12345));
 }
 
 /*
@@ -4949,9 +4951,9 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache005, TestSize.Level0)
     sptr<ProducerSurface> pSurfaceTmp = new ProducerSurface(producer);
     pSurfaceTmp->Init();
     
-    GSError ret = pSurfaceTmp->SyncProducerCacheLocked();
+    GSError ret = pSurfaceTmp->SyncProducerCacheLocked(0);
     EXPECT_EQ(ret, GSERROR_OK);
-    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_.size(), 0);
+    EXPECT_EQ(pSurfaceTmp->bufferProducerCache_->Size(), 0);
 }
 
 /*
@@ -4966,7 +4968,7 @@ HWTEST_F(ProducerSurfaceTest, SyncProducerCache007, TestSize.Level0)
     sptr<IBufferProducer> producer = nullptr;
     sptr<ProducerSurface> pSurfaceTmp = new ProducerSurface(producer);
     pSurfaceTmp->Init();
-    GSError ret = pSurfaceTmp->SyncProducerCacheLocked();
+    GSError ret = pSurfaceTmp->SyncProducerCacheLocked(0);
     EXPECT_EQ(ret, GSERROR_INVALID_ARGUMENTS);
 }
 
@@ -5112,4 +5114,103 @@ HWTEST_F(ProducerSurfaceTest, SetSingleBufferMode002, TestSize.Level0)
     ret = pSurfaceTmp->SetSingleBufferMode(SingleBufferMode::SINGLE_BUFFER_MODE_TO_SINGLE);
     ASSERT_EQ(ret, GSERROR_INVALID_ARGUMENTS);
 }
+
+/*
+* Function: SetMetadataValue
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. set hdr user data and request buffers
+*                  2. check the metadata is pushed once per generation and again after a change
+ */
+HWTEST_F(ProducerSurfaceTest, UserMetadataGeneration001, TestSize.Level0)
+{
+    sptr<IConsumerSurface> cSurfTmp = IConsumerSurface::Create();
+    sptr<IBufferConsumerListener> listenerTmp = new BufferConsumerListener();
+    cSurfTmp->RegisterConsumerListener(listenerTmp);
+    sptr<IBufferProducer> producer = cSurfTmp->GetProducer();
+    sptr<ProducerSurface> pSurfaceTmp = new ProducerSurface(producer);
+    ASSERT_EQ(pSurfaceTmp->userMetadataGeneration_, 0);
+
+    sptr<SurfaceBuffer> buffer = nullptr;
+    ASSERT_EQ(pSurfaceTmp->SetMetadataValue(buffer), GSERROR_OK);
+    ASSERT_EQ(pSurfaceTmp->SetUserData("OH_HDR_METADATA_TYPE", "1"), GSERROR_OK);
+    ASSERT_EQ(pSurfaceTmp->SetUserData("ATTRKEY_COLORSPACE_INFO", "1"), GSERROR_OK);
+    ASSERT_EQ(pSurfaceTmp->userMetadata_.size(), 2);
+    ASSERT_EQ(pSurfaceTmp->SetMetadataValue(buffer), GSERROR_NO_BUFFER);
+    uint64_t generation = pSurfaceTmp->userMetadataGeneration_;
+    ASSERT_NE(generation, 0);
+    // unrelated keys leave the metadata alone
+    ASSERT_EQ(pSurfaceTmp->SetUserData("Unrelated", "1"), GSERROR_OK);
+    ASSERT_EQ(pSurfaceTmp->userMetadataGeneration_, generation);
+
+    sptr<SyncFence> releaseFence = SyncFence::InvalidFence();
+    GSError ret = pSurfaceTmp->RequestBuffer(buffer, releaseFence, requestConfig);
+    ASSERT_EQ(ret, GSERROR_OK);
+    ASSERT_EQ(buffer->GetAppliedMetadataGeneration(), generation);
+    std::vector<uint8_t> type;
+    ASSERT_EQ(buffer->GetMetadata(ATTRKEY_HDR_METADATA_TYPE, type), GSERROR_OK);
+    // nothing changed, the buffer is left alone
+    ASSERT_EQ(buffer->EraseMetadataKey(ATTRKEY_HDR_METADATA_TYPE), GSERROR_OK);
+    buffer->SetAppliedMetadataGeneration(generation);
+    ASSERT_EQ(pSurfaceTmp->SetMetadataValue(buffer), GSERROR_OK);
+    ASSERT_NE(buffer->GetMetadata(ATTRKEY_HDR_METADATA_TYPE, type), GSERROR_OK);
+
+    ASSERT_EQ(pSurfaceTmp->SetUserData("OH_HDR_METADATA_TYPE", "2"), GSERROR_OK);
+    ASSERT_GT(pSurfaceTmp->userMetadataGeneration_, generation);
+    ASSERT_EQ(pSurfaceTmp->SetMetadataValue(buffer), GSERROR_OK);
+    ASSERT_EQ(buffer->GetAppliedMetadataGeneration(), pSurfaceTmp->userMetadataGeneration_);
+    ASSERT_EQ(buffer->GetMetadata(ATTRKEY_HDR_METADATA_TYPE, type), GSERROR_OK);
+
+    ASSERT_EQ(pSurfaceTmp->SetUserData("OH_HDR_METADATA_TYPE", ""), GSERROR_OK);
+    ASSERT_EQ(pSurfaceTmp->userMetadata_.size(), 1);
+    ASSERT_EQ(pSurfaceTmp->CancelBuffer(buffer), GSERROR_OK);
+}
+
+/*
+ * Function: RequestBuffers
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. request 3 buffers, then 4 when only 1 is left
+ *                  2. check that each batch asks for the given count and that extra data the queue did not use
+ *                     is kept for the next batch
+ *                  3. check that a count of 0 or above SURFACE_MAX_QUEUE_SIZE is rejected
+ */
+HWTEST_F(ProducerSurfaceTest, RequestBuffersCount001, TestSize.Level0)
+{
+    sptr<IConsumerSurface> cSurfTmp = IConsumerSurface::Create();
+    sptr<IBufferConsumerListener> listenerTmp = new BufferConsumerListener();
+    cSurfTmp->RegisterConsumerListener(listenerTmp);
+    sptr<IBufferProducer> producerTmp = cSurfTmp->GetProducer();
+    sptr<ProducerSurface> pSurfaceTmp = new ProducerSurface(producerTmp);
+    ASSERT_EQ(pSurfaceTmp->Init(), GSERROR_OK);
+    ASSERT_EQ(pSurfaceTmp->SetQueueSize(4), GSERROR_OK);
+
+    std::vector<sptr<SurfaceBuffer>> buffers;
+    std::vector<sptr<SyncFence>> fences;
+    ASSERT_EQ(pSurfaceTmp->RequestBuffers(buffers, fences, requestConfig, 3), GSERROR_OK); // 3: less than the queue has
+    ASSERT_EQ(buffers.size(), 3u);
+    ASSERT_EQ(fences.size(), 3u);
+    ASSERT_EQ(pSurfaceTmp->batchExtraData_.size(), 3u);
+    ASSERT_TRUE(pSurfaceTmp->batchRetvalues_.empty());
+    for (const auto &buffer : buffers) {
+        ASSERT_NE(buffer, nullptr);
+        ASSERT_NE(buffer->GetExtraData(), nullptr);
+    }
+
+    std::vector<sptr<SurfaceBuffer>> moreBuffers;
+    std::vector<sptr<SyncFence>> moreFences;
+    // 4: more than the queue has left
+    ASSERT_EQ(pSurfaceTmp->RequestBuffers(moreBuffers, moreFences, requestConfig, 4), GSERROR_OK);
+    ASSERT_EQ(moreBuffers.size(), 1u);
+    ASSERT_EQ(pSurfaceTmp->batchExtraData_.size(), 4u);
+    ASSERT_EQ(pSurfaceTmp->batchExtraData_[0], nullptr);
+    for (size_t i = 1; i < pSurfaceTmp->batchExtraData_.size(); i++) {
+        ASSERT_NE(pSurfaceTmp->batchExtraData_[i], nullptr);
+    }
+    ASSERT_EQ(pSurfaceTmp->RequestBuffers(moreBuffers, moreFences, requestConfig, 0), GSERROR_INVALID_ARGUMENTS);
+    ASSERT_EQ(pSurfaceTmp->RequestBuffers(moreBuffers, moreFences, requestConfig, SURFACE_MAX_QUEUE_SIZE + 1),
+        GSERROR_INVALID_ARGUMENTS);
+}
 }
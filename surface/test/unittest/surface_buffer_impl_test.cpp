@@ -12,6 +12,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
 #include <securec.h>
 #include <gtest/gtest.h>
 #include <fcntl.h>
@@ -135,6 +139,51 @@ HWTEST_F(SurfaceBufferImplTest, GenerateSequenceNumber001, TestSize.Level0)
     ASSERT_EQ(0, SurfaceBufferImpl::GenerateSequenceNumber(maxSeqNum));
 }
 
+/*
+* Function: SurfaceBufferImpl ctor and dtor
+* Type: Performance
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. 8 threads new and drop 50000 SurfaceBufferImpl in total, each keeping 256 alive at a time
+*                  2. check every live buffer has its own seqNum and bufferId, print the elapsed time
+ */
+HWTEST_F(SurfaceBufferImplTest, SeqNumAllocStress001, TestSize.Level0)
+{
+    constexpr uint32_t threadCount = 8;
+    constexpr uint32_t totalBuffers = 50000;
+    constexpr uint32_t liveBuffers = 256;
+    std::vector<std::vector<sptr<SurfaceBuffer>>> live(threadCount);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back([&live, i]() {
+            auto &buffers = live[i];
+            buffers.resize(liveBuffers);
+            for (uint32_t j = 0; j < totalBuffers / threadCount; j++) {
+                buffers[j % liveBuffers] = new SurfaceBufferImpl();
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("SeqNumAllocStress001: %u buffers on %u threads in %lld us\n", totalBuffers, threadCount,
+        static_cast<long long>(elapsed));
+
+    std::set<uint32_t> seqNums;
+    std::set<uint64_t> bufferIds;
+    for (const auto &buffers : live) {
+        for (const auto &liveBuffer : buffers) {
+            ASSERT_NE(liveBuffer, nullptr);
+            ASSERT_TRUE(seqNums.insert(liveBuffer->GetSeqNum()).second);
+            ASSERT_TRUE(bufferIds.insert(liveBuffer->GetBufferId()).second);
+        }
+    }
+    ASSERT_EQ(seqNums.size(), threadCount * liveBuffers);
+}
+
 /*
 * Function: check buffer state
 * Type: Function
@@ -240,6 +289,60 @@ HWTEST_F(SurfaceBufferImplTest, Alloc001, TestSize.Level0)
     ASSERT_EQ(sret, OHOS::GSERROR_OK);
 }
 
+/*
+* Function: GetWidth, GetHeight, GetStride, GetFormat, GetUsage, GetSize, GetFileDescriptor and GetSeqNum
+* Type: Performance
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. new SurfaceBufferImpl and Alloc
+*                  2. 8 threads call the getters 10^7 times in total, check every value, print the elapsed time
+*                  3. free the handle and check the getters return the invalid values
+ */
+HWTEST_F(SurfaceBufferImplTest, GetterStress001, TestSize.Level0)
+{
+    sptr<SurfaceBufferImpl> buffer = new SurfaceBufferImpl();
+    ASSERT_EQ(buffer->Alloc(requestConfig), OHOS::GSERROR_OK);
+    BufferHandle *handle = buffer->GetBufferHandle();
+    ASSERT_NE(handle, nullptr);
+    BufferHandle expected = *handle;
+    uint32_t seqNum = buffer->GetSeqNum();
+
+    constexpr uint32_t threadCount = 8;
+    constexpr uint32_t totalCalls = 10000000;
+    constexpr uint32_t gettersPerLoop = 8;
+    std::atomic<uint32_t> mismatches = 0;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads.emplace_back([&]() {
+            for (uint32_t j = 0; j < totalCalls / threadCount / gettersPerLoop; j++) {
+                if (buffer->GetWidth() != expected.width || buffer->GetHeight() != expected.height ||
+                    buffer->GetStride() != expected.stride || buffer->GetFormat() != expected.format ||
+                    buffer->GetUsage() != expected.usage || buffer->GetSize() != static_cast<uint32_t>(expected.size) ||
+                    buffer->GetFileDescriptor() != expected.fd || buffer->GetSeqNum() != seqNum) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("GetterStress001: %u getter calls on %u threads in %lld us\n", totalCalls, threadCount,
+        static_cast<long long>(elapsed));
+    ASSERT_EQ(mismatches.load(), 0);
+
+    BufferHandle *taken = buffer->TakeBufferHandle();
+    ASSERT_EQ(taken, handle);
+    ASSERT_EQ(buffer->GetBufferHandle(), nullptr);
+    ASSERT_EQ(buffer->GetWidth(), -1);
+    ASSERT_EQ(buffer->GetSize(), 0);
+    ASSERT_EQ(buffer->GetSeqNum(), seqNum);
+    SurfaceBufferImpl::FreeTakenBufferHandle(taken);
+}
+
 /*
 * Function: Set/Get/List/Erase Metadata
 * Type: Function
@@ -371,6 +474,73 @@ HWTEST_F(SurfaceBufferImplTest, Metadata003, TestSize.Level0)
     }
 }
 
+/*
+ * Function: SetMetadataBatch, GetMetadataBatch and InvalidateMetadataCache
+ * Type: Function
+ * Rank: Important(2)
+ * EnvConditions: N/A
+ * CaseDescription: 1. new SurfaceBufferImpl and Alloc
+ *                  2. set two keys with SetMetadataBatch, read them back with GetMetadataBatch from the cache
+ *                  3. InvalidateMetadataCache drops the read cache only, the next reads fill it again
+ *                  4. a key that is not set reads back empty, its lookup is cached when the hdi reports it absent
+ *                  5. EraseMetadataKey marks the key absent, SetMetadata and InvalidateMetadataCache drop that
+ */
+HWTEST_F(SurfaceBufferImplTest, Metadata004, TestSize.Level0)
+{
+    using namespace HDI::Display::Graphic::Common::V1_0;
+
+    sptr<SurfaceBufferImpl> sbi = new SurfaceBufferImpl(0);
+    ASSERT_EQ(sbi->Alloc(requestConfig), OHOS::GSERROR_OK);
+
+    std::vector<uint8_t> colorSpaceData;
+    std::vector<uint8_t> hdrTypeData;
+    CM_ColorSpaceInfo colorSpaceInfo = {};
+    ASSERT_EQ(MetadataHelper::ConvertMetadataToVec(colorSpaceInfo, colorSpaceData), OHOS::GSERROR_OK);
+    ASSERT_EQ(MetadataHelper::ConvertMetadataToVec(CM_VIDEO_HDR10, hdrTypeData), OHOS::GSERROR_OK);
+    ASSERT_EQ(sbi->SetMetadataBatch({{0, colorSpaceData}}), GSERROR_INVALID_ARGUMENTS);
+    auto sret = sbi->SetMetadataBatch({{ATTRKEY_COLORSPACE_INFO, colorSpaceData},
+        {ATTRKEY_HDR_METADATA_TYPE, hdrTypeData}});
+    ASSERT_TRUE(sret == OHOS::GSERROR_OK || sret == GSERROR_HDI_ERROR);
+    if (sret != OHOS::GSERROR_OK) {
+        return;
+    }
+    ASSERT_EQ(sbi->metaDataReadCache_.size(), 2);
+
+    std::vector<uint32_t> keys = {ATTRKEY_COLORSPACE_INFO, ATTRKEY_HDR_METADATA_TYPE, ATTRKEY_HDR_STATIC_METADATA};
+    std::vector<std::vector<uint8_t>> values;
+    ASSERT_EQ(sbi->GetMetadataBatch(keys, values), OHOS::GSERROR_OK);
+    ASSERT_EQ(values.size(), keys.size());
+    ASSERT_EQ(values[0], colorSpaceData);
+    ASSERT_EQ(values[1], hdrTypeData);
+    ASSERT_TRUE(values[2].empty());
+    // only the not found error is cached, a busy or failing hdi is asked again on the next read
+    std::shared_ptr<HDI::Display::Buffer::V1_4::IDisplayBuffer> displayBuffer(
+        HDI::Display::Buffer::V1_4::IDisplayBuffer::Get());
+    ASSERT_NE(displayBuffer, nullptr);
+    std::vector<uint8_t> absentData;
+    int32_t dRet = displayBuffer->GetMetadata(*sbi->GetBufferHandle(), ATTRKEY_HDR_STATIC_METADATA, absentData);
+    ASSERT_NE(dRet, GRAPHIC_DISPLAY_SUCCESS);
+    ASSERT_EQ(sbi->metaDataAbsentKeys_.count(ATTRKEY_HDR_STATIC_METADATA),
+        dRet == GRAPHIC_DISPLAY_NOT_SUPPORT ? 1u : 0u);
+
+    sbi->InvalidateMetadataCache();
+    ASSERT_TRUE(sbi->metaDataReadCache_.empty());
+    ASSERT_TRUE(sbi->metaDataAbsentKeys_.empty());
+    ASSERT_EQ(sbi->metaDataCache_.size(), 2);
+    std::vector<uint8_t> getData;
+    ASSERT_EQ(sbi->GetMetadata(ATTRKEY_HDR_METADATA_TYPE, getData), OHOS::GSERROR_OK);
+    ASSERT_EQ(getData, hdrTypeData);
+    ASSERT_EQ(sbi->metaDataReadCache_.size(), 1);
+
+    ASSERT_EQ(sbi->EraseMetadataKey(ATTRKEY_HDR_METADATA_TYPE), OHOS::GSERROR_OK);
+    ASSERT_EQ(sbi->metaDataAbsentKeys_.count(ATTRKEY_HDR_METADATA_TYPE), 1u);
+    ASSERT_NE(sbi->GetMetadata(ATTRKEY_HDR_METADATA_TYPE, getData), OHOS::GSERROR_OK);
+    ASSERT_EQ(sbi->SetMetadata(ATTRKEY_HDR_METADATA_TYPE, hdrTypeData), OHOS::GSERROR_OK);
+    ASSERT_EQ(sbi->metaDataAbsentKeys_.count(ATTRKEY_HDR_METADATA_TYPE), 0u);
+    ASSERT_EQ(sbi->GetMetadata(ATTRKEY_HDR_METADATA_TYPE, getData), OHOS::GSERROR_OK);
+    ASSERT_EQ(getData, hdrTypeData);
+}
+
 /*
 * Function: BufferRequestConfig
 * Type: Function
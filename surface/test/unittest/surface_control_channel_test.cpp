@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <message_parcel.h>
+
+#include "buffer_client_producer.h"
+#include "buffer_consumer_listener.h"
+#include "buffer_extra_data_impl.h"
+#include "buffer_producer_listener.h"
+#include "buffer_queue_producer.h"
+#include "surface_control_channel.h"
+#include "sync_fence.h"
+
+using namespace testing;
+using namespace testing::ext;
+
+namespace OHOS::Rosen {
+class SurfaceControlChannelTest : public testing::Test {
+public:
+    static inline BufferRequestConfig requestConfig = {
+        .width = 0x100,
+        .height = 0x100,
+        .strideAlignment = 0x8,
+        .format = GRAPHIC_PIXEL_FMT_RGBA_8888,
+        .usage = BUFFER_USAGE_CPU_READ | BUFFER_USAGE_CPU_WRITE | BUFFER_USAGE_MEM_DMA,
+        .timeout = 0,
+    };
+};
+
+// hands the proxy's transactions to the stub in this process, counted per code
+class LocalProducerObject : public IRemoteObject {
+public:
+    explicit LocalProducerObject(const sptr<BufferQueueProducer> &stub)
+        : IRemoteObject(IBufferProducer::GetDescriptor()), stub_(stub) {}
+    ~LocalProducerObject() override = default;
+
+    int32_t GetObjectRefCount() override
+    {
+        return 1;
+    }
+
+    int SendRequest(uint32_t code, MessageParcel &data, MessageParcel &reply, MessageOption &option) override
+    {
+        {
+            std::lock_guard<std::mutex> lockGuard(mutex_);
+            transactions_[code]++;
+        }
+        return stub_->OnRemoteRequest(code, data, reply, option);
+    }
+
+    bool IsProxyObject() const override
+    {
+        return true;
+    }
+
+    bool AddDeathRecipient(const sptr<DeathRecipient> &recipient) override
+    {
+        return true;
+    }
+
+    bool RemoveDeathRecipient(const sptr<DeathRecipient> &recipient) override
+    {
+        return true;
+    }
+
+    int Dump(int fd, const std::vector<std::u16string> &args) override
+    {
+        return 0;
+    }
+
+    uint32_t GetTransactions(uint32_t code)
+    {
+        std::lock_guard<std::mutex> lockGuard(mutex_);
+        return transactions_[code];
+    }
+
+private:
+    sptr<BufferQueueProducer> stub_;
+    std::mutex mutex_;
+    std::map<uint32_t, uint32_t> transactions_;
+};
+
+class SurfaceControlChannelProducerTest : public testing::Test {
+public:
+    void SetUp() override
+    {
+        bq = new BufferQueue("testControlChannelProducer");
+        sptr<IBufferConsumerListener> listener = new BufferConsumerListener();
+        bq->RegisterConsumerListener(listener);
+        bqp = new BufferQueueProducer(bq);
+        remote = new LocalProducerObject(bqp);
+        client = new BufferClientProducer(remote);
+    }
+
+    void TearDown() override
+    {
+        client = nullptr;
+        remote = nullptr;
+        bqp = nullptr;
+        bq = nullptr;
+    }
+
+    static inline BufferRequestConfig requestConfig = {
+        .width = 0x100,
+        .height = 0x100,
+        .strideAlignment = 0x8,
+        .format = GRAPHIC_PIXEL_FMT_RGBA_8888,
+        .usage = BUFFER_USAGE_CPU_READ | BUFFER_USAGE_CPU_WRITE | BUFFER_USAGE_MEM_DMA,
+        .timeout = 0,
+    };
+    static inline BufferFlushConfigWithDamages flushConfig = {
+        .damages = {
+            {
+                .w = 0x100,
+                .h = 0x100,
+            }
+        },
+    };
+    sptr<BufferQueue> bq = nullptr;
+    sptr<BufferQueueProducer> bqp = nullptr;
+    sptr<LocalProducerObject> remote = nullptr;
+    sptr<BufferClientProducer> client = nullptr;
+};
+
+/*
+* Function: Send and Receive
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. create a pair, send a record with a fence fd each way
+*                  2. check the records and that a new fence fd arrives
+ */
+HWTEST_F(SurfaceControlChannelTest, SendAndReceive001, TestSize.Level0)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd), GSERROR_OK);
+    ASSERT_EQ(producerEnd->GetRole(), SurfaceControlChannel::Role::PRODUCER);
+    ASSERT_EQ(queueEnd->GetRole(), SurfaceControlChannel::Role::QUEUE);
+
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::REQUEST;
+    record.id = 1;
+    record.config = requestConfig;
+    int32_t fenceFd = eventfd(0, EFD_CLOEXEC);
+    ASSERT_GE(fenceFd, 0);
+    ASSERT_EQ(producerEnd->Send(record, fenceFd), GSERROR_OK);
+
+    SurfaceControlRecord received;
+    int32_t receivedFd = -1;
+    ASSERT_EQ(queueEnd->Receive(received, receivedFd), GSERROR_OK);
+    ASSERT_EQ(received.type, SurfaceControlRecordType::REQUEST);
+    ASSERT_EQ(received.id, 1);
+    ASSERT_EQ(received.config, requestConfig);
+    ASSERT_TRUE(received.hasFence);
+    ASSERT_GE(receivedFd, 0);
+    ASSERT_NE(receivedFd, fenceFd);
+    close(receivedFd);
+    close(fenceFd);
+    ASSERT_EQ(queueEnd->Receive(received, receivedFd), GSERROR_NO_ENTRY);
+
+    record.type = SurfaceControlRecordType::REQUEST_REPLY;
+    record.sequence = 7; // 7: any sequence
+    ASSERT_EQ(queueEnd->Send(record), GSERROR_OK);
+    ASSERT_EQ(producerEnd->Receive(received, receivedFd), GSERROR_OK);
+    ASSERT_EQ(received.type, SurfaceControlRecordType::REQUEST_REPLY);
+    ASSERT_EQ(received.sequence, 7);
+    ASSERT_FALSE(received.hasFence);
+    ASSERT_EQ(receivedFd, -1);
+}
+
+/*
+* Function: Send
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. fill the ring
+*                  2. check that Send fails with GSERROR_NO_BUFFER until the other end reads
+ */
+HWTEST_F(SurfaceControlChannelTest, RingFull001, TestSize.Level0)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    uint32_t capacity = 4;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd, capacity), GSERROR_OK);
+
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::FLUSH;
+    for (uint32_t i = 0; i < capacity; i++) {
+        record.sequence = i;
+        ASSERT_EQ(producerEnd->Send(record), GSERROR_OK);
+    }
+    ASSERT_EQ(producerEnd->Send(record), GSERROR_NO_BUFFER);
+
+    SurfaceControlRecord received;
+    int32_t receivedFd = -1;
+    ASSERT_EQ(queueEnd->Receive(received, receivedFd), GSERROR_OK);
+    ASSERT_EQ(received.sequence, 0);
+    ASSERT_EQ(producerEnd->Send(record), GSERROR_OK);
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd, 0), GSERROR_INVALID_ARGUMENTS);
+}
+
+/*
+* Function: Wait and Shutdown
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. block in Wait on one thread
+*                  2. check that a Send, then Shutdown, wake it
+ */
+HWTEST_F(SurfaceControlChannelTest, WaitAndShutdown001, TestSize.Level0)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd), GSERROR_OK);
+
+    SurfaceControlRecord received;
+    int32_t receivedFd = -1;
+    std::thread waiter([&queueEnd, &received, &receivedFd]() {
+        while (queueEnd->Receive(received, receivedFd) == GSERROR_NO_ENTRY) {
+            queueEnd->Wait(-1);
+        }
+        queueEnd->Wait(-1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // 10ms: let the waiter sleep
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::FLUSH;
+    ASSERT_EQ(producerEnd->Send(record), GSERROR_OK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // 10ms: let the waiter sleep again
+    queueEnd->Shutdown();
+    waiter.join();
+    ASSERT_EQ(received.type, SurfaceControlRecordType::FLUSH);
+    ASSERT_TRUE(queueEnd->IsClosed());
+    ASSERT_NE(queueEnd->Send(record), GSERROR_OK);
+}
+
+/*
+* Function: Wait
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. block in Wait, then drop the other end
+*                  2. check that Wait returns and the channel reports closed
+ */
+HWTEST_F(SurfaceControlChannelTest, PeerClosed001, TestSize.Level0)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd), GSERROR_OK);
+
+    std::thread waiter([&producerEnd]() {
+        producerEnd->Wait(-1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10)); // 10ms: let the waiter sleep
+    queueEnd = nullptr;
+    waiter.join();
+    ASSERT_TRUE(producerEnd->IsClosed());
+}
+
+/*
+* Function: WriteToMessageParcel and ReadFromMessageParcel
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. send the queue end through a parcel
+*                  2. check that records flow between the producer end and the copy
+ */
+HWTEST_F(SurfaceControlChannelTest, Parcel001, TestSize.Level0)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd), GSERROR_OK);
+    MessageParcel parcel;
+    ASSERT_EQ(queueEnd->WriteToMessageParcel(parcel), GSERROR_OK);
+    queueEnd = nullptr;
+    sptr<SurfaceControlChannel> remoteEnd = SurfaceControlChannel::ReadFromMessageParcel(parcel);
+    ASSERT_NE(remoteEnd, nullptr);
+    ASSERT_EQ(remoteEnd->GetRole(), SurfaceControlChannel::Role::QUEUE);
+
+    SurfaceControlRecord record;
+    record.type = SurfaceControlRecordType::FLUSH;
+    record.damageCount = 1;
+    record.damages[0] = { 1, 2, 3, 4 }; // 1, 2, 3, 4: any rect
+    ASSERT_EQ(producerEnd->Send(record), GSERROR_OK);
+    SurfaceControlRecord received;
+    int32_t receivedFd = -1;
+    ASSERT_EQ(remoteEnd->Receive(received, receivedFd), GSERROR_OK);
+    ASSERT_EQ(received.damageCount, 1);
+    ASSERT_EQ(received.damages[0].w, 3);
+
+    MessageParcel emptyParcel;
+    ASSERT_EQ(SurfaceControlChannel::ReadFromMessageParcel(emptyParcel), nullptr);
+}
+
+/*
+* Function: EnableControlChannel and RequestBuffer
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. enable the channel, request a buffer, cancel it and request again
+*                  2. check the first request falls back to binder since the queue has no buffer cached and the
+*                     second is served from the cache over the channel
+ */
+HWTEST_F(SurfaceControlChannelProducerTest, RequestBufferFromChannel001, TestSize.Level0)
+{
+    ASSERT_EQ(client->EnableControlChannel(), GSERROR_OK);
+    ASSERT_EQ(remote->GetTransactions(IBufferProducer::BUFFER_PRODUCER_SETUP_CONTROL_CHANNEL), 1u);
+    ASSERT_TRUE(bqp->hasControlChannel_.load());
+
+    sptr<BufferExtraData> bedata = new BufferExtraDataImpl;
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(client->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    ASSERT_NE(retval.buffer, nullptr);
+    ASSERT_EQ(remote->GetTransactions(IBufferProducer::BUFFER_PRODUCER_REQUEST_BUFFER), 1u);
+    uint32_t sequence = retval.sequence;
+    ASSERT_EQ(client->CancelBuffer(sequence, bedata), GSERROR_OK);
+
+    IBufferProducer::RequestBufferReturnValue cachedRetval;
+    ASSERT_EQ(client->RequestBuffer(requestConfig, bedata, cachedRetval), GSERROR_OK);
+    ASSERT_EQ(cachedRetval.sequence, sequence);
+    ASSERT_EQ(cachedRetval.buffer, nullptr);
+    ASSERT_TRUE(cachedRetval.deletingBuffers.empty());
+    ASSERT_EQ(remote->GetTransactions(IBufferProducer::BUFFER_PRODUCER_REQUEST_BUFFER), 1u);
+    ASSERT_EQ(bq->bufferQueueCache_[sequence].state, BUFFER_STATE_REQUESTED);
+}
+
+/*
+* Function: RequestBuffer
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. give the client a channel whose queue end nobody reads and request a buffer
+*                  2. check the request waits for the timeout and then goes over binder
+ */
+HWTEST_F(SurfaceControlChannelProducerTest, RequestBufferFromChannel002, TestSize.Level0)
+{
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd), GSERROR_OK);
+    client->controlChannel_ = producerEnd;
+
+    sptr<BufferExtraData> bedata = new BufferExtraDataImpl;
+    IBufferProducer::RequestBufferReturnValue retval;
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(client->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 100); // 100ms: the timeout
+    ASSERT_NE(retval.buffer, nullptr);
+    ASSERT_EQ(remote->GetTransactions(IBufferProducer::BUFFER_PRODUCER_REQUEST_BUFFER), 1u);
+    ASSERT_TRUE(client->waitingControlRequests_.empty());
+
+    SurfaceControlRecord record;
+    int32_t fenceFd = -1;
+    ASSERT_EQ(queueEnd->Receive(record, fenceFd), GSERROR_OK);
+    ASSERT_EQ(record.type, SurfaceControlRecordType::REQUEST);
+    client->StopControlChannel();
+}
+
+/*
+* Function: FlushBuffer and OnRemoteRequest
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. request a buffer, then connect a channel that no thread drains and flush over it
+*                  2. check the flush is applied before the next binder call is handled
+ */
+HWTEST_F(SurfaceControlChannelProducerTest, DrainControlChannel001, TestSize.Level0)
+{
+    sptr<BufferExtraData> bedata = new BufferExtraDataImpl;
+    IBufferProducer::RequestBufferReturnValue retval;
+    ASSERT_EQ(client->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+
+    sptr<SurfaceControlChannel> producerEnd = nullptr;
+    sptr<SurfaceControlChannel> queueEnd = nullptr;
+    ASSERT_EQ(SurfaceControlChannel::CreatePair(producerEnd, queueEnd), GSERROR_OK);
+    client->controlChannel_ = producerEnd;
+    bqp->controlChannel_ = queueEnd;
+    bqp->controlChannelPid_ = getpid();
+    bqp->hasControlChannel_ = true;
+
+    ASSERT_EQ(client->FlushBuffer(retval.sequence, bedata, SyncFence::InvalidFence(), flushConfig), GSERROR_OK);
+    ASSERT_EQ(remote->GetTransactions(IBufferProducer::BUFFER_PRODUCER_FLUSH_BUFFER), 0u);
+    ASSERT_EQ(bq->bufferQueueCache_[retval.sequence].state, BUFFER_STATE_REQUESTED);
+
+    ASSERT_EQ(client->GetQueueSize(), bq->GetQueueSize());
+    ASSERT_EQ(bq->bufferQueueCache_[retval.sequence].state, BUFFER_STATE_FLUSHED);
+    client->StopControlChannel();
+    bqp->StopControlChannel();
+}
+
+/*
+* Function: RegisterReleaseListener
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. register a release listener with the channel enabled, release a flushed buffer
+*                  2. check the queue holds a wrapper and the release arrives over the channel
+*                  3. stop the channel, release again and check the wrapper calls the listener itself
+ */
+HWTEST_F(SurfaceControlChannelProducerTest, ReleaseListener001, TestSize.Level0)
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint32_t releaseCount = 0;
+    std::thread::id releaseThread;
+    OnReleaseFunc onRelease = [&mutex, &cond, &releaseCount, &releaseThread](sptr<SurfaceBuffer> &buffer) {
+        std::lock_guard<std::mutex> lockGuard(mutex);
+        releaseCount++;
+        releaseThread = std::this_thread::get_id();
+        cond.notify_all();
+        return GSERROR_OK;
+    };
+    sptr<IProducerListener> listener = new BufferReleaseProducerListener(onRelease);
+    ASSERT_EQ(bqp->RegisterReleaseListener(listener), GSERROR_OK);
+    client->releaseListener_ = listener;
+    ASSERT_EQ(bq->producerListener_, listener);
+    ASSERT_EQ(client->EnableControlChannel(), GSERROR_OK);
+    ASSERT_NE(bq->producerListener_, listener);
+
+    auto requestFlushAndRelease = [this]() {
+        sptr<BufferExtraData> bedata = new BufferExtraDataImpl;
+        IBufferProducer::RequestBufferReturnValue retval;
+        ASSERT_EQ(client->RequestBuffer(requestConfig, bedata, retval), GSERROR_OK);
+        ASSERT_EQ(client->FlushBuffer(retval.sequence, bedata, SyncFence::InvalidFence(), flushConfig),
+            GSERROR_OK);
+        (void)client->GetQueueSize();
+        sptr<SurfaceBuffer> buffer = nullptr;
+        sptr<SyncFence> fence = SyncFence::InvalidFence();
+        int64_t timestamp = 0;
+        std::vector<Rect> damages;
+        ASSERT_EQ(bq->AcquireBuffer(buffer, fence, timestamp, damages), GSERROR_OK);
+        ASSERT_EQ(bq->ReleaseBuffer(buffer, SyncFence::InvalidFence()), GSERROR_OK);
+    };
+    requestFlushAndRelease();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(cond.wait_for(lock, std::chrono::seconds(1), [&releaseCount]() { return releaseCount == 1; }));
+        ASSERT_NE(releaseThread, std::this_thread::get_id());
+    }
+
+    bqp->StopControlChannel();
+    client->StopControlChannel();
+    requestFlushAndRelease();
+    std::lock_guard<std::mutex> lockGuard(mutex);
+    ASSERT_EQ(releaseCount, 2u);
+    ASSERT_EQ(releaseThread, std::this_thread::get_id());
+}
+}
@@ -17,7 +17,6 @@
 #define UTILS_INCLUDE_ACQUIRE_FENCE_TRACKER_H
 
 #include <atomic>
-#include <event_handler.h>
 #include "sync_fence_tracker.h"
 #include "sync_fence.h"
 
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTILS_INCLUDE_FENCE_WAITER_H
+#define UTILS_INCLUDE_FENCE_WAITER_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "sync_fence.h"
+
+namespace OHOS {
+// waits for any number of fences on one epoll thread, so a slow fence never holds back the others
+class FenceWaiter {
+public:
+    static FenceWaiter& GetInstance();
+
+    FenceWaiter(const FenceWaiter&) = delete;
+    FenceWaiter& operator=(const FenceWaiter&) = delete;
+
+    /*
+     * calls callback once on the waiter thread when the fence signals, fails or times out.
+     * returns 0 when the wait is queued, or a negative errno and the callback is never called.
+     * owner only tags the wait for Cancel
+     */
+    int32_t Add(const sptr<SyncFence>& fence, uint32_t timeout, const SyncFenceCallback& callback,
+        const void* owner = nullptr);
+    /* drops the pending waits of owner; when called off the waiter thread, it also waits for a running callback */
+    void Cancel(const void* owner);
+    size_t GetPendingCount();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Entry {
+        int32_t fd = -1;
+        sptr<SyncFence> fence = nullptr;
+        SyncFenceCallback callback = nullptr;
+        const void* owner = nullptr;
+        std::multimap<Clock::time_point, uint64_t>::iterator deadline;
+    };
+    struct Done {
+        sptr<SyncFence> fence = nullptr;
+        SyncFenceCallback callback = nullptr;
+        int32_t result = 0;
+    };
+
+    FenceWaiter() = default;
+    ~FenceWaiter();
+    int32_t StartLocked();
+    void Loop();
+    int32_t GetEpollTimeoutLocked();
+    void RemoveLocked(std::map<uint64_t, Entry>::iterator it);
+    void Wake();
+
+    std::mutex mutex_;
+    // held while callbacks run, Cancel takes it to wait for them
+    std::mutex dispatchMutex_;
+    std::thread thread_;
+    int32_t epollFd_ = -1;
+    int32_t wakeFd_ = -1;
+    bool isStopped_ = false;
+    uint64_t nextId_ = 1;
+    std::map<uint64_t, Entry> entries_;
+    std::multimap<Clock::time_point, uint64_t> deadlines_;
+};
+}
+#endif // UTILS_INCLUDE_FENCE_WAITER_H
@@ -17,10 +17,13 @@
 #define UTILS_INCLUDE_SYNC_FENCE_TRACKER_H
 
 #include <atomic>
-#include <event_handler.h>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <shared_mutex>
+#include <string>
+#include <unordered_map>
 #include "sync_fence.h"
 
 namespace OHOS {
@@ -29,7 +32,7 @@ public:
     explicit SyncFenceTracker(const std::string threadName);
 
     SyncFenceTracker() = delete;
-    ~SyncFenceTracker() = default;
+    ~SyncFenceTracker();
 
     void TrackFence(const sptr<SyncFence>& fence, bool traceTag = true);
 
@@ -43,15 +46,19 @@ private:
     bool isGpuFence_ = false;
     bool isGpuEnable_ = false;
     bool isGpuFreq_ = false;
-    std::shared_ptr<OHOS::AppExecFwk::EventRunner> runner_ = nullptr;
-    std::shared_ptr<OHOS::AppExecFwk::EventHandler> handler_ = nullptr;
     std::atomic<uint32_t> fencesQueued_;
     std::atomic<uint32_t> fencesSignaled_;
     int32_t gpuSubhealthEventNum_ = 0;
     int32_t gpuSubhealthEventDay_ = 0;
+    // only touched from fence waiter callbacks
     std::queue<int64_t> frameStartTimes_;
-    void Loop(const sptr<SyncFence>& fence, bool traceTag);
-    int32_t WaitFence(const sptr<SyncFence>& fence);
+    // fences waiting for the gpu monitor, oldest first. the front one is monitored, frame sched only takes one
+    // MonitorGpuStart at a time and MonitorGpuEnd has no index, so the next Start waits for the previous End
+    std::mutex gpuMonitorMutex_;
+    std::deque<uint32_t> gpuMonitorFences_;
+    void StartGpuMonitor(uint32_t fenceIndex);
+    void EndGpuMonitor(uint32_t fenceIndex);
+    void OnFenceDone(uint32_t fenceIndex, bool traceTag, int64_t startTimestamp, int32_t result);
     bool CheckGpuSubhealthEventLimit();
     void ReportEventGpuSubhealth(int64_t duration);
     inline void UpdateFrameQueue(int64_t startTime);
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fence_set.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <sys/poll.h>
+
+namespace OHOS {
+void FenceSet::Add(const sptr<SyncFence>& fence)
+{
+    if (fence == nullptr || !fence->IsValid()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::find(fences_.begin(), fences_.end(), fence) != fences_.end()) {
+        return;
+    }
+    if (fences_.size() >= MAX_FENCE_COUNT) {
+        (void)PruneLocked();
+    }
+    if (fences_.size() >= MAX_FENCE_COUNT) {
+        (void)MergeLocked("FenceSet");
+    }
+    fences_.push_back(fence);
+}
+
+void FenceSet::Add(const sptr<FenceSet>& fences)
+{
+    if (fences == nullptr || fences == this) {
+        return;
+    }
+    std::vector<sptr<SyncFence>> members;
+    {
+        std::lock_guard<std::mutex> lock(fences->mutex_);
+        members = fences->fences_;
+    }
+    for (const auto &fence : members) {
+        Add(fence);
+    }
+}
+
+size_t FenceSet::GetSize()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fences_.size();
+}
+
+FenceStatus FenceSet::PruneLocked()
+{
+    if (fences_.empty()) {
+        return SIGNALED;
+    }
+    std::vector<struct pollfd> pollfds(fences_.size());
+    for (size_t i = 0; i < fences_.size(); i++) {
+        pollfds[i] = { .fd = fences_[i]->Get(), .events = POLLIN, .revents = 0 };
+    }
+    int32_t ret = 0;
+    do {
+        ret = poll(pollfds.data(), pollfds.size(), 0);
+    } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+    if (ret < 0) {
+        return ERROR;
+    }
+    bool isError = false;
+    size_t kept = 0;
+    for (size_t i = 0; i < fences_.size(); i++) {
+        isError = isError || (pollfds[i].revents & (POLLERR | POLLNVAL)) != 0;
+        if ((pollfds[i].revents & POLLIN) == 0 || (pollfds[i].revents & (POLLERR | POLLNVAL)) != 0) {
+            fences_[kept++] = fences_[i];
+        }
+    }
+    fences_.resize(kept);
+    if (isError) {
+        return ERROR;
+    }
+    return fences_.empty() ? SIGNALED : ACTIVE;
+}
+
+FenceStatus FenceSet::GetStatus()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return PruneLocked();
+}
+
+int32_t FenceSet::Wait(uint32_t timeout)
+{
+    std::vector<sptr<SyncFence>> fences;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (PruneLocked() == SIGNALED) {
+            return 0;
+        }
+        fences = fences_;
+    }
+    // the members were checked just now, so wait for them one by one within the whole timeout
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    for (const auto &fence : fences) {
+        auto remain = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        int32_t ret = fence->Wait(static_cast<uint32_t>(std::max<int64_t>(remain.count(), 0)));
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    (void)PruneLocked();
+    return 0;
+}
+
+sptr<SyncFence> FenceSet::MergeLocked(const std::string &name)
+{
+    if (fences_.empty()) {
+        return SyncFence::INVALID_FENCE;
+    }
+    sptr<SyncFence> merged = fences_[0];
+    for (size_t i = 1; i < fences_.size(); i++) {
+        merged = SyncFence::MergeFence(name, merged, fences_[i]);
+        mergeCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+    fences_.clear();
+    if (merged->IsValid()) {
+        fences_.push_back(merged);
+    }
+    return merged;
+}
+
+sptr<SyncFence> FenceSet::Merge(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    (void)PruneLocked();
+    return MergeLocked(name);
+}
+
+void FenceSet::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    fences_.clear();
+}
+
+uint64_t FenceSet::GetMergeCount()
+{
+    return mergeCount_.load(std::memory_order_relaxed);
+}
+} // namespace OHOS
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fence_waiter.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+#include "hilog/log.h"
+
+#ifdef FENCE_SCHED_ENABLE
+#include <sys/ioctl.h>
+#endif
+
+namespace OHOS {
+using namespace OHOS::HiviewDFX;
+namespace {
+#undef LOG_DOMAIN
+#define LOG_DOMAIN 0xD001400
+#undef LOG_TAG
+#define LOG_TAG "SyncFence"
+
+#define B_CPRINTF(func, fmt, ...) \
+    func(LOG_CORE, "<%{public}d>%{public}s: " fmt, \
+        __LINE__, __func__, ##__VA_ARGS__)
+
+#define UTILS_LOGD(fmt, ...) B_CPRINTF(HILOG_DEBUG, fmt, ##__VA_ARGS__)
+#define UTILS_LOGE(fmt, ...) B_CPRINTF(HILOG_ERROR, fmt, ##__VA_ARGS__)
+
+constexpr uint64_t WAKE_ID = 0;
+constexpr int32_t MAX_EVENTS = 32;
+
+#ifdef FENCE_SCHED_ENABLE
+constexpr unsigned int QOS_CTRL_IPC_MAGIC = 0xCC;
+
+#define QOS_CTRL_BASIC_OPERATION \
+    _IOWR(QOS_CTRL_IPC_MAGIC, 1, struct QosCtrlData)
+
+#define QOS_APPLY 1
+
+typedef enum {
+    QOS_BACKGROUND = 0,
+    QOS_UTILITY,
+    QOS_DEFAULT,
+    QOS_USER_INITIATED,
+    QOS_DEADLINE_REQUEST,
+    QOS_USER_INTERACTIVE,
+    QOS_KEY_BACKGROUND,
+} QosLevel;
+
+struct QosCtrlData {
+    int pid;
+    unsigned int type;
+    unsigned int level;
+    int qos;
+    int staticQos;
+    int dynamicQos;
+    bool tagSchedEnable = false;
+};
+
+static int TrivalOpenQosCtrlNode(void)
+{
+    char fileName[] = "/proc/thread-self/sched_qos_ctrl";
+    int fd = open(fileName, O_RDWR);
+    if (fd < 0) {
+        HILOG_WARN(LOG_CORE, "open qos node failed");
+    }
+    return fd;
+}
+
+void QosApply(unsigned int level)
+{
+    int fd = TrivalOpenQosCtrlNode();
+    if (fd < 0) {
+        return;
+    }
+    fdsan_exchange_owner_tag(fd, 0, LOG_DOMAIN);
+
+    int tid = gettid();
+    struct QosCtrlData data;
+    data.level = level;
+    data.type = QOS_APPLY;
+    data.pid = tid;
+    int ret = ioctl(fd, QOS_CTRL_BASIC_OPERATION, &data);
+    if (ret < 0) {
+        HILOG_WARN(LOG_CORE, "qos apply failed");
+    }
+    fdsan_close_with_tag(fd, LOG_DOMAIN);
+}
+#endif
+}
+
+FenceWaiter& FenceWaiter::GetInstance()
+{
+    static FenceWaiter instance;
+    return instance;
+}
+
+FenceWaiter::~FenceWaiter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        isStopped_ = true;
+    }
+    if (thread_.joinable()) {
+        Wake();
+        thread_.join();
+    }
+    for (auto &[id, entry] : entries_) {
+        close(entry.fd);
+    }
+    entries_.clear();
+    deadlines_.clear();
+    if (epollFd_ >= 0) {
+        close(epollFd_);
+    }
+    if (wakeFd_ >= 0) {
+        close(wakeFd_);
+    }
+}
+
+int32_t FenceWaiter::StartLocked()
+{
+    if (thread_.joinable()) {
+        return 0;
+    }
+    if (isStopped_) {
+        return -ESHUTDOWN;
+    }
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_ID;
+    if (epollFd_ < 0 || wakeFd_ < 0 || epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event) < 0) {
+        int32_t error = errno;
+        UTILS_LOGE("create epoll failed, error: %{public}s", strerror(error));
+        if (epollFd_ >= 0) {
+            close(epollFd_);
+        }
+        if (wakeFd_ >= 0) {
+            close(wakeFd_);
+        }
+        epollFd_ = -1;
+        wakeFd_ = -1;
+        return -error;
+    }
+    thread_ = std::thread([this]() { Loop(); });
+    return 0;
+}
+
+void FenceWaiter::Wake()
+{
+    uint64_t one = 1;
+    (void)write(wakeFd_, &one, sizeof(one));
+}
+
+int32_t FenceWaiter::Add(const sptr<SyncFence>& fence, uint32_t timeout, const SyncFenceCallback& callback,
+    const void* owner)
+{
+    if (fence == nullptr || !fence->IsValid() || callback == nullptr) {
+        return -EINVAL;
+    }
+    // a private dup, so one fence can be waited on twice and the caller may close its own fd
+    int32_t fd = fcntl(fence->Get(), F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    int32_t ret = StartLocked();
+    if (ret != 0) {
+        close(fd);
+        return ret;
+    }
+    uint64_t id = nextId_++;
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ret = -errno;
+        UTILS_LOGE("epoll add fence failed, error: %{public}s", strerror(-ret));
+        close(fd);
+        return ret;
+    }
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout);
+    // the thread only sleeps until the earliest deadline, wake it when this one comes first
+    bool isEarliest = deadlines_.empty() || deadline < deadlines_.begin()->first;
+    auto deadlineIt = deadlines_.emplace(deadline, id);
+    entries_[id] = { fd, fence, callback, owner, deadlineIt };
+    if (isEarliest) {
+        Wake();
+    }
+    return 0;
+}
+
+void FenceWaiter::RemoveLocked(std::map<uint64_t, Entry>::iterator it)
+{
+    (void)epoll_ctl(epollFd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    close(it->second.fd);
+    deadlines_.erase(it->second.deadline);
+    entries_.erase(it);
+}
+
+void FenceWaiter::Cancel(const void* owner)
+{
+    bool isWaiterThread = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            auto current = it++;
+            if (current->second.owner == owner) {
+                RemoveLocked(current);
+            }
+        }
+        isWaiterThread = std::this_thread::get_id() == thread_.get_id();
+    }
+    if (!isWaiterThread) {
+        std::lock_guard<std::mutex> dispatchLock(dispatchMutex_);
+    }
+}
+
+size_t FenceWaiter::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+int32_t FenceWaiter::GetEpollTimeoutLocked()
+{
+    if (deadlines_.empty()) {
+        return -1;
+    }
+    auto remain = std::chrono::ceil<std::chrono::milliseconds>(deadlines_.begin()->first - Clock::now()).count();
+    return remain > 0 ? static_cast<int32_t>(remain) : 0;
+}
+
+void FenceWaiter::Loop()
+{
+#ifdef FENCE_SCHED_ENABLE
+    QosApply(QosLevel::QOS_USER_INTERACTIVE);
+#endif
+    struct epoll_event events[MAX_EVENTS];
+    std::vector<Done> done;
+    while (true) {
+        int32_t timeout = -1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (isStopped_) {
+                return;
+            }
+            timeout = GetEpollTimeoutLocked();
+        }
+        int32_t count = epoll_wait(epollFd_, events, MAX_EVENTS, timeout);
+        if (count < 0 && errno != EINTR) {
+            UTILS_LOGE("epoll_wait failed, error: %{public}s", strerror(errno));
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (int32_t i = 0; i < count; i++) {
+            if (events[i].data.u64 == WAKE_ID) {
+                uint64_t value = 0;
+                (void)read(wakeFd_, &value, sizeof(value));
+                continue;
+            }
+            auto it = entries_.find(events[i].data.u64);
+            if (it == entries_.end()) {
+                continue;
+            }
+            int32_t result = (events[i].events & EPOLLERR) ? -EINVAL : 0;
+            done.push_back({ it->second.fence, std::move(it->second.callback), result });
+            RemoveLocked(it);
+        }
+        Clock::time_point now = Clock::now();
+        while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+            auto it = entries_.find(deadlines_.begin()->second);
+            done.push_back({ it->second.fence, std::move(it->second.callback), -ETIME });
+            RemoveLocked(it);
+        }
+        if (done.empty()) {
+            continue;
+        }
+        // take the dispatch lock before dropping mutex_, so Cancel cannot return in between
+        std::lock_guard<std::mutex> dispatchLock(dispatchMutex_);
+        lock.unlock();
+        for (auto &item : done) {
+            ns_sec_t timestamp = SyncFence::INVALID_TIMESTAMP;
+            if (item.result == 0) {
+                timestamp = item.fence->SyncFileReadTimestamp();
+                timestamp = timestamp == SyncFence::FENCE_PENDING_TIMESTAMP ? SyncFence::INVALID_TIMESTAMP : timestamp;
+            } else {
+                UTILS_LOGD("fence %{public}d done with %{public}d", item.fence->Get(), item.result);
+            }
+            item.callback(item.result, timestamp);
+        }
+        done.clear();
+    }
+}
+} // namespace OHOS
@@ -27,6 +27,7 @@
 #include <linux/sync_file.h>
 #include <sys/ioctl.h>
 #include "hilog/log.h"
+#include "fence_waiter.h"
 
 namespace OHOS {
 using namespace OHOS::HiviewDFX;
@@ -91,6 +92,11 @@ int32_t SyncFence::Wait(uint32_t timeout)
     return retCode < 0 ? -errno : 0;
 }
 
+int32_t SyncFence::WaitAsync(uint32_t timeout, const SyncFenceCallback &callback)
+{
+    return FenceWaiter::GetInstance().Add(this, timeout, callback);
+}
+
 int32_t SyncFence::SyncMerge(const char *name, int32_t fd1, int32_t fd2, int32_t &newFenceFd)
 {
     struct sync_merge_data syncMergeData = {};
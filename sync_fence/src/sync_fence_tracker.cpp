@@ -13,10 +13,13 @@
  * limitations under the License.
  */
 
+#include <chrono>
 #include <ctime>
 #include <cinttypes>
+#include <cstring>
 
 #include "sync_fence_tracker.h"
+#include "fence_waiter.h"
 #include "frame_sched.h"
 #include "hilog/log.h"
 #include "parameters.h"
@@ -30,13 +33,6 @@
 #define RS_TRACE_NAME_FMT(fmt, ...)
 #endif //ROSEN_TRACE_DISABLE
 
-#ifdef FENCE_SCHED_ENABLE
-#include <fcntl.h>
-#include <stdio.h>
-#include <sys/ioctl.h>
-#include <unistd.h>
-#endif
-
 namespace OHOS {
 using namespace OHOS::HiviewDFX;
 namespace {
@@ -47,64 +43,11 @@ namespace {
 
 const std::string ACQUIRE_FENCE_TASK = "Acquire Fence";
 
-#ifdef FENCE_SCHED_ENABLE
-constexpr unsigned int QOS_CTRL_IPC_MAGIC = 0xCC;
-
-#define QOS_CTRL_BASIC_OPERATION \
-    _IOWR(QOS_CTRL_IPC_MAGIC, 1, struct QosCtrlData)
-
-#define QOS_APPLY 1
-
-typedef enum {
-    QOS_BACKGROUND = 0,
-    QOS_UTILITY,
-    QOS_DEFAULT,
-    QOS_USER_INITIATED,
-    QOS_DEADLINE_REQUEST,
-    QOS_USER_INTERACTIVE,
-    QOS_KEY_BACKGROUND,
-} QosLevel;
-
-struct QosCtrlData {
-    int pid;
-    unsigned int type;
-    unsigned int level;
-    int qos;
-    int staticQos;
-    int dynamicQos;
-    bool tagSchedEnable = false;
-};
-
-static int TrivalOpenQosCtrlNode(void)
+int64_t NowMs()
 {
-    char fileName[] = "/proc/thread-self/sched_qos_ctrl";
-    int fd = open(fileName, O_RDWR);
-    if (fd < 0) {
-        HILOG_WARN(LOG_CORE, "open qos node failed");
-    }
-    return fd;
-}
-
-void QosApply(unsigned int level)
-{
-    int fd = TrivalOpenQosCtrlNode();
-    if (fd < 0) {
-        return;
-    }
-    fdsan_exchange_owner_tag(fd, 0, LOG_DOMAIN);
-
-    int tid = gettid();
-    struct QosCtrlData data;
-    data.level = level;
-    data.type = QOS_APPLY;
-    data.pid = tid;
-    int ret = ioctl(fd, QOS_CTRL_BASIC_OPERATION, &data);
-    if (ret < 0) {
-        HILOG_WARN(LOG_CORE, "qos apply failed");
-    }
-    fdsan_close_with_tag(fd, LOG_DOMAIN);
+    return static_cast<int64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
 }
-#endif
 }
 
 SyncFenceTracker::SyncFenceTracker(const std::string threadName)
@@ -112,15 +55,8 @@ SyncFenceTracker::SyncFenceTracker(const std::string threadName)
     fencesQueued_(0),
     fencesSignaled_(0)
 {
-    runner_ = OHOS::AppExecFwk::EventRunner::Create(threadName_);
-    handler_ = std::make_shared<OHOS::AppExecFwk::EventHandler>(runner_);
-#ifdef FENCE_SCHED_ENABLE
-    if (handler_) {
-        handler_->PostTask([]() {
-            QosApply(QosLevel::QOS_USER_INTERACTIVE);
-        });
-    }
-#endif
+    // touch the waiter first, so it is destroyed after static trackers
+    (void)FenceWaiter::GetInstance();
     if (threadName_.compare(ACQUIRE_FENCE_TASK) == 0) {
         isGpuFence_ = true;
     }
@@ -132,6 +68,50 @@ SyncFenceTracker::SyncFenceTracker(const std::string threadName)
     }
 }
 
+SyncFenceTracker::~SyncFenceTracker()
+{
+    FenceWaiter::GetInstance().Cancel(this);
+    // cancelled fences never call back, close the monitor that is still open
+    std::lock_guard<std::mutex> lock(gpuMonitorMutex_);
+    if (!gpuMonitorFences_.empty()) {
+        Rosen::FrameSched::GetInstance().MonitorGpuEnd();
+        gpuMonitorFences_.clear();
+    }
+}
+
+void SyncFenceTracker::StartGpuMonitor(uint32_t fenceIndex)
+{
+    // frame sched calls stay under the lock, their order is what pairs them
+    std::lock_guard<std::mutex> lock(gpuMonitorMutex_);
+    gpuMonitorFences_.push_back(fenceIndex);
+    if (gpuMonitorFences_.size() == 1) {
+        Rosen::FrameSched::GetInstance().MonitorGpuStart(fenceIndex);
+    }
+}
+
+void SyncFenceTracker::EndGpuMonitor(uint32_t fenceIndex)
+{
+    std::lock_guard<std::mutex> lock(gpuMonitorMutex_);
+    if (gpuMonitorFences_.empty()) {
+        return;
+    }
+    if (gpuMonitorFences_.front() != fenceIndex) {
+        // signaled before the monitored one, it is never started
+        for (auto it = gpuMonitorFences_.begin(); it != gpuMonitorFences_.end(); ++it) {
+            if (*it == fenceIndex) {
+                gpuMonitorFences_.erase(it);
+                break;
+            }
+        }
+        return;
+    }
+    Rosen::FrameSched::GetInstance().MonitorGpuEnd();
+    gpuMonitorFences_.pop_front();
+    if (!gpuMonitorFences_.empty()) {
+        Rosen::FrameSched::GetInstance().MonitorGpuStart(gpuMonitorFences_.front());
+    }
+}
+
 void SyncFenceTracker::TrackFence(const sptr<SyncFence>& fence, bool traceTag)
 {
     if (fence == nullptr) {
@@ -148,7 +128,7 @@ void SyncFenceTracker::TrackFence(const sptr<SyncFence>& fence, bool traceTag)
             return;
         }
     }
-    if (fence->SyncFileReadTimestamp() != SyncFence::FENCE_PENDING_TIMESTAMP) {
+    if (!fence->IsValid() || fence->SyncFileReadTimestamp() != SyncFence::FENCE_PENDING_TIMESTAMP) {
         RS_TRACE_NAME_FMT("%s %u has signaled", threadName_.c_str(), fencesQueued_.load());
         fencesQueued_.fetch_add(1);
         fencesSignaled_.fetch_add(1);
@@ -156,15 +136,26 @@ void SyncFenceTracker::TrackFence(const sptr<SyncFence>& fence, bool traceTag)
     }
 
     RS_TRACE_NAME_FMT("%s %u", threadName_.c_str(), fencesQueued_.load());
+    uint32_t fenceIndex = fencesQueued_.load();
     bool needSendFenceId = threadName_ == ACQUIRE_FENCE_TASK && isGpuFreq_;
     if (needSendFenceId) {
-        Rosen::FrameSched::GetInstance().SendFenceId(fencesQueued_.load());
+        Rosen::FrameSched::GetInstance().SendFenceId(fenceIndex);
     }
-    if (handler_) {
-        handler_->PostTask([this, fence, traceTag]() {
-            Loop(fence, traceTag);
-        });
-        fencesQueued_.fetch_add(1);
+    if (isGpuFence_ && isGpuFreq_) {
+        StartGpuMonitor(fenceIndex);
+    }
+    int64_t startTimestamp = NowMs();
+    int32_t ret = FenceWaiter::GetInstance().Add(fence, SYNC_TIME_OUT,
+        [this, fenceIndex, traceTag, startTimestamp](int32_t result, ns_sec_t) {
+            OnFenceDone(fenceIndex, traceTag, startTimestamp, result);
+        }, this);
+    fencesQueued_.fetch_add(1);
+    if (ret != 0) {
+        HILOG_DEBUG(LOG_CORE, "Track fence failed, ret: %{public}d", ret);
+        if (isGpuFence_ && isGpuFreq_) {
+            EndGpuMonitor(fenceIndex);
+        }
+        fencesSignaled_.fetch_add(1);
     }
 }
 
@@ -213,60 +204,32 @@ int64_t SyncFenceTracker::GetFrameRate()
 
 void SyncFenceTracker::ReportEventGpuSubhealth(int64_t duration)
 {
-    if (handler_) {
-        handler_->PostTask([this, duration]() {
-            RS_TRACE_NAME_FMT("report GPU_SUBHEALTH_MONITORING");
-            auto reportName = "GPU_SUBHEALTH_MONITORING";
-            HILOG_DEBUG(LOG_CORE, "report GPU_SUBHEALTH_MONITORING. duration : %{public}"
-                PRId64, duration);
-            HiSysEventWrite(OHOS::HiviewDFX::HiSysEvent::Domain::GRAPHIC, reportName,
-                OHOS::HiviewDFX::HiSysEvent::EventType::STATISTIC, "WAIT_ACQUIRE_FENCE_TIME",
-                duration, "FRAME_RATE", GetFrameRate());
-        });
-    }
-}
-
-void SyncFenceTracker::Loop(const sptr<SyncFence>& fence, bool traceTag)
-{
-    uint32_t fenceIndex = 0;
-    fenceIndex = fencesSignaled_.load();
-    {
-        RS_TRACE_NAME_FMT("Waiting for %s %u", threadName_.c_str(), fenceIndex);
-        int32_t result = 0;
-        if (isGpuFence_ && traceTag) {
-            int64_t startTimestamp = static_cast<int64_t>(
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now().time_since_epoch()).count());
-            UpdateFrameQueue(startTimestamp);
-            result = WaitFence(fence);
-            int64_t endTimestamp = static_cast<int64_t>(
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now().time_since_epoch()).count());
-            int64_t duration = endTimestamp - startTimestamp;
-            HILOG_DEBUG(LOG_CORE, "Waiting for Acquire Fence: %{public}" PRId64 "ms", duration);
-            if (duration > GPU_SUBHEALTH_EVENT_THRESHOLD && CheckGpuSubhealthEventLimit()) {
-                ReportEventGpuSubhealth(duration);
-            }
-        } else {
-            result = WaitFence(fence);
-        }
-
-        if (result < 0) {
-            HILOG_DEBUG(LOG_CORE, "Error waiting for SyncFence: %s", strerror(result));
-        }
-    }
-    fencesSignaled_.fetch_add(1);
+    RS_TRACE_NAME_FMT("report GPU_SUBHEALTH_MONITORING");
+    auto reportName = "GPU_SUBHEALTH_MONITORING";
+    HILOG_DEBUG(LOG_CORE, "report GPU_SUBHEALTH_MONITORING. duration : %{public}"
+        PRId64, duration);
+    HiSysEventWrite(OHOS::HiviewDFX::HiSysEvent::Domain::GRAPHIC, reportName,
+        OHOS::HiviewDFX::HiSysEvent::EventType::STATISTIC, "WAIT_ACQUIRE_FENCE_TIME",
+        duration, "FRAME_RATE", GetFrameRate());
 }
 
-int32_t SyncFenceTracker::WaitFence(const sptr<SyncFence>& fence)
+void SyncFenceTracker::OnFenceDone(uint32_t fenceIndex, bool traceTag, int64_t startTimestamp, int32_t result)
 {
+    RS_TRACE_NAME_FMT("%s %u done", threadName_.c_str(), fenceIndex);
     if (isGpuFence_ && isGpuFreq_) {
-        Rosen::FrameSched::GetInstance().MonitorGpuStart(fencesSignaled_.load());
+        EndGpuMonitor(fenceIndex);
+    }
+    if (isGpuFence_ && traceTag) {
+        UpdateFrameQueue(startTimestamp);
+        int64_t duration = NowMs() - startTimestamp;
+        HILOG_DEBUG(LOG_CORE, "Waiting for Acquire Fence: %{public}" PRId64 "ms", duration);
+        if (duration > GPU_SUBHEALTH_EVENT_THRESHOLD && CheckGpuSubhealthEventLimit()) {
+            ReportEventGpuSubhealth(duration);
+        }
     }
-    int32_t result = fence->Wait(SYNC_TIME_OUT);
-    if (isGpuFence_ && isGpuFreq_) {
-        Rosen::FrameSched::GetInstance().MonitorGpuEnd();
+    if (result < 0) {
+        HILOG_DEBUG(LOG_CORE, "Error waiting for SyncFence: %s", strerror(-result));
     }
-    return result;
+    fencesSignaled_.fetch_add(1);
 }
 } // namespace OHOS
\ No newline at end of file
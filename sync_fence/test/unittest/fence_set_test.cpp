@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "fence_set.h"
+
+using namespace testing;
+using namespace testing::ext;
+
+namespace OHOS {
+class FenceSetTest : public testing::Test {
+public:
+    // an eventfd polls like a sync file, writing to it signals the fence
+    static sptr<SyncFence> CreateFence()
+    {
+        return new SyncFence(eventfd(0, EFD_CLOEXEC));
+    }
+
+    static void Signal(const sptr<SyncFence>& fence)
+    {
+        uint64_t one = 1;
+        ASSERT_EQ(write(fence->Get(), &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    }
+};
+
+/*
+* Function: Add and GetStatus
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. add null, invalid, pending and repeated fences
+*                  2. check that only distinct valid fences are kept and GetStatus drops the signaled ones
+*/
+HWTEST_F(FenceSetTest, AddAndGetStatus001, Function | MediumTest | Level2)
+{
+    sptr<FenceSet> fences = new FenceSet();
+    ASSERT_EQ(fences->GetStatus(), SIGNALED);
+    sptr<SyncFence> fence1 = CreateFence();
+    sptr<SyncFence> fence2 = CreateFence();
+    fences->Add(sptr<SyncFence>(nullptr));
+    fences->Add(SyncFence::InvalidFence());
+    fences->Add(fence1);
+    fences->Add(fence1);
+    fences->Add(fence2);
+    ASSERT_EQ(fences->GetSize(), 2u);
+    ASSERT_EQ(fences->GetStatus(), ACTIVE);
+
+    Signal(fence1);
+    ASSERT_EQ(fences->GetStatus(), ACTIVE);
+    ASSERT_EQ(fences->GetSize(), 1u);
+    Signal(fence2);
+    ASSERT_EQ(fences->GetStatus(), SIGNALED);
+    ASSERT_EQ(fences->GetSize(), 0u);
+
+    sptr<FenceSet> other = new FenceSet();
+    other->Add(fence1);
+    other->Add(CreateFence());
+    fences->Add(other);
+    ASSERT_EQ(fences->GetSize(), 2u);
+    fences->Clear();
+    ASSERT_EQ(fences->GetSize(), 0u);
+}
+
+/*
+* Function: Wait
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. wait on a set with one pending member
+*                  2. check that it times out, then returns 0 once every member signaled
+*/
+HWTEST_F(FenceSetTest, Wait001, Function | MediumTest | Level2)
+{
+    sptr<FenceSet> fences = new FenceSet();
+    ASSERT_EQ(fences->Wait(0), 0);
+    sptr<SyncFence> fence1 = CreateFence();
+    sptr<SyncFence> fence2 = CreateFence();
+    fences->Add(fence1);
+    fences->Add(fence2);
+    Signal(fence1);
+    ASSERT_EQ(fences->Wait(10), -ETIME); // 10ms: timeout
+    Signal(fence2);
+    ASSERT_EQ(fences->Wait(10), 0); // 10ms: timeout
+    ASSERT_EQ(fences->GetSize(), 0u);
+}
+
+/*
+* Function: Merge
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. merge sets whose members have all signaled but one
+*                  2. check that no merge is issued and the pending member comes back as is
+*/
+HWTEST_F(FenceSetTest, Merge001, Function | MediumTest | Level2)
+{
+    uint64_t mergeCount = FenceSet::GetMergeCount();
+    sptr<FenceSet> fences = new FenceSet();
+    ASSERT_EQ(fences->Merge("Merge001"), SyncFence::INVALID_FENCE);
+
+    sptr<SyncFence> pending = CreateFence();
+    for (uint32_t i = 0; i < FenceSet::MAX_FENCE_COUNT - 1; i++) {
+        sptr<SyncFence> fence = CreateFence();
+        fences->Add(fence);
+        Signal(fence);
+    }
+    fences->Add(pending);
+    ASSERT_EQ(fences->GetSize(), FenceSet::MAX_FENCE_COUNT);
+    // a full set makes room by dropping the signaled members first
+    fences->Add(CreateFence());
+    ASSERT_EQ(fences->GetSize(), 2u);
+    fences->Clear();
+
+    fences->Add(pending);
+    ASSERT_EQ(fences->Merge("Merge001"), pending);
+    ASSERT_EQ(FenceSet::GetMergeCount(), mergeCount);
+}
+}
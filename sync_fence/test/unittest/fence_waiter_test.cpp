@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2025 Huawei Device Co., Ltd.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "fence_waiter.h"
+
+using namespace testing;
+using namespace testing::ext;
+
+namespace OHOS {
+class FenceWaiterTest : public testing::Test {
+public:
+    // an eventfd polls like a sync file, writing to it signals the fence
+    static sptr<SyncFence> CreateFence()
+    {
+        return new SyncFence(eventfd(0, EFD_CLOEXEC));
+    }
+
+    static void Signal(const sptr<SyncFence>& fence)
+    {
+        uint64_t one = 1;
+        ASSERT_EQ(write(fence->Get(), &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    }
+
+    SyncFenceCallback Record(int32_t tag)
+    {
+        return [this, tag](int32_t result, int64_t) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.push_back({ tag, result });
+            cv_.notify_all();
+        };
+    }
+
+    bool WaitDone(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, std::chrono::seconds(1), [this, count]() { return done_.size() >= count; });
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<std::pair<int32_t, int32_t>> done_;
+};
+
+/*
+* Function: WaitAsync
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. wait on a fence that never signals, then on one that signals
+*                  2. check that the second calls back first and the first one times out with -ETIME
+*/
+HWTEST_F(FenceWaiterTest, WaitAsync001, Function | MediumTest | Level2)
+{
+    sptr<SyncFence> slowFence = CreateFence();
+    sptr<SyncFence> fastFence = CreateFence();
+    ASSERT_EQ(slowFence->WaitAsync(200, Record(0)), 0); // 200ms: timeout
+    ASSERT_EQ(fastFence->WaitAsync(3000, Record(1)), 0); // 3000ms: timeout
+    Signal(fastFence);
+    ASSERT_TRUE(WaitDone(1));
+    ASSERT_EQ(done_[0], std::make_pair(1, 0));
+    ASSERT_TRUE(WaitDone(2)); // 2: both fences
+    ASSERT_EQ(done_[1], std::make_pair(0, -ETIME));
+    ASSERT_EQ(FenceWaiter::GetInstance().GetPendingCount(), 0u);
+
+    ASSERT_NE(SyncFence::InvalidFence()->WaitAsync(0, Record(2)), 0); // 2: never called back
+    ASSERT_NE(fastFence->WaitAsync(0, nullptr), 0);
+}
+
+/*
+* Function: Add
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. wait on many fences, some of them twice, and signal them in reverse order
+*                  2. check that every wait calls back exactly once
+*/
+HWTEST_F(FenceWaiterTest, ManyFences001, Function | MediumTest | Level2)
+{
+    constexpr int32_t fenceCount = 64;
+    std::vector<sptr<SyncFence>> fences;
+    for (int32_t i = 0; i < fenceCount; i++) {
+        fences.push_back(CreateFence());
+        ASSERT_EQ(FenceWaiter::GetInstance().Add(fences.back(), 3000, Record(i)), 0); // 3000ms: timeout
+    }
+    ASSERT_EQ(FenceWaiter::GetInstance().Add(fences[0], 3000, Record(fenceCount)), 0); // 3000ms: timeout
+    for (int32_t i = fenceCount - 1; i >= 0; i--) {
+        Signal(fences[i]);
+    }
+    ASSERT_TRUE(WaitDone(fenceCount + 1));
+    std::vector<int32_t> tags;
+    for (auto &[tag, result] : done_) {
+        ASSERT_EQ(result, 0);
+        tags.push_back(tag);
+    }
+    std::sort(tags.begin(), tags.end());
+    for (int32_t i = 0; i <= fenceCount; i++) {
+        ASSERT_EQ(tags[i], i);
+    }
+    ASSERT_EQ(FenceWaiter::GetInstance().GetPendingCount(), 0u);
+}
+
+/*
+* Function: Cancel
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. wait on two fences with different owners and cancel one owner
+*                  2. check that only the other wait calls back
+*/
+HWTEST_F(FenceWaiterTest, Cancel001, Function | MediumTest | Level2)
+{
+    int32_t owner = 0;
+    sptr<SyncFence> fence = CreateFence();
+    ASSERT_EQ(FenceWaiter::GetInstance().Add(fence, 3000, Record(0), &owner), 0); // 3000ms: timeout
+    ASSERT_EQ(FenceWaiter::GetInstance().Add(fence, 3000, Record(1), this), 0); // 3000ms: timeout
+    FenceWaiter::GetInstance().Cancel(&owner);
+    ASSERT_EQ(FenceWaiter::GetInstance().GetPendingCount(), 1u);
+    Signal(fence);
+    ASSERT_TRUE(WaitDone(1));
+    ASSERT_EQ(done_[0].first, 1);
+    FenceWaiter::GetInstance().Cancel(this);
+    ASSERT_EQ(done_.size(), 1u);
+}
+}
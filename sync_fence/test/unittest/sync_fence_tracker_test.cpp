@@ -16,7 +16,12 @@
 #include <gtest/gtest.h>
 
 #include "sync_fence_tracker.h"
+#include "fence_waiter.h"
+#include <chrono>
 #include <fcntl.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace testing;
 using namespace testing::ext;
@@ -159,46 +164,73 @@ HWTEST_F(SyncFenceTrackerTest, GetFrameRate001, Function | MediumTest | Level2)
 HWTEST_F(SyncFenceTrackerTest, ReportEventGpuSubhealth001, Function | MediumTest | Level2)
 {
     auto tracker = new SyncFenceTracker("ReportEventGpuSubhealth001");
-    EXPECT_NE(tracker->handler_, nullptr);
     tracker->ReportEventGpuSubhealth(0);
-    tracker->handler_ = nullptr;
+    tracker->frameStartTimes_.push(1);
+    tracker->frameStartTimes_.push(2);
     tracker->ReportEventGpuSubhealth(0);
     delete tracker;
 }
 
 /*
-* Function: WaitFence
+* Function: TrackFence and OnFenceDone
 * Type: Function
 * Rank: Important(2)
 * EnvConditions: N/A
-* CaseDescription: 1. call WaitFence
-*                  2. check ret
+* CaseDescription: 1. track a pending fence and one that never signals
+*                  2. check that the first is counted once it signals without waiting for the second,
+*                     and that deleting the tracker drops the second
 */
-HWTEST_F(SyncFenceTrackerTest, WaitFence001, Function | MediumTest | Level2)
+HWTEST_F(SyncFenceTrackerTest, TrackPendingFence001, Function | MediumTest | Level2)
 {
-    auto tracker = new SyncFenceTracker("WaitFence001");
-    auto fence = SyncFence::INVALID_FENCE;
+    auto tracker = new SyncFenceTracker("TrackPendingFence001");
+    sptr<SyncFence> slowFence = new SyncFence(eventfd(0, EFD_CLOEXEC));
+    sptr<SyncFence> fastFence = new SyncFence(eventfd(0, EFD_CLOEXEC));
+    tracker->TrackFence(slowFence, true);
+    tracker->TrackFence(fastFence, true);
+    EXPECT_EQ(tracker->fencesQueued_.load(), 2);
+    EXPECT_EQ(tracker->fencesSignaled_.load(), 0);
 
-    tracker->isGpuFence_ = true;
-    tracker->isGpuEnable_ = true;
-    int32_t retCode = tracker->WaitFence(fence);
-    EXPECT_EQ(retCode, -1);
+    uint64_t one = 1;
+    ASSERT_EQ(write(fastFence->Get(), &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+    for (int32_t i = 0; i < 100 && tracker->fencesSignaled_.load() == 0; i++) { // 100: 1s at most
+        std::this_thread::sleep_for(std::chrono::milliseconds(10)); // 10ms: poll interval
+    }
+    EXPECT_EQ(tracker->fencesSignaled_.load(), 1);
+    EXPECT_EQ(FenceWaiter::GetInstance().GetPendingCount(), 1u);
+    delete tracker;
+    EXPECT_EQ(FenceWaiter::GetInstance().GetPendingCount(), 0u);
+}
 
-    tracker->isGpuFence_ = true;
-    tracker->isGpuEnable_ = false;
-    tracker->WaitFence(fence);
-    EXPECT_EQ(retCode, -1);
+/*
+* Function: StartGpuMonitor and EndGpuMonitor
+* Type: Function
+* Rank: Important(2)
+* EnvConditions: N/A
+* CaseDescription: 1. start the monitor for three fences, end the second, then the first
+*                  2. check that only the oldest fence is monitored, an out of order end only drops its fence
+*                     and ending the monitored one moves the monitor to the next
+*/
+HWTEST_F(SyncFenceTrackerTest, GpuMonitorOrder001, Function | MediumTest | Level2)
+{
+    auto tracker = new SyncFenceTracker("GpuMonitorOrder001");
+    tracker->StartGpuMonitor(0);
+    tracker->StartGpuMonitor(1);
+    tracker->StartGpuMonitor(2); // 2: third fence
+    ASSERT_EQ(tracker->gpuMonitorFences_.size(), 3u);
+    EXPECT_EQ(tracker->gpuMonitorFences_.front(), 0u);
 
-    tracker->isGpuFence_ = false;
-    tracker->isGpuEnable_ = true;
-    tracker->WaitFence(fence);
-    EXPECT_EQ(retCode, -1);
+    tracker->EndGpuMonitor(1);
+    ASSERT_EQ(tracker->gpuMonitorFences_.size(), 2u);
+    EXPECT_EQ(tracker->gpuMonitorFences_.front(), 0u);
 
-    tracker->isGpuFence_ = false;
-    tracker->isGpuEnable_ = false;
-    tracker->WaitFence(fence);
-    EXPECT_EQ(retCode, -1);
+    tracker->EndGpuMonitor(0);
+    ASSERT_EQ(tracker->gpuMonitorFences_.size(), 1u);
+    EXPECT_EQ(tracker->gpuMonitorFences_.front(), 2u);
 
+    tracker->EndGpuMonitor(2); // 2: third fence
+    EXPECT_TRUE(tracker->gpuMonitorFences_.empty());
+    tracker->EndGpuMonitor(2); // 2: ending twice is ignored
+    EXPECT_TRUE(tracker->gpuMonitorFences_.empty());
     delete tracker;
 }
 